@@ -54,13 +54,7 @@ void ActFunc :: activate( const MDVector & inMD, MDVector * outMD ) const
 	}
 
 	if( eLeakyReLU == mType ) {
-		for( size_t i = 0; i < total; i++ ) {
-			if( input[ i ] < 0 ) {
-				output[ i ] = 0.01 * input[ i ];
-			} else if( input[ i ] > 1 ) {
-				output[ i ] = 1 + 0.01 * ( input[ i ] - 1 );
-			}
-		}
+		gx_leaky_relu( input, output, total );
 	}
 
 	if( eTanh == mType ) {
@@ -108,9 +102,7 @@ void ActFunc :: derivate( const MDVector & outMD, MDVector * outDeltaMD ) const
 	}
 
 	if( eLeakyReLU == mType ) {
-		for( size_t i = 0; i < total; i++ ) {
-			outDelta[ i ] = outDelta[ i ] * ( output[ i ] < 0 || output[ i ] > 1 ? 0.01 : 1 );
-		}
+		gx_leaky_relu_derivate( output, outDelta, total );
 	}
 
 	if( eTanh == mType ) {
@@ -0,0 +1,132 @@
+#include "augment.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace gxnet {
+
+Augment :: Augment()
+	: mGen( std::random_device()() )
+{
+	mRotation = mShift = mCenterRatio = 0;
+}
+
+Augment :: ~Augment()
+{
+}
+
+void Augment :: seed( unsigned int value )
+{
+	mGen.seed( value );
+}
+
+void Augment :: setRotation( DataType degrees )
+{
+	mRotation = degrees;
+}
+
+void Augment :: setShift( DataType pixels )
+{
+	mShift = pixels;
+}
+
+void Augment :: setCenterRatio( DataType ratio )
+{
+	mCenterRatio = ratio;
+}
+
+bool Augment :: isEnabled() const
+{
+	return mRotation > 0 || mShift > 0 || mCenterRatio > 0;
+}
+
+const uint8_t * Augment :: apply( const uint8_t * in, const Dims & dims )
+{
+	std::uniform_real_distribution< DataType > unit( 0, 1 );
+
+	DataType degrees = mRotation > 0 ? ( unit( mGen ) * 2 - 1 ) * mRotation : 0;
+	DataType shiftX = mShift > 0 ? ( unit( mGen ) * 2 - 1 ) * mShift : 0;
+	DataType shiftY = mShift > 0 ? ( unit( mGen ) * 2 - 1 ) * mShift : 0;
+	bool isCenter = mCenterRatio > 0 && unit( mGen ) < mCenterRatio;
+
+	mOutput.resize( gx_dims_flatten_size( dims ) );
+
+	apply( in, dims, degrees, shiftX, shiftY, isCenter, mOutput.data() );
+
+	return mOutput.data();
+}
+
+void Augment :: apply( const uint8_t * in, const Dims & dims, DataType degrees,
+		DataType shiftX, DataType shiftY, bool isCenter, uint8_t * out )
+{
+	size_t size = gx_dims_flatten_size( dims );
+
+	if( dims.size() < 2 || ( 0 == degrees && 0 == shiftX && 0 == shiftY && ! isCenter ) ) {
+		memcpy( out, in, size );
+		return;
+	}
+
+	int rows = dims[ dims.size() - 2 ], cols = dims[ dims.size() - 1 ];
+	size_t channels = size / ( rows * cols );
+
+	float centerY = ( rows - 1 ) / 2.0f, centerX = ( cols - 1 ) / 2.0f;
+
+	// the source point that lands on the image center
+	float fromY = centerY, fromX = centerX;
+
+	if( isCenter ) {
+		int beginY = rows, beginX = cols, endY = -1, endX = -1;
+
+		for( size_t c = 0; c < channels; c++ ) {
+			const uint8_t * src = in + c * rows * cols;
+
+			for( int y = 0; y < rows; y++, src += cols ) {
+				int first = std::find_if( src, src + cols, []( uint8_t v ) { return 0 != v; } ) - src;
+				if( first >= cols ) continue;
+
+				int last = cols - 1;
+				while( 0 == src[ last ] ) last--;
+
+				beginY = std::min( beginY, y );
+				endY = std::max( endY, y );
+				beginX = std::min( beginX, first );
+				endX = std::max( endX, last );
+			}
+		}
+
+		if( endY >= 0 ) {
+			fromY = ( beginY + endY ) / 2.0f;
+			fromX = ( beginX + endX ) / 2.0f;
+		}
+	}
+
+	float radian = degrees * M_PI / 180, cosValue = std::cos( radian ), sinValue = std::sin( radian );
+
+	// one zero row and column before, two after, so any clamped point reads zeros
+	// for the taps outside the image, and 4 more bytes for the 32-bit gathers
+	int padCols = cols + 3, padRows = rows + 3;
+
+	mPadded.assign( (size_t)padRows * padCols + 4, 0 );
+
+	for( size_t c = 0; c < channels; c++ ) {
+		const uint8_t * src = in + c * rows * cols;
+		uint8_t * dest = out + c * rows * cols;
+
+		for( int y = 0; y < rows; y++ ) memcpy( mPadded.data() + ( y + 1 ) * padCols + 1, src + y * cols, cols );
+
+		for( int y = 0; y < rows; y++ ) {
+			float relY = y - centerY - shiftY, relX = -centerX - shiftX;
+
+			// the source point moves by ( cos, -sin ) along an output row
+			float srcX = cosValue * relX + sinValue * relY + fromX + 1;
+			float srcY = -sinValue * relX + cosValue * relY + fromY + 1;
+
+			gx_kernels().mBilinearRow( mPadded.data(), padCols, cols + 1, rows + 1,
+					srcX, srcY, cosValue, -sinValue, cols, dest + y * cols );
+		}
+	}
+}
+
+}; // namespace gxnet;
+
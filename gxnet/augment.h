@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common.h"
+
+#include <random>
+#include <vector>
+#include <cstdint>
+
+namespace gxnet {
+
+/**
+ * Random affine transforms of byte images, made while a mini batch is staged, so
+ * every epoch sees new samples at no extra memory. Centering, rotation and shift
+ * are combined into one mapping and sampled once with bilinear interpolation.
+ * Each training context owns one, the generator is never shared between threads.
+ */
+class Augment {
+public:
+	Augment();
+	~Augment();
+
+	void seed( unsigned int value );
+
+	// uniform in [ -degrees, degrees ]
+	void setRotation( DataType degrees );
+
+	// uniform in [ -pixels, pixels ] for both axes
+	void setShift( DataType pixels );
+
+	// the share of samples moved to the center of their bounding box first
+	void setCenterRatio( DataType ratio );
+
+	bool isEnabled() const;
+
+	/**
+	 * dims: { ..., rows, cols } of one sample, the leading dims are channels that share
+	 * the transform. Returns a buffer of the augment, valid until the next call.
+	 */
+	const uint8_t * apply( const uint8_t * in, const Dims & dims );
+
+	// out holds the same number of bytes as in
+	void apply( const uint8_t * in, const Dims & dims, DataType degrees,
+			DataType shiftX, DataType shiftY, bool isCenter, uint8_t * out );
+
+private:
+	std::mt19937 mGen;
+
+	DataType mRotation, mShift, mCenterRatio;
+
+	// zero padded copy of one channel, the sampling loop needs no bound checks
+	std::vector< uint8_t > mPadded, mOutput;
+};
+
+}; // namespace gxnet;
+
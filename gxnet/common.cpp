@@ -10,142 +10,194 @@ namespace gxnet {
 
 bool gx_is_inner_debug = false;
 
-stdx::element_aligned_tag Aligned = stdx::element_aligned;
-
-DataType gx_inner_product( const DataType * a, const DataType * b, size_t count )
+static const Kernels_t * gx_select_kernels()
 {
-	DataType result = 0;
+#ifdef GX_KERNELS_X86
+	__builtin_cpu_init();
+
+	if( __builtin_cpu_supports( "avx512f" ) && __builtin_cpu_supports( "avx512dq" )
+			&& __builtin_cpu_supports( "avx512bw" ) && __builtin_cpu_supports( "avx512vl" )
+			&& __builtin_cpu_supports( "f16c" ) ) {
+		if( __builtin_cpu_supports( "avx512vnni" ) && __builtin_cpu_supports( "avx512vpopcntdq" ) ) {
+			return &avx512vpopcnt::gKernels;
+		}
 
-#if 1
-	size_t idx = 0;
+		if( __builtin_cpu_supports( "avx512vnni" ) ) return &avx512vnni::gKernels;
 
-	for( ; ( idx + 8 * DataSimd::size() - 1 ) < count; idx += 8 * DataSimd::size() ) {
-		const DataType * pA = a + idx;
-		const DataType * pB = b + idx;
+		return &avx512::gKernels;
+	}
 
-		DataSimd tA0( pA, Aligned );
-		tA0 *= DataSimd( pB, Aligned );
+	if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" )
+			&& __builtin_cpu_supports( "f16c" ) ) {
+		return &avx2::gKernels;
+	}
 
-		DataSimd tA1( pA + DataSimd::size(), Aligned );
-		tA1 *= DataSimd( pB + DataSimd::size(), Aligned );
+	if( __builtin_cpu_supports( "sse4.2" ) && __builtin_cpu_supports( "popcnt" ) ) return &sse42::gKernels;
+#endif
 
-		DataSimd tA2( pA + 2 * DataSimd::size(), Aligned );
-		tA2 *= DataSimd( pB + 2 * DataSimd::size(), Aligned );
+	return &generic::gKernels;
+}
 
-		DataSimd tA3( pA + 3 * DataSimd::size(), Aligned );
-		tA3 *= DataSimd( pB + 3 * DataSimd::size(), Aligned );
+// constant initialized, so calls from other static initializers still work before the selection
+static const Kernels_t * gx_curr_kernels = &generic::gKernels;
 
-		DataSimd tA4( pA + 4 * DataSimd::size(), Aligned );
-		tA4 *= DataSimd( pB + 4 * DataSimd::size(), Aligned );
+__attribute__(( constructor )) static void gx_init_kernels()
+{
+	gx_curr_kernels = gx_select_kernels();
+}
 
-		DataSimd tA5( pA + 5 * DataSimd::size(), Aligned );
-		tA5 *= DataSimd( pB + 5 * DataSimd::size(), Aligned );
+const Kernels_t & gx_kernels()
+{
+	return *gx_curr_kernels;
+}
 
-		DataSimd tA6( pA + 6 * DataSimd::size(), Aligned );
-		tA6 *= DataSimd( pB + 6 * DataSimd::size(), Aligned );
+DataType gx_inner_product( const DataType * a, const DataType * b, size_t count )
+{
+	return gx_curr_kernels->mInnerProduct( a, b, count );
+}
 
-		DataSimd tA7( pA + 7 * DataSimd::size(), Aligned );
-		tA7 *= DataSimd( pB + 7 * DataSimd::size(), Aligned );
+void gx_vs_product( const DataType * a, const DataType & b, DataType * c, size_t count )
+{
+	gx_curr_kernels->mVsProduct( a, b, c, count );
+}
 
-		tA0 += tA1 + tA2 + tA3 + tA4 + tA5 + tA6 + tA7;
+void gx_vs_product_add( const DataType * a, const DataType & b, DataType * c, size_t count )
+{
+	gx_curr_kernels->mVsProductAdd( a, b, c, count );
+}
 
-		result += stdx::reduce( tA0, std::plus{} );
-	}
+void gx_vv_add( const DataType * a, DataType * c, size_t count )
+{
+	gx_curr_kernels->mVvAdd( a, c, count );
+}
 
-	for( ; ( idx + 2 * DataSimd::size() - 1 ) < count; idx += 2 * DataSimd::size() ) {
-		const DataType * pA = a + idx;
-		const DataType * pB = b + idx;
+DataType gx_sum( const DataType * a, size_t count )
+{
+	return gx_curr_kernels->mSum( a, count );
+}
 
-		DataSimd tA0( pA, Aligned );
-		tA0 *= DataSimd( pB, Aligned );
+DataType gx_sq_diff_sum( const DataType * a, DataType mean, size_t count )
+{
+	return gx_curr_kernels->mSqDiffSum( a, mean, count );
+}
 
-		DataSimd tA1( pA + DataSimd::size(), Aligned );
-		tA1 *= DataSimd( pB + DataSimd::size(), Aligned );
+void gx_vs_scale_shift( const DataType * a, DataType scale, DataType shift, DataType * c, size_t count )
+{
+	gx_curr_kernels->mVsScaleShift( a, scale, shift, c, count );
+}
 
-		tA0 += tA1;
+void gx_vv_argmax( const DataType * a, DataType tag, DataType * c, DataType * idx, size_t count )
+{
+	gx_curr_kernels->mVvArgmax( a, tag, c, idx, count );
+}
 
-		result += stdx::reduce( tA0, std::plus{} );
-	}
+void gx_leaky_relu( const DataType * in, DataType * out, size_t count )
+{
+	gx_curr_kernels->mLeakyReLU( in, out, count );
+}
 
-	for( ; ( idx + DataSimd::size() - 1 ) < count; idx += DataSimd::size() ) {
-		const DataType * pA = a + idx;
-		const DataType * pB = b + idx;
+void gx_leaky_relu_derivate( const DataType * out, DataType * outDelta, size_t count )
+{
+	gx_curr_kernels->mLeakyReLUDerivate( out, outDelta, count );
+}
 
-		DataSimd tA0( pA, Aligned );
-		tA0 *= DataSimd( pB, Aligned );
+// output columns [ *begin, *end ) whose input column y * stride + offset - padding is inside the input
+static void gx_dwconv_range( size_t offset, size_t stride, size_t padding, size_t inSize, size_t outSize,
+		size_t * begin, size_t * end )
+{
+	*begin = offset >= padding ? 0 : ( padding - offset + stride - 1 ) / stride;
+	*end = inSize + padding > offset ? std::min( outSize, ( inSize + padding - offset - 1 ) / stride + 1 ) : 0;
+	*end = std::max( *begin, *end );
+}
 
-		result += stdx::reduce( tA0, std::plus{} );
-	}
+void gx_dwconv_forward( const DataType * in, size_t inHeight, size_t inWidth,
+		const DataType * filter, size_t filterSize, size_t stride, size_t padding,
+		DataType * out, size_t outHeight, size_t outWidth )
+{
+	size_t beginX = 0, endX = 0, beginY = 0, endY = 0;
 
-	for( ; idx < count; idx++ ) result += a[ idx ] * b[ idx ];
-#else
+	for( size_t i = 0; i < filterSize; i++ ) {
+		gx_dwconv_range( i, stride, padding, inHeight, outHeight, &beginX, &endX );
 
-	result = std::transform_reduce( a, a + count, b, 0.0 );
+		for( size_t j = 0; j < filterSize; j++ ) {
+			gx_dwconv_range( j, stride, padding, inWidth, outWidth, &beginY, &endY );
 
-	//for( size_t idx = 0; idx < count; idx++ ) result += a[ idx ] * b[ idx ];
+			DataType weight = filter[ i * filterSize + j ];
 
-#endif
+			if( beginY >= endY ) continue;
+
+			for( size_t x = beginX; x < endX; x++ ) {
+				const DataType * inRow = in + ( x * stride + i - padding ) * inWidth + beginY * stride + j - padding;
+				DataType * outRow = out + x * outWidth + beginY;
 
-	return result;
+				if( 1 == stride ) {
+					gx_vs_product_add( inRow, weight, outRow, endY - beginY );
+				} else {
+					for( size_t y = 0; y < endY - beginY; y++ ) outRow[ y ] += weight * inRow[ y * stride ];
+				}
+			}
+		}
+	}
 }
 
-void gx_vs_product( const DataType * a, const DataType & b, DataType * c, size_t count )
+void gx_dwconv_backward( const DataType * outDelta, size_t outHeight, size_t outWidth,
+		const DataType * filter, size_t filterSize, size_t stride, size_t padding,
+		DataType * inDelta, size_t inHeight, size_t inWidth )
 {
-	size_t idx = 0;
-
-	DataVector temp( b, DataSimd::size() );
-	DataSimd tB( std::begin( temp ), Aligned );
-
-	for( ; ( idx + 8 * DataSimd::size() - 1 ) < count; idx += 8 * DataSimd::size() ) {
-		const DataType * pA = a + idx;
-		DataType * pC = c + idx;
-
-		DataSimd tA0 = tB * DataSimd( pA, Aligned );
-		tA0.copy_to( pC, Aligned );
-
-		DataSimd tA1 = tB * DataSimd( pA + DataSimd::size(), Aligned );
-		tA1.copy_to( pC + DataSimd::size(), Aligned );
+	size_t beginX = 0, endX = 0, beginY = 0, endY = 0;
 
-		DataSimd tA2 = tB * DataSimd( pA + 2 * DataSimd::size(), Aligned );
-		tA2.copy_to( pC + 2 * DataSimd::size(), Aligned );
+	for( size_t i = 0; i < filterSize; i++ ) {
+		gx_dwconv_range( i, stride, padding, inHeight, outHeight, &beginX, &endX );
 
-		DataSimd tA3 = tB * DataSimd( pA + 3 * DataSimd::size(), Aligned );
-		tA3.copy_to( pC + 3 * DataSimd::size(), Aligned );
+		for( size_t j = 0; j < filterSize; j++ ) {
+			gx_dwconv_range( j, stride, padding, inWidth, outWidth, &beginY, &endY );
 
-		DataSimd tA4 = tB * DataSimd( pA + 4 * DataSimd::size(), Aligned );
-		tA4.copy_to( pC + 4 * DataSimd::size(), Aligned );
+			DataType weight = filter[ i * filterSize + j ];
 
-		DataSimd tA5 = tB * DataSimd( pA + 5 * DataSimd::size(), Aligned );
-		tA5.copy_to( pC + 5 * DataSimd::size(), Aligned );
+			if( beginY >= endY ) continue;
 
-		DataSimd tA6 = tB * DataSimd( pA + 6 * DataSimd::size(), Aligned );
-		tA6.copy_to( pC + 6 * DataSimd::size(), Aligned );
+			for( size_t x = beginX; x < endX; x++ ) {
+				DataType * inRow = inDelta + ( x * stride + i - padding ) * inWidth + beginY * stride + j - padding;
+				const DataType * outRow = outDelta + x * outWidth + beginY;
 
-		DataSimd tA7 = tB * DataSimd( pA + 7 * DataSimd::size(), Aligned );
-		tA7.copy_to( pC + 7 * DataSimd::size(), Aligned );
+				if( 1 == stride ) {
+					gx_vs_product_add( outRow, weight, inRow, endY - beginY );
+				} else {
+					for( size_t y = 0; y < endY - beginY; y++ ) inRow[ y * stride ] += weight * outRow[ y ];
+				}
+			}
+		}
 	}
+}
 
-	for( ; ( idx + 2 * DataSimd::size() - 1 ) < count; idx += 2 * DataSimd::size() ) {
-		const DataType * pA = a + idx;
-		DataType * pC = c + idx;
+void gx_dwconv_gradients( const DataType * in, size_t inHeight, size_t inWidth,
+		const DataType * outDelta, size_t outHeight, size_t outWidth,
+		size_t filterSize, size_t stride, size_t padding, DataType * gradients )
+{
+	size_t beginX = 0, endX = 0, beginY = 0, endY = 0;
 
-		DataSimd tA0 = tB * DataSimd( pA, Aligned );
-		tA0.copy_to( pC, Aligned );
+	for( size_t i = 0; i < filterSize; i++ ) {
+		gx_dwconv_range( i, stride, padding, inHeight, outHeight, &beginX, &endX );
 
-		DataSimd tA1 = tB * DataSimd( pA + DataSimd::size(), Aligned );
-		tA1.copy_to( pC + DataSimd::size(), Aligned );
-	}
+		for( size_t j = 0; j < filterSize; j++ ) {
+			gx_dwconv_range( j, stride, padding, inWidth, outWidth, &beginY, &endY );
 
-	for( ; ( idx + DataSimd::size() - 1 ) < count; idx += DataSimd::size() ) {
-		const DataType * pA = a + idx;
-		DataType * pC = c + idx;
+			DataType total = 0;
 
-		DataSimd tA0 = tB * DataSimd( pA, Aligned );
+			for( size_t x = beginX; x < endX && beginY < endY; x++ ) {
+				const DataType * inRow = in + ( x * stride + i - padding ) * inWidth + beginY * stride + j - padding;
+				const DataType * outRow = outDelta + x * outWidth + beginY;
 
-		tA0.copy_to( pC, Aligned );
-	}
+				if( 1 == stride ) {
+					total += gx_inner_product( inRow, outRow, endY - beginY );
+				} else {
+					for( size_t y = 0; y < endY - beginY; y++ ) total += inRow[ y * stride ] * outRow[ y ];
+				}
+			}
 
-	for( ; idx < count; idx++ ) c[ idx ] = b * a[ idx ];
+			gradients[ i * filterSize + j ] += total;
+		}
+	}
 }
 
 void gx_kronecker_product( const DataType * a, size_t aCount,
@@ -195,13 +247,11 @@ void gx_rows_product( const MDSpanRO & a, const MDSpanRO & b,
 	}
 
 #else
-	const DataType * aPtr = a.data();
+	gx_curr_kernels->mRowsProduct( a.data(), aRows, b.data(), bRows, aCols, c );
 
-	for( size_t i = 0; i < aRows; i++, aPtr += aCols ) {
-		const DataType * bPtr = b.data();
-		for( size_t j = 0; j < bRows; j++, bPtr += aCols ) {
-			rw( i, j ) = gx_inner_product( aPtr, bPtr, aCols )
-					+ ( isABiases ? biases[ i ] : biases[ j ] );
+	for( size_t i = 0; i < aRows; i++ ) {
+		for( size_t j = 0; j < bRows; j++ ) {
+			rw( i, j ) += isABiases ? biases[ i ] : biases[ j ];
 		}
 	}
 #endif
@@ -225,17 +275,7 @@ void gx_rows_product( const MDSpanRO & a, const MDSpanRO & b, DataType * c, size
 
 	mpC = mpA * mpB;
 #else
-	const DataType * aPtr = a.data();
-
-	MDSpanRW rw( c, dims );
-
-	for( size_t i = 0; i < aRows; i++, aPtr += aCols ) {
-		const DataType * bPtr = b.data();
-		for( size_t j = 0; j < bRows; j++, bPtr += aCols ) {
-			rw( i, j ) = gx_inner_product( aPtr, bPtr, aCols );
-		}
-	}
-
+	gx_curr_kernels->mRowsProduct( a.data(), aRows, b.data(), bRows, aCols, c );
 #endif
 }
 
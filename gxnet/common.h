@@ -10,19 +10,19 @@
 #include <assert.h>
 #include <string.h>
 
-#include <experimental/simd>
 #include <numeric>
 
-namespace gxnet {
+#include "kernels.h"
 
-typedef double DataType;
-//typedef float DataType;
+namespace gxnet {
 
 extern bool gx_is_inner_debug;
 const DataType gx_debug_weight = 0.1;
 
-namespace stdx = std::experimental::parallelism_v2;
-typedef stdx::native_simd< DataType > DataSimd;
+inline const char * gx_data_type_name()
+{
+	return sizeof( DataType ) == sizeof( float ) ? "float" : "double";
+}
 
 typedef std::vector< size_t > Dims;
 typedef std::vector< Dims > DimsList;
@@ -40,6 +40,40 @@ DataType gx_inner_product( const DataType * a, const DataType * b, size_t count
 
 void gx_vs_product( const DataType * a, const DataType & b, DataType * c, size_t count );
 
+// c[i] += a[i] * b
+void gx_vs_product_add( const DataType * a, const DataType & b, DataType * c, size_t count );
+
+void gx_vv_add( const DataType * a, DataType * c, size_t count );
+
+DataType gx_sum( const DataType * a, size_t count );
+
+// sum of ( a[i] - mean )^2
+DataType gx_sq_diff_sum( const DataType * a, DataType mean, size_t count );
+
+// c[i] = a[i] * scale + shift, a and c may be the same
+void gx_vs_scale_shift( const DataType * a, DataType scale, DataType shift, DataType * c, size_t count );
+
+// c[i] = max( c[i], a[i] ), and idx[i] = tag where a[i] wins, first occurrence kept on ties
+void gx_vv_argmax( const DataType * a, DataType tag, DataType * c, DataType * idx, size_t count );
+
+// depthwise convolution on one channel plane with a filterSize x filterSize filter,
+// all of them accumulate into the destination
+void gx_dwconv_forward( const DataType * in, size_t inHeight, size_t inWidth,
+		const DataType * filter, size_t filterSize, size_t stride, size_t padding,
+		DataType * out, size_t outHeight, size_t outWidth );
+
+void gx_dwconv_backward( const DataType * outDelta, size_t outHeight, size_t outWidth,
+		const DataType * filter, size_t filterSize, size_t stride, size_t padding,
+		DataType * inDelta, size_t inHeight, size_t inWidth );
+
+void gx_dwconv_gradients( const DataType * in, size_t inHeight, size_t inWidth,
+		const DataType * outDelta, size_t outHeight, size_t outWidth,
+		size_t filterSize, size_t stride, size_t padding, DataType * gradients );
+
+void gx_leaky_relu( const DataType * in, DataType * out, size_t count );
+
+void gx_leaky_relu_derivate( const DataType * out, DataType * outDelta, size_t count );
+
 void gx_kronecker_product( const DataType * a, size_t aCount,
 		const DataType * b, size_t bCount, DataType * c, size_t count );
 
@@ -64,11 +98,17 @@ inline size_t gx_dims_flatten_size( const Dims & dims )
 	return ret;
 }
 
+inline size_t gx_conv_out_size( size_t inSize, size_t filterSize, size_t stride, size_t padding )
+{
+	return ( inSize + 2 * padding - filterSize ) / stride + 1;
+}
+
 template< typename NumberVector >
-std::string gx_vector2string( const NumberVector & vec, const char delim = ',' )
+std::string gx_vector2string( const NumberVector & vec, const char delim = ',', int precision = 6 )
 {
 	std::ostringstream ret;
 	ret.setf( std::ios::scientific, std::ios::floatfield );
+	ret.precision( precision );
 
 	for( size_t i = 0; i < vec.size(); i++ ) {
 		if( i > 0 ) ret << delim;
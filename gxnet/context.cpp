@@ -61,6 +61,12 @@ MDVector & BaseLayerContext :: getOutput()
 
 FullConnLayerContext :: FullConnLayerContext()
 {
+	mSparseInput.mIsEnabled = false;
+	mSparseInput.mIsSparse = false;
+	mSparseInput.mWeightsVersion = SIZE_MAX;
+	mSparseInput.mStride = 0;
+	mSparseInput.mStamp = 0;
+	mSparseInput.mIsDenseGradients = true;
 }
 
 FullConnLayerContext :: ~FullConnLayerContext()
@@ -72,6 +78,16 @@ DataVector & FullConnLayerContext :: getTempGradients()
 	return mTempGradients;
 }
 
+SparseInput & FullConnLayerContext :: getSparseInput()
+{
+	return mSparseInput;
+}
+
+PackedScratch & FullConnLayerContext :: getPackedScratch()
+{
+	return mPackedScratch;
+}
+
 ////////////////////////////////////////////////////////////
 
 ConvLayerContext :: ConvLayerContext()
@@ -117,6 +133,51 @@ DataVector & ConvExLayerContext :: getTempGradients()
 	return mTempGradients;
 }
 
+PackedScratch & ConvExLayerContext :: getPackedScratch()
+{
+	return mPackedScratch;
+}
+
+////////////////////////////////////////////////////////////
+
+MaxPoolLayerContext :: MaxPoolLayerContext()
+{
+}
+
+MaxPoolLayerContext :: ~MaxPoolLayerContext()
+{
+}
+
+IntVector & MaxPoolLayerContext :: getArgmax()
+{
+	return mArgmax;
+}
+
+DataVector & MaxPoolLayerContext :: getRowMax()
+{
+	return mRowMax;
+}
+
+DataVector & MaxPoolLayerContext :: getRowIdx()
+{
+	return mRowIdx;
+}
+
+////////////////////////////////////////////////////////////
+
+AvgPoolLayerContext :: AvgPoolLayerContext()
+{
+}
+
+AvgPoolLayerContext :: ~AvgPoolLayerContext()
+{
+}
+
+DataVector & AvgPoolLayerContext :: getRowSum()
+{
+	return mRowSum;
+}
+
 ////////////////////////////////////////////////////////////
 
 DropoutLayerContext :: DropoutLayerContext()
@@ -132,5 +193,35 @@ BoolVector & DropoutLayerContext :: getMask()
 	return mMask;
 }
 
+////////////////////////////////////////////////////////////
+
+BatchNormLayerContext :: BatchNormLayerContext()
+{
+}
+
+BatchNormLayerContext :: ~BatchNormLayerContext()
+{
+}
+
+DataVector & BatchNormLayerContext :: getXHat()
+{
+	return mXHat;
+}
+
+DataVector & BatchNormLayerContext :: getMean()
+{
+	return mMean;
+}
+
+DataVector & BatchNormLayerContext :: getVar()
+{
+	return mVar;
+}
+
+DataVector & BatchNormLayerContext :: getInvStd()
+{
+	return mInvStd;
+}
+
 }; // namespace gxnet;
 
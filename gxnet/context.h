@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "packed.h"
 
 #include <vector>
 #include <utility>
@@ -51,6 +52,34 @@ protected:
 	MDVector mOutput;
 };
 
+// the state of a FullConn layer on a data input that is mostly zeros, see FullConnLayer::calcOutput
+typedef struct tagSparseInput {
+	// only the ctx of the layer on the data input, the hidden outputs are dense
+	bool mIsEnabled;
+
+	// the batch is mostly zeros, and its nonzeros in CSR, one row per sample
+	bool mIsSparse;
+	std::vector< uint32_t > mRowPtr, mColIdx;
+	DataVector mValues;
+
+	// one row of output weights per input column, copied at mWeightsVersion of the layer,
+	// the rows are mStride long, the output count rounded up to whole SIMD vectors
+	DataVector mWeightsT;
+	size_t mWeightsVersion, mStride;
+
+	// one padded output or delta row
+	DataVector mRow;
+
+	// the gradients of the nonzero columns, a row per column, and the columns of the batch
+	// marked with mStamp; only the columns of the last two batches are written back
+	DataVector mGradientsT;
+	std::vector< uint32_t > mMarks, mCols, mPrevCols;
+	uint32_t mStamp;
+
+	// the dense path wrote every column of the gradients
+	bool mIsDenseGradients;
+} SparseInput;
+
 class FullConnLayerContext : public BaseLayerContext {
 public:
 	FullConnLayerContext();
@@ -59,8 +88,14 @@ public:
 
 	DataVector & getTempGradients();
 
+	SparseInput & getSparseInput();
+
+	PackedScratch & getPackedScratch();
+
 protected:
 	DataVector mTempGradients;
+	SparseInput mSparseInput;
+	PackedScratch mPackedScratch;
 };
 
 class ConvLayerContext : public BaseLayerContext {
@@ -87,9 +122,40 @@ public:
 
 	DataVector & getTempGradients();
 
+	PackedScratch & getPackedScratch();
+
 private:
 	MDVector mRows4calcOutput, mRows4backpropagate, mRows4collectGradient;
 	DataVector mTempGradients;
+	PackedScratch mPackedScratch;
+};
+
+class MaxPoolLayerContext : public BaseLayerContext {
+public:
+	MaxPoolLayerContext();
+	~MaxPoolLayerContext();
+
+	// argmax offsets inside the input channel plane, one for each output element
+	IntVector & getArgmax();
+
+	DataVector & getRowMax();
+
+	DataVector & getRowIdx();
+
+private:
+	IntVector mArgmax;
+	DataVector mRowMax, mRowIdx;
+};
+
+class AvgPoolLayerContext : public BaseLayerContext {
+public:
+	AvgPoolLayerContext();
+	~AvgPoolLayerContext();
+
+	DataVector & getRowSum();
+
+private:
+	DataVector mRowSum;
 };
 
 class DropoutLayerContext : public BaseLayerContext {
@@ -103,5 +169,24 @@ private:
 	mutable BoolVector mMask;
 };
 
+class BatchNormLayerContext : public BaseLayerContext {
+public:
+	BatchNormLayerContext();
+	~BatchNormLayerContext();
+
+	// normalized input, same layout as the input
+	DataVector & getXHat();
+
+	// per-channel batch mean, biased batch variance and 1 / sqrt( var + epsilon )
+	DataVector & getMean();
+
+	DataVector & getVar();
+
+	DataVector & getInvStd();
+
+private:
+	DataVector mXHat, mMean, mVar, mInvStd;
+};
+
 }; // namespace gxnet;
 
@@ -0,0 +1,821 @@
+#include "dataset.h"
+#include "inflate.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+namespace gxnet {
+
+// dims[ 0 ] items of unsigned bytes, written to a temporary file first,
+// so readers see the whole file or none
+static bool gx_write_idx( const std::string & path, const Dims & dims, const uint8_t * data )
+{
+	std::string tmpPath = path + ".tmp";
+
+	// the idx header, the type and the dimension count, then one big endian int32 per dimension
+	std::vector< uint8_t > header = { 0, 0, 0x08, (uint8_t)dims.size() };
+
+	for( auto item : dims ) {
+		for( int shift : { 24, 16, 8, 0 } ) header.push_back( ( item >> shift ) & 0xff );
+	}
+
+	FILE * fp = fopen( tmpPath.c_str(), "wb" );
+
+	if( NULL == fp ) {
+		printf( "open %s fail, errno %d, %s\n", tmpPath.c_str(), errno, strerror( errno ) );
+		return false;
+	}
+
+	bool ret = 1 == fwrite( header.data(), header.size(), 1, fp );
+
+	size_t size = gx_dims_flatten_size( dims );
+
+	if( size > 0 ) ret = ret && 1 == fwrite( data, size, 1, fp );
+
+	ret = 0 == fclose( fp ) && ret;
+
+	if( ! ret || 0 != rename( tmpPath.c_str(), path.c_str() ) ) {
+		printf( "write %s fail\n", path.c_str() );
+		remove( tmpPath.c_str() );
+		return false;
+	}
+
+	return true;
+}
+
+IdxFile :: IdxFile()
+{
+	mMap = NULL;
+	mMapSize = 0;
+	mData = NULL;
+	mItemSize = 0;
+}
+
+IdxFile :: ~IdxFile()
+{
+	close();
+}
+
+void IdxFile :: close()
+{
+	if( NULL != mMap ) munmap( mMap, mMapSize );
+
+	mMap = NULL;
+	mMapSize = 0;
+	std::vector< uint8_t >().swap( mInflated );
+	mDims.clear();
+	mData = NULL;
+	mItemSize = 0;
+}
+
+bool IdxFile :: open( const char * path )
+{
+	close();
+
+	// a missing file is looked for gzipped, as the datasets are shipped
+	std::string gzPath = std::string( path ) + ".gz";
+
+	if( 0 != access( path, F_OK ) && 0 == access( gzPath.c_str(), F_OK ) ) path = gzPath.c_str();
+
+	int fd = ::open( path, O_RDONLY );
+
+	if( fd < 0 ) {
+		printf( "open %s fail, errno %d, %s\n", path, errno, strerror( errno ) );
+		return false;
+	}
+
+	struct stat fileStat;
+
+	if( 0 != fstat( fd, &fileStat ) || fileStat.st_size < 4 ) {
+		printf( "stat %s fail, or too small\n", path );
+		::close( fd );
+		return false;
+	}
+
+	mMapSize = fileStat.st_size;
+	mMap = mmap( NULL, mMapSize, PROT_READ, MAP_SHARED, fd, 0 );
+
+	// the mapping holds its own reference to the file
+	::close( fd );
+
+	if( MAP_FAILED == mMap ) {
+		printf( "mmap %s fail, errno %d, %s\n", path, errno, strerror( errno ) );
+		mMap = NULL;
+		mMapSize = 0;
+		return false;
+	}
+
+	const uint8_t * header = (const uint8_t *)mMap;
+	size_t size = mMapSize;
+
+	// decoded in one pass into memory owned by the file, the gzip mapping is dropped
+	if( Inflate::isGzip( header, size ) ) {
+		madvise( mMap, mMapSize, MADV_SEQUENTIAL );
+
+		bool ret = Inflate::gunzip( header, size, &mInflated );
+
+		munmap( mMap, mMapSize );
+		mMap = NULL;
+		mMapSize = 0;
+
+		if( ! ret || mInflated.size() < 4 ) {
+			printf( "%s gunzip fail\n", path );
+			close();
+			return false;
+		}
+
+		header = mInflated.data();
+		size = mInflated.size();
+	}
+
+	// magic: 0, 0, type, dimension count, then one big endian int32 per dimension
+	int type = header[ 2 ], dimCount = header[ 3 ];
+
+	if( 0 != header[ 0 ] || 0 != header[ 1 ] || 0x08 != type || dimCount < 1 || dimCount > 4
+			|| size < 4 + 4 * (size_t)dimCount ) {
+		printf( "%s invalid header, type 0x%02x, dims %d\n", path, type, dimCount );
+		close();
+		return false;
+	}
+
+	for( int i = 0; i < dimCount; i++ ) {
+		const uint8_t * item = header + 4 + 4 * i;
+		mDims.push_back( ( (size_t)item[ 0 ] << 24 ) | ( item[ 1 ] << 16 ) | ( item[ 2 ] << 8 ) | item[ 3 ] );
+	}
+
+	mData = header + 4 + 4 * dimCount;
+
+	size_t available = header + size - mData, total = mDims[ 0 ];
+
+	// the dims are int32 in the format, and no product of them may wrap around
+	bool isValid = mDims[ 0 ] <= INT32_MAX;
+
+	mItemSize = 1;
+
+	for( int i = 1; i < dimCount; i++ ) {
+		isValid = isValid && mDims[ i ] > 0 && mDims[ i ] <= INT32_MAX
+				&& ! __builtin_mul_overflow( mItemSize, mDims[ i ], &mItemSize );
+	}
+
+	isValid = isValid && ! __builtin_mul_overflow( total, mItemSize, &total );
+
+	if( ! isValid ) {
+		printf( "%s invalid dims { %s }\n", path, gx_vector2string( mDims ).c_str() );
+		close();
+		return false;
+	}
+
+	if( available < total ) {
+		printf( "%s truncated, %zu items of %zu bytes need %zu bytes\n", path, mDims[ 0 ], mItemSize, total );
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void IdxFile :: advise( int access ) const
+{
+	if( NULL == mMap ) return;
+
+	int advice = eSequential == access ? MADV_SEQUENTIAL : ( eRandom == access ? MADV_RANDOM
+			: ( eWillNeed == access ? MADV_WILLNEED : MADV_NORMAL ) );
+
+	madvise( mMap, mMapSize, advice );
+}
+
+const Dims & IdxFile :: getDims() const
+{
+	return mDims;
+}
+
+size_t IdxFile :: getCount() const
+{
+	return mDims.size() > 0 ? mDims[ 0 ] : 0;
+}
+
+size_t IdxFile :: getItemSize() const
+{
+	return mItemSize;
+}
+
+const uint8_t * IdxFile :: getItem( size_t index ) const
+{
+	return mData + index * mItemSize;
+}
+
+////////////////////////////////////////////////////////////
+
+ByteDataset :: ByteDataset( size_t sampleSize )
+{
+	mSampleSize = sampleSize;
+	mSampleDims = { sampleSize };
+	mFileCount = 0;
+
+	setNormalization( 0, 1 );
+}
+
+ByteDataset :: ~ByteDataset()
+{
+}
+
+void ByteDataset :: reset( size_t sampleSize )
+{
+	mSampleSize = sampleSize;
+	mSampleDims = { sampleSize };
+	mBytes.clear();
+
+	mFile.reset();
+	mFileCount = 0;
+}
+
+void ByteDataset :: attach( const IdxFilePtr & file, size_t count )
+{
+	reset( file->getItemSize() );
+
+	mSampleDims.assign( file->getDims().begin() + 1, file->getDims().end() );
+
+	mFile = file;
+	mFileCount = count > 0 ? std::min( count, file->getCount() ) : file->getCount();
+}
+
+void ByteDataset :: detach()
+{
+	if( ! mFile ) return;
+
+	IdxFilePtr file = mFile;
+	size_t count = mFileCount;
+
+	mFile.reset();
+	mFileCount = 0;
+
+	mBytes.assign( file->getItem( 0 ), file->getItem( count ) );
+}
+
+void ByteDataset :: advise( int access ) const
+{
+	if( mFile ) mFile->advise( access );
+}
+
+void ByteDataset :: setNormalization( DataType mean, DataType stddev )
+{
+	mMean = mean;
+	mStddev = stddev;
+
+	// the same b / 255.0 as the DataMatrix loader for the default normalization
+	for( int i = 0; i < 256; i++ ) mTable[ i ] = ( i / 255.0 - mean ) / stddev;
+}
+
+void ByteDataset :: setSampleDims( const Dims & dims )
+{
+	if( gx_dims_flatten_size( dims ) == mSampleSize ) mSampleDims = dims;
+}
+
+const Dims & ByteDataset :: getSampleDims() const
+{
+	return mSampleDims;
+}
+
+void ByteDataset :: reserve( size_t count )
+{
+	detach();
+
+	mBytes.reserve( count * mSampleSize );
+}
+
+void ByteDataset :: resize( size_t count )
+{
+	detach();
+
+	mBytes.resize( count * mSampleSize, 0 );
+}
+
+uint8_t * ByteDataset :: extend( size_t count )
+{
+	detach();
+
+	size_t offset = mBytes.size();
+
+	mBytes.resize( offset + count * mSampleSize, 0 );
+
+	return mBytes.data() + offset;
+}
+
+void ByteDataset :: append( const uint8_t * sample )
+{
+	detach();
+
+	mBytes.insert( mBytes.end(), sample, sample + mSampleSize );
+}
+
+void ByteDataset :: append( const DataVector & sample )
+{
+	detach();
+
+	size_t offset = mBytes.size();
+
+	mBytes.resize( offset + mSampleSize, 0 );
+
+	for( size_t i = 0; i < mSampleSize && i < sample.size(); i++ ) {
+		DataType value = std::round( ( sample[ i ] * mStddev + mMean ) * 255 );
+
+		mBytes[ offset + i ] = (uint8_t)std::clamp( value, DataType( 0 ), DataType( 255 ) );
+	}
+}
+
+size_t ByteDataset :: size() const
+{
+	if( mFile ) return mFileCount;
+
+	return mSampleSize > 0 ? mBytes.size() / mSampleSize : 0;
+}
+
+size_t ByteDataset :: getSampleSize() const
+{
+	return mSampleSize;
+}
+
+const uint8_t * ByteDataset :: getBytes( size_t index ) const
+{
+	if( mFile ) return mFile->getItem( index );
+
+	return mBytes.data() + index * mSampleSize;
+}
+
+void ByteDataset :: getSample( size_t index, DataType * out, Augment * augment ) const
+{
+	const uint8_t * bytes = getBytes( index );
+
+	if( NULL != augment && augment->isEnabled() ) bytes = augment->apply( bytes, mSampleDims );
+
+	for( size_t i = 0; i < mSampleSize; i++ ) out[ i ] = mTable[ bytes[ i ] ];
+}
+
+void ByteDataset :: getSample( size_t index, DataVector * out ) const
+{
+	out->resize( mSampleSize );
+
+	getSample( index, std::begin( *out ) );
+}
+
+void ByteDataset :: toMatrix( DataMatrix * matrix, size_t count ) const
+{
+	count = count > 0 ? std::min( count, size() ) : size();
+
+	matrix->reserve( matrix->size() + count );
+
+	for( size_t i = 0; i < count; i++ ) {
+		matrix->emplace_back( DataVector( mSampleSize ) );
+		getSample( i, std::begin( matrix->back() ) );
+	}
+}
+
+// an attached file lives in the page cache, not in the dataset
+size_t ByteDataset :: getMemorySize() const
+{
+	return mBytes.capacity() + sizeof( *this );
+}
+
+////////////////////////////////////////////////////////////
+
+LabelDataset :: LabelDataset( size_t classCount )
+{
+	mClassCount = classCount;
+}
+
+LabelDataset :: ~LabelDataset()
+{
+}
+
+void LabelDataset :: reset( size_t classCount )
+{
+	mClassCount = classCount;
+	mLabels.clear();
+}
+
+void LabelDataset :: setClassCount( size_t classCount )
+{
+	mClassCount = classCount;
+}
+
+size_t LabelDataset :: getClassCount() const
+{
+	return mClassCount;
+}
+
+void LabelDataset :: reserve( size_t count )
+{
+	mLabels.reserve( count );
+}
+
+void LabelDataset :: append( uint16_t label )
+{
+	mLabels.push_back( label );
+
+	mClassCount = std::max( mClassCount, (size_t)label + 1 );
+}
+
+size_t LabelDataset :: size() const
+{
+	return mLabels.size();
+}
+
+uint16_t LabelDataset :: get( size_t index ) const
+{
+	return mLabels[ index ];
+}
+
+void LabelDataset :: getOneHot( size_t index, DataType * out ) const
+{
+	std::fill( out, out + mClassCount, 0 );
+
+	out[ mLabels[ index ] ] = 1;
+}
+
+void LabelDataset :: toMatrix( DataMatrix * matrix, size_t count ) const
+{
+	count = count > 0 ? std::min( count, size() ) : size();
+
+	matrix->reserve( matrix->size() + count );
+
+	for( size_t i = 0; i < count; i++ ) {
+		matrix->emplace_back( DataVector( mClassCount ) );
+		getOneHot( i, std::begin( matrix->back() ) );
+	}
+}
+
+void LabelDataset :: fromMatrix( const DataMatrix & matrix )
+{
+	reset( matrix.size() > 0 ? matrix[ 0 ].size() : 0 );
+
+	mLabels.reserve( matrix.size() );
+
+	for( auto & item : matrix ) {
+		mLabels.push_back( std::max_element( std::begin( item ), std::end( item ) ) - std::begin( item ) );
+	}
+}
+
+size_t LabelDataset :: getMemorySize() const
+{
+	return mLabels.capacity() * sizeof( uint16_t ) + sizeof( *this );
+}
+
+////////////////////////////////////////////////////////////
+
+DatasetCache :: DatasetCache()
+{
+	mCrc = 0;
+	mSourceSize = 0;
+}
+
+DatasetCache :: ~DatasetCache()
+{
+}
+
+bool DatasetCache :: addSource( const char * path )
+{
+	std::string gzPath = std::string( path ) + ".gz";
+
+	if( 0 != access( path, F_OK ) && 0 == access( gzPath.c_str(), F_OK ) ) path = gzPath.c_str();
+
+	int fd = ::open( path, O_RDONLY );
+
+	if( fd < 0 ) {
+		printf( "open %s fail, errno %d, %s\n", path, errno, strerror( errno ) );
+		return false;
+	}
+
+	struct stat fileStat;
+
+	void * data = MAP_FAILED;
+
+	if( 0 == fstat( fd, &fileStat ) && fileStat.st_size > 0 ) {
+		data = mmap( NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	}
+
+	::close( fd );
+
+	if( MAP_FAILED == data ) {
+		printf( "mmap %s fail\n", path );
+		return false;
+	}
+
+	madvise( data, fileStat.st_size, MADV_SEQUENTIAL );
+
+	mCrc = Inflate::crc32( mCrc, (const uint8_t *)data, fileStat.st_size );
+	mSourceSize += fileStat.st_size;
+
+	munmap( data, fileStat.st_size );
+
+	if( mFirstSource.empty() ) mFirstSource = path;
+
+	return true;
+}
+
+void DatasetCache :: addParams( const char * params )
+{
+	mCrc = Inflate::crc32( mCrc, (const uint8_t *)params, strlen( params ) );
+}
+
+std::string DatasetCache :: getPath() const
+{
+	char suffix[ 64 ] = { 0 };
+	snprintf( suffix, sizeof( suffix ), ".%08x-%zu.cache", mCrc, mSourceSize );
+
+	return mFirstSource + suffix;
+}
+
+bool DatasetCache :: load( ByteDataset * dataset ) const
+{
+	std::string path = getPath();
+
+	if( mFirstSource.empty() || 0 != access( path.c_str(), F_OK ) ) return false;
+
+	IdxFilePtr file( new IdxFile() );
+
+	if( ! file->open( path.c_str() ) || file->getDims().size() < 2 ) return false;
+
+	dataset->attach( file );
+
+	printf( "DatasetCache load %s, %zu samples\n", path.c_str(), dataset->size() );
+
+	return true;
+}
+
+bool DatasetCache :: save( const ByteDataset & dataset ) const
+{
+	if( mFirstSource.empty() ) return false;
+
+	std::string path = getPath();
+
+	Dims dims = dataset.getSampleDims();
+	dims.insert( dims.begin(), dataset.size() );
+
+	if( ! gx_write_idx( path, dims, dataset.size() > 0 ? dataset.getBytes( 0 ) : NULL ) ) return false;
+
+	size_t slash = mFirstSource.rfind( '/' );
+
+	std::string dir = std::string::npos == slash ? "." : mFirstSource.substr( 0, slash );
+	std::string prefix = mFirstSource.substr( std::string::npos == slash ? 0 : slash + 1 ) + ".";
+	std::string name = path.substr( std::string::npos == slash ? 0 : slash + 1 );
+
+	DIR * dirp = opendir( dir.c_str() );
+
+	for( struct dirent * entry = NULL; NULL != dirp && NULL != ( entry = readdir( dirp ) ); ) {
+		std::string item = entry->d_name;
+
+		if( item != name && 0 == item.compare( 0, prefix.size(), prefix )
+				&& item.size() > 6 && 0 == item.compare( item.size() - 6, 6, ".cache" ) ) {
+			remove( ( dir + "/" + item ).c_str() );
+		}
+	}
+
+	if( NULL != dirp ) closedir( dirp );
+
+	printf( "DatasetCache save %s, %zu samples\n", path.c_str(), dataset.size() );
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+
+Dataset :: ~Dataset()
+{
+}
+
+////////////////////////////////////////////////////////////
+
+ShardedDataset :: ShardedDataset()
+{
+	mClassCount = mCount = 0;
+	mNextShard = (size_t)-1;
+}
+
+ShardedDataset :: ~ShardedDataset()
+{
+}
+
+bool ShardedDataset :: open( const char * path )
+{
+	FILE * fp = fopen( path, "r" );
+
+	if( NULL == fp ) {
+		printf( "open %s fail, errno %d, %s\n", path, errno, strerror( errno ) );
+		return false;
+	}
+
+	const char * slash = strrchr( path, '/' );
+	mDir = NULL == slash ? "." : std::string( path, slash - path );
+
+	mSampleDims.clear();
+	mClassCount = mCount = 0;
+	mImages.clear();
+	mLabels.clear();
+	mShardSizes.clear();
+
+	mNextShard = (size_t)-1;
+	mNextImages.reset();
+	mNextLabels.reset();
+
+	bool ret = true;
+
+	char line[ 1024 ] = { 0 }, images[ 256 ] = { 0 }, labels[ 256 ] = { 0 };
+
+	for( int lineNo = 1; ret && NULL != fgets( line, sizeof( line ), fp ); lineNo++ ) {
+		size_t count = 0;
+		int offset = 0;
+
+		if( 1 == lineNo ) {
+			ret = 0 == strncmp( line, "gxnet shards", 12 );
+		} else if( 0 == strncmp( line, "dims ", 5 ) ) {
+			for( char * pos = line + 5; 1 == sscanf( pos, "%zu%n", &count, &offset ); pos += offset ) {
+				mSampleDims.push_back( count );
+			}
+		} else if( 1 == sscanf( line, "classes %zu", &count ) ) {
+			mClassCount = count;
+		} else if( 3 == sscanf( line, "shard %zu %255s %255s", &count, images, labels ) ) {
+			mShardSizes.push_back( count );
+			mImages.push_back( images );
+			mLabels.push_back( labels );
+			mCount += count;
+		} else {
+			ret = '\n' == line[ 0 ];
+		}
+
+		if( ! ret ) printf( "%s invalid line %d, %s", path, lineNo, line );
+	}
+
+	fclose( fp );
+
+	if( ret && ( mSampleDims.empty() || 0 == mClassCount ) ) {
+		printf( "%s has no dims or classes\n", path );
+		ret = false;
+	}
+
+	return ret;
+}
+
+size_t ShardedDataset :: size() const
+{
+	return mCount;
+}
+
+const Dims & ShardedDataset :: getSampleDims() const
+{
+	return mSampleDims;
+}
+
+size_t ShardedDataset :: getClassCount() const
+{
+	return mClassCount;
+}
+
+size_t ShardedDataset :: getShardCount() const
+{
+	return mShardSizes.size();
+}
+
+size_t ShardedDataset :: getShardSize( size_t shard ) const
+{
+	return mShardSizes[ shard ];
+}
+
+bool ShardedDataset :: openShard( size_t shard, IdxFilePtr * images, IdxFilePtr * labels ) const
+{
+	images->reset( new IdxFile() );
+	labels->reset( new IdxFile() );
+
+	std::string imagesPath = mDir + "/" + mImages[ shard ], labelsPath = mDir + "/" + mLabels[ shard ];
+
+	if( ! ( *images )->open( imagesPath.c_str() ) || ! ( *labels )->open( labelsPath.c_str() ) ) return false;
+
+	Dims dims( ( *images )->getDims().begin() + 1, ( *images )->getDims().end() );
+
+	if( dims != mSampleDims || ( *images )->getCount() != mShardSizes[ shard ]
+			|| ( *labels )->getCount() != mShardSizes[ shard ] || ( *labels )->getDims().size() != 1 ) {
+		printf( "shard %zu (%s) does not match the index\n", shard, imagesPath.c_str() );
+		return false;
+	}
+
+	return true;
+}
+
+bool ShardedDataset :: load( size_t shard, ByteDataset * input, LabelDataset * target )
+{
+	if( shard >= mShardSizes.size() ) return false;
+
+	IdxFilePtr images, labels;
+
+	if( shard == mNextShard && mNextImages ) {
+		images.swap( mNextImages );
+		labels.swap( mNextLabels );
+	} else if( ! openShard( shard, &images, &labels ) ) {
+		return false;
+	}
+
+	mNextShard = (size_t)-1;
+
+	input->attach( images );
+
+	target->reset( mClassCount );
+	target->reserve( labels->getCount() );
+
+	for( size_t i = 0; i < labels->getCount(); i++ ) target->append( *labels->getItem( i ) );
+
+	return true;
+}
+
+void ShardedDataset :: prefetch( size_t shard )
+{
+	if( shard >= mShardSizes.size() || shard == mNextShard ) return;
+
+	mNextShard = shard;
+
+	if( openShard( shard, &mNextImages, &mNextLabels ) ) {
+		mNextImages->advise( IdxFile::eWillNeed );
+	} else {
+		mNextImages.reset();
+		mNextLabels.reset();
+	}
+}
+
+bool ShardedDataset :: convert( const char * images, const char * labels, const char * prefix, size_t shardSize )
+{
+	IdxFile imagesFile, labelsFile;
+
+	if( ! imagesFile.open( images ) || ! labelsFile.open( labels ) ) return false;
+
+	if( imagesFile.getDims().size() < 2 || labelsFile.getDims().size() != 1
+			|| imagesFile.getCount() != labelsFile.getCount() || 0 == shardSize ) {
+		printf( "%s and %s do not match, or shard size %zu\n", images, labels, shardSize );
+		return false;
+	}
+
+	size_t count = imagesFile.getCount();
+
+	const uint8_t * items = labelsFile.getItem( 0 );
+	size_t classCount = count > 0 ? *std::max_element( items, items + count ) + 1 : 0;
+
+	const char * slash = strrchr( prefix, '/' );
+	const char * name = NULL == slash ? prefix : slash + 1;
+
+	// the source is read once from the front, its pages are not needed again
+	imagesFile.advise( IdxFile::eSequential );
+
+	std::string index = "gxnet shards\ndims";
+
+	for( size_t i = 1; i < imagesFile.getDims().size(); i++ ) index += " " + std::to_string( imagesFile.getDims()[ i ] );
+
+	index += "\nclasses " + std::to_string( classCount ) + "\n";
+
+	for( size_t begin = 0, shard = 0; begin < count; begin += shardSize, shard++ ) {
+		size_t end = std::min( count, begin + shardSize );
+
+		char suffix[ 32 ] = { 0 };
+		snprintf( suffix, sizeof( suffix ), ".%05zu", shard );
+
+		Dims dims = imagesFile.getDims();
+		dims[ 0 ] = end - begin;
+
+		if( ! gx_write_idx( std::string( prefix ) + suffix + ".images", dims, imagesFile.getItem( begin ) )
+				|| ! gx_write_idx( std::string( prefix ) + suffix + ".labels", { end - begin }, labelsFile.getItem( begin ) ) ) {
+			return false;
+		}
+
+		index += "shard " + std::to_string( end - begin ) + " " + name + suffix + ".images "
+				+ name + suffix + ".labels\n";
+	}
+
+	std::string path = std::string( prefix ) + ".shards", tmpPath = path + ".tmp";
+
+	FILE * fp = fopen( tmpPath.c_str(), "w" );
+
+	bool ret = NULL != fp && 1 == fwrite( index.data(), index.size(), 1, fp );
+
+	ret = NULL != fp && 0 == fclose( fp ) && ret;
+
+	if( ! ret || 0 != rename( tmpPath.c_str(), path.c_str() ) ) {
+		printf( "write %s fail\n", path.c_str() );
+		remove( tmpPath.c_str() );
+		return false;
+	}
+
+	printf( "%s save %s, %zu samples in %zu shards\n", __func__, path.c_str(), count,
+			( count + shardSize - 1 ) / shardSize );
+
+	return true;
+}
+
+}; // namespace gxnet;
+
@@ -0,0 +1,278 @@
+#pragma once
+
+#include "common.h"
+#include "augment.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+namespace gxnet {
+
+/**
+ * A read-only idx file mapped into memory. The header is validated against the file
+ * size, and the items are views straight into the mapping, so opening costs no copy
+ * and the page cache is shared with every other process reading the same file.
+ * A gzipped file, or path.gz when path is missing, is inflated into memory instead.
+ */
+class IdxFile {
+public:
+	enum { eNormal = 0, eSequential = 1, eRandom = 2, eWillNeed = 3 };
+
+	IdxFile();
+	~IdxFile();
+
+	IdxFile( const IdxFile & ) = delete;
+	IdxFile & operator=( const IdxFile & ) = delete;
+
+	// only the unsigned byte type, 0x08, is supported
+	bool open( const char * path );
+
+	void close();
+
+	// madvise for the access pattern of the next epoch, eWillNeed starts reading the file in
+	void advise( int access ) const;
+
+	// { count, rows, cols } for images, { count } for labels
+	const Dims & getDims() const;
+
+	size_t getCount() const;
+
+	size_t getItemSize() const;
+
+	const uint8_t * getItem( size_t index ) const;
+
+private:
+	void * mMap;
+	size_t mMapSize;
+
+	std::vector< uint8_t > mInflated;
+
+	Dims mDims;
+	const uint8_t * mData;
+	size_t mItemSize;
+};
+
+typedef std::shared_ptr< IdxFile > IdxFilePtr;
+
+/**
+ * Samples of one size kept as contiguous uint8, the way the idx files store them.
+ * A sample becomes DataType only when it is staged, through a 256 entry table of
+ * ( byte / 255 - mean ) / stddev.
+ */
+class ByteDataset {
+public:
+	ByteDataset( size_t sampleSize = 0 );
+	~ByteDataset();
+
+	// drops the samples
+	void reset( size_t sampleSize );
+
+	/**
+	 * A read-only view of the first count items of the file, no copy is made.
+	 * The first call that adds samples copies the view into the dataset.
+	 */
+	void attach( const IdxFilePtr & file, size_t count = 0 );
+
+	// forwards the access pattern to an attached file
+	void advise( int access ) const;
+
+	void setNormalization( DataType mean, DataType stddev );
+
+	// { rows, cols } for images, { sampleSize } until told otherwise
+	void setSampleDims( const Dims & dims );
+
+	const Dims & getSampleDims() const;
+
+	void reserve( size_t count );
+
+	// keeps the first count samples, or adds zero samples up to count
+	void resize( size_t count );
+
+	// adds count zero samples, returns the first one to be filled in
+	uint8_t * extend( size_t count );
+
+	void append( const uint8_t * sample );
+
+	// the inverse of the normalization, rounded and clamped to a byte
+	void append( const DataVector & sample );
+
+	size_t size() const;
+
+	size_t getSampleSize() const;
+
+	const uint8_t * getBytes( size_t index ) const;
+
+	// out holds getSampleSize() values, an enabled augment transforms the bytes first
+	void getSample( size_t index, DataType * out, Augment * augment = NULL ) const;
+
+	void getSample( size_t index, DataVector * out ) const;
+
+	// the full DataType copy, for the DataMatrix based interfaces
+	void toMatrix( DataMatrix * matrix, size_t count = 0 ) const;
+
+	size_t getMemorySize() const;
+
+private:
+	// copy an attached view into mBytes before it changes
+	void detach();
+
+private:
+	std::vector< uint8_t > mBytes;
+	size_t mSampleSize;
+	Dims mSampleDims;
+
+	IdxFilePtr mFile;
+	size_t mFileCount;
+
+	DataType mMean, mStddev;
+	DataType mTable[ 256 ];
+};
+
+/**
+ * One class index per sample, 2 bytes instead of a one-hot DataVector. The one-hot
+ * rows are built only where a dense target is still needed.
+ */
+class LabelDataset {
+public:
+	LabelDataset( size_t classCount = 0 );
+	~LabelDataset();
+
+	void reset( size_t classCount );
+
+	// the one-hot size, grows with the labels appended
+	void setClassCount( size_t classCount );
+
+	size_t getClassCount() const;
+
+	void reserve( size_t count );
+
+	void append( uint16_t label );
+
+	size_t size() const;
+
+	uint16_t get( size_t index ) const;
+
+	// out holds getClassCount() values
+	void getOneHot( size_t index, DataType * out ) const;
+
+	void toMatrix( DataMatrix * matrix, size_t count = 0 ) const;
+
+	// the argmax of every row, the class count is the row size
+	void fromMatrix( const DataMatrix & matrix );
+
+	size_t getMemorySize() const;
+
+private:
+	std::vector< uint16_t > mLabels;
+	size_t mClassCount;
+};
+
+/**
+ * Preprocessed byte samples kept on disk as an idx file, named by a crc32 of the
+ * source files and of the preprocessing parameters. Later runs map the file instead
+ * of parsing and preprocessing again, a change of either picks another name.
+ */
+class DatasetCache {
+public:
+	DatasetCache();
+	~DatasetCache();
+
+	// path, or path.gz when path is missing, the way IdxFile opens it
+	bool addSource( const char * path );
+
+	// everything that changes the result, counts, sizes, options
+	void addParams( const char * params );
+
+	// <first source>.<crc32>-<source bytes>.cache
+	std::string getPath() const;
+
+	// attaches the cached samples, false on a miss
+	bool load( ByteDataset * dataset ) const;
+
+	// also removes the caches of the first source left by other keys
+	bool save( const ByteDataset & dataset ) const;
+
+private:
+	std::string mFirstSource;
+	uint32_t mCrc;
+	size_t mSourceSize;
+};
+
+/**
+ * The streaming interface of the datasets that do not fit in memory, they are read
+ * one shard at a time, and the next shard is read while the current one is trained.
+ */
+class Dataset {
+public:
+	virtual ~Dataset();
+
+	virtual size_t size() const = 0;
+
+	virtual const Dims & getSampleDims() const = 0;
+
+	virtual size_t getClassCount() const = 0;
+
+	virtual size_t getShardCount() const = 0;
+
+	virtual size_t getShardSize( size_t shard ) const = 0;
+
+	// views of the shard, they keep its memory alive until they are reset
+	virtual bool load( size_t shard, ByteDataset * input, LabelDataset * target ) = 0;
+
+	// starts reading the shard in the background, a later load of it does not wait
+	virtual void prefetch( size_t shard ) = 0;
+};
+
+/**
+ * Fixed size records in shards of idx files, <prefix>.<n>.images and <prefix>.<n>.labels,
+ * listed by the text index <prefix>.shards, so every shard still opens with the idx
+ * loaders. Only the loaded shard and the prefetched one are mapped.
+ */
+class ShardedDataset : public Dataset {
+public:
+	ShardedDataset();
+	~ShardedDataset();
+
+	// the index file, the shards are relative to its directory
+	bool open( const char * path );
+
+	size_t size() const;
+
+	const Dims & getSampleDims() const;
+
+	size_t getClassCount() const;
+
+	size_t getShardCount() const;
+
+	size_t getShardSize( size_t shard ) const;
+
+	bool load( size_t shard, ByteDataset * input, LabelDataset * target );
+
+	void prefetch( size_t shard );
+
+	/**
+	 * Split an idx3 images file and its idx1 labels file into shards of shardSize samples,
+	 * one mapped range at a time, and write <prefix>.shards last.
+	 */
+	static bool convert( const char * images, const char * labels, const char * prefix, size_t shardSize );
+
+private:
+	bool openShard( size_t shard, IdxFilePtr * images, IdxFilePtr * labels ) const;
+
+private:
+	std::string mDir;
+
+	Dims mSampleDims;
+	size_t mClassCount, mCount;
+
+	std::vector< std::string > mImages, mLabels;
+	std::vector< size_t > mShardSizes;
+
+	size_t mNextShard;
+	IdxFilePtr mNextImages, mNextLabels;
+};
+
+}; // namespace gxnet;
+
@@ -5,35 +5,47 @@
 namespace gxnet {
 
 void gx_eval( const char * tag, Network & network, DataMatrix & input, DataMatrix & target )
+{
+	LabelDataset labels;
+	labels.fromMatrix( target );
+
+	gx_eval( tag, network, input, labels );
+}
+
+void gx_eval( const char * tag, Network & network, DataMatrix & input, const LabelDataset & target,
+		DataMatrix * result )
 {
 	printf( "%s( %s, ..., input { %ld }, target { %ld } )\n", __func__, tag, input.size(), target.size() );
 
 	if( gx_is_inner_debug ) network.print();
 	network.setTraining( false );
 
-	DataMatrix confusionMatrix;
-	DataVector targetTotal;
-
-	size_t maxClasses = target[ 0 ].size();
-	confusionMatrix.resize( maxClasses );
-	targetTotal.resize( maxClasses );
-	for( size_t i = 0; i < maxClasses; i++ ) confusionMatrix[ i ].resize( maxClasses, 0.0 );
-
 	int correct = 0;
 
-	DataMatrix output;
+	DataMatrix local;
+	DataMatrix & output = NULL != result ? *result : local;
 
 	bool ret = network.forward( input, &output );
 
 	if( ! ret ) {
 		printf( "forward fail\n" );
+		output.clear();
 		return;
 	}
 
+	DataMatrix confusionMatrix;
+	DataVector targetTotal;
+
+	// the output may have more classes than the labels
+	size_t maxClasses = std::max( target.getClassCount(), output.size() > 0 ? output[ 0 ].size() : 0 );
+	confusionMatrix.resize( maxClasses );
+	targetTotal.resize( maxClasses );
+	for( size_t i = 0; i < maxClasses; i++ ) confusionMatrix[ i ].resize( maxClasses, 0.0 );
+
 	for( size_t i = 0; i < output.size(); i++ ) {
 
 		int outputType = Utils::max_index( std::begin( output[ i ] ), std::end( output[ i ] ) );
-		int targetType = Utils::max_index( std::begin( target[ i ] ), std::end( target[ i ] ) );
+		int targetType = target.get( i );
 
 		if( gx_is_inner_debug ) printf( "forward %d, index %zu, %d %d\n", ret, i, outputType, targetType );
 
@@ -43,7 +55,7 @@ void gx_eval( const char * tag, Network & network, DataMatrix & input, DataMatri
 		targetTotal[ targetType ] += 1;
 
 		for( size_t j = 0; gx_is_inner_debug && j < output[ i ].size() && j < 10; j++ ) {
-			printf( "\t%zu %.8f %.8f\n", j, output[ i ][ j ], target[ i ][ j ] );
+			printf( "\t%zu %.8f %d\n", j, output[ i ][ j ], (int)j == targetType );
 		}
 	}
 
@@ -56,6 +68,33 @@ void gx_eval( const char * tag, Network & network, DataMatrix & input, DataMatri
 	Utils::printMatrix( "confusion matrix", confusionMatrix, false, true );
 }
 
+DataType gx_accuracy( Network & network, const DataMatrix & input, const DataMatrix & target )
+{
+	LabelDataset labels;
+	labels.fromMatrix( target );
+
+	return gx_accuracy( network, input, labels );
+}
+
+DataType gx_accuracy( Network & network, const DataMatrix & input, const LabelDataset & target )
+{
+	network.setTraining( false );
+
+	DataMatrix output;
+
+	if( input.empty() || ! network.forward( input, &output ) ) return 0;
+
+	int correct = 0;
+
+	for( size_t i = 0; i < output.size(); i++ ) {
+		int outputType = Utils::max_index( std::begin( output[ i ] ), std::end( output[ i ] ) );
+
+		if( outputType == target.get( i ) ) correct++;
+	}
+
+	return DataType( correct ) / input.size();
+}
+
 
 }; // namespace gxnet;
 
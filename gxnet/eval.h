@@ -7,7 +7,17 @@ namespace gxnet {
 
 class Network;
 
+// the one-hot targets are reduced to class indexes first
 void gx_eval( const char * tag, Network & network, DataMatrix & input, DataMatrix & target );
 
+// output keeps the forward results when it is not NULL
+void gx_eval( const char * tag, Network & network, DataMatrix & input, const LabelDataset & target,
+		DataMatrix * output = NULL );
+
+// the ratio of argmax hits, without the report of gx_eval
+DataType gx_accuracy( Network & network, const DataMatrix & input, const DataMatrix & target );
+
+DataType gx_accuracy( Network & network, const DataMatrix & input, const LabelDataset & target );
+
 }; // namespace gxnet;
 
@@ -1,5 +1,7 @@
 #include "network.h"
 #include "utils.h"
+#include "eval.h"
+#include "image.h"
 
 #include <iostream>
 #include <fstream>
@@ -17,6 +19,7 @@
 
 using namespace gxnet;
 
+// a jpeg or png goes through the conv2mnist.py steps, anything else is a .mnist csv
 bool readImage( const char * path, DataVector * input )
 {
 	auto getNumberVector = []( std::string const & line, DataVector * data ) {
@@ -32,13 +35,36 @@ bool readImage( const char * path, DataVector * input )
 		}
 	};
 
-	std::ifstream fp( path );
+	std::ifstream fp( path, std::ios::binary );
 
 	if( !fp ) {
 		printf( "open %s fail, errno %d, %s\n", path, errno, strerror( errno ) );
 		return false;
 	}
 
+	std::string data( ( std::istreambuf_iterator< char >( fp ) ), std::istreambuf_iterator< char >() );
+
+	if( Image::isImage( (const uint8_t *)data.data(), data.size() ) ) {
+		int width = 0, height = 0;
+		std::vector< uint8_t > rgba;
+
+		if( ! Image::decode( (const uint8_t *)data.data(), data.size(), &width, &height, &rgba ) ) {
+			printf( "decode %s fail\n", path );
+			return false;
+		}
+
+		uint8_t mnist[ Image::eMnistSize * Image::eMnistSize ];
+		Image::toMnist( rgba.data(), width, height, mnist );
+
+		input->resize( sizeof( mnist ) );
+		for( size_t i = 0; i < sizeof( mnist ); i++ ) ( *input )[ i ] = mnist[ i ] / 255.0;
+
+		return true;
+	}
+
+	fp.clear();
+	fp.seekg( 0 );
+
 	std::string line;
 
 	if( ! std::getline( fp, line ) ) {
@@ -53,7 +79,33 @@ bool readImage( const char * path, DataVector * input )
 	return true;
 }
 
-int test( const char * model, const char * file )
+bool loadModel( const char * model, int storage, Network * network )
+{
+	if( ! Utils::load( model, network ) ) return false;
+
+	if( storage < 0 ) return true;
+
+	for( auto & layer : network->getLayers() ) {
+		// ConvLayer keeps its DataType filters, bf16 and fp16 under PackedRows::eHalfMinBytes stay dense
+		if( BaseLayer::eFullConn == layer->getType() ) ( (FullConnLayer*)layer )->setStorage( storage );
+		if( BaseLayer::eConvEx == layer->getType() ) ( (ConvExLayer*)layer )->setStorage( storage );
+	}
+
+	return true;
+}
+
+void expandImages( const Network & network, DataMatrix * input )
+{
+	for( auto & item : *input ) {
+		if( item.size() < network.getLayers()[ 0 ]->getBaseInSize() ) {
+			DataVector newInput;
+			Utils::expandMnistImage( item, &newInput );
+			item = newInput;
+		}
+	}
+}
+
+int test( const char * model, int storage, const char * file )
 {
 	DataVector input, output;
 
@@ -61,7 +113,7 @@ int test( const char * model, const char * file )
 
 	Network network;
 
-	if( ! Utils::load( model, &network ) ) return -1;
+	if( ! loadModel( model, storage, &network ) ) return -1;
 
 	if( input.size() < network.getLayers()[ 0 ]->getBaseInSize() ) {
 		DataVector newInput;
@@ -83,9 +135,10 @@ int test( const char * model, const char * file )
 	return result;
 }
 
-int eval( const char * model, const char * images, const char * labels )
+int eval( const char * model, int storage, const char * images, const char * labels )
 {
-	DataMatrix input, target;
+	DataMatrix input;
+	LabelDataset target;
 
 	if( ! Utils::loadMnistImages( 0, images, &input ) ) {
 		printf( "read %s fail\n", images );
@@ -108,43 +161,162 @@ int eval( const char * model, const char * images, const char * labels )
 
 	Network network;
 
-	if( ! Utils::load( model, &network ) ) return -1;
+	if( ! loadModel( model, storage, &network ) ) return -1;
 
-	DataVector output;
+	expandImages( network, &input );
 
-	Dims inDims = { 28, 28 };
+	// one forward for both the report and the result file
+	DataMatrix output;
 
-	for( size_t i = 0; i < input.size(); i++ ) {
+	gx_eval( model, network, input, target, &output );
 
-		if( input[ i ].size() < network.getLayers()[ 0 ]->getBaseInSize() ) {
-			DataVector newInput;
-			Utils::expandMnistImage( input[ i ], &newInput );
-			input[ i ] = newInput;
-		}
+	if( output.size() != input.size() ) {
+		fclose( fp );
+		return -1;
+	}
 
-		bool ret = network.forward( input[ i ], &output );
+	for( size_t i = 0; i < output.size(); i++ ) {
+		int outputType = Utils::max_index( std::begin( output[ i ] ), std::end( output[ i ] ) );
+		fprintf( fp, "%d %d %.6f\n", target.get( i ), outputType, output[ i ][ outputType ] );
+	}
+
+	printf( "save eval result in %s\n", result );
 
-		if( ! ret ) {
-			printf( "forward fail\n" );
+	fclose( fp );
+	
+	return 0;
+}
+
+int freeze( const char * model, int storage, const char * output )
+{
+	Network network;
+
+	if( ! loadModel( model, storage, &network ) ) return -1;
+
+	int count = network.foldBatchNorm();
+
+	if( ! Utils::save( output, network ) ) {
+		printf( "save %s fail\n", output );
+		return -1;
+	}
+
+	printf( "fold %d batchnorm layers, save to %s\n", count, output );
+
+	return 0;
+}
+
+int quantize( const char * model, const char * images, int calibCount, const char * output )
+{
+	DataMatrix input;
+
+	if( ! Utils::loadMnistImages( calibCount, images, &input ) ) {
+		printf( "read %s fail\n", images );
+		return -1;
+	}
+
+	Network network;
+
+	if( ! loadModel( model, -1, &network ) ) return -1;
+
+	expandImages( network, &input );
+
+	int count = network.quantize( input );
+
+	if( ! Utils::save( output, network ) ) {
+		printf( "save %s fail\n", output );
+		return -1;
+	}
+
+	printf( "quantize %d layers with %zu calibration images, save to %s\n", count, input.size(), output );
+
+	return 0;
+}
+
+int binarize( const char * model, const char * output )
+{
+	Network network;
+
+	if( ! loadModel( model, -1, &network ) ) return -1;
+
+	int count = network.binarize();
+
+	if( ! Utils::save( output, network ) ) {
+		printf( "save %s fail\n", output );
+		return -1;
+	}
+
+	printf( "binarize %d layers, save to %s\n", count, output );
+
+	return 0;
+}
+
+// maxDrop >= 0 searches the smallest energy whose accuracy drop stays within it
+int lowRank( const char * model, DataType energy, DataType maxDrop,
+		const char * images, const char * labels, const char * output )
+{
+	DataMatrix input;
+	LabelDataset target;
+
+	if( maxDrop >= 0 ) {
+		if( NULL == images || NULL == labels ) {
+			printf( "--maxdrop needs --images and --labels\n" );
+			return -1;
+		}
+
+		if( ! Utils::loadMnistImages( 0, images, &input ) || ! Utils::loadMnistLabels( 0, labels, &target ) ) {
+			printf( "read %s or %s fail\n", images, labels );
 			return -1;
 		}
+	}
+
+	Network network;
+
+	if( ! loadModel( model, -1, &network ) ) return -1;
+
+	expandImages( network, &input );
+
+	if( maxDrop >= 0 ) {
+		DataType baseline = gx_accuracy( network, input, target );
+
+		printf( "baseline accuracy %.4f\n", baseline );
+
+		for( DataType item : { 0.5, 0.6, 0.7, 0.8, 0.9, 0.95, 0.98, 0.99, 0.999 } ) {
+			Network candidate;
+
+			if( ! loadModel( model, -1, &candidate ) ) return -1;
+
+			candidate.factorize( item );
+
+			DataType accuracy = gx_accuracy( candidate, input, target );
+
+			printf( "energy %.3f, accuracy %.4f\n", item, accuracy );
+
+			energy = item;
+
+			if( baseline - accuracy <= maxDrop ) break;
+		}
+	}
 
-		int outputType = Utils::max_index( std::begin( output ), std::end( output ) );
-		int targetType = Utils::max_index( std::begin( target[ i ] ), std::end( target[ i ] ) );
+	int count = network.factorize( energy );
 
-		fprintf( fp, "%d %d %.6f\n", targetType, outputType, output[ outputType ] );
+	if( ! Utils::save( output, network ) ) {
+		printf( "save %s fail\n", output );
+		return -1;
 	}
 
-	printf( "save eval result in %s\n", result );
+	printf( "factorize %d layers with energy %.3f, save to %s\n", count, energy, output );
 
-	fclose( fp );
-	
 	return 0;
 }
 
 void usage( const char * name )
 {
-	printf( "%s --model <model file> [ --file <csv file> ] [ --images <idx3 ubyte> --labels <idx1 ubyte> ]\n", name );
+	printf( "%s --model <model file> [ --file <jpeg/png/csv file> ] [ --images <idx3 ubyte> --labels <idx1 ubyte> ]"
+			" [ --freeze <output model file> ] [ --storage <none|bf16|fp16|int8|csr|binary> ]"
+			" [ --quant <output model file> --images <calibration idx3 ubyte> [ --calib <count> ] ]"
+			" [ --lowrank <output model file> [ --energy <ratio> ] [ --maxdrop <accuracy> --images --labels ] ]"
+			" [ --binarize <output model file> ]\n", name );
+	printf( "%s --shards <output prefix> --images <idx3 ubyte> --labels <idx1 ubyte> [ --shardsize <samples> ]\n", name );
 }
 
 int main( const int argc, char * argv[] )
@@ -154,11 +326,24 @@ int main( const int argc, char * argv[] )
 		{ "file",  required_argument,  NULL, 2 },
 		{ "images",  required_argument,  NULL, 3 },
 		{ "labels",  required_argument,  NULL, 4 },
+		{ "freeze",  required_argument,  NULL, 5 },
+		{ "storage", required_argument,  NULL, 6 },
+		{ "quant",   required_argument,  NULL, 7 },
+		{ "calib",   required_argument,  NULL, 8 },
+		{ "lowrank", required_argument,  NULL, 9 },
+		{ "energy",  required_argument,  NULL, 10 },
+		{ "maxdrop", required_argument,  NULL, 11 },
+		{ "binarize", required_argument, NULL, 12 },
+		{ "shards",  required_argument,  NULL, 13 },
+		{ "shardsize", required_argument, NULL, 14 },
 		{ 0, 0, 0, 0}
 	};
 
 	char * model = NULL, * file = NULL;
 	char * images = NULL, * labels = NULL;
+	char * frozen = NULL, * quant = NULL, * lowrank = NULL, * binary = NULL, * shards = NULL;
+	int storage = -1, calibCount = 1000, shardSize = 65536;
+	DataType energy = 0.9, maxDrop = -1;
 
 	int c = 0;
 	while( ( c = getopt_long( argc, argv, "", opts, NULL ) ) != EOF ) {
@@ -175,14 +360,51 @@ int main( const int argc, char * argv[] )
 			case 4:
 				labels = optarg;
 				break;
+			case 5:
+				frozen = optarg;
+				break;
+			case 6:
+				storage = PackedRows::name2type( optarg );
+				if( storage < 0 ) printf( "unknown storage %s, ignore it\n", optarg );
+				break;
+			case 7:
+				quant = optarg;
+				break;
+			case 8:
+				calibCount = atoi( optarg );
+				break;
+			case 9:
+				lowrank = optarg;
+				break;
+			case 10:
+				energy = atof( optarg );
+				break;
+			case 11:
+				maxDrop = atof( optarg );
+				break;
+			case 12:
+				binary = optarg;
+				break;
+			case 13:
+				shards = optarg;
+				break;
+			case 14:
+				shardSize = atoi( optarg );
+				break;
 			default:
 				usage( argv[ 0 ] );
 				break;
 		}
 	}
 
+	// converting needs no model
+	if( NULL != shards && NULL != images && NULL != labels ) {
+		return ShardedDataset::convert( images, labels, shards, std::max( shardSize, 1 ) ) ? 0 : -1;
+	}
+
 	if( ( NULL == model ) ||
-		( ! ( ( NULL != file ) || ( NULL != images && NULL != labels ) ) )
+		( ! ( ( NULL != file ) || ( NULL != images && NULL != labels ) || ( NULL != frozen )
+			|| ( NULL != quant && NULL != images ) || ( NULL != lowrank ) || ( NULL != binary ) ) )
 	) {
 		usage( argv[ 0 ] );
 		return 0;
@@ -190,9 +412,20 @@ int main( const int argc, char * argv[] )
 
 	int ret = -1;
 
-	if( NULL != file ) ret = test( model, file );
+	if( NULL != frozen ) ret = freeze( model, storage, frozen );
 
-	if( NULL != images && NULL != labels ) ret = eval( model, images, labels );
+	if( NULL != binary ) ret = binarize( model, binary );
+
+	if( NULL != file ) ret = test( model, storage, file );
+
+	// with --quant the images are the calibration set, not an evaluation set
+	if( NULL != quant && NULL != images ) {
+		ret = quantize( model, images, calibCount, quant );
+	} else if( NULL != lowrank ) {
+		ret = lowRank( model, energy, maxDrop, images, labels, lowrank );
+	} else if( NULL != images && NULL != labels ) {
+		ret = eval( model, storage, images, labels );
+	}
 
 	return ret;
 }
@@ -30,10 +30,10 @@ void Im2Rows :: rot180Filters2Rows( const MDVector & src, MDVector * rot180 )
 }
 
 void Im2Rows :: input2Rows( const MDSpanRO & inRO, size_t sampleIndex,
-		const Dims & filterDims, MDVector * dest )
+		const Dims & filterDims, MDVector * dest, size_t stride, size_t padding )
 {
-	size_t xMax = inRO.dim( 2 ) - filterDims[ 2 ] + 1;
-	size_t yMax = inRO.dim( 3 ) - filterDims[ 3 ] + 1;
+	size_t xMax = gx_conv_out_size( inRO.dim( 2 ), filterDims[ 2 ], stride, padding );
+	size_t yMax = gx_conv_out_size( inRO.dim( 3 ), filterDims[ 3 ], stride, padding );
 
 	Dims dims = { xMax * yMax, filterDims[ 1 ], filterDims[ 2 ], filterDims[ 3 ] };
 	dest->first.resize( gx_dims_flatten_size( dims ) );
@@ -46,8 +46,14 @@ void Im2Rows :: input2Rows( const MDSpanRO & inRO, size_t sampleIndex,
 		for( size_t y = 0; y < yMax; y++ ) {
 			for( size_t c = 0; c < inRO.dim( 1 ); c++ ) {
 				for( size_t i = 0; i < filterDims[ 2 ]; i++ ) {
+					size_t inX = x * stride + i - padding;
+					bool isRowValid = x * stride + i >= padding && inX < inRO.dim( 2 );
+
 					for( size_t j = 0; j < filterDims[ 3 ]; j++ ) {
-						rw( ( x * yMax + y ), c, i, j ) = inRO( sampleIndex, c, x + i, y + j );
+						size_t inY = y * stride + j - padding;
+						bool isValid = isRowValid && y * stride + j >= padding && inY < inRO.dim( 3 );
+
+						rw( ( x * yMax + y ), c, i, j ) = isValid ? inRO( sampleIndex, c, inX, inY ) : 0;
 					}
 				}
 			}
@@ -56,25 +62,31 @@ void Im2Rows :: input2Rows( const MDSpanRO & inRO, size_t sampleIndex,
 }
 
 void Im2Rows :: input2Rows4Gradients( const MDSpanRO & inRO, size_t sampleIndex,
-		const Dims & filterDims, MDVector * dest )
+		const Dims & filterDims, MDVector * dest, size_t stride, size_t padding )
 {
-	size_t xMax = inRO.dim( 2 ) - filterDims[ 2 ] + 1;
-	size_t yMax = inRO.dim( 3 ) - filterDims[ 3 ] + 1;
+	size_t xMax = gx_conv_out_size( inRO.dim( 2 ), filterDims[ 2 ], stride, padding );
+	size_t yMax = gx_conv_out_size( inRO.dim( 3 ), filterDims[ 3 ], stride, padding );
 
-	Dims dims = { inRO.dim( 1 ), xMax * yMax, filterDims[ 2 ], filterDims[ 3 ] };
+	Dims dims = { inRO.dim( 1 ), filterDims[ 2 ], filterDims[ 3 ], xMax * yMax };
 	dest->first.resize( gx_dims_flatten_size( dims ) );
 
-	dest->second = { inRO.dim( 1 ) * xMax * yMax, filterDims[ 2 ] * filterDims[ 3 ] };
+	dest->second = { inRO.dim( 1 ) * filterDims[ 2 ] * filterDims[ 3 ], xMax * yMax };
 
 	MDSpanRW rw( std::begin( dest->first ), dims );
 
 	for( size_t c = 0; c < inRO.dim( 1 ); c++ ) {
-		for( size_t x = 0; x < inRO.dim( 2 ) - filterDims[ 2 ] + 1; x++ ) {
-			for( size_t y = 0; y < inRO.dim( 3 ) - filterDims[ 3 ] + 1; y++ ) {
+		for( size_t i = 0; i < filterDims[ 2 ]; i++ ) {
+			for( size_t j = 0; j < filterDims[ 3 ]; j++ ) {
 
-				for( size_t i = 0; i < filterDims[ 2 ]; i++ ) {
-					for( size_t j = 0; j < filterDims[ 3 ]; j++ ) {
-						rw( c, x * yMax + y, i, j ) = inRO( sampleIndex, c, x + i, y + j );
+				for( size_t x = 0; x < xMax; x++ ) {
+					size_t inX = x * stride + i - padding;
+					bool isRowValid = x * stride + i >= padding && inX < inRO.dim( 2 );
+
+					for( size_t y = 0; y < yMax; y++ ) {
+						size_t inY = y * stride + j - padding;
+						bool isValid = isRowValid && y * stride + j >= padding && inY < inRO.dim( 3 );
+
+						rw( c, i, j, x * yMax + y ) = isValid ? inRO( sampleIndex, c, inX, inY ) : 0;
 					}
 				}
 			}
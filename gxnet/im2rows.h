@@ -8,11 +8,17 @@ class Im2Rows {
 public:
 	static void rot180Filters2Rows( const MDVector & src, MDVector * rot180 );
 
+	/**
+	 * dest dims: ( Hout * Wout, C * K * K ), zero for the positions inside padding
+	 */
 	static void input2Rows( const MDSpanRO & inRO, size_t sampleIndex, const Dims & filterDims,
-			MDVector * dest );
+			MDVector * dest, size_t stride = 1, size_t padding = 0 );
 
+	/**
+	 * dest dims: ( C * K * K, Hout * Wout ), zero for the positions inside padding
+	 */
 	static void input2Rows4Gradients( const MDSpanRO & inRO, size_t sampleIndex,
-			const Dims & filterDims, MDVector * dest );
+			const Dims & filterDims, MDVector * dest, size_t stride = 1, size_t padding = 0 );
 
 	static void rot180Filters( const MDVector & src, MDVector * dest );
 };
@@ -0,0 +1,1036 @@
+#include "image.h"
+#include "inflate.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+namespace gxnet {
+
+static const uint8_t gPngSignature[ 8 ] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+static inline uint32_t gx_read_be32( const uint8_t * in )
+{
+	return ( (uint32_t)in[ 0 ] << 24 ) | ( in[ 1 ] << 16 ) | ( in[ 2 ] << 8 ) | in[ 3 ];
+}
+
+static inline uint8_t gx_clamp8( int value )
+{
+	return value < 0 ? 0 : ( value > 255 ? 255 : value );
+}
+
+static inline int gx_clamp( int64_t value, int limit )
+{
+	return value < -limit ? -limit : ( value > limit ? limit : value );
+}
+
+bool Image :: isJpeg( const uint8_t * in, size_t size )
+{
+	return size >= 3 && 0xff == in[ 0 ] && 0xd8 == in[ 1 ] && 0xff == in[ 2 ];
+}
+
+bool Image :: isPng( const uint8_t * in, size_t size )
+{
+	return size >= sizeof( gPngSignature ) && 0 == memcmp( in, gPngSignature, sizeof( gPngSignature ) );
+}
+
+bool Image :: isImage( const uint8_t * in, size_t size )
+{
+	return isJpeg( in, size ) || isPng( in, size );
+}
+
+bool Image :: decode( const uint8_t * in, size_t size, int * width, int * height, std::vector< uint8_t > * rgba )
+{
+	if( isJpeg( in, size ) ) return decodeJpeg( in, size, width, height, rgba );
+
+	if( isPng( in, size ) ) return decodePng( in, size, width, height, rgba );
+
+	printf( "%s unknown image format\n", __func__ );
+
+	return false;
+}
+
+bool Image :: load( const char * path, int * width, int * height, std::vector< uint8_t > * rgba )
+{
+	FILE * fp = fopen( path, "rb" );
+
+	if( NULL == fp ) {
+		printf( "open %s fail, errno %d, %s\n", path, errno, strerror( errno ) );
+		return false;
+	}
+
+	std::vector< uint8_t > data;
+
+	uint8_t buff[ 64 * 1024 ];
+	for( size_t count = 0; ( count = fread( buff, 1, sizeof( buff ), fp ) ) > 0; ) {
+		data.insert( data.end(), buff, buff + count );
+	}
+
+	fclose( fp );
+
+	if( ! decode( data.data(), data.size(), width, height, rgba ) ) {
+		printf( "decode %s fail\n", path );
+		return false;
+	}
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+
+static uint8_t gx_paeth( int a, int b, int c )
+{
+	int p = a + b - c, pa = std::abs( p - a ), pb = std::abs( p - b ), pc = std::abs( p - c );
+
+	return pa <= pb && pa <= pc ? a : ( pb <= pc ? b : c );
+}
+
+// rows of 1 filter byte and stride bytes, undone in place
+static bool gx_png_unfilter( uint8_t * data, size_t rows, size_t stride, size_t bpp )
+{
+	const uint8_t * prior = NULL;
+
+	for( size_t y = 0; y < rows; y++ ) {
+		int type = data[ 0 ];
+		uint8_t * row = data + 1;
+
+		for( size_t i = 0; i < stride; i++ ) {
+			int left = i >= bpp ? row[ i - bpp ] : 0, up = NULL != prior ? prior[ i ] : 0;
+			int upLeft = NULL != prior && i >= bpp ? prior[ i - bpp ] : 0;
+
+			switch( type ) {
+				case 0: break;
+				case 1: row[ i ] += left; break;
+				case 2: row[ i ] += up; break;
+				case 3: row[ i ] += ( left + up ) >> 1; break;
+				case 4: row[ i ] += gx_paeth( left, up, upLeft ); break;
+				default:
+					printf( "png invalid filter %d\n", type );
+					return false;
+			}
+		}
+
+		prior = row;
+		data += 1 + stride;
+	}
+
+	return true;
+}
+
+static uint32_t gx_adler32( const uint8_t * data, size_t size )
+{
+	uint32_t a = 1, b = 0;
+
+	while( size > 0 ) {
+		// no overflow of b within 5552 bytes
+		size_t count = std::min( size, (size_t)5552 );
+
+		for( size_t i = 0; i < count; i++ ) {
+			a += data[ i ];
+			b += a;
+		}
+
+		a %= 65521;
+		b %= 65521;
+		data += count;
+		size -= count;
+	}
+
+	return ( b << 16 ) | a;
+}
+
+bool Image :: decodePng( const uint8_t * in, size_t size, int * width, int * height, std::vector< uint8_t > * rgba )
+{
+	if( ! isPng( in, size ) ) return false;
+
+	const uint8_t * pos = in + sizeof( gPngSignature ), * end = in + size;
+
+	uint32_t w = 0, h = 0;
+	int depth = 0, colorType = -1, interlace = 0;
+
+	std::vector< uint8_t > idat, palette, alpha;
+	int keyR = -1, keyG = -1, keyB = -1;
+
+	bool isEnd = false;
+
+	// chunk: length, type, data, crc32 of the type and the data
+	while( ! isEnd ) {
+		if( end - pos < 12 ) {
+			printf( "png truncated\n" );
+			return false;
+		}
+
+		uint32_t length = gx_read_be32( pos );
+		const uint8_t * type = pos + 4, * data = pos + 8;
+
+		if( length > (size_t)( end - pos ) - 12 ) {
+			printf( "png truncated chunk %.4s\n", (const char *)type );
+			return false;
+		}
+
+		if( Inflate::crc32( 0, type, length + 4 ) != gx_read_be32( data + length ) ) {
+			printf( "png crc mismatch in chunk %.4s\n", (const char *)type );
+			return false;
+		}
+
+		if( 0 == memcmp( type, "IHDR", 4 ) && length >= 13 ) {
+			w = gx_read_be32( data );
+			h = gx_read_be32( data + 4 );
+			depth = data[ 8 ];
+			colorType = data[ 9 ];
+			interlace = data[ 12 ];
+
+			// the bit depths allowed for each color type
+			bool isValid = ( 0 == colorType && ( 1 == depth || 2 == depth || 4 == depth || 8 == depth || 16 == depth ) )
+				|| ( 3 == colorType && ( 1 == depth || 2 == depth || 4 == depth || 8 == depth ) )
+				|| ( ( 2 == colorType || 4 == colorType || 6 == colorType ) && ( 8 == depth || 16 == depth ) );
+
+			if( ! isValid || 0 == w || 0 == h || (uint64_t)w * h > eMaxPixels || 0 != data[ 10 ]
+					|| 0 != data[ 11 ] || interlace > 1 ) {
+				printf( "png unsupported header, %ux%u, depth %d, color type %d\n", w, h, depth, colorType );
+				return false;
+			}
+		} else if( 0 == memcmp( type, "PLTE", 4 ) ) {
+			palette.assign( data, data + length );
+		} else if( 0 == memcmp( type, "tRNS", 4 ) ) {
+			if( 3 == colorType ) alpha.assign( data, data + length );
+			if( 0 == colorType && length >= 2 ) keyR = keyG = keyB = ( data[ 0 ] << 8 ) | data[ 1 ];
+			if( 2 == colorType && length >= 6 ) {
+				keyR = ( data[ 0 ] << 8 ) | data[ 1 ];
+				keyG = ( data[ 2 ] << 8 ) | data[ 3 ];
+				keyB = ( data[ 4 ] << 8 ) | data[ 5 ];
+			}
+		} else if( 0 == memcmp( type, "IDAT", 4 ) ) {
+			idat.insert( idat.end(), data, data + length );
+		} else if( 0 == memcmp( type, "IEND", 4 ) ) {
+			isEnd = true;
+		}
+
+		pos = data + length + 4;
+	}
+
+	if( colorType < 0 || idat.size() < 6 || ( 3 == colorType && palette.size() < 3 ) ) {
+		printf( "png missing IHDR, IDAT or PLTE\n" );
+		return false;
+	}
+
+	// zlib: the method and window byte, the flag byte, the deflate stream, the adler32
+	if( 8 != ( idat[ 0 ] & 0x0f ) || 0 != ( idat[ 0 ] * 256 + idat[ 1 ] ) % 31 || 0 != ( idat[ 1 ] & 0x20 ) ) {
+		printf( "png invalid zlib header\n" );
+		return false;
+	}
+
+	static const int channelsOfType[ 7 ] = { 1, 0, 3, 1, 2, 0, 4 };
+
+	size_t bits = channelsOfType[ colorType ] * depth, bpp = std::max( (size_t)1, bits / 8 );
+
+	// the pass origins and steps of Adam7, one full pass when not interlaced
+	static const int adam7[ 7 ][ 4 ] = {
+		{ 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 }
+	};
+	static const int single[ 1 ][ 4 ] = { { 0, 0, 1, 1 } };
+
+	const int ( * passes )[ 4 ] = interlace ? adam7 : single;
+	int passCount = interlace ? 7 : 1;
+
+	size_t rawSize = 0;
+	for( int p = 0; p < passCount; p++ ) {
+		size_t pw = ( w - passes[ p ][ 0 ] + passes[ p ][ 2 ] - 1 ) / passes[ p ][ 2 ];
+		size_t ph = ( h - passes[ p ][ 1 ] + passes[ p ][ 3 ] - 1 ) / passes[ p ][ 3 ];
+
+		if( passes[ p ][ 0 ] < (int)w && passes[ p ][ 1 ] < (int)h ) rawSize += ph * ( 1 + ( pw * bits + 7 ) / 8 );
+	}
+
+	// deflate expands at most 1032 times, a header asking for more is refused
+	if( rawSize > ( idat.size() - 2 ) * 1032 ) {
+		printf( "png %ux%u needs %zu bytes, %zu compressed bytes can not hold them\n", w, h, rawSize, idat.size() );
+		return false;
+	}
+
+	std::vector< uint8_t > raw;
+	raw.reserve( rawSize );
+
+	size_t consumed = 0;
+
+	if( ! Inflate::inflate( idat.data() + 2, idat.size() - 2, &raw, &consumed ) || raw.size() < rawSize
+			|| idat.size() < 2 + consumed + 4 || gx_adler32( raw.data(), raw.size() ) != gx_read_be32( idat.data() + 2 + consumed ) ) {
+		printf( "png inflate fail, %zu of %zu bytes\n", raw.size(), rawSize );
+		return false;
+	}
+
+	*width = w;
+	*height = h;
+	rgba->assign( (size_t)w * h * 4, 255 );
+
+	int maxValue = ( 1 << std::min( depth, 8 ) ) - 1;
+
+	uint8_t * data = raw.data();
+
+	for( int p = 0; p < passCount; p++ ) {
+		if( passes[ p ][ 0 ] >= (int)w || passes[ p ][ 1 ] >= (int)h ) continue;
+
+		size_t pw = ( w - passes[ p ][ 0 ] + passes[ p ][ 2 ] - 1 ) / passes[ p ][ 2 ];
+		size_t ph = ( h - passes[ p ][ 1 ] + passes[ p ][ 3 ] - 1 ) / passes[ p ][ 3 ];
+		size_t stride = ( pw * bits + 7 ) / 8;
+
+		if( ! gx_png_unfilter( data, ph, stride, bpp ) ) return false;
+
+		for( size_t y = 0; y < ph; y++ ) {
+			const uint8_t * row = data + y * ( 1 + stride ) + 1;
+			uint8_t * out = rgba->data() + ( ( passes[ p ][ 1 ] + y * passes[ p ][ 3 ] ) * w + passes[ p ][ 0 ] ) * 4;
+
+			for( size_t x = 0; x < pw; x++, out += passes[ p ][ 2 ] * 4 ) {
+				// the samples of the pixel, the high byte of the 16-bit ones, and the full value for the keys
+				int sample[ 4 ] = { 0 }, full[ 3 ] = { 0 };
+
+				for( int c = 0; c < channelsOfType[ colorType ]; c++ ) {
+					if( 16 == depth ) {
+						sample[ c ] = row[ ( x * channelsOfType[ colorType ] + c ) * 2 ];
+						if( c < 3 ) full[ c ] = ( sample[ c ] << 8 ) | row[ ( x * channelsOfType[ colorType ] + c ) * 2 + 1 ];
+					} else if( 8 == depth ) {
+						sample[ c ] = row[ x * channelsOfType[ colorType ] + c ];
+						if( c < 3 ) full[ c ] = sample[ c ];
+					} else {
+						size_t bit = x * depth;
+						sample[ c ] = ( row[ bit / 8 ] >> ( 8 - depth - bit % 8 ) ) & maxValue;
+						full[ c ] = sample[ c ];
+					}
+				}
+
+				switch( colorType ) {
+					case 0:
+						out[ 0 ] = out[ 1 ] = out[ 2 ] = sample[ 0 ] * 255 / maxValue;
+						if( full[ 0 ] == keyR ) out[ 3 ] = 0;
+						break;
+					case 2:
+						out[ 0 ] = sample[ 0 ];
+						out[ 1 ] = sample[ 1 ];
+						out[ 2 ] = sample[ 2 ];
+						if( full[ 0 ] == keyR && full[ 1 ] == keyG && full[ 2 ] == keyB ) out[ 3 ] = 0;
+						break;
+					case 3:
+						if( (size_t)sample[ 0 ] * 3 + 2 >= palette.size() ) {
+							printf( "png palette index %d out of range\n", sample[ 0 ] );
+							return false;
+						}
+						memcpy( out, palette.data() + sample[ 0 ] * 3, 3 );
+						if( (size_t)sample[ 0 ] < alpha.size() ) out[ 3 ] = alpha[ sample[ 0 ] ];
+						break;
+					case 4:
+						out[ 0 ] = out[ 1 ] = out[ 2 ] = sample[ 0 ];
+						out[ 3 ] = sample[ 1 ];
+						break;
+					case 6:
+						out[ 0 ] = sample[ 0 ];
+						out[ 1 ] = sample[ 1 ];
+						out[ 2 ] = sample[ 2 ];
+						out[ 3 ] = sample[ 3 ];
+						break;
+				}
+			}
+		}
+
+		data += ph * ( 1 + stride );
+	}
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+
+// the natural index of the coefficients in zigzag order, 16 more for corrupt runs
+static const uint8_t gDezigzag[ 64 + 16 ] = {
+	 0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+	63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63
+};
+
+// codes up to this length decode with one table lookup
+static const int gJpegFastBits = 9;
+
+// msb first bit reader of the entropy coded segments, the stuffed zero after 0xff
+// is skipped, and zeros are read once a marker or the end is reached
+class JpegBits {
+public:
+	JpegBits( const uint8_t * in, const uint8_t * end )
+	{
+		mIn = in;
+		mEnd = end;
+		reset();
+	}
+
+	void reset()
+	{
+		mBits = 0;
+		mCount = 0;
+		mIsMarker = false;
+	}
+
+	// up to 57 bits, a code and its extra bits need one refill
+	inline void refill()
+	{
+		while( mCount <= 56 ) {
+			uint64_t byte = 0;
+
+			if( ! mIsMarker && mIn < mEnd ) {
+				if( 0xff != *mIn ) {
+					byte = *mIn++;
+				} else if( mIn + 1 < mEnd && 0 == mIn[ 1 ] ) {
+					byte = 0xff;
+					mIn += 2;
+				} else {
+					mIsMarker = true;
+				}
+			}
+
+			mBits |= byte << ( 56 - mCount );
+			mCount += 8;
+		}
+	}
+
+	inline uint32_t peek( int n ) const
+	{
+		return mBits >> ( 64 - n );
+	}
+
+	inline void drop( int n )
+	{
+		mBits <<= n;
+		mCount -= n;
+	}
+
+	inline int get( int n )
+	{
+		if( 0 == n ) return 0;
+
+		if( mCount < n ) refill();
+
+		int value = peek( n );
+		drop( n );
+
+		return value;
+	}
+
+	// the n bits of a coefficient, with the sign of the JPEG magnitude categories
+	inline int extend( int n )
+	{
+		int value = get( n );
+
+		return 0 == n || value >= ( 1 << ( n - 1 ) ) ? value : value - ( 1 << n ) + 1;
+	}
+
+	int getCount() const
+	{
+		return mCount;
+	}
+
+	// points at the marker that ended the segment
+	const uint8_t * getPos() const
+	{
+		return mIn;
+	}
+
+	void skip( size_t count )
+	{
+		mIn += std::min( count, (size_t)( mEnd - mIn ) );
+	}
+
+private:
+	const uint8_t * mIn, * mEnd;
+
+	uint64_t mBits;
+	int mCount;
+	bool mIsMarker;
+};
+
+class JpegHuffman {
+public:
+	JpegHuffman()
+	{
+		mIsValid = false;
+	}
+
+	bool build( const uint8_t counts[ 16 ], const uint8_t * values, int valueCount )
+	{
+		mIsValid = false;
+
+		if( valueCount > 256 ) return false;
+
+		memcpy( mValues, values, valueCount );
+		std::fill( std::begin( mFast ), std::end( mFast ), -1 );
+
+		int code = 0, k = 0;
+
+		for( int len = 1; len <= 16; len++ ) {
+			mDelta[ len ] = k - code;
+
+			// over subscribed, or more codes than values, before any table is written
+			if( code + counts[ len - 1 ] > ( 1 << len ) || k + counts[ len - 1 ] > valueCount ) return false;
+
+			for( int i = 0; i < counts[ len - 1 ]; i++, k++, code++ ) {
+				if( len <= gJpegFastBits ) {
+					int first = code << ( gJpegFastBits - len );
+					for( int j = 0; j < ( 1 << ( gJpegFastBits - len ) ); j++ ) mFast[ first + j ] = k;
+				}
+
+				mSizes[ k ] = len;
+			}
+
+			mMaxCode[ len ] = code;
+			code <<= 1;
+		}
+
+		mMaxCode[ 17 ] = 0x7fffffff;
+		mIsValid = true;
+
+		return true;
+	}
+
+	bool isValid() const
+	{
+		return mIsValid;
+	}
+
+	// -1 for an invalid code
+	inline int decode( JpegBits * bits ) const
+	{
+		if( bits->getCount() < 16 ) bits->refill();
+
+		int k = mFast[ bits->peek( gJpegFastBits ) ];
+
+		if( k >= 0 ) {
+			bits->drop( mSizes[ k ] );
+			return mValues[ k ];
+		}
+
+		for( int len = gJpegFastBits + 1; len <= 16; len++ ) {
+			int code = bits->peek( len );
+
+			if( code < mMaxCode[ len ] ) {
+				bits->drop( len );
+				return mValues[ code + mDelta[ len ] ];
+			}
+		}
+
+		return -1;
+	}
+
+private:
+	bool mIsValid;
+
+	// the value index of the codes up to gJpegFastBits long, -1 for the longer ones
+	int16_t mFast[ 1 << gJpegFastBits ];
+	uint8_t mValues[ 256 ], mSizes[ 256 ];
+
+	int mMaxCode[ 18 ], mDelta[ 17 ];
+};
+
+typedef struct tagJpegComponent {
+	int mId, mH, mV, mTq, mTd, mTa;
+	int mDcPred;
+
+	// whole MCUs of samples, cropped when the colors are converted
+	std::vector< uint8_t > mPlane;
+	size_t mStride;
+} JpegComponent;
+
+/**
+ * The islow integer IDCT of libjpeg, with 12 fraction bits. The dequantized coefficients
+ * of 8-bit samples stay within 2048, and the column results within 16384, the limits
+ * only bite on a corrupt stream, where they keep the 32-bit sums from overflowing.
+ */
+static void gx_jpeg_idct( const int in[ 64 ], uint8_t * out, size_t stride )
+{
+	// FIX( x ) = x * 4096 rounded
+	enum {
+		c0541 = 2217, c0765 = 3135, c1847 = 7568, c1175 = 4816, c0298 = 1223, c2053 = 8410,
+		c3072 = 12586, c1501 = 6149, c0899 = 3686, c2562 = 10498, c1961 = 8035, c0390 = 1598
+	};
+
+	// 8 samples s0..s7 at step, into the even part x0..x3 and the odd part t0..t3
+	auto idct1d = []( const int * s, int step, int * x, int * t ) {
+		int p1 = ( s[ 2 * step ] + s[ 6 * step ] ) * c0541;
+		int t2 = p1 - s[ 6 * step ] * c1847, t3 = p1 + s[ 2 * step ] * c0765;
+		int t0 = ( s[ 0 ] + s[ 4 * step ] ) * 4096, t1 = ( s[ 0 ] - s[ 4 * step ] ) * 4096;
+
+		x[ 0 ] = t0 + t3;
+		x[ 3 ] = t0 - t3;
+		x[ 1 ] = t1 + t2;
+		x[ 2 ] = t1 - t2;
+
+		int o0 = s[ 7 * step ], o1 = s[ 5 * step ], o2 = s[ 3 * step ], o3 = s[ step ];
+		int p3 = o0 + o2, p4 = o1 + o3, p5 = ( p3 + p4 ) * c1175;
+		int q1 = p5 - ( o0 + o3 ) * c0899, q2 = p5 - ( o1 + o2 ) * c2562;
+
+		p3 *= -c1961;
+		p4 *= -c0390;
+
+		t[ 0 ] = o0 * c0298 + q1 + p3;
+		t[ 1 ] = o1 * c2053 + q2 + p4;
+		t[ 2 ] = o2 * c3072 + q2 + p3;
+		t[ 3 ] = o3 * c1501 + q1 + p4;
+	};
+
+	int tmp[ 64 ], x[ 4 ], t[ 4 ];
+
+	// columns, keeping 2 more bits
+	for( int i = 0; i < 8; i++ ) {
+		const int * s = in + i;
+
+		if( 0 == ( s[ 8 ] | s[ 16 ] | s[ 24 ] | s[ 32 ] | s[ 40 ] | s[ 48 ] | s[ 56 ] ) ) {
+			for( int j = 0; j < 8; j++ ) tmp[ j * 8 + i ] = s[ 0 ] * 4;
+			continue;
+		}
+
+		idct1d( s, 8, x, t );
+
+		for( int j = 0; j < 4; j++ ) {
+			x[ j ] += 512;
+			tmp[ j * 8 + i ] = gx_clamp( ( x[ j ] + t[ 3 - j ] ) >> 10, 16384 );
+			tmp[ ( 7 - j ) * 8 + i ] = gx_clamp( ( x[ j ] - t[ 3 - j ] ) >> 10, 16384 );
+		}
+	}
+
+	// rows, the 12 + 2 + 3 bits of scale are rounded off, and the level shift added
+	for( int i = 0; i < 8; i++, out += stride ) {
+		const int * s = tmp + i * 8;
+
+		// flat rows are common after quantization
+		if( 0 == ( s[ 1 ] | s[ 2 ] | s[ 3 ] | s[ 4 ] | s[ 5 ] | s[ 6 ] | s[ 7 ] ) ) {
+			memset( out, gx_clamp8( ( s[ 0 ] + 16 + ( 128 << 5 ) ) >> 5 ), 8 );
+			continue;
+		}
+
+		idct1d( s, 1, x, t );
+
+		for( int j = 0; j < 4; j++ ) {
+			x[ j ] += 65536 + ( 128 << 17 );
+			out[ j ] = gx_clamp8( ( x[ j ] + t[ 3 - j ] ) >> 17 );
+			out[ 7 - j ] = gx_clamp8( ( x[ j ] - t[ 3 - j ] ) >> 17 );
+		}
+	}
+}
+
+static bool gx_jpeg_block( JpegBits * bits, const JpegHuffman & dc, const JpegHuffman & ac,
+		const uint16_t quant[ 64 ], int * dcPred, uint8_t * out, size_t stride )
+{
+	int coef[ 64 ] = { 0 };
+
+	int size = dc.decode( bits );
+	if( size < 0 || size > 11 ) return false;
+
+	*dcPred = gx_clamp( *dcPred + bits->extend( size ), 2048 );
+	coef[ 0 ] = gx_clamp( (int64_t)*dcPred * quant[ 0 ], 2048 );
+
+	for( int k = 1; k < 64; ) {
+		int rs = ac.decode( bits );
+		if( rs < 0 ) return false;
+
+		int run = rs >> 4;
+		size = rs & 0x0f;
+
+		if( 0 == size ) {
+			// end of block, or a run of 16 zeros
+			if( 15 != run ) break;
+			k += 16;
+			continue;
+		}
+
+		k += run;
+		if( k > 63 ) return false;
+
+		coef[ gDezigzag[ k ] ] = gx_clamp( (int64_t)bits->extend( size ) * quant[ k ], 2048 );
+		k++;
+	}
+
+	gx_jpeg_idct( coef, out, stride );
+
+	return true;
+}
+
+bool Image :: decodeJpeg( const uint8_t * in, size_t size, int * width, int * height, std::vector< uint8_t > * rgba )
+{
+	if( ! isJpeg( in, size ) ) return false;
+
+	const uint8_t * pos = in + 2, * end = in + size;
+
+	uint16_t quant[ 4 ][ 64 ];
+	JpegHuffman huffman[ 2 ][ 4 ];
+
+	std::vector< JpegComponent > comps;
+	int w = 0, h = 0, hMax = 1, vMax = 1, mcusX = 0, mcusY = 0, restartInterval = 0;
+
+	memset( quant, 0, sizeof( quant ) );
+
+	// the scans of a sequential image run up to EOI
+	while( pos < end ) {
+		// markers may be padded with 0xff
+		while( pos < end && 0xff != *pos ) pos++;
+		while( pos < end && 0xff == *pos ) pos++;
+
+		if( pos >= end ) break;
+
+		int marker = *pos++;
+
+		if( 0xd9 == marker ) break;
+		if( ( marker >= 0xd0 && marker <= 0xd7 ) || 0x01 == marker ) continue;
+
+		if( end - pos < 2 ) break;
+
+		size_t length = ( pos[ 0 ] << 8 ) | pos[ 1 ];
+
+		if( length < 2 || length > (size_t)( end - pos ) ) {
+			printf( "jpeg truncated segment 0x%02x\n", marker );
+			return false;
+		}
+
+		const uint8_t * seg = pos + 2, * segEnd = pos + length;
+
+		pos = segEnd;
+
+		if( 0xdb == marker ) {
+			while( seg < segEnd ) {
+				int precision = seg[ 0 ] >> 4, tq = seg[ 0 ] & 3;
+
+				if( seg + 1 + 64 * ( precision + 1 ) > segEnd ) return false;
+
+				for( int k = 0; k < 64; k++ ) {
+					quant[ tq ][ k ] = precision ? ( seg[ 1 + 2 * k ] << 8 ) | seg[ 2 + 2 * k ] : seg[ 1 + k ];
+				}
+
+				seg += 1 + 64 * ( precision + 1 );
+			}
+		} else if( 0xc4 == marker ) {
+			while( seg + 17 <= segEnd ) {
+				int tc = seg[ 0 ] >> 4, th = seg[ 0 ] & 3, count = 0;
+
+				for( int i = 0; i < 16; i++ ) count += seg[ 1 + i ];
+
+				if( tc > 1 || seg + 17 + count > segEnd || ! huffman[ tc ][ th ].build( seg + 1, seg + 17, count ) ) {
+					printf( "jpeg invalid huffman table\n" );
+					return false;
+				}
+
+				seg += 17 + count;
+			}
+		} else if( 0xdd == marker && length >= 4 ) {
+			restartInterval = ( seg[ 0 ] << 8 ) | seg[ 1 ];
+		} else if( 0xc0 == marker || 0xc1 == marker ) {
+			if( length < 8 || 8 != seg[ 0 ] ) {
+				printf( "jpeg unsupported precision\n" );
+				return false;
+			}
+
+			h = ( seg[ 1 ] << 8 ) | seg[ 2 ];
+			w = ( seg[ 3 ] << 8 ) | seg[ 4 ];
+
+			int count = seg[ 5 ];
+
+			if( 0 == w || 0 == h || (size_t)w * h > eMaxPixels || ( 1 != count && 3 != count )
+					|| length < 8 + 3 * (size_t)count ) {
+				printf( "jpeg unsupported frame, %dx%d, %d components\n", w, h, count );
+				return false;
+			}
+
+			comps.resize( count );
+
+			for( int i = 0; i < count; i++ ) {
+				JpegComponent & comp = comps[ i ];
+
+				comp.mId = seg[ 6 + 3 * i ];
+				comp.mH = seg[ 7 + 3 * i ] >> 4;
+				comp.mV = seg[ 7 + 3 * i ] & 0x0f;
+				comp.mTq = seg[ 8 + 3 * i ] & 3;
+
+				if( comp.mH < 1 || comp.mH > 4 || comp.mV < 1 || comp.mV > 4 ) return false;
+
+				hMax = std::max( hMax, comp.mH );
+				vMax = std::max( vMax, comp.mV );
+			}
+
+			mcusX = ( w + 8 * hMax - 1 ) / ( 8 * hMax );
+			mcusY = ( h + 8 * vMax - 1 ) / ( 8 * vMax );
+
+			for( auto & comp : comps ) {
+				comp.mStride = mcusX * comp.mH * 8;
+				comp.mPlane.assign( comp.mStride * mcusY * comp.mV * 8, 0 );
+			}
+		} else if( marker >= 0xc2 && marker <= 0xcf && 0xc4 != marker && 0xc8 != marker && 0xcc != marker ) {
+			printf( "jpeg SOF 0x%02x, only baseline and extended sequential huffman are supported\n", marker );
+			return false;
+		} else if( 0xda == marker ) {
+			int count = seg[ 0 ];
+
+			if( comps.empty() || count < 1 || count > 4 || length < 6 + 2 * (size_t)count ) return false;
+
+			std::vector< JpegComponent * > scan;
+
+			for( int i = 0; i < count; i++ ) {
+				auto iter = std::find_if( comps.begin(), comps.end(),
+						[&]( const JpegComponent & comp ) { return comp.mId == seg[ 1 + 2 * i ]; } );
+
+				if( comps.end() == iter ) return false;
+
+				iter->mTd = seg[ 2 + 2 * i ] >> 4 & 3;
+				iter->mTa = seg[ 2 + 2 * i ] & 3;
+				iter->mDcPred = 0;
+
+				if( ! huffman[ 0 ][ iter->mTd ].isValid() || ! huffman[ 1 ][ iter->mTa ].isValid() ) {
+					printf( "jpeg scan without huffman table\n" );
+					return false;
+				}
+
+				scan.push_back( &( *iter ) );
+			}
+
+			JpegBits bits( segEnd, end );
+
+			// a single component scan covers its own blocks only, not whole MCUs
+			int unitsX = mcusX, unitsY = mcusY;
+
+			if( 1 == count ) {
+				unitsX = ( ( w * scan[ 0 ]->mH + hMax - 1 ) / hMax + 7 ) / 8;
+				unitsY = ( ( h * scan[ 0 ]->mV + vMax - 1 ) / vMax + 7 ) / 8;
+			}
+
+			int todo = restartInterval;
+
+			for( int unitY = 0; unitY < unitsY; unitY++ ) {
+				for( int unitX = 0; unitX < unitsX; unitX++ ) {
+					for( auto comp : scan ) {
+						int blocksX = 1 == count ? 1 : comp->mH, blocksY = 1 == count ? 1 : comp->mV;
+
+						for( int by = 0; by < blocksY; by++ ) {
+							for( int bx = 0; bx < blocksX; bx++ ) {
+								uint8_t * out = comp->mPlane.data() + ( unitY * blocksY + by ) * 8 * comp->mStride
+										+ ( unitX * blocksX + bx ) * 8;
+
+								if( ! gx_jpeg_block( &bits, huffman[ 0 ][ comp->mTd ], huffman[ 1 ][ comp->mTa ],
+										quant[ comp->mTq ], &comp->mDcPred, out, comp->mStride ) ) {
+									printf( "jpeg corrupt block at %d, %d\n", unitX, unitY );
+									return false;
+								}
+							}
+						}
+					}
+
+					// the bits of the interval end at a RSTn marker, the predictions start over
+					if( restartInterval > 0 && 0 == --todo ) {
+						const uint8_t * marker = bits.getPos();
+
+						if( marker + 1 < end && 0xff == marker[ 0 ] && marker[ 1 ] >= 0xd0 && marker[ 1 ] <= 0xd7 ) {
+							bits.skip( 2 );
+						}
+
+						bits.reset();
+
+						for( auto comp : scan ) comp->mDcPred = 0;
+
+						todo = restartInterval;
+					}
+				}
+			}
+
+			pos = bits.getPos();
+		}
+	}
+
+	if( comps.empty() ) {
+		printf( "jpeg no frame\n" );
+		return false;
+	}
+
+	*width = w;
+	*height = h;
+	rgba->resize( (size_t)w * h * 4 );
+
+	uint8_t * out = rgba->data();
+
+	// nearest upsampling of the subsampled components
+	std::vector< int > colsOf[ 3 ];
+	for( size_t c = 0; c < comps.size(); c++ ) {
+		colsOf[ c ].resize( w );
+		for( int x = 0; x < w; x++ ) colsOf[ c ][ x ] = x * comps[ c ].mH / hMax;
+	}
+
+	for( int y = 0; y < h; y++ ) {
+		const uint8_t * rows[ 3 ] = { NULL };
+
+		for( size_t c = 0; c < comps.size(); c++ ) {
+			rows[ c ] = comps[ c ].mPlane.data() + ( y * comps[ c ].mV / vMax ) * comps[ c ].mStride;
+		}
+
+		if( 1 == comps.size() ) {
+			for( int x = 0; x < w; x++, out += 4 ) {
+				out[ 0 ] = out[ 1 ] = out[ 2 ] = rows[ 0 ][ x ];
+				out[ 3 ] = 255;
+			}
+			continue;
+		}
+
+		// YCbCr of JFIF, with 16 fraction bits
+		for( int x = 0; x < w; x++, out += 4 ) {
+			int luma = ( rows[ 0 ][ colsOf[ 0 ][ x ] ] << 16 ) + 32768;
+			int cb = rows[ 1 ][ colsOf[ 1 ][ x ] ] - 128, cr = rows[ 2 ][ colsOf[ 2 ][ x ] ] - 128;
+
+			out[ 0 ] = gx_clamp8( ( luma + 91881 * cr ) >> 16 );
+			out[ 1 ] = gx_clamp8( ( luma - 22554 * cb - 46802 * cr ) >> 16 );
+			out[ 2 ] = gx_clamp8( ( luma + 116130 * cb ) >> 16 );
+			out[ 3 ] = 255;
+		}
+	}
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+
+// the bicubic filter of PIL, a = -0.5
+static double gx_bicubic( double x )
+{
+	const double a = -0.5;
+
+	x = std::fabs( x );
+
+	if( x < 1 ) return ( ( a + 2 ) * x - ( a + 3 ) ) * x * x + 1;
+	if( x < 2 ) return ( ( ( x - 5 ) * x + 8 ) * x - 4 ) * a;
+
+	return 0;
+}
+
+/**
+ * One axis of the PIL resampling, the filter support grows with the downscale so every
+ * input pixel counts, and the weights are fixed point with 22 fraction bits.
+ */
+static void gx_resample( const uint8_t * in, int inSize, size_t inStep, int count, size_t lineStep,
+		uint8_t * out, int outSize, size_t outStep, size_t outLineStep )
+{
+	const int precision = 22;
+
+	double scale = (double)inSize / outSize, filterScale = std::max( scale, 1.0 ), support = 2 * filterScale;
+
+	std::vector< int > begins( outSize ), sizes( outSize );
+	std::vector< int > weights;
+
+	int kernelSize = (int)std::ceil( support ) * 2 + 1;
+	weights.resize( (size_t)outSize * kernelSize );
+
+	for( int i = 0; i < outSize; i++ ) {
+		double center = ( i + 0.5 ) * scale, total = 0;
+
+		int begin = std::max( 0, (int)( center - support + 0.5 ) );
+		int size = std::min( inSize, (int)( center + support + 0.5 ) ) - begin;
+
+		std::vector< double > kernel( size > 0 ? size : 0 );
+
+		for( int j = 0; j < size; j++ ) {
+			kernel[ j ] = gx_bicubic( ( j + begin - center + 0.5 ) / filterScale );
+			total += kernel[ j ];
+		}
+
+		for( int j = 0; j < size; j++ ) {
+			double value = 0 != total ? kernel[ j ] / total : 0;
+			weights[ i * kernelSize + j ] = (int)( value * ( 1 << precision ) + ( value < 0 ? -0.5 : 0.5 ) );
+		}
+
+		begins[ i ] = begin;
+		sizes[ i ] = size;
+	}
+
+	for( int line = 0; line < count; line++ ) {
+		const uint8_t * src = in + line * lineStep;
+		uint8_t * dest = out + line * outLineStep;
+
+		for( int i = 0; i < outSize; i++ ) {
+			int sum = 1 << ( precision - 1 );
+
+			const int * weight = weights.data() + i * kernelSize;
+			for( int j = 0; j < sizes[ i ]; j++ ) sum += src[ ( begins[ i ] + j ) * inStep ] * weight[ j ];
+
+			dest[ i * outStep ] = gx_clamp8( sum >> precision );
+		}
+	}
+}
+
+void Image :: toMnist( const uint8_t * rgba, int width, int height, uint8_t * out )
+{
+	const int size = eMnistSize, limit = 20, margin = ( size - limit ) / 2;
+
+	// any channel below 220 is ink, the rest goes to gray with the ITU-R 601 weights of PIL
+	std::vector< uint8_t > gray( (size_t)width * height );
+
+	for( size_t i = 0; i < gray.size(); i++ ) {
+		const uint8_t * pixel = rgba + i * 4;
+
+		if( pixel[ 0 ] < 220 || pixel[ 1 ] < 220 || pixel[ 2 ] < 220 || pixel[ 3 ] < 220 ) {
+			gray[ i ] = 0;
+		} else {
+			gray[ i ] = ( pixel[ 0 ] * 19595 + pixel[ 1 ] * 38470 + pixel[ 2 ] * 7471 + 0x8000 ) >> 16;
+		}
+	}
+
+	// drop_margin of conv2mnist.py finds the pixels != 255 but throws the crop away,
+	// so the whole image is resized, the models are scored on exactly that
+	int cropWidth = width, cropHeight = height;
+
+	// the longer side becomes the limit, python rounds half to even
+	int newWidth = limit, newHeight = limit, left = margin, top = margin;
+
+	if( cropWidth > cropHeight ) {
+		newHeight = std::max( 1, (int)std::nearbyint( (double)limit / cropWidth * cropHeight ) );
+		top = (int)std::nearbyint( ( size - newHeight ) / 2.0 );
+	} else {
+		newWidth = std::max( 1, (int)std::nearbyint( (double)limit / cropHeight * cropWidth ) );
+		left = (int)std::nearbyint( ( size - newWidth ) / 2.0 );
+	}
+
+	// horizontal pass first, as PIL does, each pass only when the size changes
+	const uint8_t * crop = gray.data();
+
+	std::vector< uint8_t > wide( (size_t)newWidth * cropHeight ), resized( (size_t)newWidth * newHeight );
+
+	if( newWidth != cropWidth ) {
+		gx_resample( crop, cropWidth, 1, cropHeight, width, wide.data(), newWidth, 1, newWidth );
+	} else {
+		for( int y = 0; y < cropHeight; y++ ) memcpy( wide.data() + y * newWidth, crop + (size_t)y * width, newWidth );
+	}
+
+	if( newHeight != cropHeight ) {
+		gx_resample( wide.data(), cropHeight, newWidth, newWidth, 1, resized.data(), newHeight, newWidth, 1 );
+	} else {
+		resized = wide;
+	}
+
+	// ImageFilter.SHARPEN, the border pixels are kept
+	std::vector< uint8_t > sharpened( resized );
+
+	for( int y = 1; y + 1 < newHeight; y++ ) {
+		for( int x = 1; x + 1 < newWidth; x++ ) {
+			int sum = 0;
+
+			for( int dy = -1; dy <= 1; dy++ ) {
+				for( int dx = -1; dx <= 1; dx++ ) sum += resized[ ( y + dy ) * newWidth + x + dx ];
+			}
+
+			float value = ( 34 * resized[ y * newWidth + x ] - 2 * sum ) / 16.0f;
+
+			sharpened[ y * newWidth + x ] = value <= 0 ? 0 : ( value >= 255 ? 255 : (uint8_t)( value + 0.5f ) );
+		}
+	}
+
+	// white canvas, then inverted, the ink is bright like mnist
+	memset( out, 0, size * size );
+
+	for( int y = 0; y < newHeight && top + y < size; y++ ) {
+		for( int x = 0; x < newWidth && left + x < size; x++ ) {
+			out[ ( top + y ) * size + left + x ] = 255 - sharpened[ y * newWidth + x ];
+		}
+	}
+}
+
+}; // namespace gxnet;
+
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace gxnet {
+
+/**
+ * In-tree decoders of the images the UAT digits come in, baseline JPEG and PNG,
+ * into 8-bit RGBA rows of 4 bytes per pixel, and the conv2mnist.py preprocessing.
+ */
+class Image {
+public:
+	enum { eMnistSize = 28 };
+
+	// the decoders refuse larger frames before allocating, 8192x4096 is 128 MB of RGBA
+	enum { eMaxPixels = 1 << 25 };
+
+	static bool isJpeg( const uint8_t * in, size_t size );
+
+	static bool isPng( const uint8_t * in, size_t size );
+
+	static bool isImage( const uint8_t * in, size_t size );
+
+	// baseline and extended sequential huffman JPEG, gray or YCbCr
+	static bool decodeJpeg( const uint8_t * in, size_t size, int * width, int * height, std::vector< uint8_t > * rgba );
+
+	// every color type and bit depth, interlaced or not
+	static bool decodePng( const uint8_t * in, size_t size, int * width, int * height, std::vector< uint8_t > * rgba );
+
+	// by the signature
+	static bool decode( const uint8_t * in, size_t size, int * width, int * height, std::vector< uint8_t > * rgba );
+
+	static bool load( const char * path, int * width, int * height, std::vector< uint8_t > * rgba );
+
+	/**
+	 * The steps of conv2mnist.py: pixels with any channel below 220 become black, the rest
+	 * gray, bicubic resize of the whole image into 20x20 keeping the aspect, sharpen,
+	 * center in 28x28 on white and invert. out holds eMnistSize * eMnistSize bytes.
+	 */
+	static void toMnist( const uint8_t * rgba, int width, int height, uint8_t * out );
+};
+
+}; // namespace gxnet;
+
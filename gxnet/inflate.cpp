@@ -0,0 +1,476 @@
+#include "inflate.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+
+namespace gxnet {
+
+// codes up to this length decode with one table lookup, longer ones bit by bit
+static const int gFastBits = 10;
+
+static const int gMaxBits = 15;
+
+// lsb first bit reader, reads zeros past the end and remembers how many
+class BitReader {
+public:
+	BitReader( const uint8_t * in, size_t size )
+	{
+		mBegin = mIn = in;
+		mEnd = in + size;
+		mBits = 0;
+		mCount = mPad = 0;
+	}
+
+	inline void refill()
+	{
+		// whole little endian words while the input lasts
+		if( mEnd - mIn >= 8 ) {
+			uint64_t word;
+			memcpy( &word, mIn, 8 );
+
+			mBits |= word << mCount;
+			mIn += ( 63 - mCount ) >> 3;
+			mCount |= 56;
+
+			return;
+		}
+
+		while( mCount <= 56 ) {
+			uint64_t byte = 0;
+			if( mIn < mEnd ) {
+				byte = *mIn++;
+			} else {
+				mPad++;
+			}
+			mBits |= byte << mCount;
+			mCount += 8;
+		}
+	}
+
+	inline uint32_t peek( int n ) const
+	{
+		return (uint32_t)( mBits & ( ( 1ULL << n ) - 1 ) );
+	}
+
+	inline void drop( int n )
+	{
+		mBits >>= n;
+		mCount -= n;
+	}
+
+	inline uint32_t get( int n )
+	{
+		refill();
+
+		uint32_t ret = peek( n );
+		drop( n );
+
+		return ret;
+	}
+
+	// skip to the next byte boundary of the stream
+	void align()
+	{
+		drop( mCount % 8 );
+	}
+
+	// the bits taken so far came from the stream, not from the zero padding
+	bool isOverrun() const
+	{
+		return mCount < mPad * 8;
+	}
+
+	// whole bytes of the stream taken so far
+	size_t consumed() const
+	{
+		return ( mIn - mBegin ) - ( mCount / 8 - mPad );
+	}
+
+	// stored blocks, only valid after align(), the buffered bytes go first
+	bool copy( size_t len, uint8_t * out )
+	{
+		for( ; len > 0 && mCount >= 8; len--, out++ ) {
+			*out = peek( 8 );
+			drop( 8 );
+		}
+
+		if( 0 == len ) return ! isOverrun();
+
+		if( mPad > 0 || len > (size_t)( mEnd - mIn ) ) return false;
+
+		memcpy( out, mIn, len );
+		mIn += len;
+
+		// the buffer is empty, but may hold the look ahead of a word refill
+		mBits = 0;
+
+		return true;
+	}
+
+private:
+	const uint8_t * mBegin, * mIn, * mEnd;
+	uint64_t mBits;
+	int mCount, mPad;
+};
+
+class Huffman {
+public:
+	// lengths of 0 are unused symbols, an incomplete code is allowed as in zlib
+	bool build( const uint8_t * lengths, int n )
+	{
+		memset( mCount, 0, sizeof( mCount ) );
+		memset( mFast, 0, sizeof( mFast ) );
+
+		for( int i = 0; i < n; i++ ) mCount[ lengths[ i ] ]++;
+
+		mCount[ 0 ] = 0;
+
+		int left = 1;
+		for( int len = 1; len <= gMaxBits; len++ ) {
+			left = ( left << 1 ) - mCount[ len ];
+			if( left < 0 ) return false;
+		}
+
+		uint16_t offset[ gMaxBits + 2 ] = { 0 }, next[ gMaxBits + 2 ] = { 0 };
+
+		for( int len = 1; len <= gMaxBits; len++ ) {
+			offset[ len + 1 ] = offset[ len ] + mCount[ len ];
+			next[ len + 1 ] = ( next[ len ] + mCount[ len ] ) << 1;
+		}
+
+		for( int i = 0; i < n; i++ ) {
+			int len = lengths[ i ];
+			if( 0 == len ) continue;
+
+			mSymbol[ offset[ len ]++ ] = i;
+
+			uint32_t code = next[ len ]++;
+
+			if( len > gFastBits ) continue;
+
+			// the stream sends the code msb first into an lsb first reader
+			uint32_t reversed = 0;
+			for( int b = 0; b < len; b++ ) reversed |= ( ( code >> b ) & 1 ) << ( len - 1 - b );
+
+			for( uint32_t idx = reversed; idx < ( 1U << gFastBits ); idx += 1U << len ) {
+				mFast[ idx ] = ( i << 4 ) | len;
+			}
+		}
+
+		return true;
+	}
+
+	// -1 for a code that is not in the table
+	inline int decode( BitReader * reader ) const
+	{
+		reader->refill();
+
+		uint16_t entry = mFast[ reader->peek( gFastBits ) ];
+
+		if( 0 != entry ) {
+			reader->drop( entry & 15 );
+			return entry >> 4;
+		}
+
+		uint32_t bits = reader->peek( gMaxBits );
+
+		int code = 0, first = 0, index = 0;
+
+		for( int len = 1; len <= gMaxBits; len++ ) {
+			code |= ( bits >> ( len - 1 ) ) & 1;
+
+			int count = mCount[ len ];
+
+			if( code - first < count ) {
+				reader->drop( len );
+				return mSymbol[ index + code - first ];
+			}
+
+			index += count;
+			first = ( first + count ) << 1;
+			code <<= 1;
+		}
+
+		return -1;
+	}
+
+private:
+	uint16_t mFast[ 1 << gFastBits ];
+	uint16_t mCount[ gMaxBits + 1 ];
+	uint16_t mSymbol[ 288 ];
+};
+
+static const uint16_t gLengthBase[ 29 ] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+
+static const uint8_t gLengthExtra[ 29 ] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+static const uint16_t gDistBase[ 30 ] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+
+static const uint8_t gDistExtra[ 30 ] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// the output grows by doubling, pos is the decoded size
+static bool gx_inflate_codes( BitReader * reader, const Huffman & lenCode, const Huffman & distCode,
+		std::vector< uint8_t > * out, size_t * pos )
+{
+	for( ; ; ) {
+		int symbol = lenCode.decode( reader );
+
+		if( symbol < 0 || reader->isOverrun() ) return false;
+
+		if( 256 == symbol ) return true;
+
+		if( out->size() < *pos + 258 ) out->resize( std::max( out->size() * 2, *pos + 258 ) );
+
+		uint8_t * dest = out->data() + *pos;
+
+		if( symbol < 256 ) {
+			*dest = symbol;
+			( *pos )++;
+			continue;
+		}
+
+		symbol -= 257;
+		if( symbol >= 29 ) return false;
+
+		size_t len = gLengthBase[ symbol ] + reader->get( gLengthExtra[ symbol ] );
+
+		symbol = distCode.decode( reader );
+		if( symbol < 0 || symbol >= 30 ) return false;
+
+		size_t dist = gDistBase[ symbol ] + reader->get( gDistExtra[ symbol ] );
+
+		if( dist > *pos ) return false;
+
+		const uint8_t * src = dest - dist;
+
+		// overlapped copies repeat the last dist bytes, so byte by byte
+		if( dist >= len ) {
+			memcpy( dest, src, len );
+		} else {
+			for( size_t i = 0; i < len; i++ ) dest[ i ] = src[ i ];
+		}
+
+		*pos += len;
+	}
+}
+
+static bool gx_inflate_dynamic( BitReader * reader, Huffman * lenCode, Huffman * distCode )
+{
+	static const uint8_t order[ 19 ] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	int nlen = reader->get( 5 ) + 257, ndist = reader->get( 5 ) + 1, ncode = reader->get( 4 ) + 4;
+
+	if( nlen > 286 || ndist > 30 ) return false;
+
+	uint8_t lengths[ 286 + 30 ] = { 0 };
+
+	for( int i = 0; i < ncode; i++ ) lengths[ order[ i ] ] = reader->get( 3 );
+
+	if( ! lenCode->build( lengths, 19 ) ) return false;
+
+	for( int i = 0; i < nlen + ndist; ) {
+		int symbol = lenCode->decode( reader );
+
+		if( symbol < 0 ) return false;
+
+		if( symbol < 16 ) {
+			lengths[ i++ ] = symbol;
+			continue;
+		}
+
+		int len = 0, repeat = 0;
+
+		if( 16 == symbol ) {
+			if( 0 == i ) return false;
+			len = lengths[ i - 1 ];
+			repeat = 3 + reader->get( 2 );
+		} else if( 17 == symbol ) {
+			repeat = 3 + reader->get( 3 );
+		} else {
+			repeat = 11 + reader->get( 7 );
+		}
+
+		if( i + repeat > nlen + ndist ) return false;
+
+		while( repeat-- > 0 ) lengths[ i++ ] = len;
+	}
+
+	// a block must be able to end
+	if( 0 == lengths[ 256 ] ) return false;
+
+	return lenCode->build( lengths, nlen ) && distCode->build( lengths + nlen, ndist );
+}
+
+bool Inflate :: inflate( const uint8_t * in, size_t size, std::vector< uint8_t > * out, size_t * consumed )
+{
+	BitReader reader( in, size );
+
+	std::unique_ptr< Huffman[] > codes( new Huffman[ 2 ] );
+	Huffman & lenCode = codes[ 0 ], & distCode = codes[ 1 ];
+
+	size_t pos = out->size();
+
+	bool ret = true, isLast = false;
+
+	while( ret && ! isLast ) {
+		isLast = reader.get( 1 );
+
+		int type = reader.get( 2 );
+
+		if( 0 == type ) {
+			reader.align();
+
+			uint32_t len = reader.get( 16 ), nlen = reader.get( 16 );
+
+			if( ( len ^ 0xffff ) != nlen || reader.isOverrun() ) {
+				ret = false;
+				break;
+			}
+
+			if( out->size() < pos + len ) out->resize( std::max( out->size() * 2, pos + len ) );
+
+			ret = reader.copy( len, out->data() + pos );
+			pos += len;
+		} else if( 1 == type ) {
+			uint8_t lengths[ 288 + 30 ];
+
+			memset( lengths, 8, 144 );
+			memset( lengths + 144, 9, 112 );
+			memset( lengths + 256, 7, 24 );
+			memset( lengths + 280, 8, 8 );
+			memset( lengths + 288, 5, 30 );
+
+			ret = lenCode.build( lengths, 288 ) && distCode.build( lengths + 288, 30 )
+					&& gx_inflate_codes( &reader, lenCode, distCode, out, &pos );
+		} else if( 2 == type ) {
+			ret = gx_inflate_dynamic( &reader, &lenCode, &distCode )
+					&& gx_inflate_codes( &reader, lenCode, distCode, out, &pos );
+		} else {
+			ret = false;
+		}
+
+		ret = ret && ! reader.isOverrun();
+	}
+
+	out->resize( pos );
+
+	if( NULL != consumed ) *consumed = reader.consumed();
+
+	return ret;
+}
+
+bool Inflate :: isGzip( const uint8_t * in, size_t size )
+{
+	return size >= 18 && 0x1f == in[ 0 ] && 0x8b == in[ 1 ] && 8 == in[ 2 ];
+}
+
+bool Inflate :: gunzip( const uint8_t * in, size_t size, std::vector< uint8_t > * out )
+{
+	out->clear();
+
+	const uint8_t * end = in + size;
+
+	// isize of the last member, the whole output for the usual single member file,
+	// capped by the best ratio deflate can reach in case the trailer is damaged
+	if( size >= 4 ) {
+		size_t isize = end[ -4 ] | ( end[ -3 ] << 8 ) | ( end[ -2 ] << 16 ) | ( (uint32_t)end[ -1 ] << 24 );
+		out->reserve( std::min( isize, size * 1032 ) );
+	}
+
+	while( isGzip( in, end - in ) ) {
+		int flags = in[ 3 ];
+
+		const uint8_t * pos = in + 10;
+
+		// FEXTRA, FNAME, FCOMMENT, FHCRC
+		if( flags & 4 ) {
+			if( end - pos < 2 ) return false;
+			pos += 2 + ( pos[ 0 ] | ( pos[ 1 ] << 8 ) );
+		}
+		for( int flag : { 8, 16 } ) {
+			if( ! ( flags & flag ) ) continue;
+			while( pos < end && 0 != *pos ) pos++;
+			pos++;
+		}
+		if( flags & 2 ) pos += 2;
+
+		if( pos >= end ) return false;
+
+		size_t begin = out->size(), consumed = 0;
+
+		if( ! inflate( pos, end - pos, out, &consumed ) ) {
+			printf( "%s corrupt deflate stream at %zu\n", __func__, (size_t)( pos - ( end - size ) ) );
+			return false;
+		}
+
+		pos += consumed;
+
+		if( end - pos < 8 ) return false;
+
+		uint32_t crc = pos[ 0 ] | ( pos[ 1 ] << 8 ) | ( pos[ 2 ] << 16 ) | ( (uint32_t)pos[ 3 ] << 24 );
+		uint32_t isize = pos[ 4 ] | ( pos[ 5 ] << 8 ) | ( pos[ 6 ] << 16 ) | ( (uint32_t)pos[ 7 ] << 24 );
+
+		if( crc != crc32( 0, out->data() + begin, out->size() - begin ) || isize != (uint32_t)( out->size() - begin ) ) {
+			printf( "%s crc or size mismatch\n", __func__ );
+			return false;
+		}
+
+		in = pos + 8;
+	}
+
+	return true;
+}
+
+uint32_t Inflate :: crc32( uint32_t crc, const uint8_t * data, size_t size )
+{
+	// slicing by 8, mValues[ k ] advances a byte through k more zero bytes
+	static const struct Table {
+		uint32_t mValues[ 8 ][ 256 ];
+
+		Table()
+		{
+			for( uint32_t i = 0; i < 256; i++ ) {
+				uint32_t value = i;
+				for( int k = 0; k < 8; k++ ) value = value & 1 ? 0xedb88320 ^ ( value >> 1 ) : value >> 1;
+				mValues[ 0 ][ i ] = value;
+			}
+
+			for( int k = 1; k < 8; k++ ) {
+				for( int i = 0; i < 256; i++ ) {
+					uint32_t prev = mValues[ k - 1 ][ i ];
+					mValues[ k ][ i ] = mValues[ 0 ][ prev & 0xff ] ^ ( prev >> 8 );
+				}
+			}
+		}
+	} table;
+
+	const uint32_t ( * t )[ 256 ] = table.mValues;
+
+	crc = ~crc;
+
+	size_t i = 0;
+
+	for( ; i + 8 <= size; i += 8 ) {
+		uint32_t lo = crc ^ ( data[ i ] | ( data[ i + 1 ] << 8 ) | ( data[ i + 2 ] << 16 ) | ( (uint32_t)data[ i + 3 ] << 24 ) );
+
+		crc = t[ 7 ][ lo & 0xff ] ^ t[ 6 ][ ( lo >> 8 ) & 0xff ] ^ t[ 5 ][ ( lo >> 16 ) & 0xff ] ^ t[ 4 ][ lo >> 24 ]
+				^ t[ 3 ][ data[ i + 4 ] ] ^ t[ 2 ][ data[ i + 5 ] ] ^ t[ 1 ][ data[ i + 6 ] ] ^ t[ 0 ][ data[ i + 7 ] ];
+	}
+
+	for( ; i < size; i++ ) crc = t[ 0 ][ ( crc ^ data[ i ] ) & 0xff ] ^ ( crc >> 8 );
+
+	return ~crc;
+}
+
+}; // namespace gxnet;
+
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace gxnet {
+
+class Inflate {
+public:
+	/**
+	 * Decode a raw deflate stream (RFC 1951), appending to out. consumed is the byte
+	 * count of the stream, the last byte may be partly used. Returns false on a corrupt
+	 * or truncated stream.
+	 */
+	static bool inflate( const uint8_t * in, size_t size, std::vector< uint8_t > * out, size_t * consumed );
+
+	/**
+	 * Decode every member of a gzip file (RFC 1952) into out, the crc32 and the size of
+	 * each member are checked.
+	 */
+	static bool gunzip( const uint8_t * in, size_t size, std::vector< uint8_t > * out );
+
+	static bool isGzip( const uint8_t * in, size_t size );
+
+	static uint32_t crc32( uint32_t crc, const uint8_t * data, size_t size );
+};
+
+}; // namespace gxnet;
+
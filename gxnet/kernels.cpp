@@ -0,0 +1,1090 @@
+#include "kernels.h"
+
+#include <experimental/simd>
+#include <functional>
+#include <cstring>
+#include <algorithm>
+
+#if defined( __F16C__ ) || defined( __AVX2__ )
+#include <immintrin.h>
+#endif
+
+// only raw pointers and stdx::simd in here, this file is built with different -m flags
+#ifndef GX_ISA
+#define GX_ISA generic
+#endif
+
+namespace gxnet {
+
+namespace GX_ISA {
+
+namespace stdx = std::experimental::parallelism_v2;
+typedef stdx::native_simd< DataType > DataSimd;
+
+static constexpr stdx::element_aligned_tag Aligned = stdx::element_aligned;
+
+static DataType gx_inner_product( const DataType * a, const DataType * b, size_t count )
+{
+	DataType result = 0;
+
+	size_t idx = 0;
+
+	for( ; ( idx + 8 * DataSimd::size() - 1 ) < count; idx += 8 * DataSimd::size() ) {
+		const DataType * pA = a + idx;
+		const DataType * pB = b + idx;
+
+		DataSimd tA0( pA, Aligned );
+		tA0 *= DataSimd( pB, Aligned );
+
+		DataSimd tA1( pA + DataSimd::size(), Aligned );
+		tA1 *= DataSimd( pB + DataSimd::size(), Aligned );
+
+		DataSimd tA2( pA + 2 * DataSimd::size(), Aligned );
+		tA2 *= DataSimd( pB + 2 * DataSimd::size(), Aligned );
+
+		DataSimd tA3( pA + 3 * DataSimd::size(), Aligned );
+		tA3 *= DataSimd( pB + 3 * DataSimd::size(), Aligned );
+
+		DataSimd tA4( pA + 4 * DataSimd::size(), Aligned );
+		tA4 *= DataSimd( pB + 4 * DataSimd::size(), Aligned );
+
+		DataSimd tA5( pA + 5 * DataSimd::size(), Aligned );
+		tA5 *= DataSimd( pB + 5 * DataSimd::size(), Aligned );
+
+		DataSimd tA6( pA + 6 * DataSimd::size(), Aligned );
+		tA6 *= DataSimd( pB + 6 * DataSimd::size(), Aligned );
+
+		DataSimd tA7( pA + 7 * DataSimd::size(), Aligned );
+		tA7 *= DataSimd( pB + 7 * DataSimd::size(), Aligned );
+
+		tA0 += tA1 + tA2 + tA3 + tA4 + tA5 + tA6 + tA7;
+
+		result += stdx::reduce( tA0, std::plus{} );
+	}
+
+	for( ; ( idx + 2 * DataSimd::size() - 1 ) < count; idx += 2 * DataSimd::size() ) {
+		const DataType * pA = a + idx;
+		const DataType * pB = b + idx;
+
+		DataSimd tA0( pA, Aligned );
+		tA0 *= DataSimd( pB, Aligned );
+
+		DataSimd tA1( pA + DataSimd::size(), Aligned );
+		tA1 *= DataSimd( pB + DataSimd::size(), Aligned );
+
+		tA0 += tA1;
+
+		result += stdx::reduce( tA0, std::plus{} );
+	}
+
+	for( ; ( idx + DataSimd::size() - 1 ) < count; idx += DataSimd::size() ) {
+		const DataType * pA = a + idx;
+		const DataType * pB = b + idx;
+
+		DataSimd tA0( pA, Aligned );
+		tA0 *= DataSimd( pB, Aligned );
+
+		result += stdx::reduce( tA0, std::plus{} );
+	}
+
+	for( ; idx < count; idx++ ) result += a[ idx ] * b[ idx ];
+
+	return result;
+}
+
+static void gx_vs_product( const DataType * a, const DataType & b, DataType * c, size_t count )
+{
+	size_t idx = 0;
+
+	DataSimd tB( b );
+
+	for( ; ( idx + 8 * DataSimd::size() - 1 ) < count; idx += 8 * DataSimd::size() ) {
+		const DataType * pA = a + idx;
+		DataType * pC = c + idx;
+
+		DataSimd tA0 = tB * DataSimd( pA, Aligned );
+		tA0.copy_to( pC, Aligned );
+
+		DataSimd tA1 = tB * DataSimd( pA + DataSimd::size(), Aligned );
+		tA1.copy_to( pC + DataSimd::size(), Aligned );
+
+		DataSimd tA2 = tB * DataSimd( pA + 2 * DataSimd::size(), Aligned );
+		tA2.copy_to( pC + 2 * DataSimd::size(), Aligned );
+
+		DataSimd tA3 = tB * DataSimd( pA + 3 * DataSimd::size(), Aligned );
+		tA3.copy_to( pC + 3 * DataSimd::size(), Aligned );
+
+		DataSimd tA4 = tB * DataSimd( pA + 4 * DataSimd::size(), Aligned );
+		tA4.copy_to( pC + 4 * DataSimd::size(), Aligned );
+
+		DataSimd tA5 = tB * DataSimd( pA + 5 * DataSimd::size(), Aligned );
+		tA5.copy_to( pC + 5 * DataSimd::size(), Aligned );
+
+		DataSimd tA6 = tB * DataSimd( pA + 6 * DataSimd::size(), Aligned );
+		tA6.copy_to( pC + 6 * DataSimd::size(), Aligned );
+
+		DataSimd tA7 = tB * DataSimd( pA + 7 * DataSimd::size(), Aligned );
+		tA7.copy_to( pC + 7 * DataSimd::size(), Aligned );
+	}
+
+	for( ; ( idx + 2 * DataSimd::size() - 1 ) < count; idx += 2 * DataSimd::size() ) {
+		const DataType * pA = a + idx;
+		DataType * pC = c + idx;
+
+		DataSimd tA0 = tB * DataSimd( pA, Aligned );
+		tA0.copy_to( pC, Aligned );
+
+		DataSimd tA1 = tB * DataSimd( pA + DataSimd::size(), Aligned );
+		tA1.copy_to( pC + DataSimd::size(), Aligned );
+	}
+
+	for( ; ( idx + DataSimd::size() - 1 ) < count; idx += DataSimd::size() ) {
+		const DataType * pA = a + idx;
+		DataType * pC = c + idx;
+
+		DataSimd tA0 = tB * DataSimd( pA, Aligned );
+
+		tA0.copy_to( pC, Aligned );
+	}
+
+	for( ; idx < count; idx++ ) c[ idx ] = b * a[ idx ];
+}
+
+static void gx_vs_product_add( const DataType * a, const DataType & b, DataType * c, size_t count )
+{
+	size_t idx = 0;
+
+	DataSimd tB( b );
+
+	for( ; ( idx + 4 * DataSimd::size() - 1 ) < count; idx += 4 * DataSimd::size() ) {
+		const DataType * pA = a + idx;
+		DataType * pC = c + idx;
+
+		DataSimd tC0( pC, Aligned );
+		tC0 += tB * DataSimd( pA, Aligned );
+		tC0.copy_to( pC, Aligned );
+
+		DataSimd tC1( pC + DataSimd::size(), Aligned );
+		tC1 += tB * DataSimd( pA + DataSimd::size(), Aligned );
+		tC1.copy_to( pC + DataSimd::size(), Aligned );
+
+		DataSimd tC2( pC + 2 * DataSimd::size(), Aligned );
+		tC2 += tB * DataSimd( pA + 2 * DataSimd::size(), Aligned );
+		tC2.copy_to( pC + 2 * DataSimd::size(), Aligned );
+
+		DataSimd tC3( pC + 3 * DataSimd::size(), Aligned );
+		tC3 += tB * DataSimd( pA + 3 * DataSimd::size(), Aligned );
+		tC3.copy_to( pC + 3 * DataSimd::size(), Aligned );
+	}
+
+	for( ; ( idx + DataSimd::size() - 1 ) < count; idx += DataSimd::size() ) {
+		DataSimd tC0( c + idx, Aligned );
+		tC0 += tB * DataSimd( a + idx, Aligned );
+		tC0.copy_to( c + idx, Aligned );
+	}
+
+	for( ; idx < count; idx++ ) c[ idx ] += a[ idx ] * b;
+}
+
+static void gx_vv_add( const DataType * a, DataType * c, size_t count )
+{
+	size_t idx = 0;
+
+	for( ; ( idx + 4 * DataSimd::size() - 1 ) < count; idx += 4 * DataSimd::size() ) {
+		const DataType * pA = a + idx;
+		DataType * pC = c + idx;
+
+		DataSimd tC0( pC, Aligned );
+		tC0 += DataSimd( pA, Aligned );
+		tC0.copy_to( pC, Aligned );
+
+		DataSimd tC1( pC + DataSimd::size(), Aligned );
+		tC1 += DataSimd( pA + DataSimd::size(), Aligned );
+		tC1.copy_to( pC + DataSimd::size(), Aligned );
+
+		DataSimd tC2( pC + 2 * DataSimd::size(), Aligned );
+		tC2 += DataSimd( pA + 2 * DataSimd::size(), Aligned );
+		tC2.copy_to( pC + 2 * DataSimd::size(), Aligned );
+
+		DataSimd tC3( pC + 3 * DataSimd::size(), Aligned );
+		tC3 += DataSimd( pA + 3 * DataSimd::size(), Aligned );
+		tC3.copy_to( pC + 3 * DataSimd::size(), Aligned );
+	}
+
+	for( ; ( idx + DataSimd::size() - 1 ) < count; idx += DataSimd::size() ) {
+		DataSimd tC0( c + idx, Aligned );
+		tC0 += DataSimd( a + idx, Aligned );
+		tC0.copy_to( c + idx, Aligned );
+	}
+
+	for( ; idx < count; idx++ ) c[ idx ] += a[ idx ];
+}
+
+static DataType gx_sum( const DataType * a, size_t count )
+{
+	size_t idx = 0;
+
+	DataSimd t0( 0 ), t1( 0 );
+
+	for( ; ( idx + 2 * DataSimd::size() - 1 ) < count; idx += 2 * DataSimd::size() ) {
+		t0 += DataSimd( a + idx, Aligned );
+		t1 += DataSimd( a + idx + DataSimd::size(), Aligned );
+	}
+
+	for( ; ( idx + DataSimd::size() - 1 ) < count; idx += DataSimd::size() ) {
+		t0 += DataSimd( a + idx, Aligned );
+	}
+
+	DataType ret = stdx::reduce( t0 + t1, std::plus{} );
+
+	for( ; idx < count; idx++ ) ret += a[ idx ];
+
+	return ret;
+}
+
+static DataType gx_sq_diff_sum( const DataType * a, DataType mean, size_t count )
+{
+	size_t idx = 0;
+
+	DataSimd tMean( mean ), t0( 0 ), t1( 0 );
+
+	for( ; ( idx + 2 * DataSimd::size() - 1 ) < count; idx += 2 * DataSimd::size() ) {
+		DataSimd d0 = DataSimd( a + idx, Aligned ) - tMean;
+		DataSimd d1 = DataSimd( a + idx + DataSimd::size(), Aligned ) - tMean;
+		t0 += d0 * d0;
+		t1 += d1 * d1;
+	}
+
+	for( ; ( idx + DataSimd::size() - 1 ) < count; idx += DataSimd::size() ) {
+		DataSimd d0 = DataSimd( a + idx, Aligned ) - tMean;
+		t0 += d0 * d0;
+	}
+
+	DataType ret = stdx::reduce( t0 + t1, std::plus{} );
+
+	for( ; idx < count; idx++ ) ret += ( a[ idx ] - mean ) * ( a[ idx ] - mean );
+
+	return ret;
+}
+
+static void gx_vs_scale_shift( const DataType * a, DataType scale, DataType shift, DataType * c, size_t count )
+{
+	size_t idx = 0;
+
+	DataSimd tScale( scale ), tShift( shift );
+
+	for( ; ( idx + 2 * DataSimd::size() - 1 ) < count; idx += 2 * DataSimd::size() ) {
+		DataSimd t0 = DataSimd( a + idx, Aligned ) * tScale + tShift;
+		DataSimd t1 = DataSimd( a + idx + DataSimd::size(), Aligned ) * tScale + tShift;
+		t0.copy_to( c + idx, Aligned );
+		t1.copy_to( c + idx + DataSimd::size(), Aligned );
+	}
+
+	for( ; ( idx + DataSimd::size() - 1 ) < count; idx += DataSimd::size() ) {
+		DataSimd t0 = DataSimd( a + idx, Aligned ) * tScale + tShift;
+		t0.copy_to( c + idx, Aligned );
+	}
+
+	for( ; idx < count; idx++ ) c[ idx ] = a[ idx ] * scale + shift;
+}
+
+static void gx_vv_argmax( const DataType * a, DataType tag, DataType * c, DataType * idx, size_t count )
+{
+	size_t i = 0;
+
+	DataSimd tTag( tag );
+
+	for( ; ( i + DataSimd::size() - 1 ) < count; i += DataSimd::size() ) {
+		DataSimd tA( a + i, Aligned ), tC( c + i, Aligned ), tIdx( idx + i, Aligned );
+
+		auto mask = tA > tC;
+
+		stdx::where( mask, tC ) = tA;
+		stdx::where( mask, tIdx ) = tTag;
+
+		tC.copy_to( c + i, Aligned );
+		tIdx.copy_to( idx + i, Aligned );
+	}
+
+	for( ; i < count; i++ ) {
+		if( a[ i ] > c[ i ] ) {
+			c[ i ] = a[ i ];
+			idx[ i ] = tag;
+		}
+	}
+}
+
+static void gx_rows_product( const DataType * a, size_t aRows, const DataType * b, size_t bRows,
+		size_t cols, DataType * c )
+{
+	for( size_t i = 0; i < aRows; i++, a += cols, c += bRows ) {
+		size_t j = 0;
+
+		// 4 rows of b share every load of a row
+		for( ; ( j + 3 ) < bRows; j += 4 ) {
+			const DataType * pB0 = b + j * cols, * pB1 = pB0 + cols, * pB2 = pB1 + cols, * pB3 = pB2 + cols;
+
+			DataSimd t0( 0 ), t1( 0 ), t2( 0 ), t3( 0 );
+
+			size_t idx = 0;
+
+			for( ; ( idx + DataSimd::size() - 1 ) < cols; idx += DataSimd::size() ) {
+				DataSimd tA( a + idx, Aligned );
+
+				t0 += tA * DataSimd( pB0 + idx, Aligned );
+				t1 += tA * DataSimd( pB1 + idx, Aligned );
+				t2 += tA * DataSimd( pB2 + idx, Aligned );
+				t3 += tA * DataSimd( pB3 + idx, Aligned );
+			}
+
+			DataType r0 = stdx::reduce( t0, std::plus{} ), r1 = stdx::reduce( t1, std::plus{} );
+			DataType r2 = stdx::reduce( t2, std::plus{} ), r3 = stdx::reduce( t3, std::plus{} );
+
+			for( ; idx < cols; idx++ ) {
+				r0 += a[ idx ] * pB0[ idx ];
+				r1 += a[ idx ] * pB1[ idx ];
+				r2 += a[ idx ] * pB2[ idx ];
+				r3 += a[ idx ] * pB3[ idx ];
+			}
+
+			c[ j ] = r0;
+			c[ j + 1 ] = r1;
+			c[ j + 2 ] = r2;
+			c[ j + 3 ] = r3;
+		}
+
+		for( ; j < bRows; j++ ) c[ j ] = gx_inner_product( a, b + j * cols, cols );
+	}
+}
+
+// block size of the portable 16-bit weights conversion
+enum { eHalfBlock = 256 };
+
+static inline float gx_bf16_to_float( uint16_t h )
+{
+	uint32_t bits = ( (uint32_t)h ) << 16;
+
+	float ret;
+	memcpy( &ret, &bits, sizeof( ret ) );
+
+	return ret;
+}
+
+static inline float gx_fp16_to_float( uint16_t h )
+{
+	uint32_t sign = ( h & 0x8000 ) << 16, exp = ( h >> 10 ) & 0x1f, mant = h & 0x3ff;
+
+	uint32_t bits = 0;
+
+	if( 0x1f == exp ) {
+		bits = sign | 0x7f800000 | ( mant << 13 );
+	} else if( exp > 0 ) {
+		bits = sign | ( ( exp + 112 ) << 23 ) | ( mant << 13 );
+	} else if( mant > 0 ) {
+		// subnormal, normalize it
+		exp = 113;
+		while( 0 == ( mant & 0x400 ) ) {
+			mant <<= 1;
+			exp--;
+		}
+		bits = sign | ( exp << 23 ) | ( ( mant & 0x3ff ) << 13 );
+	} else {
+		bits = sign;
+	}
+
+	float ret;
+	memcpy( &ret, &bits, sizeof( ret ) );
+
+	return ret;
+}
+
+template< bool isBF16 >
+static inline float gx_half_to_float( uint16_t h )
+{
+	return isBF16 ? gx_bf16_to_float( h ) : gx_fp16_to_float( h );
+}
+
+#if defined( __AVX512F__ ) && defined( __AVX512BW__ )
+
+// the unmasked forms of the widening intrinsics trip -Wmaybe-uninitialized in gcc 12 too
+
+// up to 16 stored values widened to 16 floats, the lanes past mask are 0
+template< bool isBF16 >
+static inline __m512 gx_load16_half( const uint16_t * b, __mmask16 mask )
+{
+	__m256i half = _mm256_maskz_loadu_epi16( mask, b );
+
+	if( isBF16 ) {
+		return _mm512_castsi512_ps( _mm512_maskz_slli_epi32( 0xffff, _mm512_maskz_cvtepu16_epi32( 0xffff, half ), 16 ) );
+	}
+
+	return _mm512_maskz_cvtph_ps( 0xffff, half );
+}
+
+// the upper or lower 8 floats, _mm512_castps512_ps256 is an unmasked extract as well
+static inline __m256 gx_half8( __m512 x, int upper )
+{
+	return upper ? _mm256_castpd_ps( _mm512_maskz_extractf64x4_pd( 0xff, _mm512_castps_pd( x ), 1 ) )
+			: _mm256_castpd_ps( _mm512_maskz_extractf64x4_pd( 0xff, _mm512_castps_pd( x ), 0 ) );
+}
+
+static inline DataType gx_reduce16( __m512 acc )
+{
+	__m256 tmp = _mm256_add_ps( gx_half8( acc, 0 ), gx_half8( acc, 1 ) );
+
+	float buff[ 8 ];
+	_mm256_storeu_ps( buff, tmp );
+
+	DataType ret = 0;
+	for( size_t i = 0; i < 8; i++ ) ret += buff[ i ];
+
+	return ret;
+}
+
+static inline DataType gx_reduce16( __m512d lo, __m512d hi )
+{
+	double buff[ 8 ];
+	_mm512_storeu_pd( buff, _mm512_add_pd( lo, hi ) );
+
+	DataType ret = 0;
+	for( size_t i = 0; i < 8; i++ ) ret += buff[ i ];
+
+	return ret;
+}
+
+// 4 rows of b share every load of a, b is widened inside the FMA loop, the tail is masked
+template< bool isBF16 >
+static void gx_rows_product_half( const DataType * a, size_t aRows, const uint16_t * b, size_t bRows,
+		size_t cols, DataType * c )
+{
+	for( size_t i = 0; i < aRows; i++, a += cols, c += bRows ) {
+		for( size_t j = 0; j < bRows; j += 4 ) {
+			size_t count = std::min( bRows - j, (size_t)4 );
+
+			const uint16_t * pB[ 4 ];
+			for( size_t k = 0; k < 4; k++ ) pB[ k ] = b + ( j + std::min( k, count - 1 ) ) * cols;
+
+#ifdef GX_USE_FLOAT
+			__m512 acc[ 4 ];
+			for( size_t k = 0; k < 4; k++ ) acc[ k ] = _mm512_setzero_ps();
+#else
+			__m512d lo[ 4 ], hi[ 4 ];
+			for( size_t k = 0; k < 4; k++ ) lo[ k ] = hi[ k ] = _mm512_setzero_pd();
+#endif
+
+			for( size_t idx = 0; idx < cols; idx += 16 ) {
+				__mmask16 mask = cols - idx >= 16 ? 0xffff : ( 1u << ( cols - idx ) ) - 1;
+
+#ifdef GX_USE_FLOAT
+				__m512 tA = _mm512_maskz_loadu_ps( mask, a + idx );
+
+				for( size_t k = 0; k < 4; k++ ) {
+					acc[ k ] = _mm512_fmadd_ps( tA, gx_load16_half< isBF16 >( pB[ k ] + idx, mask ), acc[ k ] );
+				}
+#else
+				__m512d tLo = _mm512_maskz_loadu_pd( (__mmask8)mask, a + idx );
+				__m512d tHi = _mm512_maskz_loadu_pd( (__mmask8)( mask >> 8 ), a + idx + 8 );
+
+				for( size_t k = 0; k < 4; k++ ) {
+					__m512 w = gx_load16_half< isBF16 >( pB[ k ] + idx, mask );
+
+					lo[ k ] = _mm512_fmadd_pd( tLo, _mm512_maskz_cvtps_pd( 0xff, gx_half8( w, 0 ) ), lo[ k ] );
+					hi[ k ] = _mm512_fmadd_pd( tHi, _mm512_maskz_cvtps_pd( 0xff, gx_half8( w, 1 ) ), hi[ k ] );
+				}
+#endif
+			}
+
+			for( size_t k = 0; k < count; k++ ) {
+#ifdef GX_USE_FLOAT
+				c[ j + k ] = gx_reduce16( acc[ k ] );
+#else
+				c[ j + k ] = gx_reduce16( lo[ k ], hi[ k ] );
+#endif
+			}
+		}
+	}
+}
+
+#elif defined( __F16C__ ) && defined( __AVX2__ ) && defined( __FMA__ )
+
+// 8 stored values widened to 8 floats
+template< bool isBF16 >
+static inline __m256 gx_load8_half( const uint16_t * b )
+{
+	__m128i half = _mm_loadu_si128( (const __m128i *)b );
+
+	if( isBF16 ) return _mm256_castsi256_ps( _mm256_slli_epi32( _mm256_cvtepu16_epi32( half ), 16 ) );
+
+	return _mm256_cvtph_ps( half );
+}
+
+static inline DataType gx_reduce8( __m256 lo, __m256 hi )
+{
+	float tmp[ 8 ];
+	_mm256_storeu_ps( tmp, _mm256_add_ps( lo, hi ) );
+
+	DataType ret = 0;
+	for( size_t i = 0; i < 8; i++ ) ret += tmp[ i ];
+
+	return ret;
+}
+
+static inline DataType gx_reduce8( __m256d lo, __m256d hi )
+{
+	double tmp[ 4 ];
+	_mm256_storeu_pd( tmp, _mm256_add_pd( lo, hi ) );
+
+	return tmp[ 0 ] + tmp[ 1 ] + tmp[ 2 ] + tmp[ 3 ];
+}
+
+// 4 rows of b share every load of a, b is widened inside the FMA loop
+template< bool isBF16 >
+static void gx_rows_product_half( const DataType * a, size_t aRows, const uint16_t * b, size_t bRows,
+		size_t cols, DataType * c )
+{
+#ifdef GX_USE_FLOAT
+	typedef __m256 Acc_t;
+#else
+	typedef __m256d Acc_t;
+#endif
+
+	for( size_t i = 0; i < aRows; i++, a += cols, c += bRows ) {
+		for( size_t j = 0; j < bRows; j += 4 ) {
+			size_t count = std::min( bRows - j, (size_t)4 );
+
+			const uint16_t * pB[ 4 ];
+			for( size_t k = 0; k < 4; k++ ) pB[ k ] = b + ( j + std::min( k, count - 1 ) ) * cols;
+
+			Acc_t lo[ 4 ], hi[ 4 ];
+			for( size_t k = 0; k < 4; k++ ) lo[ k ] = hi[ k ] = Acc_t{};
+
+			size_t idx = 0;
+
+			for( ; ( idx + 7 ) < cols; idx += 8 ) {
+#ifdef GX_USE_FLOAT
+				__m256 tA = _mm256_loadu_ps( a + idx );
+
+				for( size_t k = 0; k < 4; k++ ) {
+					lo[ k ] = _mm256_fmadd_ps( tA, gx_load8_half< isBF16 >( pB[ k ] + idx ), lo[ k ] );
+				}
+#else
+				__m256d tLo = _mm256_loadu_pd( a + idx ), tHi = _mm256_loadu_pd( a + idx + 4 );
+
+				for( size_t k = 0; k < 4; k++ ) {
+					__m256 w = gx_load8_half< isBF16 >( pB[ k ] + idx );
+
+					lo[ k ] = _mm256_fmadd_pd( tLo, _mm256_cvtps_pd( _mm256_castps256_ps128( w ) ), lo[ k ] );
+					hi[ k ] = _mm256_fmadd_pd( tHi, _mm256_cvtps_pd( _mm256_extractf128_ps( w, 1 ) ), hi[ k ] );
+				}
+#endif
+			}
+
+			for( size_t k = 0; k < count; k++ ) {
+				DataType ret = gx_reduce8( lo[ k ], hi[ k ] );
+
+				for( size_t n = idx; n < cols; n++ ) ret += a[ n ] * gx_half_to_float< isBF16 >( pB[ k ][ n ] );
+
+				c[ j + k ] = ret;
+			}
+		}
+	}
+}
+
+#else
+
+// convert a block of b into a stack buffer, then the SIMD inner product
+template< bool isBF16 >
+static void gx_rows_product_half( const DataType * a, size_t aRows, const uint16_t * b, size_t bRows,
+		size_t cols, DataType * c )
+{
+	DataType buff[ eHalfBlock ];
+
+	for( size_t j = 0; j < bRows; j++, b += cols ) {
+		for( size_t i = 0; i < aRows; i++ ) c[ i * bRows + j ] = 0;
+
+		for( size_t begin = 0; begin < cols; begin += eHalfBlock ) {
+			size_t len = std::min( cols - begin, (size_t)eHalfBlock );
+
+			for( size_t n = 0; n < len; n++ ) buff[ n ] = gx_half_to_float< isBF16 >( b[ begin + n ] );
+
+			for( size_t i = 0; i < aRows; i++ ) {
+				c[ i * bRows + j ] += gx_inner_product( a + i * cols + begin, buff, len );
+			}
+		}
+	}
+}
+
+#endif
+
+static void gx_rows_product_bf16( const DataType * a, size_t aRows, const uint16_t * b, size_t bRows,
+		size_t cols, DataType * c )
+{
+	gx_rows_product_half< true >( a, aRows, b, bRows, cols, c );
+}
+
+static void gx_rows_product_fp16( const DataType * a, size_t aRows, const uint16_t * b, size_t bRows,
+		size_t cols, DataType * c )
+{
+	gx_rows_product_half< false >( a, aRows, b, bRows, cols, c );
+}
+
+#ifdef __AVX2__
+static inline int32_t gx_reduce_epi32( __m256i acc )
+{
+	__m128i tmp = _mm_add_epi32( _mm256_castsi256_si128( acc ), _mm256_extracti128_si256( acc, 1 ) );
+
+	tmp = _mm_add_epi32( tmp, _mm_shuffle_epi32( tmp, 0x4e ) );
+	tmp = _mm_add_epi32( tmp, _mm_shuffle_epi32( tmp, 0xb1 ) );
+
+	return _mm_cvtsi128_si32( tmp );
+}
+#endif
+
+#ifdef __AVX512F__
+// the unmasked extract and _mm512_reduce_add_epi32 trip -Wmaybe-uninitialized in gcc 12
+static inline int32_t gx_reduce_epi32( __m512i acc )
+{
+	return gx_reduce_epi32( _mm256_add_epi32( _mm512_maskz_extracti64x4_epi64( 0xff, acc, 0 ), _mm512_maskz_extracti64x4_epi64( 0xff, acc, 1 ) ) );
+}
+#endif
+
+// accumulate a * pB[ k ] for 4 rows of b, return the count of columns done
+static inline size_t gx_dot4_int8( const uint8_t * a, const int8_t * const pB[ 4 ], size_t cols, int32_t sum[ 4 ] )
+{
+	size_t idx = 0;
+
+#if defined( __AVX512VNNI__ ) && defined( __AVX512BW__ )
+	__m512i acc[ 4 ] = { _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512() };
+
+	// vpdpbusd adds 4 u8 * s8 products into each int32 lane without saturation
+	for( ; idx < cols; idx += 64 ) {
+		__mmask64 mask = ( cols - idx ) >= 64 ? ~(__mmask64)0 : ( ( (__mmask64)1 << ( cols - idx ) ) - 1 );
+
+		__m512i tA = _mm512_maskz_loadu_epi8( mask, a + idx );
+
+		for( size_t k = 0; k < 4; k++ ) {
+			acc[ k ] = _mm512_dpbusd_epi32( acc[ k ], tA, _mm512_maskz_loadu_epi8( mask, pB[ k ] + idx ) );
+		}
+	}
+
+	for( size_t k = 0; k < 4; k++ ) sum[ k ] = gx_reduce_epi32( acc[ k ] );
+#elif defined( __AVX512BW__ )
+	__m512i acc[ 4 ] = { _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512() };
+
+	// widen to int16 and use vpmaddwd, vpmaddubsw saturates on u8 * s8 pairs
+	for( ; idx < cols; idx += 32 ) {
+		__mmask32 mask = ( cols - idx ) >= 32 ? ~(__mmask32)0 : ( ( (__mmask32)1 << ( cols - idx ) ) - 1 );
+
+		__m512i tA = _mm512_cvtepu8_epi16( _mm256_maskz_loadu_epi8( mask, a + idx ) );
+
+		for( size_t k = 0; k < 4; k++ ) {
+			__m512i tB = _mm512_cvtepi8_epi16( _mm256_maskz_loadu_epi8( mask, pB[ k ] + idx ) );
+			acc[ k ] = _mm512_add_epi32( acc[ k ], _mm512_madd_epi16( tA, tB ) );
+		}
+	}
+
+	for( size_t k = 0; k < 4; k++ ) sum[ k ] = gx_reduce_epi32( acc[ k ] );
+#elif defined( __AVX2__ )
+	__m256i acc[ 4 ] = { _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256() };
+
+	// widen to int16 and use vpmaddwd, vpmaddubsw saturates on u8 * s8 pairs
+	for( ; ( idx + 15 ) < cols; idx += 16 ) {
+		__m256i tA = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i *)( a + idx ) ) );
+
+		for( size_t k = 0; k < 4; k++ ) {
+			__m256i tB = _mm256_cvtepi8_epi16( _mm_loadu_si128( (const __m128i *)( pB[ k ] + idx ) ) );
+			acc[ k ] = _mm256_add_epi32( acc[ k ], _mm256_madd_epi16( tA, tB ) );
+		}
+	}
+
+	for( size_t k = 0; k < 4; k++ ) sum[ k ] = gx_reduce_epi32( acc[ k ] );
+#else
+	for( size_t k = 0; k < 4; k++ ) sum[ k ] = 0;
+#endif
+
+	return std::min( idx, cols );
+}
+
+static void gx_rows_product_int8( const uint8_t * a, size_t aRows, const int8_t * b, size_t bRows,
+		size_t cols, int32_t * c )
+{
+	for( size_t i = 0; i < aRows; i++, a += cols, c += bRows ) {
+		for( size_t j = 0; j < bRows; j += 4 ) {
+			size_t count = std::min( bRows - j, (size_t)4 );
+
+			const int8_t * pB[ 4 ];
+			for( size_t k = 0; k < 4; k++ ) pB[ k ] = b + ( j + std::min( k, count - 1 ) ) * cols;
+
+			int32_t sum[ 4 ];
+
+			size_t idx = gx_dot4_int8( a, pB, cols, sum );
+
+			for( size_t k = 0; k < count; k++ ) {
+				for( size_t n = idx; n < cols; n++ ) sum[ k ] += (int32_t)a[ n ] * pB[ k ][ n ];
+
+				c[ j + k ] = sum[ k ];
+			}
+		}
+	}
+}
+
+// sum of v[ k ] * a[ idx[ k ] ], the a elements come in with one gather per vector,
+// the masked gathers with a zero source keep gcc 12 quiet about an undefined source
+static inline DataType gx_sparse_dot( const DataType * a, const uint32_t * idx, const DataType * v, size_t count )
+{
+	size_t k = 0;
+
+	DataType sum = 0;
+
+#if defined( __AVX512F__ ) && defined( __FMA__ )
+#ifdef GX_USE_FLOAT
+	__m512 acc = _mm512_setzero_ps(), zero = acc;
+
+	for( ; ( k + 16 ) <= count; k += 16 ) {
+		__m512i tIdx = _mm512_loadu_si512( idx + k );
+		acc = _mm512_fmadd_ps( _mm512_loadu_ps( v + k ), _mm512_mask_i32gather_ps( zero, 0xffff, tIdx, a, 4 ), acc );
+	}
+
+	float buff[ 16 ];
+	_mm512_storeu_ps( buff, acc );
+#else
+	__m512d acc = _mm512_setzero_pd(), zero = acc;
+
+	for( ; ( k + 8 ) <= count; k += 8 ) {
+		__m256i tIdx = _mm256_loadu_si256( (const __m256i *)( idx + k ) );
+		acc = _mm512_fmadd_pd( _mm512_loadu_pd( v + k ), _mm512_mask_i32gather_pd( zero, 0xff, tIdx, a, 8 ), acc );
+	}
+
+	double buff[ 8 ];
+	_mm512_storeu_pd( buff, acc );
+#endif
+	for( auto item : buff ) sum += item;
+#elif defined( __AVX2__ ) && defined( __FMA__ )
+#ifdef GX_USE_FLOAT
+	__m256 acc = _mm256_setzero_ps(), zero = acc, ones = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+
+	for( ; ( k + 8 ) <= count; k += 8 ) {
+		__m256i tIdx = _mm256_loadu_si256( (const __m256i *)( idx + k ) );
+		acc = _mm256_fmadd_ps( _mm256_loadu_ps( v + k ), _mm256_mask_i32gather_ps( zero, a, tIdx, ones, 4 ), acc );
+	}
+
+	float buff[ 8 ];
+	_mm256_storeu_ps( buff, acc );
+#else
+	__m256d acc = _mm256_setzero_pd(), zero = acc, ones = _mm256_castsi256_pd( _mm256_set1_epi64x( -1 ) );
+
+	for( ; ( k + 4 ) <= count; k += 4 ) {
+		__m128i tIdx = _mm_loadu_si128( (const __m128i *)( idx + k ) );
+		acc = _mm256_fmadd_pd( _mm256_loadu_pd( v + k ), _mm256_mask_i32gather_pd( zero, a, tIdx, ones, 8 ), acc );
+	}
+
+	double buff[ 4 ];
+	_mm256_storeu_pd( buff, acc );
+#endif
+	for( auto item : buff ) sum += item;
+#endif
+
+	for( ; k < count; k++ ) sum += v[ k ] * a[ idx[ k ] ];
+
+	return sum;
+}
+
+static void gx_rows_product_csr( const DataType * a, size_t aRows, size_t cols, const uint32_t * bRowPtr,
+		const uint32_t * bCols, const DataType * bValues, size_t bRows, DataType * c )
+{
+	for( size_t i = 0; i < aRows; i++, a += cols, c += bRows ) {
+		for( size_t j = 0; j < bRows; j++ ) {
+			size_t begin = bRowPtr[ j ];
+
+			c[ j ] = gx_sparse_dot( a, bCols + begin, bValues + begin, bRowPtr[ j + 1 ] - begin );
+		}
+	}
+}
+
+static size_t gx_csr_pack_row( const DataType * a, size_t count, uint32_t * cols, DataType * values )
+{
+	size_t idx = 0, nonzeros = 0;
+
+#if defined( __AVX512F__ ) && defined( __AVX512VL__ )
+#ifdef GX_USE_FLOAT
+	__m512i tIdx = _mm512_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 ), tStep = _mm512_set1_epi32( 16 );
+
+	for( ; ( idx + 16 ) <= count; idx += 16, tIdx = _mm512_add_epi32( tIdx, tStep ) ) {
+		__m512 tA = _mm512_loadu_ps( a + idx );
+		__mmask16 mask = _mm512_cmp_ps_mask( tA, _mm512_setzero_ps(), _CMP_NEQ_UQ );
+
+		_mm512_mask_compressstoreu_ps( values + nonzeros, mask, tA );
+		_mm512_mask_compressstoreu_epi32( cols + nonzeros, mask, tIdx );
+		nonzeros += __builtin_popcount( mask );
+	}
+#else
+	__m256i tIdx = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ), tStep = _mm256_set1_epi32( 8 );
+
+	for( ; ( idx + 8 ) <= count; idx += 8, tIdx = _mm256_add_epi32( tIdx, tStep ) ) {
+		__m512d tA = _mm512_loadu_pd( a + idx );
+		__mmask8 mask = _mm512_cmp_pd_mask( tA, _mm512_setzero_pd(), _CMP_NEQ_UQ );
+
+		_mm512_mask_compressstoreu_pd( values + nonzeros, mask, tA );
+		_mm256_mask_compressstoreu_epi32( cols + nonzeros, mask, tIdx );
+		nonzeros += __builtin_popcount( mask );
+	}
+#endif
+#endif
+
+	// branchless, the zeros of an image are too irregular to predict
+	for( ; idx < count; idx++ ) {
+		cols[ nonzeros ] = idx;
+		values[ nonzeros ] = a[ idx ];
+		nonzeros += 0 != a[ idx ];
+	}
+
+	return nonzeros;
+}
+
+// c[ j ] += sum of values[ k ] * b[ cols[ k ] * stride + j ], the accumulators stay in registers
+// across the nonzeros, a stride that is a multiple of DataSimd::size() needs no scalar tail
+static void gx_csr_row_product( const uint32_t * cols, const DataType * values, size_t count,
+		const DataType * b, size_t stride, DataType * c )
+{
+	size_t idx = 0;
+
+	for( ; ( idx + 4 * DataSimd::size() - 1 ) < stride; idx += 4 * DataSimd::size() ) {
+		DataSimd tC0( c + idx, Aligned ), tC1( c + idx + DataSimd::size(), Aligned );
+		DataSimd tC2( c + idx + 2 * DataSimd::size(), Aligned ), tC3( c + idx + 3 * DataSimd::size(), Aligned );
+
+		for( size_t k = 0; k < count; k++ ) {
+			const DataType * pB = b + cols[ k ] * stride + idx;
+			DataSimd tV( values[ k ] );
+
+			tC0 += tV * DataSimd( pB, Aligned );
+			tC1 += tV * DataSimd( pB + DataSimd::size(), Aligned );
+			tC2 += tV * DataSimd( pB + 2 * DataSimd::size(), Aligned );
+			tC3 += tV * DataSimd( pB + 3 * DataSimd::size(), Aligned );
+		}
+
+		tC0.copy_to( c + idx, Aligned );
+		tC1.copy_to( c + idx + DataSimd::size(), Aligned );
+		tC2.copy_to( c + idx + 2 * DataSimd::size(), Aligned );
+		tC3.copy_to( c + idx + 3 * DataSimd::size(), Aligned );
+	}
+
+	for( ; ( idx + DataSimd::size() - 1 ) < stride; idx += DataSimd::size() ) {
+		DataSimd tC0( c + idx, Aligned );
+
+		for( size_t k = 0; k < count; k++ ) tC0 += DataSimd( values[ k ] ) * DataSimd( b + cols[ k ] * stride + idx, Aligned );
+
+		tC0.copy_to( c + idx, Aligned );
+	}
+
+	for( ; idx < stride; idx++ ) {
+		for( size_t k = 0; k < count; k++ ) c[ idx ] += values[ k ] * b[ cols[ k ] * stride + idx ];
+	}
+}
+
+// c[ cols[ k ] * stride + j ] += values[ k ] * a[ j ], the cols are unique, a stays in registers
+static void gx_csr_outer_add( const uint32_t * cols, const DataType * values, size_t count,
+		const DataType * a, size_t stride, DataType * c )
+{
+	size_t idx = 0;
+
+	for( ; ( idx + 4 * DataSimd::size() - 1 ) < stride; idx += 4 * DataSimd::size() ) {
+		DataSimd tA0( a + idx, Aligned ), tA1( a + idx + DataSimd::size(), Aligned );
+		DataSimd tA2( a + idx + 2 * DataSimd::size(), Aligned ), tA3( a + idx + 3 * DataSimd::size(), Aligned );
+
+		for( size_t k = 0; k < count; k++ ) {
+			DataType * pC = c + cols[ k ] * stride + idx;
+			DataSimd tV( values[ k ] );
+
+			DataSimd tC0( pC, Aligned ), tC1( pC + DataSimd::size(), Aligned );
+			DataSimd tC2( pC + 2 * DataSimd::size(), Aligned ), tC3( pC + 3 * DataSimd::size(), Aligned );
+
+			tC0 += tV * tA0;
+			tC1 += tV * tA1;
+			tC2 += tV * tA2;
+			tC3 += tV * tA3;
+
+			tC0.copy_to( pC, Aligned );
+			tC1.copy_to( pC + DataSimd::size(), Aligned );
+			tC2.copy_to( pC + 2 * DataSimd::size(), Aligned );
+			tC3.copy_to( pC + 3 * DataSimd::size(), Aligned );
+		}
+	}
+
+	for( ; ( idx + DataSimd::size() - 1 ) < stride; idx += DataSimd::size() ) {
+		DataSimd tA0( a + idx, Aligned );
+
+		for( size_t k = 0; k < count; k++ ) {
+			DataType * pC = c + cols[ k ] * stride + idx;
+
+			DataSimd tC0( pC, Aligned );
+			tC0 += DataSimd( values[ k ] ) * tA0;
+			tC0.copy_to( pC, Aligned );
+		}
+	}
+
+	for( ; idx < stride; idx++ ) {
+		for( size_t k = 0; k < count; k++ ) c[ cols[ k ] * stride + idx ] += values[ k ] * a[ idx ];
+	}
+}
+
+static void gx_rows_product_binary( const uint64_t * a, size_t aRows, const uint64_t * b, size_t bRows,
+		size_t words, int32_t * c )
+{
+	for( size_t i = 0; i < aRows; i++, a += words, c += bRows ) {
+		for( size_t j = 0; j < bRows; j++ ) {
+			const uint64_t * pB = b + j * words;
+
+			size_t idx = 0;
+			int64_t sum = 0;
+
+#ifdef __AVX512VPOPCNTDQ__
+			__m512i acc = _mm512_setzero_si512();
+
+			for( ; idx < words; idx += 8 ) {
+				__mmask8 mask = words - idx >= 8 ? 0xff : ( 1u << ( words - idx ) ) - 1;
+
+				__m512i tA = _mm512_maskz_loadu_epi64( mask, a + idx ), tB = _mm512_maskz_loadu_epi64( mask, pB + idx );
+
+				acc = _mm512_add_epi64( acc, _mm512_popcnt_epi64( _mm512_xor_si512( tA, tB ) ) );
+			}
+
+			int64_t buff[ 8 ];
+			_mm512_storeu_si512( buff, acc );
+			for( auto item : buff ) sum += item;
+#endif
+
+			for( ; idx < words; idx++ ) sum += __builtin_popcountll( a[ idx ] ^ pB[ idx ] );
+
+			c[ j ] = sum;
+		}
+	}
+}
+
+// y = 0.01 * x for x < 0, 1 + 0.01 * ( x - 1 ) for x > 1, otherwise x
+static void gx_leaky_relu( const DataType * in, DataType * out, size_t count )
+{
+	size_t idx = 0;
+
+	DataSimd tZero( 0 ), tOne( 1 ), tSlope( DataType( 0.01 ) );
+
+	for( ; ( idx + DataSimd::size() - 1 ) < count; idx += DataSimd::size() ) {
+		DataSimd tX( in + idx, Aligned ), tY = tX;
+
+		stdx::where( tX < tZero, tY ) = tSlope * tX;
+		stdx::where( tX > tOne, tY ) = tOne + tSlope * ( tX - tOne );
+
+		tY.copy_to( out + idx, Aligned );
+	}
+
+	for( ; idx < count; idx++ ) {
+		DataType x = in[ idx ];
+		out[ idx ] = x < 0 ? 0.01 * x : ( x > 1 ? 1 + 0.01 * ( x - 1 ) : x );
+	}
+}
+
+static void gx_leaky_relu_derivate( const DataType * out, DataType * outDelta, size_t count )
+{
+	size_t idx = 0;
+
+	DataSimd tZero( 0 ), tOne( 1 ), tSlope( DataType( 0.01 ) );
+
+	for( ; ( idx + DataSimd::size() - 1 ) < count; idx += DataSimd::size() ) {
+		DataSimd tY( out + idx, Aligned ), tDelta( outDelta + idx, Aligned );
+
+		stdx::where( tY < tZero || tY > tOne, tDelta ) = tDelta * tSlope;
+
+		tDelta.copy_to( outDelta + idx, Aligned );
+	}
+
+	for( ; idx < count; idx++ ) {
+		outDelta[ idx ] = outDelta[ idx ] * ( out[ idx ] < 0 || out[ idx ] > 1 ? 0.01 : 1 );
+	}
+}
+
+#define GX_STRINGIFY( x ) #x
+#define GX_TO_STRING( x ) GX_STRINGIFY( x )
+
+// g++ contracts a * b + c into an fma wherever the ISA has one, even on intrinsics,
+// so the simd body and the scalar tail round like the portable kernel only without it
+#pragma GCC push_options
+#pragma GCC optimize( "fp-contract=off" )
+
+static void gx_bilinear_row( const uint8_t * image, size_t imageCols, float maxX, float maxY,
+		float srcX, float srcY, float stepX, float stepY, size_t count, uint8_t * out )
+{
+	size_t idx = 0;
+
+#ifdef __AVX2__
+	// one 32-bit gather at a byte offset brings the left and the right tap together
+	__m256 tLane = _mm256_setr_ps( 0, 1, 2, 3, 4, 5, 6, 7 ), tZero = _mm256_setzero_ps();
+	__m256 tMaxX = _mm256_set1_ps( maxX ), tMaxY = _mm256_set1_ps( maxY ), tHalf = _mm256_set1_ps( 0.5f );
+	__m256i tCols = _mm256_set1_epi32( imageCols ), tByte = _mm256_set1_epi32( 0xff );
+
+	// separate mul and add, the same roundings as the scalar tail, so every ISA gives the same bytes
+	for( ; ( idx + 7 ) < count; idx += 8 ) {
+		__m256 tI = _mm256_add_ps( tLane, _mm256_set1_ps( idx ) );
+
+		__m256 tX = _mm256_add_ps( _mm256_set1_ps( srcX ), _mm256_mul_ps( tI, _mm256_set1_ps( stepX ) ) );
+		__m256 tY = _mm256_add_ps( _mm256_set1_ps( srcY ), _mm256_mul_ps( tI, _mm256_set1_ps( stepY ) ) );
+
+		tX = _mm256_min_ps( _mm256_max_ps( tX, tZero ), tMaxX );
+		tY = _mm256_min_ps( _mm256_max_ps( tY, tZero ), tMaxY );
+
+		// the points are not negative, truncation is floor
+		__m256i tX0 = _mm256_cvttps_epi32( tX ), tY0 = _mm256_cvttps_epi32( tY );
+		__m256 tFx = _mm256_sub_ps( tX, _mm256_cvtepi32_ps( tX0 ) ), tFy = _mm256_sub_ps( tY, _mm256_cvtepi32_ps( tY0 ) );
+
+		__m256i tOffset = _mm256_add_epi32( _mm256_mullo_epi32( tY0, tCols ), tX0 );
+
+		__m256i tTop = _mm256_i32gather_epi32( (const int *)image, tOffset, 1 );
+		__m256i tBottom = _mm256_i32gather_epi32( (const int *)( image + imageCols ), tOffset, 1 );
+
+		__m256 t00 = _mm256_cvtepi32_ps( _mm256_and_si256( tTop, tByte ) );
+		__m256 t01 = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( tTop, 8 ), tByte ) );
+		__m256 t10 = _mm256_cvtepi32_ps( _mm256_and_si256( tBottom, tByte ) );
+		__m256 t11 = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( tBottom, 8 ), tByte ) );
+
+		__m256 tUp = _mm256_add_ps( t00, _mm256_mul_ps( tFx, _mm256_sub_ps( t01, t00 ) ) );
+		__m256 tDown = _mm256_add_ps( t10, _mm256_mul_ps( tFx, _mm256_sub_ps( t11, t10 ) ) );
+		__m256 tValue = _mm256_add_ps( _mm256_add_ps( tUp, _mm256_mul_ps( tFy, _mm256_sub_ps( tDown, tUp ) ) ), tHalf );
+
+		// 8 int32 to 8 bytes, the packs work within each 128-bit half
+		__m256i tPacked = _mm256_cvttps_epi32( tValue );
+		tPacked = _mm256_packus_epi32( tPacked, tPacked );
+		tPacked = _mm256_packus_epi16( tPacked, tPacked );
+
+		int32_t low = _mm256_extract_epi32( tPacked, 0 ), high = _mm256_extract_epi32( tPacked, 4 );
+		memcpy( out + idx, &low, 4 );
+		memcpy( out + idx + 4, &high, 4 );
+	}
+#endif
+
+	for( ; idx < count; idx++ ) {
+		float x = std::clamp( srcX + idx * stepX, 0.0f, maxX ), y = std::clamp( srcY + idx * stepY, 0.0f, maxY );
+
+		size_t x0 = (size_t)x, y0 = (size_t)y;
+		float fx = x - x0, fy = y - y0;
+
+		const uint8_t * tap = image + y0 * imageCols + x0;
+
+		float top = tap[ 0 ] + fx * ( tap[ 1 ] - tap[ 0 ] );
+		float bottom = tap[ imageCols ] + fx * ( tap[ imageCols + 1 ] - tap[ imageCols ] );
+
+		out[ idx ] = (uint8_t)( top + fy * ( bottom - top ) + 0.5f );
+	}
+}
+
+#pragma GCC pop_options
+
+const Kernels_t gKernels = {
+	GX_TO_STRING( GX_ISA ), DataSimd::size(),
+	gx_inner_product, gx_vs_product, gx_vs_product_add, gx_vv_add, gx_vv_argmax,
+	gx_sum, gx_sq_diff_sum, gx_vs_scale_shift, gx_rows_product,
+	gx_rows_product_bf16, gx_rows_product_fp16, gx_rows_product_int8, gx_rows_product_csr,
+	gx_csr_pack_row, gx_csr_row_product, gx_csr_outer_add, gx_rows_product_binary, gx_leaky_relu, gx_leaky_relu_derivate,
+	gx_bilinear_row
+};
+
+}; // namespace GX_ISA;
+
+}; // namespace gxnet;
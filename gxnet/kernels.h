@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace gxnet {
+
+// make float=1 builds the whole library in single precision
+#ifdef GX_USE_FLOAT
+typedef float DataType;
+#else
+typedef double DataType;
+#endif
+
+/**
+ * SIMD kernels on raw pointers. kernels.cpp is compiled once for each ISA,
+ * common.cpp selects one table by cpuid at startup and the gx_* functions
+ * call through it, so one binary keeps the full SIMD width on every host.
+ */
+typedef struct tagKernels {
+	const char * mIsa;
+	size_t mSimdSize;
+
+	DataType ( * mInnerProduct )( const DataType * a, const DataType * b, size_t count );
+
+	void ( * mVsProduct )( const DataType * a, const DataType & b, DataType * c, size_t count );
+
+	void ( * mVsProductAdd )( const DataType * a, const DataType & b, DataType * c, size_t count );
+
+	void ( * mVvAdd )( const DataType * a, DataType * c, size_t count );
+
+	void ( * mVvArgmax )( const DataType * a, DataType tag, DataType * c, DataType * idx, size_t count );
+
+	DataType ( * mSum )( const DataType * a, size_t count );
+
+	DataType ( * mSqDiffSum )( const DataType * a, DataType mean, size_t count );
+
+	void ( * mVsScaleShift )( const DataType * a, DataType scale, DataType shift, DataType * c, size_t count );
+
+	// c[ i * bRows + j ] = inner product of a row i and b row j
+	void ( * mRowsProduct )( const DataType * a, size_t aRows, const DataType * b, size_t bRows,
+			size_t cols, DataType * c );
+
+	// same as mRowsProduct with 16-bit stored b rows, accumulate in DataType
+	void ( * mRowsProductBF16 )( const DataType * a, size_t aRows, const uint16_t * b, size_t bRows,
+			size_t cols, DataType * c );
+
+	void ( * mRowsProductFP16 )( const DataType * a, size_t aRows, const uint16_t * b, size_t bRows,
+			size_t cols, DataType * c );
+
+	// c[ i * bRows + j ] = exact int32 inner product of unsigned a row i and signed b row j
+	void ( * mRowsProductInt8 )( const uint8_t * a, size_t aRows, const int8_t * b, size_t bRows,
+			size_t cols, int32_t * c );
+
+	// c[ i * bRows + j ] = inner product of a row i and sparse b row j, the nonzeros of
+	// row j are bValues[ k ] at column bCols[ k ] for k in [ bRowPtr[ j ], bRowPtr[ j + 1 ] )
+	void ( * mRowsProductCsr )( const DataType * a, size_t aRows, size_t cols, const uint32_t * bRowPtr,
+			const uint32_t * bCols, const DataType * bValues, size_t bRows, DataType * c );
+
+	// the nonzeros of a, their columns and values in order, cols and values hold count entries,
+	// returns the nonzero count
+	size_t ( * mCsrPackRow )( const DataType * a, size_t count, uint32_t * cols, DataType * values );
+
+	// c[ j ] += sum of values[ k ] * b[ cols[ k ] * stride + j ] for j in [ 0, stride ), k in [ 0, count ),
+	// one sparse row times the rows of b picked by its columns
+	void ( * mCsrRowProduct )( const uint32_t * cols, const DataType * values, size_t count,
+			const DataType * b, size_t stride, DataType * c );
+
+	// c[ cols[ k ] * stride + j ] += values[ k ] * a[ j ], the outer product of a dense and a sparse row,
+	// the cols are unique
+	void ( * mCsrOuterAdd )( const uint32_t * cols, const DataType * values, size_t count,
+			const DataType * a, size_t stride, DataType * c );
+
+	// c[ i * bRows + j ] = popcount( a row i xor b row j ), the sign mismatches of two bit rows
+	void ( * mRowsProductBinary )( const uint64_t * a, size_t aRows, const uint64_t * b, size_t bRows,
+			size_t words, int32_t * c );
+
+	void ( * mLeakyReLU )( const DataType * in, DataType * out, size_t count );
+
+	void ( * mLeakyReLUDerivate )( const DataType * out, DataType * outDelta, size_t count );
+
+	// out[ x ] = bilinear sample of the byte image at ( srcX + x * stepX, srcY + x * stepY ), the
+	// point is clamped to [ 0, maxX ] x [ 0, maxY ], image holds one more row and column past it
+	// and is readable for 3 more bytes after that
+	void ( * mBilinearRow )( const uint8_t * image, size_t imageCols, float maxX, float maxY,
+			float srcX, float srcY, float stepX, float stepY, size_t count, uint8_t * out );
+} Kernels_t;
+
+// the portable build, also the only one on non-x86 hosts
+namespace generic { extern const Kernels_t gKernels; };
+
+#ifdef GX_KERNELS_X86
+namespace sse42 { extern const Kernels_t gKernels; };
+namespace avx2 { extern const Kernels_t gKernels; };
+namespace avx512 { extern const Kernels_t gKernels; };
+namespace avx512vnni { extern const Kernels_t gKernels; };
+namespace avx512vpopcnt { extern const Kernels_t gKernels; };
+#endif
+
+const Kernels_t & gx_kernels();
+
+}; // namespace gxnet;
@@ -9,6 +9,7 @@
 
 #include <limits.h>
 #include <cstdio>
+#include <cmath>
 
 #include <iostream>
 #include <numeric>
@@ -138,6 +139,9 @@ FullConnLayer :: FullConnLayer( const Dims & baseInDims, size_t neuronCount )
 
 	mBiases.resize( neuronCount );
 	for( auto & b : mBiases ) b = gx_is_inner_debug ? gx_debug_weight : Utils::random();
+
+	mFakeQuant = PackedRows::eNone;
+	mWeightsVersion = 0;
 }
 
 FullConnLayer :: ~FullConnLayer()
@@ -176,11 +180,85 @@ void FullConnLayer :: setWeights( const MDVector & weights, const DataVector & b
 {
 	mWeights = weights;
 	mBiases = biases;
+	mWeightsVersion++;
+
+	if( PackedRows::eNone != mPacked.getType() ) setStorage( mPacked.getType(), mPacked.getInScale() );
+
+	if( PackedRows::eNone != mFakeQuant ) setFakeQuant( mFakeQuant );
+}
+
+void FullConnLayer :: setStorage( int type, DataType inScale )
+{
+	mPacked.pack( MDSpanRO( mWeights ), type, inScale );
+}
+
+int FullConnLayer :: getStorage() const
+{
+	return mPacked.getType();
+}
+
+const PackedRows & FullConnLayer :: getPacked() const
+{
+	return mPacked;
+}
+
+void FullConnLayer :: setFakeQuant( int type )
+{
+	mFakeQuant = type;
+	mWeightsVersion++;
+
+	if( PackedRows::eNone != mFakeQuant ) {
+		mFakeQuantWeights.second = mWeights.second;
+		mFakeQuantWeights.first.resize( mWeights.first.size() );
+		PackedRows::fakeQuantRows( MDSpanRO( mWeights ), mFakeQuant, std::begin( mFakeQuantWeights.first ) );
+	} else {
+		mFakeQuantWeights = MDVector();
+	}
+}
+
+int FullConnLayer :: getFakeQuant() const
+{
+	return mFakeQuant;
+}
+
+void FullConnLayer :: prune( DataType sparsity )
+{
+	size_t total = mWeights.first.size();
+	size_t count = std::min( total, (size_t)std::round( std::max( sparsity, DataType( 0 ) ) * total ) );
+
+	std::vector< size_t > order( total );
+	std::iota( order.begin(), order.end(), 0 );
+
+	// the weights pruned before are 0, so they stay among the smallest
+	std::nth_element( order.begin(), order.begin() + count, order.end(), [ this ]( size_t a, size_t b ) {
+		return std::abs( mWeights.first[ a ] ) < std::abs( mWeights.first[ b ] );
+	} );
+
+	mPruneMask.resize( total );
+	mPruneMask = 1;
+	for( size_t i = 0; i < count; i++ ) mPruneMask[ order[ i ] ] = 0;
+
+	mWeights.first *= mPruneMask;
+	mWeightsVersion++;
+
+	if( PackedRows::eNone != mPacked.getType() ) setStorage( mPacked.getType(), mPacked.getInScale() );
+
+	if( PackedRows::eNone != mFakeQuant ) setFakeQuant( mFakeQuant );
+}
+
+DataType FullConnLayer :: getSparsity() const
+{
+	return mPruneMask.size() > 0 ? 1 - mPruneMask.sum() / mPruneMask.size() : 0;
 }
 
+// below this zero ratio of the batch the dense kernels win over the column updates
+static const DataType gSparseInputRatio = 0.5;
+
 void FullConnLayer :: calcOutput( BaseLayerContext * ctx ) const
 {
-	MDSpanRO weightsRO( mWeights );
+	FullConnLayerContext * ctxImpl = dynamic_cast< FullConnLayerContext * >( ctx );
+
+	MDSpanRO weightsRO( PackedRows::eNone != mFakeQuant ? mFakeQuantWeights : mWeights );
 
 	const MDVector & inMD = ctx->getInput();
 	MDVector & outMD = ctx->getOutput();
@@ -195,8 +273,72 @@ void FullConnLayer :: calcOutput( BaseLayerContext * ctx ) const
 	Dims inDims = { sampleCount, inSize };
 	MDSpanRO inRO( std::begin( inMD.first ), inDims );
 
+	SparseInput & sparse = ctxImpl->getSparseInput();
+
+	bool isPacked = !mIsTraining && PackedRows::eNone != mPacked.getType();
+
+	// the layer on the data input packs the nonzeros of the batch once, collectGradients reuses them
+	sparse.mIsSparse = false;
+
+	if( sparse.mIsEnabled && !gx_is_inner_debug && !isPacked ) {
+		sparse.mRowPtr.resize( sampleCount + 1 );
+		sparse.mColIdx.resize( std::max( sparse.mColIdx.size(), total ) );
+		if( sparse.mValues.size() < total ) sparse.mValues.resize( total );
+
+		size_t maxNonzeros = total * ( 1 - gSparseInputRatio );
+
+		sparse.mRowPtr[ 0 ] = 0;
+		sparse.mIsSparse = true;
+
+		// a dense batch stops packing as soon as it is over the limit
+		for( size_t n = 0; n < sampleCount && sparse.mIsSparse; n++ ) {
+			size_t begin = sparse.mRowPtr[ n ];
+
+			sparse.mRowPtr[ n + 1 ] = begin + gx_kernels().mCsrPackRow( inRO.data() + n * inSize, inSize,
+					sparse.mColIdx.data() + begin, std::begin( sparse.mValues ) + begin );
+
+			sparse.mIsSparse = sparse.mRowPtr[ n + 1 ] <= maxNonzeros;
+		}
+	}
+
+	bool isSparse = sparse.mIsSparse;
+
 	if( gx_is_inner_debug ) {
 		gx_rows_product( inRO, weightsRO, std::begin( outMD.first ), outMD.first.size() );
+	} else if( isPacked ) {
+		mPacked.rowsProduct( inRO, mBiases, false, std::begin( outMD.first ), &ctxImpl->getPackedScratch() );
+	} else if( isSparse ) {
+		size_t outCount = weightsRO.dim( 0 ), simdSize = gx_kernels().mSimdSize;
+
+		sparse.mStride = ( outCount + simdSize - 1 ) / simdSize * simdSize;
+
+		// a nonzero input adds one contiguous row of the transposed weights to the output
+		if( sparse.mWeightsVersion != mWeightsVersion || sparse.mWeightsT.size() != sparse.mStride * inSize ) {
+			sparse.mWeightsT.resize( sparse.mStride * inSize );
+			sparse.mWeightsT = 0;
+
+			for( size_t i = 0; i < outCount; i++ ) {
+				for( size_t j = 0; j < inSize; j++ ) sparse.mWeightsT[ j * sparse.mStride + i ] = weightsRO( i, j );
+			}
+
+			sparse.mWeightsVersion = mWeightsVersion;
+		}
+
+		const uint32_t * rowPtr = sparse.mRowPtr.data(), * colIdx = sparse.mColIdx.data();
+		const DataType * values = std::begin( sparse.mValues );
+
+		sparse.mRow.resize( sparse.mStride );
+
+		DataType * out = std::begin( outMD.first ), * row = std::begin( sparse.mRow );
+
+		for( size_t n = 0; n < sampleCount; n++, out += outCount ) {
+			std::copy( std::begin( mBiases ), std::end( mBiases ), row );
+
+			gx_kernels().mCsrRowProduct( colIdx + rowPtr[ n ], values + rowPtr[ n ], rowPtr[ n + 1 ] - rowPtr[ n ],
+					std::begin( sparse.mWeightsT ), sparse.mStride, row );
+
+			std::copy( row, row + outCount, out );
+		}
 	} else {
 		gx_rows_product( inRO, weightsRO, mBiases, false, std::begin( outMD.first ), outMD.first.size() );
 	}
@@ -211,7 +353,7 @@ void FullConnLayer :: backpropagate( BaseLayerContext * ctx, MDVector * inDelta
 {
 	if( NULL == inDelta ) return;
 
-	MDSpanRO weightsRO( mWeights );
+	MDSpanRO weightsRO( PackedRows::eNone != mFakeQuant ? mFakeQuantWeights : mWeights );
 
 	MDSpanRO deltaRO( ctx->getDelta() );
 
@@ -248,6 +390,16 @@ void FullConnLayer :: collectGradients( BaseLayerContext * ctx ) const
 	const DataType * input = std::begin( inMD.first );
 	const DataType * delta = std::begin( deltaMD.first );
 
+	SparseInput & sparse = ctxImpl->getSparseInput();
+
+	// a single sample is cheaper dense, writing back its columns costs as much as the dense update
+	if( sparse.mIsSparse && sampleCount > 1 ) {
+		collectSparseGradients( &sparse, delta, sampleCount, &gradients );
+		return;
+	}
+
+	sparse.mIsDenseGradients = true;
+
 	for( size_t n = 0; n < sampleCount; n++, input += inSize, delta += weightsRO.dim( 0 ) ) {
 
 #if 0
@@ -277,43 +429,139 @@ void FullConnLayer :: collectGradients( BaseLayerContext * ctx ) const
 	}
 }
 
+/**
+ * The delta rows are added into the rows of mGradientsT of the nonzero input columns, each
+ * element gets the same products in the same order as on the dense path. Only these columns,
+ * and the columns of the batch before, are written back, the others stay 0.
+ */
+void FullConnLayer :: collectSparseGradients( SparseInput * sparse, const DataType * delta, size_t sampleCount,
+		MDVector * gradients ) const
+{
+	size_t outCount = mWeights.second[ 0 ], inSize = mWeights.second[ 1 ], stride = sparse->mStride;
+
+	const uint32_t * rowPtr = sparse->mRowPtr.data(), * colIdx = sparse->mColIdx.data();
+	const DataType * values = std::begin( sparse->mValues );
+
+	sparse->mGradientsT.resize( stride * inSize );
+	sparse->mMarks.resize( inSize, 0 );
+
+	if( 0 == ++sparse->mStamp ) {
+		std::fill( sparse->mMarks.begin(), sparse->mMarks.end(), 0 );
+		sparse->mStamp = 1;
+	}
+
+	std::swap( sparse->mCols, sparse->mPrevCols );
+	sparse->mCols.clear();
+
+	DataType * gradientsT = std::begin( sparse->mGradientsT );
+
+	// the columns of the batch start from 0
+	for( size_t k = 0; k < rowPtr[ sampleCount ]; k++ ) {
+		uint32_t col = colIdx[ k ];
+
+		if( sparse->mMarks[ col ] == sparse->mStamp ) continue;
+
+		sparse->mMarks[ col ] = sparse->mStamp;
+		sparse->mCols.push_back( col );
+
+		std::fill( gradientsT + col * stride, gradientsT + ( col + 1 ) * stride, DataType( 0 ) );
+	}
+
+	sparse->mRow.resize( stride );
+	sparse->mRow = 0;
+
+	DataType * row = std::begin( sparse->mRow );
+
+	for( size_t n = 0; n < sampleCount; n++, delta += outCount ) {
+		std::copy( delta, delta + outCount, row );
+
+		gx_kernels().mCsrOuterAdd( colIdx + rowPtr[ n ], values + rowPtr[ n ], rowPtr[ n + 1 ] - rowPtr[ n ],
+				row, stride, gradientsT );
+	}
+
+	DataType * out = std::begin( gradients->first );
+
+	// the columns of the batch before, or all of them after the dense path, that this batch left at 0
+	if( sparse->mIsDenseGradients ) {
+		gradients->first = 0;
+		sparse->mIsDenseGradients = false;
+	} else {
+		for( auto col : sparse->mPrevCols ) {
+			if( sparse->mMarks[ col ] == sparse->mStamp ) continue;
+
+			for( size_t i = 0; i < outCount; i++ ) out[ i * inSize + col ] = 0;
+		}
+	}
+
+	for( size_t i = 0; i < outCount; i++ ) {
+		DataType * outRow = out + i * inSize;
+
+		for( auto col : sparse->mCols ) outRow[ col ] = gradientsT[ col * stride + i ];
+	}
+}
+
 void FullConnLayer :: applyGradients( const BackwardContext & ctx, Optim * optim,
 			size_t trainingCount, size_t miniBatchCount )
 {
 	optim->update( &( mWeights.first ), ctx.getGradients().first, trainingCount, miniBatchCount );
 
+	if( mPruneMask.size() > 0 ) mWeights.first *= mPruneMask;
+
+	mWeightsVersion++;
+
 	if( !gx_is_inner_debug ) optim->updateBiases( &mBiases, ctx.getDelta().first, miniBatchCount );
+
+	if( PackedRows::eNone != mPacked.getType() ) setStorage( mPacked.getType(), mPacked.getInScale() );
+
+	if( PackedRows::eNone != mFakeQuant ) setFakeQuant( mFakeQuant );
 }
 
 ////////////////////////////////////////////////////////////
 
-ConvLayer :: ConvLayer( const Dims & baseInDims, size_t filterCount, size_t filterSize )
+ConvLayer :: ConvLayer( const Dims & baseInDims, size_t filterCount, size_t filterSize,
+		size_t stride, size_t padding )
+	: ConvLayer( baseInDims, { filterCount, baseInDims[ 0 ], filterSize, filterSize }, stride, padding )
+{
+}
+
+ConvLayer :: ConvLayer( const Dims & baseInDims, const Dims & filterDims, size_t stride, size_t padding )
 	: BaseLayer( BaseLayer::eConv )
 {
+	assert( stride > 0 && padding < filterDims[ 2 ] );
+
+	mStride = stride;
+	mPadding = padding;
+
 	mBaseInDims = baseInDims;
 	mBaseOutDims = {
-		filterCount,
-		mBaseInDims[ 1 ] - filterSize + 1,
-		mBaseInDims[ 2 ] - filterSize + 1
+		filterDims[ 0 ],
+		gx_conv_out_size( mBaseInDims[ 1 ], filterDims[ 2 ], mStride, mPadding ),
+		gx_conv_out_size( mBaseInDims[ 2 ], filterDims[ 3 ], mStride, mPadding )
 	};
 
-	mFilters.second = { filterCount, mBaseInDims[ 0 ], filterSize, filterSize };
+	mFilters.second = filterDims;
 
 	mFilters.first.resize( gx_dims_flatten_size( mFilters.second) );
 	for( auto & item : mFilters.first ) item = gx_is_inner_debug ? gx_debug_weight : Utils::random();
 
-	mBiases.resize( filterCount );
+	mBiases.resize( filterDims[ 0 ] );
 	for( auto & item : mBiases ) item = gx_is_inner_debug ? gx_debug_weight : Utils::random();
 }
 
-ConvLayer :: ConvLayer( const Dims & baseInDims, const MDVector & filters, const DataVector & biases )
+ConvLayer :: ConvLayer( const Dims & baseInDims, const MDVector & filters, const DataVector & biases,
+		size_t stride, size_t padding )
 	: BaseLayer( BaseLayer::eConv )
 {
+	assert( stride > 0 && padding < filters.second[ 2 ] );
+
+	mStride = stride;
+	mPadding = padding;
+
 	mBaseInDims = baseInDims;
 	mBaseOutDims = {
 		filters.second[ 0 ],
-		mBaseInDims[ 1 ] - filters.second[ 2 ] + 1,
-		mBaseInDims[ 2 ] - filters.second[ 3 ] + 1
+		gx_conv_out_size( mBaseInDims[ 1 ], filters.second[ 2 ], mStride, mPadding ),
+		gx_conv_out_size( mBaseInDims[ 2 ], filters.second[ 3 ], mStride, mPadding )
 	};
 
 	mFilters = filters;
@@ -334,7 +582,8 @@ BaseLayerContext * ConvLayer :: newCtx() const
 
 void ConvLayer :: printWeights( bool isDetail ) const
 {
-	printf( "\nfilterDims = %s\n", gx_vector2string( mFilters.second ).c_str() );
+	printf( "\nfilterDims = %s; stride = %zu; padding = %zu\n",
+			gx_vector2string( mFilters.second ).c_str(), mStride, mPadding );
 
 	if( !isDetail ) return;
 
@@ -352,6 +601,24 @@ const DataVector & ConvLayer :: getBiases() const
 	return mBiases;
 }
 
+void ConvLayer :: setFilters( const MDVector & filters, const DataVector & biases )
+{
+	assert( filters.second == mFilters.second && biases.size() == mBiases.size() );
+
+	mFilters = filters;
+	mBiases = biases;
+}
+
+size_t ConvLayer :: getStride() const
+{
+	return mStride;
+}
+
+size_t ConvLayer :: getPadding() const
+{
+	return mPadding;
+}
+
 void ConvLayer :: calcOutput( BaseLayerContext * ctx ) const
 {
 	const Dims & inDims = ctx->getInput().second;
@@ -361,8 +628,8 @@ void ConvLayer :: calcOutput( BaseLayerContext * ctx ) const
 	Dims & outDims = ctx->getOutput().second;
 	outDims = {
 		inDims[ 0 ], mFilters.second[ 0 ],
-		inDims[ 2 ] - mFilters.second[ 2 ] + 1,
-		inDims[ 3 ] - mFilters.second[ 3 ] + 1
+		gx_conv_out_size( inDims[ 2 ], mFilters.second[ 2 ], mStride, mPadding ),
+		gx_conv_out_size( inDims[ 3 ], mFilters.second[ 3 ], mStride, mPadding )
 	};
 	ctx->getOutput().first.resize( gx_dims_flatten_size( outDims ) );
 
@@ -376,7 +643,9 @@ void ConvLayer :: calcOutput( BaseLayerContext * ctx ) const
 		for( size_t f = 0; f < filterRO.dim( 0 ); f++ ) {
 			for( size_t x = 0; x < outDims[ 2 ]; x++ ) {
 				for( size_t y = 0; y < outDims[ 3 ]; y++ ) {
-					outRW( n, f, x, y ) = forwardConv( inRO, n, f, x, y, filterRO ) + mBiases[ f ];
+					outRW( n, f, x, y ) = forwardConv( inRO, n, f,
+							(ssize_t)( x * mStride ) - (ssize_t)mPadding,
+							(ssize_t)( y * mStride ) - (ssize_t)mPadding, filterRO ) + mBiases[ f ];
 				}
 			}
 		}
@@ -384,13 +653,18 @@ void ConvLayer :: calcOutput( BaseLayerContext * ctx ) const
 }
 
 DataType ConvLayer :: forwardConv( const MDSpanRO & inRO, size_t sampleIndex, size_t filterIndex,
-		size_t beginX, size_t beginY, const MDSpanRO & filterRO )
+		ssize_t beginX, ssize_t beginY, const MDSpanRO & filterRO )
 {
 	DataType total = 0;
 
+	// clip the filter window to the input, the padding contributes zeros
+	size_t minX = beginX < 0 ? -beginX : 0, minY = beginY < 0 ? -beginY : 0;
+	size_t maxX = std::min( (ssize_t)filterRO.dim( 2 ), (ssize_t)inRO.dim( 2 ) - beginX );
+	size_t maxY = std::min( (ssize_t)filterRO.dim( 3 ), (ssize_t)inRO.dim( 3 ) - beginY );
+
 	for( size_t c = 0; c < filterRO.dim( 1 ); c++ ) {
-		for( size_t x = 0; x < filterRO.dim( 2 ); x++ ) {
-			for( size_t y = 0; y < filterRO.dim( 3 ); y++ ) {
+		for( size_t x = minX; x < maxX; x++ ) {
+			for( size_t y = minY; y < maxY; y++ ) {
 				total += inRO( sampleIndex, c, beginX + x, beginY + y ) * filterRO( filterIndex, c, x, y );
 			}
 		}
@@ -399,6 +673,21 @@ DataType ConvLayer :: forwardConv( const MDSpanRO & inRO, size_t sampleIndex, si
 	return total;
 }
 
+void ConvLayer :: preparePaddingDelta( const Dims & inDims, const Dims & outDims, MDVector * paddingDelta ) const
+{
+	if( paddingDelta->second.size() <= 0 ) {
+		paddingDelta->second = {
+				outDims[ 0 ],
+				outDims[ 1 ],
+				inDims[ 2 ] + mFilters.second[ 2 ] - 1,
+				inDims[ 3 ] + mFilters.second[ 3 ] - 1
+		};
+	}
+	paddingDelta->second[ 0 ] = outDims[ 0 ];
+
+	paddingDelta->first.resize( gx_dims_flatten_size( paddingDelta->second ) );
+}
+
 void ConvLayer :: backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const
 {
 	ConvLayerContext * ctxImpl = dynamic_cast< ConvLayerContext * >( ctx );
@@ -407,22 +696,12 @@ void ConvLayer :: backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) co
 
 	// 1. prepare outDelta padding data
 	MDVector & paddingDelta = ctxImpl->getPaddingDelta();
-	if( paddingDelta.second.size() <= 0 ) {
-		paddingDelta.second = {
-				outDims[ 0 ],
-				outDims[ 1 ],
-				outDims[ 2 ] + 2 * ( mFilters.second[ 2 ] - 1 ),
-				outDims[ 3 ] + 2 * ( mFilters.second[ 3 ] - 1 )
-		};
-	}
-	paddingDelta.second[ 0 ] = outDims[ 0 ];
-
-	paddingDelta.first.resize( gx_dims_flatten_size( paddingDelta.second ) );
+	preparePaddingDelta( ctx->getInput().second, outDims, &paddingDelta );
 
 	MDSpanRW paddingDeltaRW( paddingDelta );
 
 	MDSpanRO deltaRO( ctx->getDelta() );
-	copyOutDelta( deltaRO, mFilters.second[ 2 ], &paddingDeltaRW );
+	copyOutDelta( deltaRO, mFilters.second[ 2 ], mStride, mPadding, &paddingDeltaRW );
 
 	if( gx_is_inner_debug ) Utils::printMDVector( "paddingDelta", paddingDelta );
 
@@ -464,13 +743,16 @@ DataType ConvLayer :: backwardConv( const MDSpanRO & inRO, size_t sampleIndex, s
 	return total;
 }
 
-void ConvLayer :: copyOutDelta( const MDSpanRO & outDeltaRO, size_t filterSize, MDSpanRW * outPaddingRW )
+void ConvLayer :: copyOutDelta( const MDSpanRO & outDeltaRO, size_t filterSize,
+		size_t stride, size_t padding, MDSpanRW * outPaddingRW )
 {
+	size_t offset = filterSize - 1 - padding;
+
 	for( size_t n = 0; n < outDeltaRO.dim( 0 ); n++ ) {
 		for( size_t f = 0; f < outDeltaRO.dim( 1 ); f++ ) {
 			for( size_t x = 0; x < outDeltaRO.dim( 2 ); x++ ) {
 				for( size_t y = 0; y < outDeltaRO.dim( 3 ); y++ ) {
-					( *outPaddingRW )( n, f, x + filterSize - 1, y + filterSize - 1 ) = outDeltaRO( n, f, x, y );
+					( *outPaddingRW )( n, f, x * stride + offset, y * stride + offset ) = outDeltaRO( n, f, x, y );
 				}
 			}
 		}
@@ -499,7 +781,8 @@ void ConvLayer :: collectGradients( BaseLayerContext * ctx ) const
 			for( size_t c = 0; c < mFilters.second[ 1 ]; c++ ) {
 				for( size_t x = 0; x < mFilters.second[ 2 ]; x++ ) {
 					for( size_t y = 0; y < mFilters.second[ 3 ]; y++ ) {
-						gradientRW( f, c, x, y ) += gradientConv( inRO, n, f, c, x, y, deltaRO );
+						gradientRW( f, c, x, y ) += gradientConv( inRO, n, f, c, x, y,
+								mStride, mPadding, deltaRO );
 					}
 				}
 			}
@@ -508,13 +791,20 @@ void ConvLayer :: collectGradients( BaseLayerContext * ctx ) const
 }
 
 DataType ConvLayer :: gradientConv( const MDSpanRO & inRO, size_t sampleIndex, size_t filterIndex,
-		size_t channelIndex, size_t beginX, size_t beginY, const MDSpanRO & filterRO )
+		size_t channelIndex, size_t beginX, size_t beginY, size_t stride, size_t padding,
+		const MDSpanRO & filterRO )
 {
 	DataType total = 0;
 
 	for( size_t x = 0; x < filterRO.dim( 2 ); x++ ) {
+		size_t inX = x * stride + beginX - padding;
+		if( x * stride + beginX < padding || inX >= inRO.dim( 2 ) ) continue;
+
 		for( size_t y = 0; y < filterRO.dim( 3 ); y++ ) {
-			total += inRO( sampleIndex, channelIndex, beginX + x, beginY + y ) * filterRO( sampleIndex, filterIndex, x, y );
+			size_t inY = y * stride + beginY - padding;
+			if( y * stride + beginY < padding || inY >= inRO.dim( 3 ) ) continue;
+
+			total += inRO( sampleIndex, channelIndex, inX, inY ) * filterRO( sampleIndex, filterIndex, x, y );
 		}
 	}
 
@@ -549,26 +839,95 @@ void ConvLayer :: applyGradients( const BackwardContext & ctx, Optim * optim,
 
 ////////////////////////////////////////////////////////////
 
-ConvExLayer :: ConvExLayer( const Dims & baseInDims, size_t filterCount, size_t filterSize )
-	: ConvLayer( baseInDims, filterCount, filterSize )
+ConvExLayer :: ConvExLayer( const Dims & baseInDims, size_t filterCount, size_t filterSize,
+		size_t stride, size_t padding )
+	: ConvLayer( baseInDims, filterCount, filterSize, stride, padding )
 {
 	mType = eConvEx;
+	mFakeQuant = PackedRows::eNone;
 
-	Im2Rows::rot180Filters2Rows( mFilters, &mRowsOfRot180Filters );
+	refresh();
 }
 
-ConvExLayer :: ConvExLayer( const Dims & baseInDims, const MDVector & filters, const DataVector & biases )
-	: ConvLayer( baseInDims, filters, biases )
+ConvExLayer :: ConvExLayer( const Dims & baseInDims, const MDVector & filters, const DataVector & biases,
+		size_t stride, size_t padding )
+	: ConvLayer( baseInDims, filters, biases, stride, padding )
 {
 	mType = eConvEx;
+	mFakeQuant = PackedRows::eNone;
 
-	Im2Rows::rot180Filters2Rows( mFilters, &mRowsOfRot180Filters );
+	refresh();
 }
 
 ConvExLayer :: ~ConvExLayer()
 {
 }
 
+void ConvExLayer :: setFilters( const MDVector & filters, const DataVector & biases )
+{
+	ConvLayer::setFilters( filters, biases );
+
+	refresh();
+
+	repack();
+}
+
+void ConvExLayer :: setStorage( int type, DataType inScale )
+{
+	Dims fakeDims = { mFilters.second[ 0 ],
+			gx_dims_flatten_size( mFilters.second ) / mFilters.second[ 0 ] };
+
+	mPacked.pack( MDSpanRO( mFilters.first, fakeDims ), type, inScale );
+}
+
+int ConvExLayer :: getStorage() const
+{
+	return mPacked.getType();
+}
+
+const PackedRows & ConvExLayer :: getPacked() const
+{
+	return mPacked;
+}
+
+void ConvExLayer :: repack()
+{
+	if( PackedRows::eNone != mPacked.getType() ) setStorage( mPacked.getType(), mPacked.getInScale() );
+}
+
+void ConvExLayer :: setFakeQuant( int type )
+{
+	mFakeQuant = type;
+
+	refresh();
+}
+
+int ConvExLayer :: getFakeQuant() const
+{
+	return mFakeQuant;
+}
+
+void ConvExLayer :: refresh()
+{
+	if( PackedRows::eNone != mFakeQuant ) {
+		Dims fakeDims = { mFilters.second[ 0 ],
+				gx_dims_flatten_size( mFilters.second ) / mFilters.second[ 0 ] };
+
+		mFakeQuantFilters.second = mFilters.second;
+		mFakeQuantFilters.first.resize( mFilters.first.size() );
+		PackedRows::fakeQuantRows( MDSpanRO( mFilters.first, fakeDims ), mFakeQuant, std::begin( mFakeQuantFilters.first ) );
+	} else {
+		mFakeQuantFilters = MDVector();
+	}
+
+	Im2Rows::rot180Filters2Rows( getActiveFilters(), &mRowsOfRot180Filters );
+}
+
+const MDVector & ConvExLayer :: getActiveFilters() const
+{
+	return PackedRows::eNone != mFakeQuant ? mFakeQuantFilters : mFilters;
+}
+
 BaseLayerContext * ConvExLayer :: newCtx() const
 {
 	ConvExLayerContext * ctx = new ConvExLayerContext();
@@ -598,18 +957,23 @@ void ConvExLayer :: calcOutput( BaseLayerContext * ctx ) const
 
 	Dims fakeDims = { mFilters.second[ 0 ],
 			gx_dims_flatten_size( mFilters.second ) / mFilters.second[ 0 ] };
-	MDSpanRO filterRO( std::begin( mFilters.first ), fakeDims );
+	MDSpanRO filterRO( std::begin( getActiveFilters().first ), fakeDims );
 
 	MDVector & rows4input = ctxImpl->getRows4calcOutput();
 
 	for( size_t n = 0; n < inDims[ 0 ]; n++, outPtr += outSize ) {
 
-		Im2Rows::input2Rows( inRO, n, mFilters.second, &rows4input );
+		Im2Rows::input2Rows( inRO, n, mFilters.second, &rows4input, mStride, mPadding );
 
 		if( gx_is_inner_debug ) Utils::printMDVector( "input", rows4input );
 
 		MDSpanRO inputRO( rows4input );
-		gx_rows_product( filterRO, inputRO, mBiases, true, outPtr, outSize );
+
+		if( !mIsTraining && PackedRows::eNone != mPacked.getType() ) {
+			mPacked.rowsProduct( inputRO, mBiases, true, outPtr, &ctxImpl->getPackedScratch() );
+		} else {
+			gx_rows_product( filterRO, inputRO, mBiases, true, outPtr, outSize );
+		}
 	}
 }
 
@@ -622,21 +986,11 @@ void ConvExLayer :: backpropagate( BaseLayerContext * ctx, MDVector * inDelta )
 	MDVector & paddingDelta = ctxImpl->getPaddingDelta();
 
 	// prepare outDelta padding data
-	if( paddingDelta.second.size() <= 0 ) {
-		paddingDelta.second = {
-				outDims[ 0 ],
-				outDims[ 1 ],
-				outDims[ 2 ] + 2 * ( mFilters.second[ 2 ] - 1 ),
-				outDims[ 3 ] + 2 * ( mFilters.second[ 3 ] - 1 )
-		};
-	}
-	paddingDelta.second[ 0 ] = outDims[ 0 ];
-
-	paddingDelta.first.resize( gx_dims_flatten_size( paddingDelta.second ) );
+	preparePaddingDelta( ctx->getInput().second, outDims, &paddingDelta );
 
 	MDSpanRW paddingDeltaRW( paddingDelta );
 	MDSpanRO deltaRO( ctx->getDelta() );
-	copyOutDelta( deltaRO, mFilters.second[ 2 ], &paddingDeltaRW );
+	copyOutDelta( deltaRO, mFilters.second[ 2 ], mStride, mPadding, &paddingDeltaRW );
 
 	if( gx_is_inner_debug ) Utils::printMDVector( "outPadding", paddingDelta );
 
@@ -689,7 +1043,7 @@ void ConvExLayer :: collectGradients( BaseLayerContext * ctx ) const
 
 		if( gx_is_inner_debug ) Utils::printMDSpan( "deltas", deltaRO );
 
-		Im2Rows::input2Rows4Gradients( inRO, n, outDims, &rows4input );
+		Im2Rows::input2Rows4Gradients( inRO, n, mFilters.second, &rows4input, mStride, mPadding );
 
 		if( gx_is_inner_debug ) Utils::printMDVector( "input", rows4input );
 
@@ -710,212 +1064,469 @@ void ConvExLayer :: applyGradients( const BackwardContext & ctx, Optim * optim,
 {
 	ConvLayer::applyGradients( ctx, optim, trainingCount, miniBatchCount );
 
-	Im2Rows::rot180Filters2Rows( mFilters, &mRowsOfRot180Filters );
+	refresh();
+
+	repack();
 }
 
 ////////////////////////////////////////////////////////////
 
-MaxPoolLayer :: MaxPoolLayer( const Dims & baseInDims, size_t poolSize )
-	: BaseLayer( BaseLayer::eMaxPool )
+DepthwiseConvLayer :: DepthwiseConvLayer( const Dims & baseInDims, size_t filterSize,
+		size_t stride, size_t padding )
+	: ConvLayer( baseInDims, { baseInDims[ 0 ], 1, filterSize, filterSize }, stride, padding )
 {
-	mBaseInDims = baseInDims;
-	mBaseOutDims = { mBaseInDims[ 0 ], mBaseInDims[ 1 ] / poolSize, mBaseInDims[ 2 ] / poolSize };
-
-	mPoolSize = poolSize;
+	mType = eDepthwiseConv;
 }
 
-MaxPoolLayer :: ~MaxPoolLayer()
+DepthwiseConvLayer :: DepthwiseConvLayer( const Dims & baseInDims, const MDVector & filters,
+		const DataVector & biases, size_t stride, size_t padding )
+	: ConvLayer( baseInDims, filters, biases, stride, padding )
 {
-}
+	mType = eDepthwiseConv;
 
-void MaxPoolLayer :: printWeights( bool isDetail ) const
-{
-	printf( "\nPoolSize = %zu\n", mPoolSize );
+	assert( filters.second[ 0 ] == baseInDims[ 0 ] && filters.second[ 1 ] == 1 );
 }
 
-size_t MaxPoolLayer :: getPoolSize() const
+DepthwiseConvLayer :: ~DepthwiseConvLayer()
 {
-	return mPoolSize;
 }
 
-BaseLayerContext * MaxPoolLayer :: newCtx() const
+BaseLayerContext * DepthwiseConvLayer :: newCtx() const
 {
 	BaseLayerContext * ctx = new BaseLayerContext();
 
 	return ctx;
 }
 
-void MaxPoolLayer :: calcOutput( BaseLayerContext * ctx ) const
+void DepthwiseConvLayer :: calcOutput( BaseLayerContext * ctx ) const
 {
 	const Dims & inDims = ctx->getInput().second;
 
-	Dims & outDims = ctx->getOutput().second;
+	assert( inDims.size() == 4 && inDims[ 1 ] == mFilters.second[ 0 ] );
 
-	outDims = { inDims[ 0 ], inDims[ 1 ], inDims[ 2 ] / mPoolSize, inDims[ 3 ] / mPoolSize };
+	Dims & outDims = ctx->getOutput().second;
+	outDims = {
+		inDims[ 0 ], inDims[ 1 ],
+		gx_conv_out_size( inDims[ 2 ], mFilters.second[ 2 ], mStride, mPadding ),
+		gx_conv_out_size( inDims[ 3 ], mFilters.second[ 3 ], mStride, mPadding )
+	};
 	ctx->getOutput().first.resize( gx_dims_flatten_size( outDims ) );
 
-	MDSpanRW outRW( ctx->getOutput() );
-	MDSpanRO inRO( ctx->getInput() );
+	size_t inPlane = inDims[ 2 ] * inDims[ 3 ], outPlane = outDims[ 2 ] * outDims[ 3 ];
+	size_t filterSize = mFilters.second[ 2 ];
 
-	for( size_t n = 0; n < outDims[ 0 ]; n++ ) { 
-		for( size_t f = 0; f < outDims[ 1 ]; f++ ) {
-			for( size_t x = 0; x < outDims[ 2 ]; x++ ) {
-				for( size_t y = 0; y < outDims[ 3 ]; y++ ) {
-					outRW( n, f, x, y ) = pool( inRO, n, f, x * mPoolSize, y * mPoolSize );
-				}
-			}
-		}
-	}
-}
+	const DataType * inPtr = std::begin( ctx->getInput().first );
+	DataType * outPtr = std::begin( ctx->getOutput().first );
 
-DataType MaxPoolLayer :: pool( const MDSpanRO & inRO, size_t sampleIndex, size_t filterIndex,
-		size_t beginX, size_t beginY ) const
-{
-	DataType result = 1.0 * INT_MIN;
+	for( size_t n = 0; n < inDims[ 0 ]; n++ ) {
+		for( size_t c = 0; c < inDims[ 1 ]; c++, inPtr += inPlane, outPtr += outPlane ) {
+			std::fill( outPtr, outPtr + outPlane, mBiases[ c ] );
 
-	for( size_t x = 0; x < mPoolSize; x++ ) {
-		for( size_t y = 0; y < mPoolSize; y++ ) {
-			result = std::max( result, inRO( sampleIndex, filterIndex, beginX + x, beginY + y ) );
+			gx_dwconv_forward( inPtr, inDims[ 2 ], inDims[ 3 ],
+					std::begin( mFilters.first ) + c * filterSize * filterSize, filterSize, mStride, mPadding,
+					outPtr, outDims[ 2 ], outDims[ 3 ] );
 		}
 	}
-
-	return result;
 }
 
-void MaxPoolLayer :: backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const
+void DepthwiseConvLayer :: backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const
 {
+	const Dims & inDims = ctx->getInput().second;
 	const Dims & outDims = ctx->getOutput().second;
 
-	MDSpanRW inDeltaRW( *inDelta );
+	size_t inPlane = inDims[ 2 ] * inDims[ 3 ], outPlane = outDims[ 2 ] * outDims[ 3 ];
+	size_t filterSize = mFilters.second[ 2 ];
 
-	MDSpanRO outRO( ctx->getOutput() );
+	inDelta->first = 0;
 
-	MDSpanRO inRO( ctx->getInput() );
-	MDSpanRO outDeltaRO( ctx->getDelta() );
+	const DataType * outDeltaPtr = std::begin( ctx->getDelta().first );
+	DataType * inDeltaPtr = std::begin( inDelta->first );
 
 	for( size_t n = 0; n < outDims[ 0 ]; n++ ) {
-		for( size_t f = 0; f < outDims[ 1 ]; f++ ) {
-			for( size_t x = 0; x < outDims[ 2 ]; x++ ) {
-				for( size_t y = 0; y < outDims[ 3 ]; y++ ) {
-					unpool( inRO, n, f, x * mPoolSize, y * mPoolSize,
-							outRO( n, f, x, y ), outDeltaRO( n, f, x, y ), &inDeltaRW );
-				}
-			}
+		for( size_t c = 0; c < outDims[ 1 ]; c++, inDeltaPtr += inPlane, outDeltaPtr += outPlane ) {
+			gx_dwconv_backward( outDeltaPtr, outDims[ 2 ], outDims[ 3 ],
+					std::begin( mFilters.first ) + c * filterSize * filterSize, filterSize, mStride, mPadding,
+					inDeltaPtr, inDims[ 2 ], inDims[ 3 ] );
 		}
 	}
 }
 
-void MaxPoolLayer :: unpool( const MDSpanRO & inRO, size_t sampleIndex, size_t filterIndex, size_t beginX, size_t beginY,
-		const DataType maxValue, DataType outDelta, MDSpanRW * inDeltaRW ) const
+void DepthwiseConvLayer :: collectGradients( BaseLayerContext * ctx ) const
 {
-	for( size_t x = 0; x < mPoolSize; x++ ) {
-		for( size_t y = 0; y < mPoolSize; y++ ) {
-			if( inRO( sampleIndex, filterIndex, beginX + x, beginY + y ) == maxValue ) {
-				( *inDeltaRW )( sampleIndex, filterIndex, beginX + x, beginY + y ) = outDelta;
-			}
+	const Dims & inDims = ctx->getInput().second;
+	const Dims & outDims = ctx->getOutput().second;
+
+	MDVector & gradients = ctx->getGradients();
+	if( gradients.first.size() <= 0 ) {
+		gradients.second = mFilters.second;
+		gradients.first.resize( mFilters.first.size() );
+	} else {
+		gradients.first = 0.0;
+	}
+
+	size_t inPlane = inDims[ 2 ] * inDims[ 3 ], outPlane = outDims[ 2 ] * outDims[ 3 ];
+	size_t filterSize = mFilters.second[ 2 ];
+
+	const DataType * inPtr = std::begin( ctx->getInput().first );
+	const DataType * deltaPtr = std::begin( ctx->getDelta().first );
+
+	for( size_t n = 0; n < outDims[ 0 ]; n++ ) {
+		for( size_t c = 0; c < outDims[ 1 ]; c++, inPtr += inPlane, deltaPtr += outPlane ) {
+			gx_dwconv_gradients( inPtr, inDims[ 2 ], inDims[ 3 ], deltaPtr, outDims[ 2 ], outDims[ 3 ],
+					filterSize, mStride, mPadding, std::begin( gradients.first ) + c * filterSize * filterSize );
 		}
 	}
 }
 
 ////////////////////////////////////////////////////////////
 
-AvgPoolLayer :: AvgPoolLayer( const Dims & baseInDims, size_t poolSize )
-	: BaseLayer( BaseLayer::eAvgPool )
+MaxPoolLayer :: MaxPoolLayer( const Dims & baseInDims, size_t poolSize, size_t stride, size_t padding )
+	: BaseLayer( BaseLayer::eMaxPool )
 {
-	mBaseInDims = baseInDims;
-	mBaseOutDims = { mBaseInDims[ 0 ], mBaseInDims[ 1 ] / poolSize, mBaseInDims[ 2 ] / poolSize };
-
 	mPoolSize = poolSize;
+	mStride = stride > 0 ? stride : poolSize;
+	mPadding = padding;
+
+	assert( mPadding < mPoolSize );
+
+	mBaseInDims = baseInDims;
+	mBaseOutDims = {
+		mBaseInDims[ 0 ],
+		gx_conv_out_size( mBaseInDims[ 1 ], mPoolSize, mStride, mPadding ),
+		gx_conv_out_size( mBaseInDims[ 2 ], mPoolSize, mStride, mPadding )
+	};
 }
 
-AvgPoolLayer :: ~AvgPoolLayer()
+MaxPoolLayer :: ~MaxPoolLayer()
 {
 }
 
-void AvgPoolLayer :: printWeights( bool isDetail ) const
+void MaxPoolLayer :: printWeights( bool isDetail ) const
 {
-	printf( "\nPoolSize = %zu\n", mPoolSize );
+	printf( "\nPoolSize = %zu; Stride = %zu; Padding = %zu\n", mPoolSize, mStride, mPadding );
 }
 
-size_t AvgPoolLayer :: getPoolSize() const
+size_t MaxPoolLayer :: getPoolSize() const
 {
 	return mPoolSize;
 }
 
-BaseLayerContext * AvgPoolLayer :: newCtx() const
+size_t MaxPoolLayer :: getStride() const
 {
-	BaseLayerContext * ctx = new BaseLayerContext();
-
-	return ctx;
+	return mStride;
 }
 
-void AvgPoolLayer :: calcOutput( BaseLayerContext * ctx ) const
+size_t MaxPoolLayer :: getPadding() const
 {
+	return mPadding;
+}
+
+BaseLayerContext * MaxPoolLayer :: newCtx() const
+{
+	MaxPoolLayerContext * ctx = new MaxPoolLayerContext();
+
+	return ctx;
+}
+
+void MaxPoolLayer :: calcOutput( BaseLayerContext * ctx ) const
+{
+	MaxPoolLayerContext * ctxImpl = dynamic_cast< MaxPoolLayerContext * >( ctx );
+
+	assert( NULL != ctxImpl );
+
 	const Dims & inDims = ctx->getInput().second;
 
 	Dims & outDims = ctx->getOutput().second;
 
-	outDims = { inDims[ 0 ], inDims[ 1 ], inDims[ 2 ] / mPoolSize, inDims[ 3 ] / mPoolSize };
+	outDims = { inDims[ 0 ], inDims[ 1 ],
+			gx_conv_out_size( inDims[ 2 ], mPoolSize, mStride, mPadding ),
+			gx_conv_out_size( inDims[ 3 ], mPoolSize, mStride, mPadding ) };
 	ctx->getOutput().first.resize( gx_dims_flatten_size( outDims ) );
 
-	MDSpanRW outRW( ctx->getOutput() );
-	MDSpanRO inRO( ctx->getInput() );
+	size_t inHeight = inDims[ 2 ], inWidth = inDims[ 3 ], inPlane = inDims[ 2 ] * inDims[ 3 ];
+	size_t outWidth = outDims[ 3 ], outPlane = outDims[ 2 ] * outDims[ 3 ];
 
-	for( size_t n = 0; n < outDims[ 0 ]; n++ ) { 
-		for( size_t f = 0; f < outDims[ 1 ]; f++ ) {
-			for( size_t x = 0; x < outDims[ 2 ]; x++ ) {
-				for( size_t y = 0; y < outDims[ 3 ]; y++ ) {
-					outRW( n, f, x, y ) = pool( inRO, n, f, x * mPoolSize, y * mPoolSize );
+	IntVector & argmax = ctxImpl->getArgmax();
+	argmax.resize( ctx->getOutput().first.size() );
+
+	DataVector & rowMax = ctxImpl->getRowMax();
+	DataVector & rowIdx = ctxImpl->getRowIdx();
+	rowMax.resize( inWidth );
+	rowIdx.resize( inWidth );
+
+	const DataType * inPtr = std::begin( ctx->getInput().first );
+	DataType * outPtr = std::begin( ctx->getOutput().first );
+	int * argPtr = argmax.data();
+
+	for( size_t plane = 0; plane < outDims[ 0 ] * outDims[ 1 ]; plane++ ) {
+		for( size_t x = 0; x < outDims[ 2 ]; x++ ) {
+
+			// vertical pass: column-wise max of the pool rows, remember the winning row,
+			// the rows inside padding are skipped
+			size_t beginX = std::max( x * mStride, mPadding ) - mPadding;
+			size_t endX = std::min( x * mStride + mPoolSize - mPadding, inHeight );
+
+			std::copy( inPtr + beginX * inWidth, inPtr + ( beginX + 1 ) * inWidth, std::begin( rowMax ) );
+			rowIdx = beginX;
+
+			for( size_t i = beginX + 1; i < endX; i++ ) {
+				gx_vv_argmax( inPtr + i * inWidth, i, std::begin( rowMax ), std::begin( rowIdx ), inWidth );
+			}
+
+			// horizontal pass: reduce each window of the max row
+			for( size_t y = 0; y < outWidth; y++ ) {
+				size_t beginY = std::max( y * mStride, mPadding ) - mPadding;
+				size_t endY = std::min( y * mStride + mPoolSize - mPadding, inWidth );
+
+				size_t best = beginY;
+				for( size_t j = beginY + 1; j < endY; j++ ) {
+					if( rowMax[ j ] > rowMax[ best ] ) best = j;
 				}
+
+				outPtr[ x * outWidth + y ] = rowMax[ best ];
+				argPtr[ x * outWidth + y ] = (int)rowIdx[ best ] * inWidth + best;
 			}
 		}
+
+		inPtr += inPlane;
+		outPtr += outPlane;
+		argPtr += outPlane;
 	}
 }
 
-DataType AvgPoolLayer :: pool( const MDSpanRO & inRO, size_t sampleIndex, size_t filterIndex,
-		size_t beginX, size_t beginY ) const
+void MaxPoolLayer :: backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const
 {
-	DataType result = 0;
+	MaxPoolLayerContext * ctxImpl = dynamic_cast< MaxPoolLayerContext * >( ctx );
 
-	for( size_t x = 0; x < mPoolSize; x++ ) {
-		for( size_t y = 0; y < mPoolSize; y++ ) {
-			result += inRO( sampleIndex, filterIndex, beginX + x, beginY + y );
-		}
+	assert( NULL != ctxImpl );
+
+	const Dims & inDims = ctx->getInput().second;
+	const Dims & outDims = ctx->getOutput().second;
+
+	size_t inPlane = inDims[ 2 ] * inDims[ 3 ];
+	size_t outPlane = outDims[ 2 ] * outDims[ 3 ];
+
+	inDelta->first = 0;
+
+	const int * argPtr = ctxImpl->getArgmax().data();
+	const DataType * outDeltaPtr = std::begin( ctx->getDelta().first );
+	DataType * inDeltaPtr = std::begin( inDelta->first );
+
+	// overlapping windows may share the same argmax, so accumulate
+	for( size_t plane = 0; plane < outDims[ 0 ] * outDims[ 1 ]; plane++ ) {
+		for( size_t i = 0; i < outPlane; i++ ) inDeltaPtr[ argPtr[ i ] ] += outDeltaPtr[ i ];
+
+		argPtr += outPlane;
+		outDeltaPtr += outPlane;
+		inDeltaPtr += inPlane;
 	}
+}
+
+////////////////////////////////////////////////////////////
+
+AvgPoolLayer :: AvgPoolLayer( const Dims & baseInDims, size_t poolSize, size_t stride, size_t padding )
+	: BaseLayer( BaseLayer::eAvgPool )
+{
+	mPoolSize = poolSize;
+	mStride = stride > 0 ? stride : poolSize;
+	mPadding = padding;
+
+	assert( mPadding < mPoolSize );
 
-	return result / ( mPoolSize * mPoolSize );
+	mBaseInDims = baseInDims;
+	mBaseOutDims = {
+		mBaseInDims[ 0 ],
+		gx_conv_out_size( mBaseInDims[ 1 ], mPoolSize, mStride, mPadding ),
+		gx_conv_out_size( mBaseInDims[ 2 ], mPoolSize, mStride, mPadding )
+	};
+}
+
+AvgPoolLayer :: ~AvgPoolLayer()
+{
+}
+
+void AvgPoolLayer :: printWeights( bool isDetail ) const
+{
+	printf( "\nPoolSize = %zu; Stride = %zu; Padding = %zu\n", mPoolSize, mStride, mPadding );
+}
+
+size_t AvgPoolLayer :: getPoolSize() const
+{
+	return mPoolSize;
+}
+
+size_t AvgPoolLayer :: getStride() const
+{
+	return mStride;
+}
+
+size_t AvgPoolLayer :: getPadding() const
+{
+	return mPadding;
+}
+
+BaseLayerContext * AvgPoolLayer :: newCtx() const
+{
+	AvgPoolLayerContext * ctx = new AvgPoolLayerContext();
+
+	return ctx;
+}
+
+void AvgPoolLayer :: calcOutput( BaseLayerContext * ctx ) const
+{
+	AvgPoolLayerContext * ctxImpl = dynamic_cast< AvgPoolLayerContext * >( ctx );
+
+	assert( NULL != ctxImpl );
+
+	const Dims & inDims = ctx->getInput().second;
+
+	Dims & outDims = ctx->getOutput().second;
+
+	outDims = { inDims[ 0 ], inDims[ 1 ],
+			gx_conv_out_size( inDims[ 2 ], mPoolSize, mStride, mPadding ),
+			gx_conv_out_size( inDims[ 3 ], mPoolSize, mStride, mPadding ) };
+	ctx->getOutput().first.resize( gx_dims_flatten_size( outDims ) );
+
+	size_t inHeight = inDims[ 2 ], inWidth = inDims[ 3 ], inPlane = inDims[ 2 ] * inDims[ 3 ];
+	size_t outWidth = outDims[ 3 ], outPlane = outDims[ 2 ] * outDims[ 3 ];
+
+	// zero padding is counted in the divisor
+	DataType scale = 1.0 / ( mPoolSize * mPoolSize );
+
+	DataVector & rowSum = ctxImpl->getRowSum();
+	rowSum.resize( inWidth );
+
+	const DataType * inPtr = std::begin( ctx->getInput().first );
+	DataType * outPtr = std::begin( ctx->getOutput().first );
+
+	for( size_t plane = 0; plane < outDims[ 0 ] * outDims[ 1 ]; plane++ ) {
+		for( size_t x = 0; x < outDims[ 2 ]; x++ ) {
+			size_t beginX = std::max( x * mStride, mPadding ) - mPadding;
+			size_t endX = std::min( x * mStride + mPoolSize - mPadding, inHeight );
+
+			std::copy( inPtr + beginX * inWidth, inPtr + ( beginX + 1 ) * inWidth, std::begin( rowSum ) );
+
+			for( size_t i = beginX + 1; i < endX; i++ ) {
+				gx_vv_add( inPtr + i * inWidth, std::begin( rowSum ), inWidth );
+			}
+
+			for( size_t y = 0; y < outWidth; y++ ) {
+				size_t beginY = std::max( y * mStride, mPadding ) - mPadding;
+				size_t endY = std::min( y * mStride + mPoolSize - mPadding, inWidth );
+
+				DataType total = 0;
+				for( size_t j = beginY; j < endY; j++ ) total += rowSum[ j ];
+
+				outPtr[ x * outWidth + y ] = total * scale;
+			}
+		}
+
+		inPtr += inPlane;
+		outPtr += outPlane;
+	}
 }
 
 void AvgPoolLayer :: backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const
 {
+	AvgPoolLayerContext * ctxImpl = dynamic_cast< AvgPoolLayerContext * >( ctx );
+
+	assert( NULL != ctxImpl );
+
+	const Dims & inDims = ctx->getInput().second;
 	const Dims & outDims = ctx->getOutput().second;
 
-	MDSpanRW inDeltaRW( *inDelta );
+	size_t inHeight = inDims[ 2 ], inWidth = inDims[ 3 ], inPlane = inDims[ 2 ] * inDims[ 3 ];
+	size_t outWidth = outDims[ 3 ], outPlane = outDims[ 2 ] * outDims[ 3 ];
 
-	MDSpanRO outRO( ctx->getOutput() );
+	DataType scale = 1.0 / ( mPoolSize * mPoolSize );
 
-	MDSpanRO inRO( ctx->getInput() );
-	MDSpanRO outDeltaRO( ctx->getDelta() );
+	inDelta->first = 0;
 
-	for( size_t n = 0; n < outDims[ 0 ]; n++ ) {
-		for( size_t f = 0; f < outDims[ 1 ]; f++ ) {
-			for( size_t x = 0; x < outDims[ 2 ]; x++ ) {
-				for( size_t y = 0; y < outDims[ 3 ]; y++ ) {
-					unpool( inRO, n, f, x * mPoolSize, y * mPoolSize,
-							outRO( n, f, x, y ), outDeltaRO( n, f, x, y ), &inDeltaRW );
-				}
+	// reuse the row buffer of forward for the expanded delta row
+	DataVector & rowDelta = ctxImpl->getRowSum();
+	rowDelta.resize( inWidth );
+
+	const DataType * outDeltaPtr = std::begin( ctx->getDelta().first );
+	DataType * inDeltaPtr = std::begin( inDelta->first );
+
+	for( size_t plane = 0; plane < outDims[ 0 ] * outDims[ 1 ]; plane++ ) {
+		for( size_t x = 0; x < outDims[ 2 ]; x++ ) {
+			rowDelta = 0;
+
+			for( size_t y = 0; y < outWidth; y++ ) {
+				size_t beginY = std::max( y * mStride, mPadding ) - mPadding;
+				size_t endY = std::min( y * mStride + mPoolSize - mPadding, inWidth );
+
+				DataType value = outDeltaPtr[ x * outWidth + y ] * scale;
+				for( size_t j = beginY; j < endY; j++ ) rowDelta[ j ] += value;
+			}
+
+			size_t beginX = std::max( x * mStride, mPadding ) - mPadding;
+			size_t endX = std::min( x * mStride + mPoolSize - mPadding, inHeight );
+
+			for( size_t i = beginX; i < endX; i++ ) {
+				gx_vv_add( std::begin( rowDelta ), inDeltaPtr + i * inWidth, inWidth );
 			}
 		}
+
+		outDeltaPtr += outPlane;
+		inDeltaPtr += inPlane;
 	}
 }
 
-void AvgPoolLayer :: unpool( const MDSpanRO & inRO, size_t sampleIndex, size_t filterIndex,
-		size_t beginX, size_t beginY, const DataType maxValue, DataType outDelta, MDSpanRW * inDeltaRW ) const
+////////////////////////////////////////////////////////////
+
+GlobalAvgPoolLayer :: GlobalAvgPoolLayer( const Dims & baseInDims )
+	: BaseLayer( eGlobalAvgPool )
 {
-	for( size_t x = 0; x < mPoolSize; x++ ) {
-		for( size_t y = 0; y < mPoolSize; y++ ) {
-			( *inDeltaRW )( sampleIndex, filterIndex, beginX + x, beginY + y ) = outDelta / ( mPoolSize * mPoolSize );
-		}
+	mBaseInDims = baseInDims;
+	mBaseOutDims = { baseInDims[ 0 ] };
+}
+
+GlobalAvgPoolLayer :: ~GlobalAvgPoolLayer()
+{
+}
+
+void GlobalAvgPoolLayer :: printWeights( bool isDetail ) const
+{
+	/* do nothing */
+}
+
+BaseLayerContext * GlobalAvgPoolLayer :: newCtx() const
+{
+	return new BaseLayerContext();
+}
+
+void GlobalAvgPoolLayer :: calcOutput( BaseLayerContext * ctx ) const
+{
+	const Dims & inDims = ctx->getInput().second;
+
+	assert( inDims.size() == 4 );
+
+	ctx->getOutput().second = { inDims[ 0 ], inDims[ 1 ] };
+	ctx->getOutput().first.resize( inDims[ 0 ] * inDims[ 1 ] );
+
+	size_t inPlane = inDims[ 2 ] * inDims[ 3 ];
+
+	const DataType * inPtr = std::begin( ctx->getInput().first );
+	DataType * outPtr = std::begin( ctx->getOutput().first );
+
+	for( size_t plane = 0; plane < inDims[ 0 ] * inDims[ 1 ]; plane++, inPtr += inPlane ) {
+		outPtr[ plane ] = gx_sum( inPtr, inPlane ) / inPlane;
+	}
+}
+
+void GlobalAvgPoolLayer :: backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const
+{
+	const Dims & inDims = ctx->getInput().second;
+
+	size_t inPlane = inDims[ 2 ] * inDims[ 3 ];
+
+	const DataType * outDeltaPtr = std::begin( ctx->getDelta().first );
+	DataType * inDeltaPtr = std::begin( inDelta->first );
+
+	for( size_t plane = 0; plane < inDims[ 0 ] * inDims[ 1 ]; plane++, inDeltaPtr += inPlane ) {
+		std::fill( inDeltaPtr, inDeltaPtr + inPlane, outDeltaPtr[ plane ] / inPlane );
 	}
 }
 
@@ -1005,6 +1616,442 @@ void DropoutLayer :: backpropagate( BaseLayerContext * ctx, MDVector * inDelta )
 	}
 }
 
+////////////////////////////////////////////////////////////
 
-}; // namespace gxnet;
+BatchNormLayer :: BatchNormLayer( const Dims & baseInDims, DataType momentum, DataType epsilon )
+	: BaseLayer( eBatchNorm )
+{
+	mBaseInDims = baseInDims;
+	mBaseOutDims = baseInDims;
+
+	mMomentum = momentum;
+	mEpsilon = epsilon;
+
+	mGamma.resize( baseInDims[ 0 ], 1.0 );
+	mBeta.resize( baseInDims[ 0 ], 0.0 );
+	mRunningMean.resize( baseInDims[ 0 ], 0.0 );
+	mRunningVar.resize( baseInDims[ 0 ], 1.0 );
+}
+
+BatchNormLayer :: ~BatchNormLayer()
+{
+}
+
+void BatchNormLayer :: setParams( const DataVector & gamma, const DataVector & beta,
+		const DataVector & runningMean, const DataVector & runningVar )
+{
+	assert( gamma.size() == mGamma.size() && beta.size() == mBeta.size() );
+	assert( runningMean.size() == mRunningMean.size() && runningVar.size() == mRunningVar.size() );
+
+	mGamma = gamma;
+	mBeta = beta;
+	mRunningMean = runningMean;
+	mRunningVar = runningVar;
+}
+
+const DataVector & BatchNormLayer :: getGamma() const
+{
+	return mGamma;
+}
+
+const DataVector & BatchNormLayer :: getBeta() const
+{
+	return mBeta;
+}
+
+const DataVector & BatchNormLayer :: getRunningMean() const
+{
+	return mRunningMean;
+}
+
+const DataVector & BatchNormLayer :: getRunningVar() const
+{
+	return mRunningVar;
+}
+
+DataType BatchNormLayer :: getMomentum() const
+{
+	return mMomentum;
+}
+
+DataType BatchNormLayer :: getEpsilon() const
+{
+	return mEpsilon;
+}
+
+void BatchNormLayer :: getFoldParams( DataVector * scale, DataVector * shift ) const
+{
+	scale->resize( mGamma.size() );
+	shift->resize( mGamma.size() );
+
+	for( size_t c = 0; c < mGamma.size(); c++ ) {
+		( *scale )[ c ] = mGamma[ c ] / std::sqrt( mRunningVar[ c ] + mEpsilon );
+		( *shift )[ c ] = mBeta[ c ] - mRunningMean[ c ] * ( *scale )[ c ];
+	}
+}
 
+void BatchNormLayer :: printWeights( bool isDetail ) const
+{
+	printf( "\nMomentum = %f; Epsilon = %e;\n", mMomentum, mEpsilon );
+
+	if( !isDetail ) return;
+
+	for( size_t c = 0; c < mGamma.size() && c < 10; c++ ) {
+		printf( "\tChannel#%zu: Gamma = %.8f, Beta = %.8f, RunningMean = %.8f, RunningVar = %.8f\n",
+				c, mGamma[ c ], mBeta[ c ], mRunningMean[ c ], mRunningVar[ c ] );
+	}
+
+	if( mGamma.size() > 10 ) printf( "\t......\n" );
+}
+
+BaseLayerContext * BatchNormLayer :: newCtx() const
+{
+	return new BatchNormLayerContext();
+}
+
+void BatchNormLayer :: calcOutput( BaseLayerContext * ctx ) const
+{
+	BatchNormLayerContext * ctxImpl = dynamic_cast< BatchNormLayerContext * >( ctx );
+
+	assert( NULL != ctxImpl );
+
+	const DataVector & input = ctx->getInput().first;
+	DataVector & output = ctx->getOutput().first;
+
+	ctx->getOutput().second = ctx->getInput().second;
+	output.resize( input.size() );
+
+	size_t channels = mGamma.size();
+	size_t planeSize = getBaseInSize() / channels;
+	size_t sampleCount = input.size() / getBaseInSize();
+
+	if( !mIsTraining ) {
+		DataVector scale, shift;
+		getFoldParams( &scale, &shift );
+
+		for( size_t n = 0, offset = 0; n < sampleCount; n++ ) {
+			for( size_t c = 0; c < channels; c++, offset += planeSize ) {
+				gx_vs_scale_shift( std::begin( input ) + offset, scale[ c ], shift[ c ],
+						std::begin( output ) + offset, planeSize );
+			}
+		}
+
+		return;
+	}
+
+	DataVector & xhat = ctxImpl->getXHat();
+	DataVector & mean = ctxImpl->getMean();
+	DataVector & var = ctxImpl->getVar();
+	DataVector & invStd = ctxImpl->getInvStd();
+
+	xhat.resize( input.size() );
+	mean.resize( channels );
+	var.resize( channels );
+	invStd.resize( channels );
+
+	size_t total = sampleCount * planeSize;
+
+	for( size_t c = 0; c < channels; c++ ) {
+		DataType sum = 0;
+		for( size_t n = 0; n < sampleCount; n++ ) {
+			sum += gx_sum( std::begin( input ) + ( n * channels + c ) * planeSize, planeSize );
+		}
+		mean[ c ] = sum / total;
+
+		DataType sqSum = 0;
+		for( size_t n = 0; n < sampleCount; n++ ) {
+			sqSum += gx_sq_diff_sum( std::begin( input ) + ( n * channels + c ) * planeSize, mean[ c ], planeSize );
+		}
+		var[ c ] = sqSum / total;
+		invStd[ c ] = 1.0 / std::sqrt( var[ c ] + mEpsilon );
+
+		for( size_t n = 0; n < sampleCount; n++ ) {
+			size_t offset = ( n * channels + c ) * planeSize;
+
+			gx_vs_scale_shift( std::begin( input ) + offset, invStd[ c ], - mean[ c ] * invStd[ c ],
+					std::begin( xhat ) + offset, planeSize );
+			gx_vs_scale_shift( std::begin( xhat ) + offset, mGamma[ c ], mBeta[ c ],
+					std::begin( output ) + offset, planeSize );
+		}
+	}
+
+	if( gx_is_inner_debug ) {
+		Utils::printMDVector( "batchnorm.input", ctx->getInput() );
+		Utils::printMDVector( "batchnorm.output", ctx->getOutput() );
+	}
+}
+
+void BatchNormLayer :: backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const
+{
+	BatchNormLayerContext * ctxImpl = dynamic_cast< BatchNormLayerContext * >( ctx );
+
+	assert( NULL != ctxImpl );
+
+	const DataVector & delta = ctx->getDelta().first;
+	const DataVector & xhat = ctxImpl->getXHat();
+	const DataVector & invStd = ctxImpl->getInvStd();
+
+	size_t channels = mGamma.size();
+	size_t planeSize = getBaseInSize() / channels;
+	size_t sampleCount = delta.size() / getBaseInSize();
+
+	// dx = gamma * invStd * ( dy - mean( dy ) - xhat * mean( dy * xhat ) )
+	for( size_t c = 0; c < channels; c++ ) {
+		DataType sumDelta = 0, sumDeltaXHat = 0;
+
+		for( size_t n = 0; n < sampleCount; n++ ) {
+			size_t offset = ( n * channels + c ) * planeSize;
+
+			sumDelta += gx_sum( std::begin( delta ) + offset, planeSize );
+			sumDeltaXHat += gx_inner_product( std::begin( delta ) + offset, std::begin( xhat ) + offset, planeSize );
+		}
+
+		DataType total = sampleCount * planeSize;
+		DataType k = mGamma[ c ] * invStd[ c ];
+
+		for( size_t n = 0; n < sampleCount; n++ ) {
+			size_t offset = ( n * channels + c ) * planeSize;
+
+			gx_vs_scale_shift( std::begin( delta ) + offset, k, - k * sumDelta / total,
+					std::begin( inDelta->first ) + offset, planeSize );
+			gx_vs_product_add( std::begin( xhat ) + offset, - k * sumDeltaXHat / total,
+					std::begin( inDelta->first ) + offset, planeSize );
+		}
+	}
+
+	if( gx_is_inner_debug ) {
+		Utils::printMDVector( "batchnorm.outDelta", ctx->getDelta() );
+		Utils::printMDVector( "batchnorm.inDelta", *inDelta );
+	}
+}
+
+void BatchNormLayer :: collectGradients( BaseLayerContext * ctx ) const
+{
+	BatchNormLayerContext * ctxImpl = dynamic_cast< BatchNormLayerContext * >( ctx );
+
+	assert( NULL != ctxImpl );
+
+	const DataVector & delta = ctx->getDelta().first;
+	const DataVector & xhat = ctxImpl->getXHat();
+
+	size_t channels = mGamma.size();
+	size_t planeSize = getBaseInSize() / channels;
+	size_t sampleCount = delta.size() / getBaseInSize();
+
+	MDVector & gradients = ctx->getGradients();
+	if( gradients.first.size() <= 0 ) {
+		gradients.second = { 2, channels };
+		gradients.first.resize( 2 * channels );
+	}
+
+	MDSpanRW gradientsRW( gradients );
+
+	for( size_t c = 0; c < channels; c++ ) {
+		DataType dGamma = 0, dBeta = 0;
+
+		for( size_t n = 0; n < sampleCount; n++ ) {
+			size_t offset = ( n * channels + c ) * planeSize;
+
+			dGamma += gx_inner_product( std::begin( delta ) + offset, std::begin( xhat ) + offset, planeSize );
+			dBeta += gx_sum( std::begin( delta ) + offset, planeSize );
+		}
+
+		gradientsRW( 0, c ) = dGamma;
+		gradientsRW( 1, c ) = dBeta;
+	}
+}
+
+void BatchNormLayer :: applyGradients( const BackwardContext & ctx, Optim * optim,
+			size_t trainingCount, size_t miniBatchCount )
+{
+	size_t channels = mGamma.size();
+
+	const DataVector & gradients = ctx.getGradients().first;
+
+	DataVector dGamma = gradients[ std::slice( 0, channels, 1 ) ];
+	DataVector dBeta = gradients[ std::slice( channels, channels, 1 ) ];
+
+	optim->updateBiases( &mGamma, dGamma, miniBatchCount );
+	optim->updateBiases( &mBeta, dBeta, miniBatchCount );
+}
+
+void BatchNormLayer :: updateRunningStats( BaseLayerContext * ctx )
+{
+	BatchNormLayerContext * ctxImpl = dynamic_cast< BatchNormLayerContext * >( ctx );
+
+	assert( NULL != ctxImpl );
+
+	const DataVector & mean = ctxImpl->getMean();
+	const DataVector & var = ctxImpl->getVar();
+
+	// no training forward yet
+	if( mean.size() != mGamma.size() ) return;
+
+	// the values of one channel over the batch
+	size_t total = ctxImpl->getXHat().size() / mGamma.size();
+
+	for( size_t c = 0; c < mGamma.size(); c++ ) {
+		// the running variance is unbiased
+		DataType unbiased = total > 1 ? var[ c ] * total / ( total - 1 ) : var[ c ];
+
+		mRunningMean[ c ] = mMomentum * mRunningMean[ c ] + ( 1 - mMomentum ) * mean[ c ];
+		mRunningVar[ c ] = mMomentum * mRunningVar[ c ] + ( 1 - mMomentum ) * unbiased;
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+FakeQuantLayer :: FakeQuantLayer( const Dims & baseInDims, DataType scale )
+	: BaseLayer( eFakeQuant )
+{
+	mBaseInDims = baseInDims;
+	mBaseOutDims = baseInDims;
+
+	mScale = scale;
+}
+
+FakeQuantLayer :: ~FakeQuantLayer()
+{
+}
+
+DataType FakeQuantLayer :: getScale() const
+{
+	return mScale;
+}
+
+void FakeQuantLayer :: printWeights( bool isDetail ) const
+{
+	printf( "\nScale = %e;\n", mScale );
+}
+
+BaseLayerContext * FakeQuantLayer :: newCtx() const
+{
+	return new BaseLayerContext();
+}
+
+void FakeQuantLayer :: calcOutput( BaseLayerContext * ctx ) const
+{
+	const DataVector & input = ctx->getInput().first;
+
+	MDVector & outMD = ctx->getOutput();
+
+	outMD.second = ctx->getInput().second;
+	outMD.first.resize( input.size() );
+
+	DataType inv = 1 / mScale;
+
+	for( size_t i = 0; i < input.size(); i++ ) {
+		outMD.first[ i ] = PackedRows::quantize( input[ i ] * inv ) * mScale;
+	}
+}
+
+void FakeQuantLayer :: backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const
+{
+	const DataVector & input = ctx->getInput().first;
+	const DataVector & delta = ctx->getDelta().first;
+
+	DataType limit = 127 * mScale;
+
+	// straight through inside the clip range
+	for( size_t i = 0; i < input.size(); i++ ) {
+		inDelta->first[ i ] = std::abs( input[ i ] ) <= limit ? delta[ i ] : 0;
+	}
+}
+
+void FakeQuantLayer :: collectGradients( BaseLayerContext * ctx ) const
+{
+	const DataVector & input = ctx->getInput().first;
+	const DataVector & delta = ctx->getDelta().first;
+
+	MDVector & gradients = ctx->getGradients();
+	if( gradients.first.size() <= 0 ) {
+		gradients.second = { 1 };
+		gradients.first.resize( 1 );
+	}
+
+	DataType inv = 1 / mScale, grad = 0;
+
+	// d( q * s ) / ds is round( v ) - v inside the clip range, the clip value outside
+	for( size_t i = 0; i < input.size(); i++ ) {
+		DataType value = input[ i ] * inv;
+
+		if( value < -127 ) {
+			grad -= delta[ i ] * 127;
+		} else if( value > 127 ) {
+			grad += delta[ i ] * 127;
+		} else {
+			grad += delta[ i ] * ( PackedRows::quantize( value ) - value );
+		}
+	}
+
+	// LSQ scales the step size gradient by 1 / sqrt( count * 127 )
+	gradients.first[ 0 ] = grad / std::sqrt( getBaseInSize() * DataType( 127 ) );
+}
+
+void FakeQuantLayer :: applyGradients( const BackwardContext & ctx, Optim * optim,
+			size_t trainingCount, size_t miniBatchCount )
+{
+	DataVector scale( mScale, 1 );
+
+	optim->updateBiases( &scale, ctx.getGradients().first, miniBatchCount );
+
+	// a step past zero keeps the old scale
+	if( scale[ 0 ] > 0 ) mScale = scale[ 0 ];
+}
+
+////////////////////////////////////////////////////////////
+
+BinarizeLayer :: BinarizeLayer( const Dims & baseInDims )
+	: BaseLayer( eBinarize )
+{
+	mBaseInDims = baseInDims;
+	mBaseOutDims = baseInDims;
+}
+
+BinarizeLayer :: ~BinarizeLayer()
+{
+}
+
+void BinarizeLayer :: printWeights( bool isDetail ) const
+{
+}
+
+BaseLayerContext * BinarizeLayer :: newCtx() const
+{
+	return new BaseLayerContext();
+}
+
+void BinarizeLayer :: calcOutput( BaseLayerContext * ctx ) const
+{
+	const DataVector & input = ctx->getInput().first;
+
+	MDVector & outMD = ctx->getOutput();
+
+	outMD.second = ctx->getInput().second;
+	outMD.first.resize( input.size() );
+
+	size_t inSize = getBaseInSize();
+
+	for( size_t n = 0; n < input.size() / inSize; n++ ) {
+		const DataType * in = std::begin( input ) + n * inSize;
+
+		DataType scale = 0;
+		for( size_t i = 0; i < inSize; i++ ) scale += std::abs( in[ i ] );
+		scale /= inSize;
+
+		for( size_t i = 0; i < inSize; i++ ) outMD.first[ n * inSize + i ] = in[ i ] < 0 ? -scale : scale;
+	}
+}
+
+void BinarizeLayer :: backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const
+{
+	const DataVector & input = ctx->getInput().first;
+	const DataVector & delta = ctx->getDelta().first;
+
+	for( size_t i = 0; i < input.size(); i++ ) {
+		inDelta->first[ i ] = std::abs( input[ i ] ) <= 1 ? delta[ i ] : 0;
+	}
+}
+
+
+}; // namespace gxnet;
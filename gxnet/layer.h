@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "packed.h"
 
 #include <string>
 #include <vector>
@@ -11,6 +12,8 @@ namespace gxnet {
 class BaseLayer;
 class BaseLayerContext;
 class BackwardContext;
+struct tagSparseInput;
+typedef struct tagSparseInput SparseInput;
 
 typedef std::vector< BaseLayer * > BaseLayerPtrVector;
 
@@ -21,8 +24,11 @@ class BaseLayer {
 public:
 	enum {
 		eFullConn = 1,
-		eConv = 10, eMaxPool = 11, eAvgPool = 12, eConvEx = 13,
-		eDropout = 20
+		eConv = 10, eMaxPool = 11, eAvgPool = 12, eConvEx = 13, eDepthwiseConv = 14, eGlobalAvgPool = 15,
+		eDropout = 20,
+		eBatchNorm = 30,
+		eFakeQuant = 40,
+		eBinarize = 41
 	};
 
 public:
@@ -94,6 +100,26 @@ public:
 
 	const DataVector & getBiases() const;
 
+	// inference weight storage, one of PackedRows::eXXX, training always uses the DataType weights
+	void setStorage( int type, DataType inScale = 0 );
+
+	int getStorage() const;
+
+	const PackedRows & getPacked() const;
+
+	// run on weights rounded to the grid of PackedRows::eInt8 or eBinary, eNone turns it off,
+	// the updates still go to the DataType weights
+	void setFakeQuant( int type );
+
+	int getFakeQuant() const;
+
+	// zero the smallest magnitude weights until sparsity of them are 0, the mask keeps them
+	// at 0 through applyGradients, a later call with a higher sparsity prunes further
+	void prune( DataType sparsity );
+
+	// the fraction of weights held at 0 by prune
+	DataType getSparsity() const;
+
 	virtual void collectGradients( BaseLayerContext * ctx ) const;
 
 	virtual void applyGradients( const BackwardContext & ctx, Optim * optim,
@@ -113,15 +139,34 @@ protected:
 
 	virtual void backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const;
 
+private:
+
+	void collectSparseGradients( SparseInput * sparse, const DataType * delta, size_t sampleCount,
+			MDVector * gradients ) const;
+
 private:
 	MDVector mWeights;
 	DataVector mBiases;
+
+	PackedRows mPacked;
+
+	int mFakeQuant;
+	MDVector mFakeQuantWeights;
+
+	// 1 for kept weights, 0 for pruned, empty before prune
+	DataVector mPruneMask;
+
+	// bumped whenever the forward weights change, the sparse input ctx copies them again
+	size_t mWeightsVersion;
 };
 
+// runs direct loops over the DataType filters, so it has no packed storage, ConvExLayer has
 class ConvLayer : public BaseLayer {
 public:
-	ConvLayer( const Dims & baseInDims, size_t filterCount, size_t filterSize );
-	ConvLayer( const Dims & baseInDims, const MDVector & filters, const DataVector & biases );
+	ConvLayer( const Dims & baseInDims, size_t filterCount, size_t filterSize,
+			size_t stride = 1, size_t padding = 0 );
+	ConvLayer( const Dims & baseInDims, const MDVector & filters, const DataVector & biases,
+			size_t stride = 1, size_t padding = 0 );
 
 	~ConvLayer();
 
@@ -129,6 +174,12 @@ public:
 
 	const DataVector & getBiases() const;
 
+	virtual void setFilters( const MDVector & filters, const DataVector & biases );
+
+	size_t getStride() const;
+
+	size_t getPadding() const;
+
 public:
 
 	virtual void collectGradients( BaseLayerContext * ctx ) const;
@@ -144,7 +195,7 @@ protected:
 
 	/**
 	 * input dims: (N,Cin,Hin,Win) 
-	 * output dims: (N,Cout,Hout,Wout)
+	 * output dims: (N,Cout,Hout,Wout), Hout=(Hin+2*padding-K)/stride+1
 	 */
 	virtual void calcOutput( BaseLayerContext * ctx ) const;
 
@@ -152,29 +203,61 @@ protected:
 
 public:
 
+	// beginX/beginY may be negative inside the zero padding
 	static DataType forwardConv( const MDSpanRO & inRO, size_t sampleIndex, size_t filterIndex,
-			size_t beginX, size_t beginY, const MDSpanRO & filterRO );
+			ssize_t beginX, ssize_t beginY, const MDSpanRO & filterRO );
 
 	static DataType backwardConv( const MDSpanRO & inRO, size_t sampleIndex, size_t channelIndex,
 			size_t beginX, size_t beginY, const MDSpanRO & filterRO );
 
 	static DataType gradientConv( const MDSpanRO & inRO, size_t sampleIndex, size_t filterIndex,
-			size_t channelIndex, size_t beginX, size_t beginY, const MDSpanRO & filterRO );
+			size_t channelIndex, size_t beginX, size_t beginY, size_t stride, size_t padding,
+			const MDSpanRO & filterRO );
 
-	static void copyOutDelta( const MDSpanRO & outDeltaRO, size_t filterSize, MDSpanRW * outPaddingRW );
+	/**
+	 * Dilate outDelta by stride and pad it by ( filterSize - 1 - padding ), so that a
+	 * stride 1 valid convolution with the rot180 filters yields the input delta.
+	 */
+	static void copyOutDelta( const MDSpanRO & outDeltaRO, size_t filterSize,
+			size_t stride, size_t padding, MDSpanRW * outPaddingRW );
+
+protected:
+	// random initialized filters with filterDims (F,C,K,K)
+	ConvLayer( const Dims & baseInDims, const Dims & filterDims, size_t stride, size_t padding );
+
+	void preparePaddingDelta( const Dims & inDims, const Dims & outDims, MDVector * paddingDelta ) const;
 
 protected:
 	MDVector mFilters;
 	DataVector mBiases;
+
+	size_t mStride, mPadding;
 };
 
 class ConvExLayer : public ConvLayer {
 public:
-	ConvExLayer( const Dims & baseInDims, size_t filterCount, size_t filterSize );
-	ConvExLayer( const Dims & baseInDims, const MDVector & filters, const DataVector & biases );
+	ConvExLayer( const Dims & baseInDims, size_t filterCount, size_t filterSize,
+			size_t stride = 1, size_t padding = 0 );
+	ConvExLayer( const Dims & baseInDims, const MDVector & filters, const DataVector & biases,
+			size_t stride = 1, size_t padding = 0 );
 
 	~ConvExLayer();
 
+	virtual void setFilters( const MDVector & filters, const DataVector & biases );
+
+	// inference filter storage, one of PackedRows::eXXX, training always uses the DataType filters
+	void setStorage( int type, DataType inScale = 0 );
+
+	int getStorage() const;
+
+	const PackedRows & getPacked() const;
+
+	// run on filters rounded to the grid of PackedRows::eInt8 or eBinary, eNone turns it off,
+	// the updates still go to the DataType filters
+	void setFakeQuant( int type );
+
+	int getFakeQuant() const;
+
 	virtual void collectGradients( BaseLayerContext * ctx ) const;
 
 	virtual void applyGradients( const BackwardContext & ctx, Optim * optim,
@@ -188,17 +271,62 @@ protected:
 
 	virtual void backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const;
 
+private:
+	void repack();
+
+	// rebuild the fake quant filters and the rot180 rows from the current filters
+	void refresh();
+
+	const MDVector & getActiveFilters() const;
+
 private:
 	MDVector mRowsOfRot180Filters;
+
+	PackedRows mPacked;
+
+	int mFakeQuant;
+	MDVector mFakeQuantFilters;
+};
+
+/**
+ * Per-channel KxK convolution, filter dims (C,1,K,K). Follow it with a 1x1 ConvExLayer
+ * as the pointwise stage to build a depthwise-separable convolution.
+ */
+class DepthwiseConvLayer : public ConvLayer {
+public:
+	DepthwiseConvLayer( const Dims & baseInDims, size_t filterSize, size_t stride = 1, size_t padding = 0 );
+	DepthwiseConvLayer( const Dims & baseInDims, const MDVector & filters, const DataVector & biases,
+			size_t stride = 1, size_t padding = 0 );
+
+	~DepthwiseConvLayer();
+
+	virtual void collectGradients( BaseLayerContext * ctx ) const;
+
+protected:
+
+	virtual BaseLayerContext * newCtx() const;
+
+	/**
+	 * input dims: (N,C,Hin,Win)
+	 * output dims: (N,C,Hout,Wout)
+	 */
+	virtual void calcOutput( BaseLayerContext * ctx ) const;
+
+	virtual void backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const;
 };
 
 class MaxPoolLayer : public BaseLayer {
 public:
-	MaxPoolLayer( const Dims & baseInDims, size_t poolSize );
+	// stride 0 means non-overlapping windows, i.e. stride = poolSize
+	MaxPoolLayer( const Dims & baseInDims, size_t poolSize, size_t stride = 0, size_t padding = 0 );
 	~MaxPoolLayer();
 
 	size_t getPoolSize() const;
 
+	size_t getStride() const;
+
+	size_t getPadding() const;
+
 protected:
 
 	virtual void printWeights( bool isDetail ) const;
@@ -210,22 +338,21 @@ protected:
 	virtual void backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const;
 
 private:
-	DataType pool( const MDSpanRO & inRO, size_t sampleIndex, size_t filterIndex, size_t beginX, size_t beginY ) const;
-
-	void unpool( const MDSpanRO & inRO, size_t sampleIndex, size_t filterIndex, size_t beginX, size_t beginY,
-			const DataType maxValue, DataType outDelta, MDSpanRW * inDeltaRW ) const;
-
-private:
-	size_t mPoolSize;
+	size_t mPoolSize, mStride, mPadding;
 };
 
 class AvgPoolLayer : public BaseLayer {
 public:
-	AvgPoolLayer( const Dims & baseInDims, size_t poolSize );
+	// stride 0 means non-overlapping windows, i.e. stride = poolSize
+	AvgPoolLayer( const Dims & baseInDims, size_t poolSize, size_t stride = 0, size_t padding = 0 );
 	~AvgPoolLayer();
 
 	size_t getPoolSize() const;
 
+	size_t getStride() const;
+
+	size_t getPadding() const;
+
 protected:
 
 	virtual void printWeights( bool isDetail ) const;
@@ -237,13 +364,27 @@ protected:
 	virtual void backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const;
 
 private:
-	DataType pool( const MDSpanRO & inRO, size_t sampleIndex, size_t filterIndex, size_t beginX, size_t beginY ) const;
+	size_t mPoolSize, mStride, mPadding;
+};
 
-	void unpool( const MDSpanRO & inRO, size_t sampleIndex, size_t filterIndex, size_t beginX, size_t beginY,
-			const DataType maxValue, DataType outDelta, MDSpanRW * inDeltaRW ) const;
+/**
+ * input dims: (N,C,H,W)
+ * output dims: (N,C), the mean of each channel plane
+ */
+class GlobalAvgPoolLayer : public BaseLayer {
+public:
+	GlobalAvgPoolLayer( const Dims & baseInDims );
+	~GlobalAvgPoolLayer();
 
-private:
-	size_t mPoolSize;
+protected:
+
+	virtual void printWeights( bool isDetail ) const;
+
+	virtual BaseLayerContext * newCtx() const;
+
+	virtual void calcOutput( BaseLayerContext * ctx ) const;
+
+	virtual void backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const;
 };
 
 class DropoutLayer : public BaseLayer {
@@ -267,5 +408,112 @@ private:
 	DataType mDropRate;
 };
 
+/**
+ * Per-channel normalization over (N,H,W), or over N for (N,C) inputs.
+ * Training uses the batch statistics and updates the running ones,
+ * inference uses the running statistics.
+ */
+class BatchNormLayer : public BaseLayer {
+public:
+	BatchNormLayer( const Dims & baseInDims, DataType momentum = 0.9, DataType epsilon = 1e-5 );
+	~BatchNormLayer();
+
+	void setParams( const DataVector & gamma, const DataVector & beta,
+			const DataVector & runningMean, const DataVector & runningVar );
+
+	const DataVector & getGamma() const;
+
+	const DataVector & getBeta() const;
+
+	const DataVector & getRunningMean() const;
+
+	const DataVector & getRunningVar() const;
+
+	DataType getMomentum() const;
+
+	DataType getEpsilon() const;
+
+	// inference as output = input * scale + shift, used to fold into the previous layer
+	void getFoldParams( DataVector * scale, DataVector * shift ) const;
+
+	/**
+	 * gradients dims: (2,C), rows are dgamma and dbeta
+	 */
+	virtual void collectGradients( BaseLayerContext * ctx ) const;
+
+	virtual void applyGradients( const BackwardContext & ctx, Optim * optim,
+			size_t trainingCount, size_t miniBatchCount );
+
+	// move the running statistics toward the batch statistics the last training forward left in ctx
+	void updateRunningStats( BaseLayerContext * ctx );
+
+protected:
+
+	virtual void printWeights( bool isDetail ) const;
+
+	virtual BaseLayerContext * newCtx() const;
+
+	virtual void calcOutput( BaseLayerContext * ctx ) const;
+
+	virtual void backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const;
+
+private:
+	DataVector mGamma, mBeta, mRunningMean, mRunningVar;
+	DataType mMomentum, mEpsilon;
+};
+
+/**
+ * Round the input to the int8 grid of PackedRows::eInt8 with a learned per-tensor scale,
+ * Network inserts one before each FullConn/ConvEx layer for quantization-aware training.
+ * The input gradient is straight-through inside the clip range, the scale gradient is LSQ.
+ */
+class FakeQuantLayer : public BaseLayer {
+public:
+	FakeQuantLayer( const Dims & baseInDims, DataType scale );
+	~FakeQuantLayer();
+
+	DataType getScale() const;
+
+	// gradients dims: (1), the scale gradient
+	virtual void collectGradients( BaseLayerContext * ctx ) const;
+
+	virtual void applyGradients( const BackwardContext & ctx, Optim * optim,
+			size_t trainingCount, size_t miniBatchCount );
+
+protected:
+
+	virtual void printWeights( bool isDetail ) const;
+
+	virtual BaseLayerContext * newCtx() const;
+
+	virtual void calcOutput( BaseLayerContext * ctx ) const;
+
+	virtual void backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const;
+
+private:
+	DataType mScale;
+};
+
+/**
+ * Binarize each sample to +-mean abs input by sign, the input rows of PackedRows::eBinary
+ * for a FullConn layer. Network inserts one before each binary FullConn layer for binary training,
+ * the input gradient is straight-through inside [-1,1], so feed it zero centered inputs.
+ */
+class BinarizeLayer : public BaseLayer {
+public:
+	BinarizeLayer( const Dims & baseInDims );
+	~BinarizeLayer();
+
+protected:
+
+	virtual void printWeights( bool isDetail ) const;
+
+	virtual BaseLayerContext * newCtx() const;
+
+	virtual void calcOutput( BaseLayerContext * ctx ) const;
+
+	virtual void backpropagate( BaseLayerContext * ctx, MDVector * inDelta ) const;
+};
+
 }; // namespace gxnet;
 
@@ -0,0 +1,104 @@
+
+#include "loader.h"
+
+#include <random>
+#include <chrono>
+
+namespace gxnet {
+
+BatchLoader :: BatchLoader( const Network & network, const TrainingData & data, const IntVector & idxOfData,
+		size_t miniBatchCount, const Augment & augment, int threadCount, int depth )
+	: mNetwork( network ), mData( data ), mIdxOfData( idxOfData )
+{
+	mMiniBatchCount = std::max( miniBatchCount, (size_t)1 );
+	mBatchCount = ( idxOfData.size() + mMiniBatchCount - 1 ) / mMiniBatchCount;
+	mNext = 0;
+	mWaitSeconds = 0;
+
+	mWorkerCount = std::max( std::min( (size_t)std::max( threadCount, 1 ), mBatchCount ), (size_t)1 );
+
+	depth = std::max( depth, 1 );
+
+	// the buffers never move once the workers see them
+	mBatches.resize( mWorkerCount * depth );
+
+	std::random_device rd;
+
+	for( size_t i = 0; i < mWorkerCount; i++ ) {
+		mFree.emplace_back( new BoundedQueue< StagedBatch * >( depth ) );
+		mReady.emplace_back( new BoundedQueue< StagedBatch * >( depth ) );
+
+		for( int j = 0; j < depth; j++ ) mFree.back()->push( &mBatches[ i * depth + j ] );
+
+		// the same transforms, each worker with its own generator
+		mAugments.push_back( augment );
+		mAugments.back().seed( rd() );
+	}
+
+	for( size_t i = 0; i < mWorkerCount; i++ ) mThreads.emplace_back( &BatchLoader::work, this, i );
+}
+
+BatchLoader :: ~BatchLoader()
+{
+	for( size_t i = 0; i < mWorkerCount; i++ ) {
+		mFree[ i ]->close();
+		mReady[ i ]->close();
+	}
+
+	for( auto & item : mThreads ) item.join();
+}
+
+size_t BatchLoader :: getBatchCount() const
+{
+	return mBatchCount;
+}
+
+void BatchLoader :: work( size_t worker )
+{
+	for( size_t i = worker; i < mBatchCount; i += mWorkerCount ) {
+		StagedBatch * batch = NULL;
+
+		if( ! mFree[ worker ]->pop( &batch ) ) break;
+
+		size_t begin = i * mMiniBatchCount, end = std::min( begin + mMiniBatchCount, mIdxOfData.size() );
+
+		batch->mIndex = i;
+
+		mNetwork.stageMiniBatch( mData, ChunkInfo( &mIdxOfData, begin, end ), &mAugments[ worker ],
+				&batch->mInput, &batch->mTarget, &batch->mLabels );
+
+		if( ! mReady[ worker ]->push( batch ) ) break;
+	}
+}
+
+StagedBatch * BatchLoader :: next()
+{
+	if( mNext >= mBatchCount ) return NULL;
+
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	StagedBatch * batch = NULL;
+
+	if( ! mReady[ mNext % mWorkerCount ]->pop( &batch ) ) return NULL;
+
+	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+	mWaitSeconds += std::chrono::duration_cast<std::chrono::nanoseconds>( endTime - beginTime ).count() / 1e9;
+
+	mNext++;
+
+	return batch;
+}
+
+void BatchLoader :: recycle( StagedBatch * batch )
+{
+	mFree[ batch->mIndex % mWorkerCount ]->push( batch );
+}
+
+double BatchLoader :: getWaitSeconds() const
+{
+	return mWaitSeconds;
+}
+
+}; // namespace gxnet;
+
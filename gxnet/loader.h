@@ -0,0 +1,122 @@
+#pragma once
+
+#include "network.h"
+#include "augment.h"
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+namespace gxnet {
+
+// a fixed capacity queue between two threads, the producer waits while it is full
+template< typename T >
+class BoundedQueue {
+public:
+	BoundedQueue( size_t capacity ) : mCapacity( capacity ), mIsClosed( false ) {}
+
+	// false once the queue is closed
+	bool push( const T & item )
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		mNotFull.wait( lock, [this] { return mIsClosed || mItems.size() < mCapacity; } );
+
+		if( mIsClosed ) return false;
+
+		mItems.push_back( item );
+		mNotEmpty.notify_one();
+
+		return true;
+	}
+
+	// false once the queue is closed
+	bool pop( T * item )
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		mNotEmpty.wait( lock, [this] { return mIsClosed || ! mItems.empty(); } );
+
+		if( mIsClosed ) return false;
+
+		*item = mItems.front();
+		mItems.pop_front();
+		mNotFull.notify_one();
+
+		return true;
+	}
+
+	// wakes up every waiting thread, the items left are dropped
+	void close()
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		mIsClosed = true;
+		mNotFull.notify_all();
+		mNotEmpty.notify_all();
+	}
+
+private:
+	std::mutex mMutex;
+	std::condition_variable mNotFull, mNotEmpty;
+	std::deque< T > mItems;
+	size_t mCapacity;
+	bool mIsClosed;
+};
+
+typedef struct tagStagedBatch {
+	// the position of the mini batch in the chunk
+	size_t mIndex;
+
+	MDVector mInput, mTarget;
+	IntVector mLabels;
+} StagedBatch;
+
+/**
+ * Stages the mini batches of one chunk of training data on worker threads, read or
+ * map, augment and normalize, while the trainer works on the batch before. Worker i
+ * stages the batches i, i + n, i + 2n, ... into its own depth buffers, so a slow
+ * trainer stops the workers instead of growing the queues, and next() hands the
+ * batches out in the order of idxOfData, the same order as the synchronous path.
+ */
+class BatchLoader {
+public:
+	BatchLoader( const Network & network, const TrainingData & data, const IntVector & idxOfData,
+			size_t miniBatchCount, const Augment & augment, int threadCount, int depth = 2 );
+	~BatchLoader();
+
+	size_t getBatchCount() const;
+
+	// NULL after the last batch, recycle() it once its buffers are not needed any more
+	StagedBatch * next();
+
+	void recycle( StagedBatch * batch );
+
+	// the time next() waited for a batch that was not staged yet
+	double getWaitSeconds() const;
+
+private:
+	void work( size_t worker );
+
+private:
+	const Network & mNetwork;
+	TrainingData mData;
+	const IntVector & mIdxOfData;
+	size_t mMiniBatchCount, mBatchCount, mWorkerCount, mNext;
+
+	std::vector< StagedBatch > mBatches;
+	std::vector< Augment > mAugments;
+
+	// one pair per worker, the free buffers and the staged batches
+	std::vector< std::unique_ptr< BoundedQueue< StagedBatch * > > > mFree, mReady;
+
+	std::vector< std::thread > mThreads;
+
+	double mWaitSeconds;
+};
+
+}; // namespace gxnet;
+
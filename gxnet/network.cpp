@@ -1,6 +1,8 @@
 
 #include "network.h"
 #include "utils.h"
+#include "activation.h"
+#include "loader.h"
 
 #include <random>
 #include <numeric>
@@ -53,6 +55,11 @@ MDVector & NetworkContext :: getTarget()
 	return mTarget;
 }
 
+IntVector & NetworkContext :: getLabels()
+{
+	return mLabels;
+}
+
 BaseLayerContext * NetworkContext :: getLayerCtx( size_t index )
 {
 	return mLayerCtx[ index ];
@@ -114,6 +121,11 @@ void NetworkContext :: addToBatch()
 	}
 }
 
+Augment & NetworkContext :: getAugment()
+{
+	return mAugment;
+}
+
 ////////////////////////////////////////////////////////////
 
 Network :: Network( int lossFuncType )
@@ -141,6 +153,482 @@ void Network :: print( bool isDetail ) const
 	printf( "}}}\n\n" );
 }
 
+int Network :: foldBatchNorm()
+{
+	int count = 0;
+
+	for( size_t i = 1; i < mLayers.size(); ) {
+		BaseLayer * layer = mLayers[ i ], * prev = mLayers[ i - 1 ];
+
+		int prevType = prev->getType();
+
+		bool isFoldable = BaseLayer::eBatchNorm == layer->getType() && NULL == prev->getActFunc()
+				&& ( BaseLayer::eFullConn == prevType || BaseLayer::eConv == prevType
+					|| BaseLayer::eConvEx == prevType || BaseLayer::eDepthwiseConv == prevType );
+
+		if( !isFoldable ) {
+			i++;
+			continue;
+		}
+
+		DataVector scale, shift;
+		( (BatchNormLayer*)layer )->getFoldParams( &scale, &shift );
+
+		MDVector weights;
+		DataVector biases;
+
+		if( BaseLayer::eFullConn == prevType ) {
+			weights = ( (FullConnLayer*)prev )->getWeights();
+			biases = ( (FullConnLayer*)prev )->getBiases();
+		} else {
+			weights = ( (ConvLayer*)prev )->getFilters();
+			biases = ( (ConvLayer*)prev )->getBiases();
+		}
+
+		// every output channel owns one contiguous row of weights
+		size_t rowSize = weights.first.size() / biases.size();
+
+		for( size_t c = 0; c < biases.size(); c++ ) {
+			DataType * row = std::begin( weights.first ) + c * rowSize;
+			gx_vs_product( row, scale[ c ], row, rowSize );
+			biases[ c ] = biases[ c ] * scale[ c ] + shift[ c ];
+		}
+
+		if( BaseLayer::eFullConn == prevType ) {
+			( (FullConnLayer*)prev )->setWeights( weights, biases );
+		} else {
+			( (ConvLayer*)prev )->setFilters( weights, biases );
+		}
+
+		if( NULL != layer->getActFunc() ) prev->setActFunc( new ActFunc( layer->getActFunc()->getType() ) );
+
+		delete layer;
+		mLayers.erase( mLayers.begin() + i );
+
+		count++;
+	}
+
+	return count;
+}
+
+void Network :: calibrate( const DataMatrix & input, DataVector * maxAbs ) const
+{
+	NetworkContext ctx;
+	initCtx( &ctx );
+
+	Dims dims = mLayers[ 0 ]->getBaseInDims();
+	dims.insert( dims.begin(), 1 );
+
+	maxAbs->resize( mLayers.size() );
+	*maxAbs = 0;
+
+	for( const auto & item : input ) {
+		MDVector inMD( item, dims );
+
+		ctx.getLayerCtx( 0 )->setInput( &inMD );
+
+		forward( &ctx );
+
+		for( size_t i = 0; i < mLayers.size(); i++ ) {
+			( *maxAbs )[ i ] = std::max( ( *maxAbs )[ i ], std::abs( ctx.getLayerCtx( i )->getInput().first ).max() );
+		}
+	}
+}
+
+int Network :: quantize( const DataMatrix & calibration )
+{
+	setTraining( false );
+
+	DataVector maxAbs;
+	calibrate( calibration, &maxAbs );
+
+	int count = 0;
+
+	for( size_t i = 0; i < mLayers.size(); i++ ) {
+		BaseLayer * layer = mLayers[ i ];
+
+		if( BaseLayer::eFullConn != layer->getType() && BaseLayer::eConvEx != layer->getType() ) continue;
+
+		DataType inScale = maxAbs[ i ] > 0 ? maxAbs[ i ] / 127 : 1;
+
+		// the scale learned by quantization-aware training
+		if( i > 0 && BaseLayer::eFakeQuant == mLayers[ i - 1 ]->getType() ) {
+			inScale = ( (FakeQuantLayer*)mLayers[ i - 1 ] )->getScale();
+		}
+
+		if( BaseLayer::eFullConn == layer->getType() ) {
+			( (FullConnLayer*)layer )->setFakeQuant( PackedRows::eNone );
+			( (FullConnLayer*)layer )->setStorage( PackedRows::eInt8, inScale );
+		} else {
+			( (ConvExLayer*)layer )->setFakeQuant( PackedRows::eNone );
+			( (ConvExLayer*)layer )->setStorage( PackedRows::eInt8, inScale );
+		}
+
+		count++;
+	}
+
+	// the int8 layers round their input on the same grid now
+	for( size_t i = 0; i < mLayers.size(); ) {
+		if( BaseLayer::eFakeQuant == mLayers[ i ]->getType() ) {
+			delete mLayers[ i ];
+			mLayers.erase( mLayers.begin() + i );
+		} else {
+			i++;
+		}
+	}
+
+	return count;
+}
+
+int Network :: prepareQat( const DataMatrix & calibration )
+{
+	setTraining( false );
+
+	DataVector maxAbs;
+	calibrate( calibration, &maxAbs );
+
+	int count = 0;
+
+	BaseLayerPtrVector layers;
+
+	for( size_t i = 0; i < mLayers.size(); i++ ) {
+		BaseLayer * layer = mLayers[ i ];
+
+		if( BaseLayer::eFullConn == layer->getType() || BaseLayer::eConvEx == layer->getType() ) {
+			if( 0 == i || BaseLayer::eFakeQuant != mLayers[ i - 1 ]->getType() ) {
+				layers.push_back( new FakeQuantLayer( layer->getBaseInDims(), maxAbs[ i ] > 0 ? maxAbs[ i ] / 127 : 1 ) );
+				count++;
+			}
+
+			if( BaseLayer::eFullConn == layer->getType() ) {
+				( (FullConnLayer*)layer )->setFakeQuant( PackedRows::eInt8 );
+			} else {
+				( (ConvExLayer*)layer )->setFakeQuant( PackedRows::eInt8 );
+			}
+		}
+
+		layers.push_back( layer );
+	}
+
+	mLayers = layers;
+
+	return count;
+}
+
+int Network :: factorize( DataType energy )
+{
+	int count = 0;
+
+	size_t macs = 0, newMacs = 0;
+
+	for( size_t i = 0; i < mLayers.size(); i++ ) {
+		if( BaseLayer::eFullConn != mLayers[ i ]->getType() ) continue;
+
+		FullConnLayer * fc = (FullConnLayer*)mLayers[ i ];
+
+		const MDVector & weights = fc->getWeights();
+
+		size_t rows = weights.second[ 0 ], cols = weights.second[ 1 ];
+
+		macs += rows * cols;
+
+		// the dense product is cheaper from this rank on, and pruned weights are sparse already
+		size_t maxRank = ( rows * cols - 1 ) / ( rows + cols );
+
+		MDVector u, vt;
+		DataVector s;
+
+		size_t rank = 0;
+		if( maxRank > 0 && fc->getSparsity() <= 0 ) rank = Utils::truncatedSvd( weights, energy, maxRank, &u, &s, &vt );
+
+		DataType ratio = ( s * s ).sum() / ( weights.first * weights.first ).sum();
+
+		if( rank <= 0 || ratio < energy ) {
+			newMacs += rows * cols;
+			continue;
+		}
+
+		// split the singular values evenly, so both factors train at the same scale
+		for( size_t k = 0; k < rank; k++ ) {
+			DataType scale = std::sqrt( s[ k ] );
+			vt.first[ std::slice( k * cols, cols, 1 ) ] *= DataVector( scale, cols );
+			u.first[ std::slice( k, rows, rank ) ] *= DataVector( scale, rows );
+		}
+
+		FullConnLayer * first = new FullConnLayer( fc->getBaseInDims(), rank );
+		first->setWeights( vt, DataVector( DataType( 0 ), rank ) );
+
+		FullConnLayer * second = new FullConnLayer( { rank }, rows );
+		second->setWeights( u, fc->getBiases() );
+		if( NULL != fc->getActFunc() ) second->setActFunc( new ActFunc( fc->getActFunc()->getType() ) );
+
+		for( auto & layer : { first, second } ) {
+			layer->setStorage( fc->getStorage(), fc->getPacked().getInScale() );
+			layer->setTraining( mIsTraining );
+		}
+
+		printf( "factorize layer#%zu %zux%zu to rank %zu, energy %.4f, macs %zu -> %zu\n",
+				i, rows, cols, rank, ratio, rows * cols, rank * ( rows + cols ) );
+
+		newMacs += rank * ( rows + cols );
+
+		delete fc;
+		mLayers[ i ] = first;
+		mLayers.insert( mLayers.begin() + i + 1, second );
+		i++;
+
+		count++;
+	}
+
+	printf( "FullConn macs %zu -> %zu\n", macs, newMacs );
+
+	return count;
+}
+
+// keep the channels of data laid out as (outer,channels,*)
+static DataVector gx_keep_channels( const DataVector & data, size_t outer, size_t channels,
+		const std::vector< size_t > & keep )
+{
+	size_t inner = data.size() / outer / channels;
+
+	DataVector ret( outer * keep.size() * inner );
+
+	for( size_t o = 0; o < outer; o++ ) {
+		for( size_t k = 0; k < keep.size(); k++ ) {
+			ret[ std::slice( ( o * keep.size() + k ) * inner, inner, 1 ) ]
+					= data[ std::slice( ( o * channels + keep[ k ] ) * inner, inner, 1 ) ];
+		}
+	}
+
+	return ret;
+}
+
+// the layers a filter pruning passes through, they work on each channel alone
+static bool gx_is_channel_wise( int type )
+{
+	return BaseLayer::eMaxPool == type || BaseLayer::eAvgPool == type || BaseLayer::eGlobalAvgPool == type
+			|| BaseLayer::eDropout == type || BaseLayer::eBatchNorm == type
+			|| BaseLayer::eDepthwiseConv == type || BaseLayer::eFakeQuant == type || BaseLayer::eBinarize == type;
+}
+
+// a copy of the layer with only the keep channels, of its filters for isOutput, otherwise of its input
+static BaseLayer * gx_keep_channels( const BaseLayer * layer, size_t channels,
+		const std::vector< size_t > & keep, bool isOutput )
+{
+	Dims inDims = layer->getBaseInDims();
+	if( !isOutput ) inDims[ 0 ] = inDims[ 0 ] / channels * keep.size();
+
+	BaseLayer * ret = NULL;
+
+	int type = layer->getType();
+
+	if( BaseLayer::eConv == type || BaseLayer::eConvEx == type || BaseLayer::eDepthwiseConv == type ) {
+		const ConvLayer * conv = (const ConvLayer*)layer;
+
+		MDVector filters = conv->getFilters();
+		DataVector biases = conv->getBiases();
+
+		if( isOutput || BaseLayer::eDepthwiseConv == type ) {
+			filters.first = gx_keep_channels( filters.first, 1, channels, keep );
+			biases = gx_keep_channels( biases, 1, channels, keep );
+			filters.second[ 0 ] = keep.size();
+		} else {
+			filters.first = gx_keep_channels( filters.first, filters.second[ 0 ], channels, keep );
+			filters.second[ 1 ] = keep.size();
+		}
+
+		if( BaseLayer::eConv == type ) {
+			ret = new ConvLayer( inDims, filters, biases, conv->getStride(), conv->getPadding() );
+		} else if( BaseLayer::eDepthwiseConv == type ) {
+			ret = new DepthwiseConvLayer( inDims, filters, biases, conv->getStride(), conv->getPadding() );
+		} else {
+			const ConvExLayer * old = (const ConvExLayer*)layer;
+			ConvExLayer * convEx = new ConvExLayer( inDims, filters, biases, conv->getStride(), conv->getPadding() );
+			convEx->setFakeQuant( old->getFakeQuant() );
+			convEx->setStorage( old->getStorage(), old->getPacked().getInScale() );
+			ret = convEx;
+		}
+	}
+
+	if( BaseLayer::eFullConn == type ) {
+		const FullConnLayer * old = (const FullConnLayer*)layer;
+
+		MDVector weights = old->getWeights();
+		weights.first = gx_keep_channels( weights.first, weights.second[ 0 ], channels, keep );
+		weights.second[ 1 ] = weights.first.size() / weights.second[ 0 ];
+
+		FullConnLayer * fc = new FullConnLayer( inDims, weights.second[ 0 ] );
+		fc->setWeights( weights, old->getBiases() );
+		if( old->getSparsity() > 0 ) fc->prune( old->getSparsity() );
+		fc->setFakeQuant( old->getFakeQuant() );
+		fc->setStorage( old->getStorage(), old->getPacked().getInScale() );
+		ret = fc;
+	}
+
+	if( BaseLayer::eMaxPool == type ) {
+		const MaxPoolLayer * pool = (const MaxPoolLayer*)layer;
+		ret = new MaxPoolLayer( inDims, pool->getPoolSize(), pool->getStride(), pool->getPadding() );
+	}
+
+	if( BaseLayer::eAvgPool == type ) {
+		const AvgPoolLayer * pool = (const AvgPoolLayer*)layer;
+		ret = new AvgPoolLayer( inDims, pool->getPoolSize(), pool->getStride(), pool->getPadding() );
+	}
+
+	if( BaseLayer::eGlobalAvgPool == type ) ret = new GlobalAvgPoolLayer( inDims );
+
+	if( BaseLayer::eDropout == type ) ret = new DropoutLayer( inDims, ( (const DropoutLayer*)layer )->getDropRate() );
+
+	if( BaseLayer::eFakeQuant == type ) ret = new FakeQuantLayer( inDims, ( (const FakeQuantLayer*)layer )->getScale() );
+
+	if( BaseLayer::eBinarize == type ) ret = new BinarizeLayer( inDims );
+
+	if( BaseLayer::eBatchNorm == type ) {
+		const BatchNormLayer * old = (const BatchNormLayer*)layer;
+
+		BatchNormLayer * bn = new BatchNormLayer( inDims, old->getMomentum(), old->getEpsilon() );
+		bn->setParams( gx_keep_channels( old->getGamma(), 1, channels, keep ),
+				gx_keep_channels( old->getBeta(), 1, channels, keep ),
+				gx_keep_channels( old->getRunningMean(), 1, channels, keep ),
+				gx_keep_channels( old->getRunningVar(), 1, channels, keep ) );
+		ret = bn;
+	}
+
+	if( NULL != ret && NULL != layer->getActFunc() ) ret->setActFunc( new ActFunc( layer->getActFunc()->getType() ) );
+
+	return ret;
+}
+
+int Network :: pruneFilters( DataType ratio )
+{
+	int count = 0;
+
+	for( size_t i = 0; i < mLayers.size(); i++ ) {
+		if( BaseLayer::eConv != mLayers[ i ]->getType() && BaseLayer::eConvEx != mLayers[ i ]->getType() ) continue;
+
+		const MDVector & filters = ( (ConvLayer*)mLayers[ i ] )->getFilters();
+
+		size_t channels = filters.second[ 0 ], rowSize = filters.first.size() / channels;
+		size_t keepCount = channels - std::min( channels - 1, (size_t)std::round( ratio * channels ) );
+
+		if( keepCount == channels ) continue;
+
+		// the next layer that mixes the channels ends the shrinking
+		size_t end = i + 1;
+		while( end < mLayers.size() && gx_is_channel_wise( mLayers[ end ]->getType() ) ) end++;
+
+		if( end >= mLayers.size() ) continue;
+
+		int endType = mLayers[ end ]->getType();
+		if( BaseLayer::eConv != endType && BaseLayer::eConvEx != endType && BaseLayer::eFullConn != endType ) continue;
+
+		DataVector norms( channels );
+		for( size_t c = 0; c < channels; c++ ) {
+			norms[ c ] = std::abs( DataVector( filters.first[ std::slice( c * rowSize, rowSize, 1 ) ] ) ).sum();
+		}
+
+		// the largest L1 norms survive, in their original order
+		std::vector< size_t > keep( channels );
+		std::iota( keep.begin(), keep.end(), 0 );
+		std::stable_sort( keep.begin(), keep.end(), [ &norms ]( size_t a, size_t b ) {
+			return norms[ a ] > norms[ b ];
+		} );
+		keep.resize( keepCount );
+		std::sort( keep.begin(), keep.end() );
+
+		for( size_t j = i; j <= end; j++ ) {
+			BaseLayer * layer = gx_keep_channels( mLayers[ j ], channels, keep, j == i );
+			layer->setTraining( mIsTraining );
+
+			delete mLayers[ j ];
+			mLayers[ j ] = layer;
+		}
+
+		count += channels - keepCount;
+	}
+
+	return count;
+}
+
+int Network :: prepareBinary()
+{
+	size_t first = mLayers.size(), last = 0;
+
+	for( size_t i = 0; i < mLayers.size(); i++ ) {
+		if( BaseLayer::eFullConn != mLayers[ i ]->getType() && BaseLayer::eConvEx != mLayers[ i ]->getType() ) continue;
+
+		first = std::min( first, i );
+		last = i;
+	}
+
+	int count = 0;
+
+	BaseLayerPtrVector layers;
+
+	// the first and the last layers stay in DataType, they lose the most when binarized;
+	// a ConvEx layer stays too, its packed rows are patches, each with its own input scale,
+	// while BinarizeLayer can only give the whole sample one
+	for( size_t i = 0; i < mLayers.size(); i++ ) {
+		BaseLayer * layer = mLayers[ i ];
+
+		if( BaseLayer::eFullConn == layer->getType() && i != first && i != last ) {
+			if( BaseLayer::eBinarize != mLayers[ i - 1 ]->getType() ) {
+				layers.push_back( new BinarizeLayer( layer->getBaseInDims() ) );
+			}
+
+			( (FullConnLayer*)layer )->setFakeQuant( PackedRows::eBinary );
+
+			count++;
+		}
+
+		layers.push_back( layer );
+	}
+
+	mLayers = layers;
+
+	return count;
+}
+
+int Network :: binarize()
+{
+	int count = 0;
+
+	for( auto & layer : mLayers ) {
+		if( BaseLayer::eFullConn == layer->getType()
+				&& PackedRows::eBinary == ( (FullConnLayer*)layer )->getFakeQuant() ) {
+			( (FullConnLayer*)layer )->setFakeQuant( PackedRows::eNone );
+			( (FullConnLayer*)layer )->setStorage( PackedRows::eBinary );
+			count++;
+		}
+	}
+
+	for( size_t i = 0; i < mLayers.size(); ) {
+		if( BaseLayer::eBinarize == mLayers[ i ]->getType() ) {
+			delete mLayers[ i ];
+			mLayers.erase( mLayers.begin() + i );
+		} else {
+			i++;
+		}
+	}
+
+	return count;
+}
+
+int Network :: prune( DataType sparsity )
+{
+	int count = 0;
+
+	for( auto & layer : mLayers ) {
+		if( BaseLayer::eFullConn != layer->getType() ) continue;
+
+		( (FullConnLayer*)layer )->prune( sparsity );
+
+		count++;
+	}
+
+	return count;
+}
+
 void Network :: setOnEpochEnd( OnEpochEnd_t onEpochEnd )
 {
 	mOnEpochEnd = onEpochEnd;
@@ -246,6 +734,11 @@ bool Network :: apply( NetworkContext * ctx, Optim * optim,
 	for( size_t i = 0; i < mLayers.size(); i++ ) {
 		BaseLayer * layer = mLayers[ i ];
 		layer->applyGradients( *( ctx->getBatchBwdCtx( i ) ), optim, trainingCount, miniBatchCount );
+
+		// the batch statistics are not gradients, they stay in the layer ctx
+		if( BaseLayer::eBatchNorm == layer->getType() ) {
+			( (BatchNormLayer*)layer )->updateRunningStats( ctx->getLayerCtx( i ) );
+		}
 	}
 
 	return true;
@@ -262,7 +755,7 @@ void Network :: collect( NetworkContext * ctx ) const
 	if( gx_is_inner_debug ) Utils::printCtx( "collect", ctx->getLayerCtx() );
 }
 
-bool Network :: backward( NetworkContext * ctx, const MDVector & targetMD ) const
+bool Network :: backward( NetworkContext * ctx, const MDVector & targetMD, const IntVector * labels ) const
 {
 	BaseLayerContext * layerCtx = ctx->getLayerCtx().back();
 
@@ -270,14 +763,25 @@ bool Network :: backward( NetworkContext * ctx, const MDVector & targetMD ) cons
 
 	const DataVector & target = targetMD.first;
 
-	assert( layerCtx->getDelta().first.size() == target.size() );
+	if( eCrossEntropy == mLossFuncType && NULL != labels ) {
+		// output - one-hot, only one element of each row moves
+		DataVector & delta = layerCtx->getDelta().first;
 
-	if( eMeanSquaredError == mLossFuncType ) {
-		layerCtx->getDelta().first = 2.0 * ( lastOutput - target );
-	}
+		delta = lastOutput;
 
-	if( eCrossEntropy == mLossFuncType ) {
-		layerCtx->getDelta().first = lastOutput - target;
+		size_t classCount = delta.size() / labels->size();
+
+		for( size_t i = 0; i < labels->size(); i++ ) delta[ i * classCount + ( *labels )[ i ] ] -= 1;
+	} else {
+		assert( layerCtx->getDelta().first.size() == target.size() );
+
+		if( eMeanSquaredError == mLossFuncType ) {
+			layerCtx->getDelta().first = 2.0 * ( lastOutput - target );
+		}
+
+		if( eCrossEntropy == mLossFuncType ) {
+			layerCtx->getDelta().first = lastOutput - target;
+		}
 	}
 
 	for( ssize_t i = mLayers.size() - 1; i >= 0; i-- ) {
@@ -300,6 +804,11 @@ void Network :: initCtx( NetworkContext * ctx ) const
 		ctx->getLayerCtx().push_back( layerCtx );
 	}
 
+	// only the data can be mostly zeros, the outputs of the hidden layers are dense
+	if( mLayers.size() > 0 && BaseLayer::eFullConn == mLayers[ 0 ]->getType() ) {
+		( (FullConnLayerContext*)ctx->getLayerCtx( 0 ) )->getSparseInput().mIsEnabled = true;
+	}
+
 	for( size_t i = 1; i < mLayers.size(); i++ ) {
 		BaseLayerContext * prev = ctx->getLayerCtx( i - 1 );
 		BaseLayerContext * curr = ctx->getLayerCtx( i );
@@ -327,16 +836,33 @@ DataType Network :: calcLoss( const DataVector & target, const DataVector & outp
 	return ret;
 }
 
-bool Network :: trainMiniBatch( NetworkContext * ctx, DataType * totalLoss )
+DataType Network :: calcLoss( const IntVector & labels, const DataVector & output )
 {
-	const DataMatrix * input = std::get<0>( ctx->getTrainingData() );
-	const DataMatrix * target = std::get<1>( ctx->getTrainingData() );
+	DataType ret = 0;
 
-	const IntVector * idxOfData = std::get<0>( ctx->getChunkInfo() );
-	size_t chunkBegin = std::get<1>( ctx->getChunkInfo() );
-	size_t chunkEnd = std::get<2>( ctx->getChunkInfo() );
+	size_t classCount = output.size() / std::max( labels.size(), (size_t)1 );
 
-	MDVector & inputMD = ctx->getInput();
+	for( size_t i = 0; i < labels.size(); i++ ) ret -= std::log( output[ i * classCount + labels[ i ] ] );
+
+	return ret;
+}
+
+void Network :: stageMiniBatch( const TrainingData & data, const ChunkInfo & chunk, Augment * augment,
+		MDVector * input4batch, MDVector * target4batch, IntVector * labels4batch ) const
+{
+	const DataMatrix * input = std::get<0>( data );
+	const DataMatrix * target = std::get<1>( data );
+	const ByteDataset * bytes = std::get<2>( data );
+	const LabelDataset * labels = std::get<3>( data );
+
+	// cross entropy needs only the class index of each sample, no one-hot target
+	bool isSparseTarget = NULL != labels && eCrossEntropy == mLossFuncType;
+
+	const IntVector * idxOfData = std::get<0>( chunk );
+	size_t chunkBegin = std::get<1>( chunk );
+	size_t chunkEnd = std::get<2>( chunk );
+
+	MDVector & inputMD = *input4batch;
 	if( inputMD.second.size() <= 0 ) {
 		inputMD.second = mLayers[ 0 ]->getBaseInDims();
 		inputMD.second.insert( inputMD.second.begin(), 1 );
@@ -344,26 +870,65 @@ bool Network :: trainMiniBatch( NetworkContext * ctx, DataType * totalLoss )
 	inputMD.second[ 0 ] = chunkEnd - chunkBegin;
 	inputMD.first.resize( gx_dims_flatten_size( inputMD.second ) );
 
-	MDVector & targetMD = ctx->getTarget();
+	MDVector & targetMD = *target4batch;
 	if( targetMD.second.size() <= 0 ) {
-		targetMD.second = { 1, ( *target )[ 0 ].size() };
+		targetMD.second = { 1, NULL != labels ? labels->getClassCount() : ( *target )[ 0 ].size() };
 	}
-	targetMD.second[ 0 ] = chunkEnd - chunkBegin;
+	targetMD.second[ 0 ] = isSparseTarget ? 0 : chunkEnd - chunkBegin;
 	targetMD.first.resize( gx_dims_flatten_size( targetMD.second ) );
 
+	IntVector & batchLabels = *labels4batch;
+	batchLabels.clear();
+
 	DataType * inPtr = std::begin( inputMD.first );
 	DataType * targetPtr = std::begin( targetMD.first );
 
 	for( size_t i = chunkBegin; i < chunkEnd; i++ ) {
-		const DataVector & currInput = ( *input )[ ( *idxOfData )[ i ] ];
-		const DataVector & currTarget = ( *target )[ ( *idxOfData )[ i ] ];
+		// the bytes are normalized right into the batch
+		if( NULL != bytes ) {
+			bytes->getSample( ( *idxOfData )[ i ], inPtr, augment );
+			inPtr += bytes->getSampleSize();
+		} else {
+			const DataVector & currInput = ( *input )[ ( *idxOfData )[ i ] ];
+
+			std::copy( std::begin( currInput ), std::end( currInput ), inPtr );
+			inPtr += currInput.size();
+		}
 
-		std::copy( std::begin( currInput ), std::end( currInput ), inPtr );
-		inPtr += currInput.size();
+		if( NULL != labels ) {
+			batchLabels.push_back( labels->get( ( *idxOfData )[ i ] ) );
 
-		std::copy( std::begin( currTarget ), std::end( currTarget ), targetPtr );
-		targetPtr += currTarget.size();
+			if( ! isSparseTarget ) {
+				labels->getOneHot( ( *idxOfData )[ i ], targetPtr );
+				targetPtr += labels->getClassCount();
+			}
+		} else {
+			const DataVector & currTarget = ( *target )[ ( *idxOfData )[ i ] ];
+
+			std::copy( std::begin( currTarget ), std::end( currTarget ), targetPtr );
+			targetPtr += currTarget.size();
+		}
 	}
+}
+
+bool Network :: trainMiniBatch( NetworkContext * ctx, DataType * totalLoss )
+{
+	stageMiniBatch( ctx->getTrainingData(), ctx->getChunkInfo(), &ctx->getAugment(),
+			&ctx->getInput(), &ctx->getTarget(), &ctx->getLabels() );
+
+	return trainStaged( ctx, totalLoss );
+}
+
+bool Network :: trainStaged( NetworkContext * ctx, DataType * totalLoss )
+{
+	MDVector & inputMD = ctx->getInput();
+	MDVector & targetMD = ctx->getTarget();
+	IntVector & batchLabels = ctx->getLabels();
+
+	// the labels replace the one-hot rows, see stageMiniBatch
+	bool isSparseTarget = ! batchLabels.empty() && eCrossEntropy == mLossFuncType;
+
+	size_t count = inputMD.second[ 0 ];
 
 	ctx->getLayerCtx( 0 )->setInput( &inputMD );
 
@@ -374,46 +939,95 @@ bool Network :: trainMiniBatch( NetworkContext * ctx, DataType * totalLoss )
 
 	forward( ctx );
 
-	backward( ctx, targetMD );
+	backward( ctx, targetMD, isSparseTarget ? &batchLabels : NULL );
 
 	collect( ctx );
 
 	ctx->addToBatch();
 
-	DataType loss = calcLoss( targetMD.first, ctx->getLayerCtx().back()->getOutput().first );
+	const DataVector & output = ctx->getLayerCtx().back()->getOutput().first;
+
+	DataType loss = isSparseTarget ? calcLoss( batchLabels, output ) : calcLoss( targetMD.first, output );
 
 	*totalLoss += loss;
 
-	loss /= chunkEnd - chunkBegin;
+	loss /= count;
 
 	if( gx_is_inner_debug ) {
-		printf( "DEBUG: input #%ld loss %.8f totalLoss %.8f\n", chunkBegin, loss, *totalLoss );
+		printf( "DEBUG: input #%ld loss %.8f totalLoss %.8f\n", std::get<1>( ctx->getChunkInfo() ), loss, *totalLoss );
 	}
 
 	return true;
 }
 
-bool Network :: trainInternal( const DataMatrix & input, const DataMatrix & target,
-		const CmdArgs_t & args, DataVector * losses )
+bool Network :: trainInternal( const TrainingData & data, Dataset * dataset, const CmdArgs_t & args, DataVector * losses )
 {
-	if( input.size() != target.size() ) return false;
+	// the shard in training, a stream keeps no other shard but the prefetched one
+	ByteDataset shardInput;
+	LabelDataset shardTarget;
+
+	if( NULL != dataset && ! dataset->load( 0, &shardInput, &shardTarget ) ) return false;
+
+	TrainingData part = NULL == dataset ? data : TrainingData( NULL, NULL, &shardInput, &shardTarget );
+
+	const DataMatrix * matrix = std::get<0>( part );
+	const ByteDataset * bytes = std::get<2>( part );
+	const DataMatrix * target = std::get<1>( part );
+	const LabelDataset * labels = std::get<3>( part );
+
+	size_t inputCount = NULL != dataset ? dataset->size() : ( NULL != bytes ? bytes->size() : matrix->size() );
+	size_t targetCount = NULL != dataset ? dataset->size() : ( NULL != labels ? labels->size() : target->size() );
+
+	if( inputCount != targetCount ) return false;
+
+	// one shot, the epochs below retrain the smaller network
+	if( args.mPruneFilterRatio > 0 ) {
+		printf( "prune %d filters\n", pruneFilters( args.mPruneFilterRatio ) );
+	}
+
+	if( args.mLowRankEnergy > 0 ) {
+		printf( "factorize %d layers\n", factorize( args.mLowRankEnergy ) );
+	}
+
+	if( args.mIsBinary ) {
+		printf( "binary: %d binary layers\n", prepareBinary() );
+	}
+
+	if( args.mIsQat ) {
+		DataMatrix calibration;
+
+		if( NULL != bytes ) {
+			bytes->toMatrix( &calibration, 1000 );
+		} else {
+			calibration.assign( matrix->begin(), matrix->begin() + std::min( matrix->size(), (size_t)1000 ) );
+		}
+
+		printf( "qat: insert %d fake quant layers\n", prepareQat( calibration ) );
+	}
 
 	setTraining( true );
 
 	time_t beginTime = time( NULL );
 
 	printf( "%s\tstart train, input { %zu }, target { %zu }\n",
-			ctime( &beginTime ), input.size(), target.size() );
+			ctime( &beginTime ), inputCount, targetCount );
 
 	int logInterval = args.mEpochCount / 10;
-	int progressInterval = ( input.size() / args.mMiniBatchCount ) / 10;
+	int progressInterval = ( inputCount / args.mMiniBatchCount ) / 10;
 
 	std::random_device rd;
 	std::mt19937 gen( rd() );
 
 	NetworkContext ctx;
 	initCtx( &ctx );
-	ctx.setTrainingData( TrainingData( &input, &target ) );
+	ctx.setTrainingData( part );
+
+	// fresh transforms every epoch, the same ranges the offline rotation used
+	if( args.mIsDataAug && NULL != bytes && bytes->getSampleDims().size() >= 2 ) {
+		ctx.getAugment().setRotation( 15 );
+		ctx.getAugment().setShift( 2 );
+		ctx.getAugment().setCenterRatio( 0.5 );
+	}
 
 	std::unique_ptr< Optim > optim( Optim::SGD( args.mLearningRate, args.mLambda ) );
 
@@ -421,48 +1035,112 @@ bool Network :: trainInternal( const DataMatrix & input, const DataMatrix & targ
 
 	for( int n = 0; n < args.mEpochCount; n++ ) {
 
-		IntVector idxOfData( input.size() );
-		std::iota( idxOfData.begin(), idxOfData.end(), 0 );
-		if( args.mIsShuffle ) std::shuffle( idxOfData.begin(), idxOfData.end(), gen );
+		// gradual pruning, the cubic ramp prunes most in the early epochs and
+		// reaches the target on the last one, the epochs in between fine-tune
+		if( args.mPruneSparsity > 0 ) {
+			DataType progress = DataType( n + 1 ) / args.mEpochCount;
+			DataType sparsity = args.mPruneSparsity * ( 1 - std::pow( 1 - progress, 3 ) );
+
+			printf( "\33[2K\rprune %d layers to sparsity %.4f\n", prune( sparsity ), sparsity );
+		}
+
+		// in memory data is one shard, the shard order is shuffled, then the samples inside
+		IntVector shardOrder( NULL == dataset ? 1 : dataset->getShardCount() );
+		std::iota( shardOrder.begin(), shardOrder.end(), 0 );
+		if( args.mIsShuffle ) std::shuffle( shardOrder.begin(), shardOrder.end(), gen );
 
 		DataType totalLoss = 0;
+		size_t doneCount = 0;
+
+		// the time the training waited for staged mini batches
+		double loaderWait = 0;
+
+		for( size_t k = 0; k < shardOrder.size(); k++ ) {
+			if( NULL != dataset ) {
+				if( ! dataset->load( shardOrder[ k ], &shardInput, &shardTarget ) ) return false;
+
+				if( k + 1 < shardOrder.size() ) dataset->prefetch( shardOrder[ k + 1 ] );
+			}
+
+			// a mapped idx file then reads ahead, or stops reading ahead for the shuffled order,
+			// the block shuffle reads whole blocks, so the default read ahead fits it
+			if( NULL != bytes ) {
+				bytes->advise( ! args.mIsShuffle ? IdxFile::eSequential
+						: ( args.mShuffleBlock > 1 ? IdxFile::eNormal : IdxFile::eRandom ) );
+			}
+
+			IntVector idxOfData( NULL != bytes ? bytes->size() : matrix->size() );
+			std::iota( idxOfData.begin(), idxOfData.end(), 0 );
+
+			// a block of samples stays in the cache while its mini batches are staged
+			if( args.mIsShuffle ) Utils::shuffle( &idxOfData, std::max( args.mShuffleBlock, 0 ), gen );
+
+			int miniBatchCount = std::max( args.mMiniBatchCount, 1 );
+
+			// the main thread trains, the other threads stage the next mini batches
+			std::unique_ptr< BatchLoader > loader;
+
+			if( args.mThreadCount > 1 ) {
+				loader.reset( new BatchLoader( *this, part, idxOfData, miniBatchCount,
+						ctx.getAugment(), args.mThreadCount - 1 ) );
+			}
+
+			for( size_t begin = 0; begin < idxOfData.size(); ) {
+				size_t end = std::min( idxOfData.size(), begin + miniBatchCount );
+
+				ctx.clearBatch();
 
-		int miniBatchCount = std::max( args.mMiniBatchCount, 1 );
+				ctx.setChunkInfo( ChunkInfo( &idxOfData, begin, end ) );
 
-		for( size_t begin = 0; begin < idxOfData.size(); ) {
-			size_t end = std::min( idxOfData.size(), begin + miniBatchCount );
+				if( NULL != loader ) {
+					StagedBatch * batch = loader->next();
 
-			ctx.clearBatch();
+					if( NULL == batch ) return false;
 
-			ctx.setChunkInfo( ChunkInfo( &idxOfData, begin, end ) );
+					// the loader refills the buffers of the previous batch
+					std::swap( ctx.getInput(), batch->mInput );
+					std::swap( ctx.getTarget(), batch->mTarget );
+					std::swap( ctx.getLabels(), batch->mLabels );
 
-			trainMiniBatch( &ctx, &totalLoss );
+					loader->recycle( batch );
 
-			if( gx_is_inner_debug ) Utils::printCtx( "batch", ctx.getBatchBwdCtx() );
+					trainStaged( &ctx, &totalLoss );
+				} else {
+					trainMiniBatch( &ctx, &totalLoss );
+				}
 
-			apply( &ctx, optim.get(), input.size(), end - begin );
+				if( gx_is_inner_debug ) Utils::printCtx( "batch", ctx.getBatchBwdCtx() );
 
-			if( gx_is_inner_debug ) print( true );
+				apply( &ctx, optim.get(), inputCount, end - begin );
 
-			if( progressInterval > 0 && 0 == ( begin % ( progressInterval * miniBatchCount ) ) ) {
-				printf( "\33[2K\r%zu / %zu, loss %.8f", end, idxOfData.size(), totalLoss / end );
-				fflush( stdout );
+				if( gx_is_inner_debug ) print( true );
+
+				if( progressInterval > 0 && 0 == ( begin % ( progressInterval * miniBatchCount ) ) ) {
+					printf( "\33[2K\r%zu / %zu, loss %.8f", doneCount + end, inputCount, totalLoss / ( doneCount + end ) );
+					fflush( stdout );
+				}
+
+				begin += miniBatchCount;
+				end = begin + miniBatchCount;
 			}
 
-			begin += miniBatchCount;
-			end = begin + miniBatchCount;
+			doneCount += idxOfData.size();
+
+			if( NULL != loader ) loaderWait += loader->getWaitSeconds();
 		}
 
-		if( NULL != losses ) ( *losses )[ n ] = totalLoss / input.size();
+		if( NULL != losses ) ( *losses )[ n ] = totalLoss / inputCount;
 
 		if( logInterval <= 1 || ( logInterval > 1 && 0 == n % logInterval ) || n == ( args.mEpochCount - 1 ) ) {
 			time_t currTime = time( NULL );
-			printf( "\33[2K\r%s\tinterval %ld [>] epoch %d, lr %f, loss %.8f\n",
-				ctime( &currTime ), currTime - beginTime, n, args.mLearningRate, totalLoss / input.size() );
+			printf( "\33[2K\r%s\tinterval %ld [>] epoch %d, lr %f, loss %.8f",
+				ctime( &currTime ), currTime - beginTime, n, args.mLearningRate, totalLoss / inputCount );
+			if( args.mThreadCount > 1 ) printf( ", loader wait %.3f s", loaderWait );
+			printf( "\n" );
 			beginTime = time( NULL );
 		}
 
-		if( mOnEpochEnd ) mOnEpochEnd( *this, n, totalLoss / input.size() );
+		if( mOnEpochEnd ) mOnEpochEnd( *this, n, totalLoss / inputCount );
 	}
 
 	return true;
@@ -473,7 +1151,7 @@ bool Network :: train( const DataMatrix & input, const DataMatrix & target,
 {
 	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();	
 
-	bool ret = trainInternal( input, target, args, losses );
+	bool ret = trainInternal( TrainingData( &input, &target, NULL, NULL ), NULL, args, losses );
 
 	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();	
 
@@ -484,6 +1162,53 @@ bool Network :: train( const DataMatrix & input, const DataMatrix & target,
 	return ret;
 }
 
+bool Network :: train( const ByteDataset & input, const DataMatrix & target,
+		const CmdArgs_t & args, DataVector * losses )
+{
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	bool ret = trainInternal( TrainingData( NULL, &target, &input, NULL ), NULL, args, losses );
+
+	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+	auto timeSpan = std::chrono::duration_cast<std::chrono::milliseconds>( endTime - beginTime );
+
+	printf( "Elapsed time: %.3f\n", timeSpan.count() / 1000.0 );
+
+	return ret;
+}
+
+bool Network :: train( const ByteDataset & input, const LabelDataset & target,
+		const CmdArgs_t & args, DataVector * losses )
+{
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	bool ret = trainInternal( TrainingData( NULL, NULL, &input, &target ), NULL, args, losses );
+
+	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+	auto timeSpan = std::chrono::duration_cast<std::chrono::milliseconds>( endTime - beginTime );
+
+	printf( "Elapsed time: %.3f\n", timeSpan.count() / 1000.0 );
+
+	return ret;
+}
+
+bool Network :: train( Dataset & dataset, const CmdArgs_t & args, DataVector * losses )
+{
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	bool ret = trainInternal( TrainingData( NULL, NULL, NULL, NULL ), &dataset, args, losses );
+
+	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+	auto timeSpan = std::chrono::duration_cast<std::chrono::milliseconds>( endTime - beginTime );
+
+	printf( "Elapsed time: %.3f\n", timeSpan.count() / 1000.0 );
+
+	return ret;
+}
+
 
 }; // namespace gxnet;
 
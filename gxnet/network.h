@@ -5,6 +5,7 @@
 #include "context.h"
 #include "optim.h"
 #include "utils.h"
+#include "dataset.h"
 
 #include <tuple>
 
@@ -14,9 +15,12 @@ class Network;
 
 typedef void ( * OnEpochEnd_t )( Network & network, int epoch, DataType loss );
 
+// one of the two inputs is NULL, and one of the two targets
 typedef std::tuple<
 			const DataMatrix * /* input */,
-			const DataMatrix * /* target */
+			const DataMatrix * /* target */,
+			const ByteDataset * /* input */,
+			const LabelDataset * /* target */
 		> TrainingData;
 
 typedef std::tuple<
@@ -50,6 +54,9 @@ public:
 
 	MDVector & getTarget();
 
+	// the class indexes of the mini batch, for the label targets
+	IntVector & getLabels();
+
 	// mini batch backward context
 	BackwardContext * getBatchBwdCtx( size_t index );
 
@@ -59,6 +66,9 @@ public:
 
 	void addToBatch();
 
+	// the byte samples pass through it while a mini batch is staged
+	Augment & getAugment();
+
 private:
 	BaseLayerContextPtrVector mLayerCtx;
 	BackwardContextPtrVector mBatchBwdCtx;
@@ -67,6 +77,9 @@ private:
 	ChunkInfo mChunkInfo;
 
 	MDVector mInput, mTarget;
+	IntVector mLabels;
+
+	Augment mAugment;
 };
 
 class Network {
@@ -99,15 +112,92 @@ public:
 	bool train( const DataMatrix & input, const DataMatrix & target, const CmdArgs_t & args,
 			DataVector * losses = nullptr );
 
+	// the uint8 input is converted to DataType one mini batch at a time
+	bool train( const ByteDataset & input, const DataMatrix & target, const CmdArgs_t & args,
+			DataVector * losses = nullptr );
+
+	// the one-hot targets are built, or skipped for cross entropy, one mini batch at a time
+	bool train( const ByteDataset & input, const LabelDataset & target, const CmdArgs_t & args,
+			DataVector * losses = nullptr );
+
+	// one shard of the stream in memory at a time, and the next one read ahead
+	bool train( Dataset & dataset, const CmdArgs_t & args, DataVector * losses = nullptr );
+
 	void print( bool isDetail = false ) const;
 
+	/**
+	 * Fold every BatchNormLayer into the preceding FullConn/Conv layer, which must have
+	 * no activation, the BatchNorm activation moves to that layer. Returns the folded count.
+	 */
+	int foldBatchNorm();
+
+	/**
+	 * Switch every FullConn/ConvEx layer to int8 storage, the per-tensor input scale of each
+	 * layer comes from the max abs input over the calibration data, or from the FakeQuantLayer
+	 * in front of it, which is then removed. Returns the quantized count.
+	 */
+	int quantize( const DataMatrix & calibration );
+
+	/**
+	 * Quantization-aware training, put a FakeQuantLayer with a calibrated scale in front of
+	 * every FullConn/ConvEx layer that has none, and round their weights to the int8 grid.
+	 * Returns the inserted count.
+	 */
+	int prepareQat( const DataMatrix & calibration );
+
+	/**
+	 * Binary training, run every FullConn layer on binary weights, with a BinarizeLayer in front,
+	 * except the first and the last FullConn/ConvEx layers. ConvEx layers stay in DataType, the
+	 * eBinary storage scales each input patch, not each sample. Returns the binary layer count.
+	 */
+	int prepareBinary();
+
+	/**
+	 * Switch the layers trained by prepareBinary to PackedRows::eBinary storage and remove
+	 * the BinarizeLayers, the storage binarizes its input rows itself. Returns the switched count.
+	 */
+	int binarize();
+
+	// magnitude prune every FullConn layer to the sparsity, returns the pruned count
+	int prune( DataType sparsity );
+
+	/**
+	 * Remove the ratio of filters with the smallest L1 norm from every Conv/ConvEx layer,
+	 * and shrink the channels of the layers up to the next Conv/ConvEx/FullConn layer,
+	 * so the network gets physically smaller. Layers whose channels reach the output are
+	 * left alone. Returns the removed filter count.
+	 */
+	int pruneFilters( DataType ratio );
+
+	/**
+	 * Replace every FullConn layer (R,C) with two thin FullConn layers (K,C) and (R,K) from
+	 * the truncated SVD of its weights, K keeps the energy ratio of the squared singular values.
+	 * Layers where K * ( R + C ) would not beat R * C are left alone. Returns the replaced count.
+	 */
+	int factorize( DataType energy );
+
 	bool trainMiniBatch( NetworkContext * ctx, DataType * totalLoss );
 
+	/**
+	 * Copy or normalize the samples of the chunk into one mini batch, with the one-hot rows,
+	 * or only the class indexes for cross entropy. Touches no network state, so the
+	 * BatchLoader threads call it while the network trains the previous batch.
+	 */
+	void stageMiniBatch( const TrainingData & data, const ChunkInfo & chunk, Augment * augment,
+			MDVector * input4batch, MDVector * target4batch, IntVector * labels4batch ) const;
+
 private:
 
+	// the mini batch already in the input, target and labels of the ctx
+	bool trainStaged( NetworkContext * ctx, DataType * totalLoss );
+
 	bool forward( NetworkContext * ctx ) const;
 
-	bool backward( NetworkContext * ctx, const MDVector & targetMD ) const;
+	// max abs input of every layer over the data
+	void calibrate( const DataMatrix & input, DataVector * maxAbs ) const;
+
+	// for cross entropy, labels can replace the one-hot targetMD
+	bool backward( NetworkContext * ctx, const MDVector & targetMD, const IntVector * labels = NULL ) const;
 
 	void collect( NetworkContext * ctx ) const;
 
@@ -115,7 +205,11 @@ private:
 
 	DataType calcLoss( const DataVector & target, const DataVector & output );
 
-	bool trainInternal( const DataMatrix & input, const DataMatrix & target, const CmdArgs_t & args,
+	// cross entropy of the output rows against their class indexes
+	DataType calcLoss( const IntVector & labels, const DataVector & output );
+
+	// data is ignored for a dataset stream, which provides the shards instead
+	bool trainInternal( const TrainingData & data, Dataset * dataset, const CmdArgs_t & args,
 			DataVector * losses = nullptr );
 
 private:
@@ -0,0 +1,386 @@
+#include "packed.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+namespace gxnet {
+
+PackedRows :: PackedRows()
+{
+	mType = eNone;
+	mRows = mCols = 0;
+	mInScale = 0;
+	mWords = 0;
+}
+
+PackedRows :: ~PackedRows()
+{
+}
+
+int PackedRows :: getType() const
+{
+	return mType;
+}
+
+size_t PackedRows :: getRows() const
+{
+	return mRows;
+}
+
+size_t PackedRows :: getCols() const
+{
+	return mCols;
+}
+
+DataType PackedRows :: getInScale() const
+{
+	return mInScale;
+}
+
+const DataVector & PackedRows :: getScales() const
+{
+	return mScales;
+}
+
+void PackedRows :: getInt8Row( size_t row, IntVector * values ) const
+{
+	assert( eInt8 == mType && row < mRows );
+
+	values->assign( mInt8.begin() + row * mCols, mInt8.begin() + ( row + 1 ) * mCols );
+}
+
+void PackedRows :: getBinaryRow( size_t row, std::vector< uint64_t > * words ) const
+{
+	assert( eBinary == mType && row < mRows );
+
+	words->assign( mBits.begin() + row * mWords, mBits.begin() + ( row + 1 ) * mWords );
+}
+
+const std::vector< uint32_t > & PackedRows :: getRowPtr() const
+{
+	return mRowPtr;
+}
+
+const std::vector< uint32_t > & PackedRows :: getColIdx() const
+{
+	return mColIdx;
+}
+
+const DataVector & PackedRows :: getValues() const
+{
+	return mValues;
+}
+
+void PackedRows :: pack( const MDSpanRO & rows, int type, DataType inScale )
+{
+	assert( rows.dims().size() == 2 );
+
+	if( ( eBF16 == type || eFP16 == type ) && rows.dim( 0 ) * rows.dim( 1 ) * sizeof( DataType ) < eHalfMinBytes ) {
+		type = eNone;
+	}
+
+	mType = type;
+	mRows = rows.dim( 0 );
+	mCols = rows.dim( 1 );
+	mInScale = inScale;
+
+	mHalf.clear();
+	mScales.resize( 0 );
+	mInt8.clear();
+	mRowSums.clear();
+	mRowPtr.clear();
+	mColIdx.clear();
+	mValues.resize( 0 );
+	mWords = 0;
+	mBits.clear();
+
+	size_t total = mRows * mCols;
+
+	if( eBF16 == mType || eFP16 == mType ) {
+		mHalf.resize( total );
+		for( size_t i = 0; i < total; i++ ) {
+			mHalf[ i ] = eBF16 == mType ? float2bf16( rows( i ) ) : float2fp16( rows( i ) );
+		}
+	}
+
+	if( eInt8 == mType ) {
+		mScales.resize( mRows );
+		mInt8.resize( total );
+		mRowSums.resize( mRows );
+
+		for( size_t r = 0; r < mRows; r++ ) {
+			const DataType * row = rows.data() + r * mCols;
+
+			DataType maxAbs = 0;
+			for( size_t i = 0; i < mCols; i++ ) maxAbs = std::max( maxAbs, std::abs( row[ i ] ) );
+
+			// symmetric, the largest weight of the row maps to 127
+			mScales[ r ] = maxAbs > 0 ? maxAbs / 127 : 1;
+
+			int32_t sum = 0;
+			for( size_t i = 0; i < mCols; i++ ) {
+				mInt8[ r * mCols + i ] = quantize( row[ i ] / mScales[ r ] );
+				sum += mInt8[ r * mCols + i ];
+			}
+			mRowSums[ r ] = sum;
+		}
+	}
+
+	if( eCsr == mType ) {
+		// also packs sparse input batches on every forward, so no growing containers
+		const DataType * data = rows.data();
+
+		size_t count = total - std::count( data, data + total, DataType( 0 ) ), k = 0;
+
+		mRowPtr.resize( mRows + 1, 0 );
+		mColIdx.resize( count + 1 );
+		mValues.resize( count );
+
+		// branchless, the zeros of an image are too irregular to predict
+		for( size_t r = 0; r < mRows; r++ ) {
+			for( size_t i = 0; i < mCols; i++ ) {
+				mColIdx[ k ] = i;
+				k += 0 != data[ r * mCols + i ];
+			}
+			mRowPtr[ r + 1 ] = k;
+		}
+
+		mColIdx.resize( count );
+
+		for( size_t r = 0; r < mRows; r++ ) {
+			for( k = mRowPtr[ r ]; k < mRowPtr[ r + 1 ]; k++ ) mValues[ k ] = data[ r * mCols + mColIdx[ k ] ];
+		}
+	}
+
+	if( eBinary == mType ) {
+		mWords = ( mCols + 63 ) / 64;
+		mBits.resize( mRows * mWords );
+		mScales.resize( mRows );
+
+		for( size_t r = 0; r < mRows; r++ ) {
+			const DataType * row = rows.data() + r * mCols;
+
+			DataType sum = 0;
+			for( size_t i = 0; i < mCols; i++ ) sum += std::abs( row[ i ] );
+
+			mScales[ r ] = mCols > 0 ? sum / mCols : 0;
+
+			binarize( row, mCols, mBits.data() + r * mWords );
+		}
+	}
+
+	if( eNone == mType ) {
+		mRows = mCols = 0;
+		mInScale = 0;
+		mHalf.shrink_to_fit();
+		mInt8.shrink_to_fit();
+		mRowPtr.shrink_to_fit();
+		mColIdx.shrink_to_fit();
+		mBits.shrink_to_fit();
+	}
+}
+
+void PackedRows :: rowsProduct( const MDSpanRO & x, const DataVector & biases,
+		bool isPackedFirst, DataType * c, PackedScratch * scratch ) const
+{
+	assert( x.dim( 1 ) == mCols && biases.size() == mRows );
+
+	size_t count = x.dim( 0 );
+
+	DataVector & tmp = scratch->mTmp;
+
+	if( isPackedFirst && tmp.size() < count * mRows ) tmp.resize( count * mRows );
+
+	// the kernels write c dims (N,R)
+	DataType * out = isPackedFirst ? std::begin( tmp ) : c;
+
+	if( eInt8 == mType ) {
+		int8Product( x, out, scratch );
+	} else if( eBinary == mType ) {
+		binaryProduct( x, out );
+	} else if( eCsr == mType ) {
+		gx_kernels().mRowsProductCsr( x.data(), count, mCols, mRowPtr.data(), mColIdx.data(),
+				std::begin( mValues ), mRows, out );
+	} else {
+		auto product = eBF16 == mType ? gx_kernels().mRowsProductBF16 : gx_kernels().mRowsProductFP16;
+
+		product( x.data(), count, mHalf.data(), mRows, mCols, out );
+	}
+
+	for( size_t n = 0; n < count; n++ ) {
+		for( size_t r = 0; r < mRows; r++ ) out[ n * mRows + r ] += biases[ r ];
+	}
+
+	if( isPackedFirst ) {
+		for( size_t r = 0; r < mRows; r++ ) {
+			for( size_t n = 0; n < count; n++ ) c[ r * count + n ] = tmp[ n * mRows + r ];
+		}
+	}
+}
+
+// c dims (N,R) without biases
+void PackedRows :: int8Product( const MDSpanRO & x, DataType * c, PackedScratch * scratch ) const
+{
+	size_t count = x.dim( 0 ), total = count * mCols;
+
+	const DataType * xPtr = x.data();
+
+	DataType inScale = mInScale;
+
+	if( inScale <= 0 ) {
+		DataType maxAbs = 0;
+		for( size_t i = 0; i < total; i++ ) maxAbs = std::max( maxAbs, std::abs( xPtr[ i ] ) );
+
+		inScale = maxAbs > 0 ? maxAbs / 127 : 1;
+	}
+
+	// x + 128 fits the unsigned operand of the kernel, the row sums take the 128 back out
+	std::vector< uint8_t > & qx = scratch->mQuantized;
+	std::vector< int32_t > & acc = scratch->mAcc;
+
+	qx.resize( total );
+	acc.resize( count * mRows );
+
+	DataType inv = 1 / inScale;
+
+	for( size_t i = 0; i < total; i++ ) qx[ i ] = 128 + quantize( xPtr[ i ] * inv );
+
+	gx_kernels().mRowsProductInt8( qx.data(), count, mInt8.data(), mRows, mCols, acc.data() );
+
+	for( size_t n = 0; n < count; n++ ) {
+		for( size_t r = 0; r < mRows; r++ ) {
+			c[ n * mRows + r ] = ( acc[ n * mRows + r ] - 128 * mRowSums[ r ] ) * inScale * mScales[ r ];
+		}
+	}
+}
+
+// c dims (N,R) without biases, each input row gets its own scale, the mean abs input
+void PackedRows :: binaryProduct( const MDSpanRO & x, DataType * c ) const
+{
+	size_t count = x.dim( 0 );
+
+	std::vector< uint64_t > bits( count * mWords );
+	std::vector< DataType > inScales( count );
+
+	for( size_t n = 0; n < count; n++ ) {
+		const DataType * row = x.data() + n * mCols;
+
+		DataType sum = 0;
+		for( size_t i = 0; i < mCols; i++ ) sum += std::abs( row[ i ] );
+
+		inScales[ n ] = mCols > 0 ? sum / mCols : 0;
+
+		binarize( row, mCols, bits.data() + n * mWords );
+	}
+
+	std::vector< int32_t > mismatch( count * mRows );
+
+	gx_kernels().mRowsProductBinary( bits.data(), count, mBits.data(), mRows, mWords, mismatch.data() );
+
+	// the +-1 inner product is matches - mismatches
+	for( size_t n = 0; n < count; n++ ) {
+		for( size_t r = 0; r < mRows; r++ ) {
+			c[ n * mRows + r ] = DataType( (int32_t)mCols - 2 * mismatch[ n * mRows + r ] ) * inScales[ n ] * mScales[ r ];
+		}
+	}
+}
+
+void PackedRows :: fakeQuantRows( const MDSpanRO & rows, int type, DataType * out )
+{
+	PackedRows packed;
+	packed.pack( rows, type );
+
+	for( size_t r = 0; r < packed.mRows; r++ ) {
+		for( size_t i = 0; i < packed.mCols; i++ ) {
+			if( eBinary == type ) {
+				bool isNegative = ( packed.mBits[ r * packed.mWords + i / 64 ] >> ( i % 64 ) ) & 1;
+				out[ r * packed.mCols + i ] = isNegative ? -packed.mScales[ r ] : packed.mScales[ r ];
+			} else {
+				out[ r * packed.mCols + i ] = packed.mInt8[ r * packed.mCols + i ] * packed.mScales[ r ];
+			}
+		}
+	}
+}
+
+void PackedRows :: binarize( const DataType * values, size_t count, uint64_t * words )
+{
+	for( size_t w = 0; w < ( count + 63 ) / 64; w++ ) words[ w ] = 0;
+
+	for( size_t i = 0; i < count; i++ ) {
+		if( values[ i ] < 0 ) words[ i / 64 ] |= uint64_t( 1 ) << ( i % 64 );
+	}
+}
+
+const char * PackedRows :: type2name( int type )
+{
+	if( eBF16 == type ) return "bf16";
+	if( eFP16 == type ) return "fp16";
+	if( eInt8 == type ) return "int8";
+	if( eCsr == type ) return "csr";
+	if( eBinary == type ) return "binary";
+
+	return "none";
+}
+
+int PackedRows :: name2type( const char * name )
+{
+	if( 0 == strcmp( name, "none" ) ) return eNone;
+	if( 0 == strcmp( name, "bf16" ) ) return eBF16;
+	if( 0 == strcmp( name, "fp16" ) ) return eFP16;
+	if( 0 == strcmp( name, "int8" ) ) return eInt8;
+	if( 0 == strcmp( name, "csr" ) ) return eCsr;
+	if( 0 == strcmp( name, "binary" ) ) return eBinary;
+
+	return -1;
+}
+
+uint16_t PackedRows :: float2bf16( float value )
+{
+	uint32_t bits = 0;
+	memcpy( &bits, &value, sizeof( bits ) );
+
+	// keep nan as a quiet nan
+	if( ( bits & 0x7fffffff ) > 0x7f800000 ) return ( bits >> 16 ) | 0x40;
+
+	// round to nearest even
+	bits += 0x7fff + ( ( bits >> 16 ) & 1 );
+
+	return bits >> 16;
+}
+
+uint16_t PackedRows :: float2fp16( float value )
+{
+	uint32_t bits = 0;
+	memcpy( &bits, &value, sizeof( bits ) );
+
+	uint32_t sign = ( bits >> 16 ) & 0x8000, mant = bits & 0x7fffff;
+	int exp = (int)( ( bits >> 23 ) & 0xff ) - 127 + 15;
+
+	if( 0xff == ( ( bits >> 23 ) & 0xff ) ) return sign | 0x7c00 | ( mant ? 0x200 : 0 );
+
+	if( exp >= 31 ) return sign | 0x7c00;
+
+	if( exp <= 0 ) {
+		if( exp < -10 ) return sign;
+
+		// subnormal
+		mant |= 0x800000;
+
+		uint32_t shift = 14 - exp, half = mant >> shift;
+		uint32_t rem = mant & ( ( 1u << shift ) - 1 ), mid = 1u << ( shift - 1 );
+
+		if( rem > mid || ( rem == mid && ( half & 1 ) ) ) half++;
+
+		return sign | half;
+	}
+
+	uint32_t half = ( exp << 10 ) | ( mant >> 13 ), rem = mant & 0x1fff;
+
+	// round to nearest even, a carry into the exponent is still correct
+	if( rem > 0x1000 || ( rem == 0x1000 && ( half & 1 ) ) ) half++;
+
+	return sign | half;
+}
+
+}; // namespace gxnet;
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "common.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace gxnet {
+
+// the buffers of PackedRows::rowsProduct, kept by the caller between the calls
+typedef struct tagPackedScratch {
+	// eInt8, the quantized input and the int32 products
+	std::vector< uint8_t > mQuantized;
+	std::vector< int32_t > mAcc;
+
+	// isPackedFirst, the (N,R) product before it is transposed into c
+	DataVector mTmp;
+} PackedScratch;
+
+/**
+ * A compact inference copy of a row-major weight matrix (R,C), each row is the
+ * weights of one neuron or filter. The master weights stay in DataType for training.
+ *
+ * eBF16 and eFP16 only pay off once the dense matrix falls out of the cache, the widening
+ * costs more than the bytes it saves below that, so a matrix under eHalfMinBytes stays eNone.
+ * The activations between the layers stay DataType: they feed the activation functions and
+ * Im2Rows as they are, half ones would cost a conversion pass in and out of every layer,
+ * and the bytes they would save are small next to the weights of the big layers.
+ *
+ * eInt8 keeps one scale per row and quantizes the input with one scale per tensor,
+ * the input scale comes from calibration, or from the input itself when it is 0.
+ *
+ * eCsr keeps only the nonzero weights in compressed sparse rows, for pruned layers.
+ *
+ * eBinary keeps the sign bit of each weight and one scale per row, the mean abs weight.
+ * The input rows are binarized the same way, so an inner product is popcounts over 64-bit words.
+ */
+class PackedRows {
+public:
+	enum { eNone = 0, eBF16 = 1, eFP16 = 2, eInt8 = 3, eCsr = 4, eBinary = 5 };
+
+	// about the size of a L2 cache, 512x512 in double
+	enum { eHalfMinBytes = 2 * 1024 * 1024 };
+
+public:
+	PackedRows();
+	~PackedRows();
+
+	// rows dims: (R,C), eNone releases the packed copy, inScale is only for eInt8
+	void pack( const MDSpanRO & rows, int type, DataType inScale = 0 );
+
+	int getType() const;
+
+	DataType getInScale() const;
+
+	// eInt8 only, weights of row r = getInt8Row( r ) * getScales()[ r ]
+	// eBinary also, weights of row r = ( bit set ? -1 : 1 ) * getScales()[ r ]
+	const DataVector & getScales() const;
+
+	void getInt8Row( size_t row, IntVector * values ) const;
+
+	// eBinary only, bit c % 64 of word c / 64 is set for a negative weight at column c
+	void getBinaryRow( size_t row, std::vector< uint64_t > * words ) const;
+
+	// eCsr only, the nonzeros of row r are getValues()[ k ] at column getColIdx()[ k ]
+	// for k in [ getRowPtr()[ r ], getRowPtr()[ r + 1 ] )
+	const std::vector< uint32_t > & getRowPtr() const;
+
+	const std::vector< uint32_t > & getColIdx() const;
+
+	const DataVector & getValues() const;
+
+	size_t getRows() const;
+
+	size_t getCols() const;
+
+	/**
+	 * isPackedFirst true: c = packed * xT + biases[ row ], c dims (R,N)
+	 * isPackedFirst false: c = x * packedT + biases[ row ], c dims (N,R)
+	 */
+	void rowsProduct( const MDSpanRO & x, const DataVector & biases, bool isPackedFirst, DataType * c,
+			PackedScratch * scratch ) const;
+
+public:
+
+	static const char * type2name( int type );
+
+	// -1 for unknown name
+	static int name2type( const char * name );
+
+	static uint16_t float2bf16( float value );
+
+	// the int8 grid of eInt8 and fake quantization, value is already divided by its scale
+	static inline int quantize( DataType value )
+	{
+		value = std::clamp( value, DataType( -127 ), DataType( 127 ) );
+
+		return (int)( value + ( value >= 0 ? DataType( 0.5 ) : DataType( -0.5 ) ) );
+	}
+
+	// out = rows rounded to the grid of eInt8 or eBinary, for quantization-aware training
+	static void fakeQuantRows( const MDSpanRO & rows, int type, DataType * out );
+
+	// 64 bits per word, set for the negative values
+	static void binarize( const DataType * values, size_t count, uint64_t * words );
+
+	static uint16_t float2fp16( float value );
+
+private:
+	void int8Product( const MDSpanRO & x, DataType * c, PackedScratch * scratch ) const;
+
+	void binaryProduct( const MDSpanRO & x, DataType * c ) const;
+
+private:
+	int mType;
+	size_t mRows, mCols;
+
+	std::vector< uint16_t > mHalf;
+
+	DataType mInScale;
+	DataVector mScales;
+	std::vector< int8_t > mInt8;
+	std::vector< int32_t > mRowSums;
+
+	std::vector< uint32_t > mRowPtr, mColIdx;
+	DataVector mValues;
+
+	size_t mWords;
+	std::vector< uint64_t > mBits;
+};
+
+}; // namespace gxnet;
@@ -2,6 +2,7 @@
 #include "layer.h"
 #include "context.h"
 #include "optim.h"
+#include "network.h"
 
 #include "utils.h"
 
@@ -12,9 +13,10 @@
 using namespace gxnet;
 
 template< typename TConvLayer >
-void testConvLayer()
+void testConvLayer( size_t stride = 1, size_t padding = 0 )
 {
-	printf( "========== test typename %s ==========\n", typeid( TConvLayer ).name() );
+	printf( "========== test typename %s, stride %zu, padding %zu ==========\n",
+			typeid( TConvLayer ).name(), stride, padding );
 
 	DataVector biases = { 1, 1 };
 
@@ -33,7 +35,7 @@ void testConvLayer()
 
 	Utils::printMDVector( "filters", filters );
 
-	TConvLayer conv( { 2, 4, 4, }, filters, biases );
+	TConvLayer conv( { 2, 4, 4, }, filters, biases, stride, padding );
 
 	conv.print( true );
 
@@ -103,6 +105,225 @@ void testMaxPoolLayer()
 	Utils::printMDVector( "maxpool.inDelta", inDelta );
 }
 
+void testAvgPoolLayer()
+{
+	Dims inDims = { 2, 1, 4, 4 };
+
+	DataVector input( gx_dims_flatten_size( inDims ) );
+	std::iota( std::begin( input ), std::end( input ), 0 );
+
+	MDVector inMD( input, inDims );
+
+	Utils::printMDVector( "input", inMD );
+
+	AvgPoolLayer avgpool( { 1, 4, 4 }, 2 );
+
+	std::unique_ptr< BaseLayerContext > ctx( avgpool.createCtx() );
+	ctx->setInput( &inMD );
+
+	avgpool.forward( ctx.get() );
+
+	Utils::printMDVector( "avgpool.output", ctx->getOutput() );
+
+	MDVector inDelta;
+
+	inDelta.second = ctx->getInput().second;
+	inDelta.first.resize( input.size() );
+	for( size_t i = 0; i < ctx->getDelta().first.size(); i++ ) ctx->getDelta().first[ i ] = i * 0.4;
+
+	avgpool.backward( ctx.get(), &inDelta );
+
+	Utils::printMDVector( "avgpool.inDelta", inDelta );
+}
+
+void testGlobalAvgPoolLayer()
+{
+	Dims inDims = { 2, 2, 3, 3 };
+
+	DataVector input( gx_dims_flatten_size( inDims ) );
+	std::iota( std::begin( input ), std::end( input ), 0 );
+
+	MDVector inMD( input, inDims );
+
+	GlobalAvgPoolLayer gap( { 2, 3, 3 } );
+
+	std::unique_ptr< BaseLayerContext > ctx( gap.createCtx() );
+	ctx->setInput( &inMD );
+
+	gap.forward( ctx.get() );
+
+	Utils::printMDVector( "gap.output", ctx->getOutput() );
+
+	MDVector inDelta;
+
+	inDelta.second = ctx->getInput().second;
+	inDelta.first.resize( input.size() );
+	for( size_t i = 0; i < ctx->getDelta().first.size(); i++ ) ctx->getDelta().first[ i ] = ( i + 1 ) * 0.9;
+
+	gap.backward( ctx.get(), &inDelta );
+
+	Utils::printMDVector( "gap.inDelta", inDelta );
+}
+
+void testDepthwiseSeparable()
+{
+	Dims inDims = { 1, 2, 4, 4 };
+
+	DataVector input( gx_dims_flatten_size( inDims ) );
+	std::iota( std::begin( input ), std::end( input ), 0 );
+
+	MDVector inMD( input, inDims );
+
+	Utils::printMDVector( "input", inMD );
+
+	DepthwiseConvLayer depthwise( { 2, 4, 4 }, 3, 1, 1 );
+	ConvExLayer pointwise( depthwise.getBaseOutDims(), 3, 1 );
+
+	std::unique_ptr< BaseLayerContext > dwCtx( depthwise.createCtx() );
+	std::unique_ptr< BaseLayerContext > pwCtx( pointwise.createCtx() );
+
+	dwCtx->setInput( &inMD );
+	depthwise.forward( dwCtx.get() );
+
+	Utils::printMDVector( "depthwise.output", dwCtx->getOutput() );
+
+	pwCtx->setInput( &( dwCtx->getOutput() ) );
+	pointwise.forward( pwCtx.get() );
+
+	Utils::printMDVector( "pointwise.output", pwCtx->getOutput() );
+
+	pwCtx->getDelta().first = 0.1;
+
+	pointwise.backward( pwCtx.get(), &( dwCtx->getDelta() ) );
+	depthwise.backward( dwCtx.get(), NULL );
+	depthwise.collectGradients( dwCtx.get() );
+
+	Utils::printMDVector( "depthwise.gradients", dwCtx->getGradients() );
+}
+
+bool testBatchNormLayer()
+{
+	Dims inDims = { 2, 2, 3, 3 };
+
+	DataVector input( gx_dims_flatten_size( inDims ) );
+	std::iota( std::begin( input ), std::end( input ), 0 );
+
+	MDVector inMD( input, inDims );
+
+	Utils::printMDVector( "input", inMD );
+
+	BatchNormLayer bn( { 2, 3, 3 } );
+	bn.setTraining( true );
+
+	std::unique_ptr< BaseLayerContext > ctx( bn.createCtx() );
+	ctx->setInput( &inMD );
+
+	bn.forward( ctx.get() );
+
+	MDVector inDelta;
+
+	inDelta.second = ctx->getInput().second;
+	inDelta.first.resize( input.size() );
+	for( size_t i = 0; i < ctx->getDelta().first.size(); i++ ) ctx->getDelta().first[ i ] = i * 0.1;
+
+	bn.backward( ctx.get(), &inDelta );
+	bn.collectGradients( ctx.get() );
+
+	Utils::printMDVector( "batchnorm.gradients", ctx->getGradients() );
+
+	std::unique_ptr< Optim > optim( Optim::SGD( 0.1, 0 ) );
+	bn.applyGradients( *ctx, optim.get(), 2, 2 );
+	bn.updateRunningStats( ctx.get() );
+	bn.print( true );
+
+	// fold into the previous conv layer, the outputs should keep the same
+	Network network;
+	network.addLayer( new ConvExLayer( { 2, 3, 3 }, 2, 2 ) );
+	network.addLayer( new BatchNormLayer( { 2, 2, 2 } ) );
+
+	( (BatchNormLayer*)network.getLayers()[ 1 ] )->setParams(
+			bn.getGamma(), bn.getBeta(), bn.getRunningMean(), bn.getRunningVar() );
+
+	DataVector expected, output;
+	network.forward( DataVector( input[ std::slice( 0, 18, 1 ) ] ), &expected );
+	Utils::printVector( "before.fold", expected );
+
+	int count = network.foldBatchNorm();
+
+	network.forward( DataVector( input[ std::slice( 0, 18, 1 ) ] ), &output );
+	Utils::printVector( "after.fold", output );
+
+	// relative to the outputs, float keeps about 7 digits
+	DataType maxDiff = std::abs( output - expected ).max(), maxOutput = std::abs( expected ).max();
+	bool isOk = 1 == count && output.size() == expected.size()
+			&& maxDiff <= maxOutput * ( sizeof( DataType ) == sizeof( float ) ? 1e-5 : 1e-12 );
+
+	printf( "fold %d layers, max diff %g, max output %g, %s\n", count, maxDiff, maxOutput, isOk ? "ok" : "fail" );
+
+	return isOk;
+}
+
+// zero out the filters, so pruning them keeps the outputs the same
+void zeroFilters( ConvLayer * conv, const std::vector< size_t > & zeros )
+{
+	MDVector filters = conv->getFilters();
+	DataVector biases = conv->getBiases();
+
+	size_t rowSize = filters.first.size() / biases.size();
+
+	for( auto & f : zeros ) {
+		filters.first[ std::slice( f * rowSize, rowSize, 1 ) ] = 0;
+		biases[ f ] = 0;
+	}
+
+	conv->setFilters( filters, biases );
+}
+
+void testPruneFilters()
+{
+	// the layer dumps of the forwards below are too long
+	gx_is_inner_debug = false;
+
+	Network network;
+	network.addLayer( new ConvExLayer( { 1, 8, 8 }, 4, 3 ) );
+	network.addLayer( new MaxPoolLayer( { 4, 6, 6 }, 2 ) );
+	network.addLayer( new BatchNormLayer( { 4, 3, 3 } ) );
+	network.addLayer( new ConvLayer( { 4, 3, 3 }, 2, 2 ) );
+	network.addLayer( new FullConnLayer( { 2, 2, 2 }, 3 ) );
+
+	zeroFilters( (ConvLayer*)network.getLayers()[ 0 ], { 1, 3 } );
+	zeroFilters( (ConvLayer*)network.getLayers()[ 3 ], { 0 } );
+
+	DataVector input( 64 ), output;
+	std::iota( std::begin( input ), std::end( input ), 0 );
+	input /= DataType( 64 );
+
+	network.forward( input, &output );
+	Utils::printVector( "before.prune", output, true );
+
+	printf( "prune %d filters\n", network.pruneFilters( 0.5 ) );
+
+	for( auto & layer : network.getLayers() ) {
+		printf( "type %d, in dims { %s }, out dims { %s }\n", layer->getType(),
+				gx_vector2string( layer->getBaseInDims() ).c_str(),
+				gx_vector2string( layer->getBaseOutDims() ).c_str() );
+	}
+
+	network.forward( input, &output );
+	Utils::printVector( "after.prune", output, true );
+
+	const char * path = "./prune.model";
+
+	Network other;
+
+	if( Utils::save( path, network ) && Utils::load( path, &other ) ) {
+		other.forward( input, &output );
+		Utils::printVector( "after.reload", output, true );
+	}
+
+	remove( path );
+}
+
 int main( int argc, const char * argv[] )
 {
 	gx_is_inner_debug = true;
@@ -111,8 +332,22 @@ int main( int argc, const char * argv[] )
 
 	testConvLayer<ConvExLayer>();
 
-	//testMaxPoolLayer();
+	testConvLayer<ConvLayer>( 2, 1 );
+
+	testConvLayer<ConvExLayer>( 2, 1 );
+
+	testMaxPoolLayer();
+
+	testAvgPoolLayer();
+
+	testGlobalAvgPoolLayer();
+
+	testDepthwiseSeparable();
+
+	bool isOk = testBatchNormLayer();
+
+	testPruneFilters();
 
-	return 0;
+	return isOk ? 0 : -1;
 }
 
@@ -0,0 +1,913 @@
+#include "network.h"
+#include "activation.h"
+#include "dataset.h"
+#include "utils.h"
+#include "eval.h"
+#include "loader.h"
+
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <chrono>
+#include <numeric>
+#include <random>
+
+#include <unistd.h>
+#include <arpa/inet.h>
+
+using namespace gxnet;
+
+// an idx3 file of random images, mostly zeros like mnist
+bool writeImages( const char * path, int count, int rows, int cols )
+{
+	FILE * fp = fopen( path, "wb" );
+
+	if( NULL == fp ) return false;
+
+	int header[ 4 ] = { (int)htonl( 2051 ), (int)htonl( count ), (int)htonl( rows ), (int)htonl( cols ) };
+	fwrite( header, sizeof( header ), 1, fp );
+
+	for( int i = 0; i < count * rows * cols; i++ ) {
+		uint8_t pixel = Utils::random( 0, 1 ) < 0.8 ? 0 : (uint8_t)Utils::random( 0, 255 );
+		fwrite( &pixel, 1, 1, fp );
+	}
+
+	fclose( fp );
+
+	return true;
+}
+
+bool writeLabels( const char * path, int count, int classCount )
+{
+	FILE * fp = fopen( path, "wb" );
+
+	if( NULL == fp ) return false;
+
+	int header[ 2 ] = { (int)htonl( 2049 ), (int)htonl( count ) };
+	fwrite( header, sizeof( header ), 1, fp );
+
+	for( int i = 0; i < count; i++ ) {
+		uint8_t label = i % classCount;
+		fwrite( &label, 1, 1, fp );
+	}
+
+	fclose( fp );
+
+	return true;
+}
+
+void testLoad( const char * path )
+{
+	printf( "========== test load ==========\n" );
+
+	DataMatrix matrix;
+	ByteDataset bytes;
+
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	bool ret = Utils::loadMnistImages( 0, path, &matrix );
+
+	std::chrono::steady_clock::time_point midTime = std::chrono::steady_clock::now();
+
+	ret = Utils::loadMnistImages( 0, path, &bytes ) && ret;
+
+	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+	DataType maxDiff = 0;
+	DataVector sample;
+
+	for( size_t i = 0; i < matrix.size(); i++ ) {
+		bytes.getSample( i, &sample );
+		maxDiff = std::max( maxDiff, std::abs( sample - matrix[ i ] ).max() );
+	}
+
+	// the valarray header and the malloc chunk header of every DataMatrix row
+	size_t matrixSize = matrix.size() * ( sizeof( DataVector ) + 16 + bytes.getSampleSize() * sizeof( DataType ) );
+
+	printf( "\tload %s, %zu / %zu samples, max diff %.6f\n", ret ? "ok" : "fail", bytes.size(), matrix.size(), maxDiff );
+	printf( "\tDataMatrix %zu bytes, %.3f ms\n", matrixSize,
+			std::chrono::duration_cast<std::chrono::microseconds>( midTime - beginTime ).count() / 1000.0 );
+	printf( "\tByteDataset %zu bytes, %.3f ms\n", bytes.getMemorySize(),
+			std::chrono::duration_cast<std::chrono::microseconds>( endTime - midTime ).count() / 1000.0 );
+
+	// the limit counts the samples already loaded, for both loaders
+	DataMatrix limitMatrix;
+	ByteDataset limitBytes;
+
+	for( int i = 0; i < 2; i++ ) {
+		Utils::loadMnistImages( 150, path, &limitMatrix );
+		Utils::loadMnistImages( 150, path, &limitBytes );
+	}
+
+	printf( "\tlimit 150 twice, %zu / %zu samples\n", limitBytes.size(), limitMatrix.size() );
+}
+
+void testIdxFile( const char * path )
+{
+	printf( "========== test idx file ==========\n" );
+
+	IdxFilePtr file( new IdxFile() );
+
+	bool ret = file->open( path );
+
+	printf( "\topen %s, dims { %s }, item size %zu\n", ret ? "ok" : "fail",
+			gx_vector2string( file->getDims() ).c_str(), file->getItemSize() );
+
+	// a view, the dataset holds no copy of the images until it changes
+	ByteDataset bytes;
+	bytes.attach( file, 100 );
+	bytes.advise( IdxFile::eRandom );
+
+	size_t attachedSize = bytes.getMemorySize();
+	int mismatch = 0 != memcmp( bytes.getBytes( 99 ), file->getItem( 99 ), file->getItemSize() );
+
+	bytes.append( file->getItem( 0 ) );
+	mismatch += 0 != memcmp( bytes.getBytes( 99 ), file->getItem( 99 ), file->getItemSize() );
+
+	printf( "\tattach 100, %zu bytes, append then %zu samples, %zu bytes, mismatch %d\n",
+			attachedSize, bytes.size(), bytes.getMemorySize(), mismatch );
+
+	// broken files are refused before any item is read
+	const char * badPath = "./dataset.bad";
+
+	FILE * fp = fopen( badPath, "wb" );
+	uint8_t header[] = { 0, 0, 8, 3, 0, 0, 0, 100, 0, 0, 0, 28, 0, 0, 0, 28, 1, 2, 3 };
+	fwrite( header, sizeof( header ), 1, fp );
+	fclose( fp );
+
+	IdxFile bad;
+	printf( "\ttruncated file %s\n", bad.open( badPath ) ? "accepted" : "refused" );
+
+	header[ 2 ] = 0x0d;
+	fp = fopen( badPath, "wb" );
+	fwrite( header, sizeof( header ), 1, fp );
+	fclose( fp );
+
+	printf( "\tfloat file %s\n", bad.open( badPath ) ? "accepted" : "refused" );
+
+	// 4 items of 2^31 x 2^31 bytes, the size wraps to 0 without the overflow check
+	uint8_t huge[] = { 0, 0, 8, 3, 0, 0, 0, 4, 0x80, 0, 0, 0, 0x80, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8,
+			9, 10, 11, 12, 13, 14, 15, 16 };
+	fp = fopen( badPath, "wb" );
+	fwrite( huge, sizeof( huge ), 1, fp );
+	fclose( fp );
+
+	printf( "\toverflowing dims %s\n", bad.open( badPath ) ? "accepted" : "refused" );
+
+	remove( badPath );
+}
+
+// the gzip of the system is the reference encoder, the test skips without it
+void testGzip( const char * path )
+{
+	printf( "========== test gzip ==========\n" );
+
+	IdxFile raw;
+	raw.open( path );
+
+	const char * gzPath = "./dataset.gz.idx";
+
+	char cmd[ 256 ] = { 0 };
+
+	for( int level : { 1, 9 } ) {
+		snprintf( cmd, sizeof( cmd ), "gzip -%d -c %s > %s.gz", level, path, gzPath );
+
+		if( 0 != system( cmd ) ) {
+			printf( "\tgzip not available, skip\n" );
+			return;
+		}
+
+		IdxFile file;
+
+		std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+		// the missing path falls back to path.gz
+		bool ret = file.open( gzPath );
+
+		std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+		int mismatch = file.getCount() != raw.getCount() || file.getItemSize() != raw.getItemSize();
+		for( size_t i = 0; 0 == mismatch && i < raw.getCount(); i++ ) {
+			mismatch += 0 != memcmp( file.getItem( i ), raw.getItem( i ), raw.getItemSize() );
+		}
+
+		double ms = std::chrono::duration_cast<std::chrono::microseconds>( endTime - beginTime ).count() / 1000.0;
+
+		printf( "\tlevel %d, open %s, %zu items, mismatch %d, %.3f ms, %.1f MB/s\n", level, ret ? "ok" : "fail",
+				file.getCount(), mismatch, ms, raw.getCount() * raw.getItemSize() / 1000.0 / std::max( ms, 0.001 ) );
+	}
+
+	// a flipped byte inside the deflate stream fails the decode or the crc
+	std::string corruptPath = std::string( gzPath ) + ".gz";
+
+	FILE * fp = fopen( corruptPath.c_str(), "r+b" );
+	fseek( fp, 0, SEEK_END );
+	long size = ftell( fp );
+	fseek( fp, size / 2, SEEK_SET );
+	int byte = fgetc( fp );
+	fseek( fp, size / 2, SEEK_SET );
+	fputc( byte ^ 0x10, fp );
+	fclose( fp );
+
+	IdxFile bad;
+	printf( "\tcorrupt file %s\n", bad.open( gzPath ) ? "accepted" : "refused" );
+
+	remove( corruptPath.c_str() );
+}
+
+void testNormalization()
+{
+	printf( "========== test normalization ==========\n" );
+
+	ByteDataset bytes( 256 );
+
+	uint8_t sample[ 256 ];
+	for( int i = 0; i < 256; i++ ) sample[ i ] = i;
+
+	bytes.append( sample );
+
+	// mnist mean and stddev
+	bytes.setNormalization( 0.1307, 0.3081 );
+
+	DataVector values;
+	bytes.getSample( 0, &values );
+
+	bytes.append( values );
+
+	int mismatch = 0;
+	for( int i = 0; i < 256; i++ ) mismatch += bytes.getBytes( 1 )[ i ] != i;
+
+	printf( "\tbyte 0 -> %.6f, byte 255 -> %.6f, round trip mismatch %d\n", values[ 0 ], values[ 255 ], mismatch );
+}
+
+// quarter turns and whole pixel shifts land on the grid, so they must be exact
+void testAugment( const char * path )
+{
+	printf( "========== test augment ==========\n" );
+
+	ByteDataset bytes;
+	Utils::loadMnistImages( 0, path, &bytes );
+
+	const Dims & dims = bytes.getSampleDims();
+	size_t rows = dims[ 0 ], cols = dims[ 1 ];
+
+	const uint8_t * in = bytes.getBytes( 0 );
+	std::vector< uint8_t > out( bytes.getSampleSize() );
+
+	Augment augment;
+	augment.seed( 1 );
+
+	augment.apply( in, dims, 0, 0, 0, false, out.data() );
+	int identity = memcmp( in, out.data(), out.size() );
+
+	augment.apply( in, dims, 90, 0, 0, false, out.data() );
+
+	int rotate = 0;
+	for( size_t y = 0; y < rows; y++ ) {
+		for( size_t x = 0; x < cols; x++ ) rotate += out[ y * cols + x ] != in[ ( cols - 1 - x ) * cols + y ];
+	}
+
+	augment.apply( in, dims, 0, 3, -2, false, out.data() );
+
+	int shift = 0;
+	for( size_t y = 0; y < rows; y++ ) {
+		for( size_t x = 0; x < cols; x++ ) {
+			bool isInside = x >= 3 && y + 2 < rows;
+			shift += out[ y * cols + x ] != ( isInside ? in[ ( y + 2 ) * cols + x - 3 ] : 0 );
+		}
+	}
+
+	printf( "\tmismatch identity %d, rotate 90 %d, shift %d\n", identity, rotate, shift );
+
+	// the simd rows against the portable ones, byte for byte
+	std::vector< uint8_t > image( ( rows + 3 ) * ( cols + 3 ) + 4, 0 ), simdRow( cols ), plainRow( cols );
+	for( size_t y = 0; y < rows; y++ ) memcpy( image.data() + ( y + 1 ) * ( cols + 3 ) + 1, in + y * cols, cols );
+
+	int kernelMismatch = 0;
+
+	for( int i = 0; i < 1000; i++ ) {
+		float radian = Utils::random( -1, 1 ), srcX = Utils::random( -5, cols + 5 ), srcY = Utils::random( -5, rows + 5 );
+
+		gx_kernels().mBilinearRow( image.data(), cols + 3, cols + 1, rows + 1, srcX, srcY,
+				std::cos( radian ), -std::sin( radian ), cols, simdRow.data() );
+		generic::gKernels.mBilinearRow( image.data(), cols + 3, cols + 1, rows + 1, srcX, srcY,
+				std::cos( radian ), -std::sin( radian ), cols, plainRow.data() );
+
+		for( size_t x = 0; x < cols; x++ ) kernelMismatch += simdRow[ x ] != plainRow[ x ];
+	}
+
+	printf( "\tbilinear row %s, mismatch %d of %zu\n", gx_kernels().mIsa, kernelMismatch, 1000 * cols );
+
+	// a 4 x 6 block in the top left corner
+	std::vector< uint8_t > corner( bytes.getSampleSize(), 0 );
+	for( size_t y = 1; y < 5; y++ ) memset( corner.data() + y * cols + 2, 255, 6 );
+
+	augment.apply( corner.data(), dims, 0, 0, 0, true, out.data() );
+
+	int beginY = rows, beginX = cols, endY = -1, endX = -1;
+	for( size_t i = 0; i < out.size(); i++ ) {
+		if( out[ i ] < 128 ) continue;
+		beginY = std::min( beginY, (int)( i / cols ) );
+		beginX = std::min( beginX, (int)( i % cols ) );
+		endY = std::max( endY, (int)( i / cols ) );
+		endX = std::max( endX, (int)( i % cols ) );
+	}
+
+	printf( "\tcenter block to rows [%d, %d], cols [%d, %d]\n", beginY, endY, beginX, endX );
+
+	augment.setRotation( 15 );
+	augment.setShift( 2 );
+	augment.setCenterRatio( 0.5 );
+
+	DataVector sample( bytes.getSampleSize() );
+
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	for( size_t i = 0; i < bytes.size(); i++ ) bytes.getSample( i, std::begin( sample ), &augment );
+
+	std::chrono::steady_clock::time_point midTime = std::chrono::steady_clock::now();
+
+	for( size_t i = 0; i < bytes.size(); i++ ) bytes.getSample( i, std::begin( sample ) );
+
+	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+	printf( "\tstaging %.3f us per sample augmented, %.3f us plain\n",
+			std::chrono::duration_cast<std::chrono::nanoseconds>( midTime - beginTime ).count() / 1000.0 / bytes.size(),
+			std::chrono::duration_cast<std::chrono::nanoseconds>( endTime - midTime ).count() / 1000.0 / bytes.size() );
+
+	// every epoch stages new transforms, the dataset itself does not grow
+	DataMatrix target;
+
+	for( size_t i = 0; i < bytes.size(); i++ ) {
+		target.emplace_back( DataVector( 0.0, 10 ) );
+		target.back()[ i % 10 ] = 1;
+	}
+
+	Network network;
+
+	network.setLossFuncType( Network::eCrossEntropy );
+
+	BaseLayer * layer = new FullConnLayer( { bytes.getSampleSize() }, 30 );
+	layer->setActFunc( ActFunc::sigmoid() );
+	network.addLayer( layer );
+
+	layer = new FullConnLayer( { 30 }, 10 );
+	layer->setActFunc( ActFunc::softmax() );
+	network.addLayer( layer );
+
+	CmdArgs_t args = {
+		.mEpochCount = 3,
+		.mMiniBatchCount = 10,
+		.mLearningRate = 0.5,
+		.mLambda = 0,
+		.mIsShuffle = true,
+		.mIsDataAug = true
+	};
+
+	size_t memorySize = bytes.getMemorySize();
+
+	DataVector losses;
+	network.train( bytes, target, args, &losses );
+
+	printf( "\ttrain augmented, loss %.6f -> %.6f, dataset %zu -> %zu bytes\n", losses[ 0 ], losses[ losses.size() - 1 ],
+			memorySize, bytes.getMemorySize() );
+}
+
+// both networks start from the same weights, so the losses must match
+void testTrain( const char * path )
+{
+	printf( "========== test train ==========\n" );
+
+	DataMatrix matrix, target;
+	ByteDataset bytes;
+
+	Utils::loadMnistImages( 0, path, &matrix );
+	Utils::loadMnistImages( 0, path, &bytes );
+
+	for( size_t i = 0; i < matrix.size(); i++ ) {
+		target.emplace_back( DataVector( 0.0, 10 ) );
+		target.back()[ i % 10 ] = 1;
+	}
+
+	Network network;
+
+	network.setLossFuncType( Network::eCrossEntropy );
+
+	Network other;
+
+	other.setLossFuncType( Network::eCrossEntropy );
+
+	for( auto item : { &network, &other } ) {
+		BaseLayer * layer = new FullConnLayer( { bytes.getSampleSize() }, 30 );
+		layer->setActFunc( ActFunc::sigmoid() );
+		item->addLayer( layer );
+
+		layer = new FullConnLayer( { 30 }, 10 );
+		layer->setActFunc( ActFunc::softmax() );
+		item->addLayer( layer );
+	}
+
+	for( size_t i = 0; i < network.getLayers().size(); i++ ) {
+		FullConnLayer * fc = (FullConnLayer*)network.getLayers()[ i ];
+		( (FullConnLayer*)other.getLayers()[ i ] )->setWeights( fc->getWeights(), fc->getBiases() );
+	}
+
+	CmdArgs_t args = {
+		.mEpochCount = 3,
+		.mMiniBatchCount = 10,
+		.mLearningRate = 0.5,
+		.mLambda = 0,
+		.mIsShuffle = false
+	};
+
+	DataVector losses, otherLosses;
+
+	network.train( matrix, target, args, &losses );
+	other.train( bytes, target, args, &otherLosses );
+
+	printf( "\tloss %.8f / %.8f, max diff %.8f\n", losses[ losses.size() - 1 ], otherLosses[ otherLosses.size() - 1 ],
+			std::abs( losses - otherLosses ).max() );
+}
+
+// a miss preprocesses and saves, a hit maps the saved samples, any change misses
+void testCache( const char * path )
+{
+	printf( "========== test cache ==========\n" );
+
+	auto preprocess = []( const char * path, ByteDataset * out ) {
+		ByteDataset images;
+		Utils::loadMnistImages( 0, path, &images );
+
+		out->reset( images.getSampleSize() );
+		out->setSampleDims( images.getSampleDims() );
+
+		for( size_t i = 0; i < images.size(); i++ ) {
+			uint8_t * sample = out->extend( 1 );
+			for( size_t j = 0; j < images.getSampleSize(); j++ ) sample[ j ] = 255 - images.getBytes( i )[ j ];
+		}
+	};
+
+	auto run = [&]( const char * params, ByteDataset * out ) {
+		DatasetCache cache;
+		cache.addSource( path );
+		cache.addParams( params );
+
+		bool isHit = cache.load( out );
+
+		if( ! isHit ) {
+			preprocess( path, out );
+			cache.save( *out );
+		}
+
+		return isHit;
+	};
+
+	ByteDataset first, second, third;
+
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	bool isHit = run( "invert", &first );
+
+	std::chrono::steady_clock::time_point midTime = std::chrono::steady_clock::now();
+
+	bool isSecondHit = run( "invert", &second );
+
+	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+	int mismatch = first.size() != second.size() || first.getSampleDims() != second.getSampleDims();
+	for( size_t i = 0; 0 == mismatch && i < first.size(); i++ ) {
+		mismatch += 0 != memcmp( first.getBytes( i ), second.getBytes( i ), first.getSampleSize() );
+	}
+
+	printf( "\tfirst %s %.3f ms, second %s %.3f ms, %zu bytes, mismatch %d\n", isHit ? "hit" : "miss",
+			std::chrono::duration_cast<std::chrono::microseconds>( midTime - beginTime ).count() / 1000.0,
+			isSecondHit ? "hit" : "miss",
+			std::chrono::duration_cast<std::chrono::microseconds>( endTime - midTime ).count() / 1000.0,
+			second.getMemorySize(), mismatch );
+
+	isHit = run( "invert twice", &third );
+
+	printf( "\tother params %s\n", isHit ? "hit" : "miss" );
+
+	// other source bytes, the saved caches of the old contents go away
+	std::vector< std::string > oldPaths;
+
+	for( const char * params : { "invert", "invert twice" } ) {
+		DatasetCache item;
+		item.addSource( path );
+		item.addParams( params );
+		oldPaths.push_back( item.getPath() );
+	}
+
+	writeImages( path, 1000, 28, 28 );
+
+	DatasetCache cache;
+	cache.addSource( path );
+	cache.addParams( "invert" );
+
+	printf( "\tother source %s\n", cache.load( &third ) ? "hit" : "miss" );
+
+	preprocess( path, &third );
+	cache.save( third );
+
+	int stale = 0;
+	for( auto & item : oldPaths ) stale += 0 == access( item.c_str(), F_OK );
+
+	printf( "\tstale caches left %d\n", stale );
+
+	remove( cache.getPath().c_str() );
+}
+
+// the label targets must train exactly like their one-hot rows, for both losses
+void testLabels( const char * path, const char * labelPath )
+{
+	printf( "========== test labels ==========\n" );
+
+	ByteDataset bytes;
+	DataMatrix matrix;
+	LabelDataset labels;
+
+	Utils::loadMnistImages( 0, path, &bytes );
+	Utils::loadMnistLabels( 0, labelPath, &matrix );
+	Utils::loadMnistLabels( 0, labelPath, &labels );
+
+	DataMatrix oneHot;
+	labels.toMatrix( &oneHot );
+
+	DataType maxDiff = 0;
+	for( size_t i = 0; i < matrix.size(); i++ ) maxDiff = std::max( maxDiff, std::abs( oneHot[ i ] - matrix[ i ] ).max() );
+
+	size_t matrixSize = matrix.size() * ( sizeof( DataVector ) + 16 + labels.getClassCount() * sizeof( DataType ) );
+
+	printf( "\tload %zu / %zu labels, %zu classes, max diff %.6f, DataMatrix %zu bytes, LabelDataset %zu bytes\n",
+			labels.size(), matrix.size(), labels.getClassCount(), maxDiff, matrixSize, labels.getMemorySize() );
+
+	for( int lossFuncType : { Network::eCrossEntropy, Network::eMeanSquaredError } ) {
+		Network network( lossFuncType ), other( lossFuncType );
+
+		for( auto item : { &network, &other } ) {
+			BaseLayer * layer = new FullConnLayer( { bytes.getSampleSize() }, 30 );
+			layer->setActFunc( ActFunc::sigmoid() );
+			item->addLayer( layer );
+
+			layer = new FullConnLayer( { 30 }, labels.getClassCount() );
+			layer->setActFunc( Network::eCrossEntropy == lossFuncType ? ActFunc::softmax() : ActFunc::sigmoid() );
+			item->addLayer( layer );
+		}
+
+		for( size_t i = 0; i < network.getLayers().size(); i++ ) {
+			FullConnLayer * fc = (FullConnLayer*)network.getLayers()[ i ];
+			( (FullConnLayer*)other.getLayers()[ i ] )->setWeights( fc->getWeights(), fc->getBiases() );
+		}
+
+		CmdArgs_t args = {
+			.mEpochCount = 2,
+			.mMiniBatchCount = 10,
+			.mLearningRate = 0.5,
+			.mLambda = 0,
+			.mIsShuffle = false
+		};
+
+		DataVector losses, otherLosses;
+
+		network.train( bytes, matrix, args, &losses );
+		other.train( bytes, labels, args, &otherLosses );
+
+		DataMatrix input;
+		bytes.toMatrix( &input );
+
+		printf( "\t%s loss %.8f / %.8f, max diff %.8f, accuracy %.4f / %.4f\n",
+				Network::eCrossEntropy == lossFuncType ? "cross entropy" : "mse",
+				losses[ losses.size() - 1 ], otherLosses[ otherLosses.size() - 1 ], std::abs( losses - otherLosses ).max(),
+				gx_accuracy( network, input, matrix ), gx_accuracy( other, input, labels ) );
+	}
+}
+
+// converted shards read back the same samples and labels, and train like the whole dataset
+void testShards( const char * path, const char * labelPath )
+{
+	printf( "========== test shards ==========\n" );
+
+	const char * prefix = "./dataset.sharded";
+
+	bool ret = ShardedDataset::convert( path, labelPath, prefix, 300 );
+
+	ShardedDataset dataset;
+
+	ret = ret && dataset.open( ( std::string( prefix ) + ".shards" ).c_str() );
+
+	ByteDataset bytes;
+	LabelDataset labels;
+
+	Utils::loadMnistImages( 0, path, &bytes );
+	Utils::loadMnistLabels( 0, labelPath, &labels );
+
+	int mismatch = dataset.size() != bytes.size() || dataset.getSampleDims() != bytes.getSampleDims()
+			|| dataset.getClassCount() != labels.getClassCount();
+
+	for( size_t shard = 0, offset = 0; ret && shard < dataset.getShardCount(); shard++ ) {
+		ByteDataset shardBytes;
+		LabelDataset shardLabels;
+
+		if( shard + 1 < dataset.getShardCount() ) dataset.prefetch( shard + 1 );
+
+		if( ! dataset.load( shard, &shardBytes, &shardLabels ) ) {
+			mismatch++;
+			break;
+		}
+
+		for( size_t i = 0; i < shardBytes.size(); i++, offset++ ) {
+			mismatch += 0 != memcmp( shardBytes.getBytes( i ), bytes.getBytes( offset ), bytes.getSampleSize() );
+			mismatch += shardLabels.get( i ) != labels.get( offset );
+		}
+	}
+
+	printf( "\tconvert %s, %zu samples in %zu shards, mismatch %d\n", ret ? "succ" : "fail",
+			dataset.size(), dataset.getShardCount(), mismatch );
+
+	Network network( Network::eCrossEntropy ), other( Network::eCrossEntropy );
+
+	for( auto item : { &network, &other } ) {
+		BaseLayer * layer = new FullConnLayer( { bytes.getSampleSize() }, 30 );
+		layer->setActFunc( ActFunc::sigmoid() );
+		item->addLayer( layer );
+
+		layer = new FullConnLayer( { 30 }, labels.getClassCount() );
+		layer->setActFunc( ActFunc::softmax() );
+		item->addLayer( layer );
+	}
+
+	for( size_t i = 0; i < network.getLayers().size(); i++ ) {
+		FullConnLayer * fc = (FullConnLayer*)network.getLayers()[ i ];
+		( (FullConnLayer*)other.getLayers()[ i ] )->setWeights( fc->getWeights(), fc->getBiases() );
+	}
+
+	// the shard size is a multiple of the mini batch, so the batches are the same
+	CmdArgs_t args = {
+		.mEpochCount = 2,
+		.mMiniBatchCount = 10,
+		.mLearningRate = 0.5,
+		.mLambda = 0,
+		.mIsShuffle = false
+	};
+
+	DataVector losses, otherLosses;
+
+	network.train( bytes, labels, args, &losses );
+	other.train( dataset, args, &otherLosses );
+
+	printf( "\tloss %.8f / %.8f, max diff %.8f\n", losses[ losses.size() - 1 ],
+			otherLosses[ otherLosses.size() - 1 ], std::abs( losses - otherLosses ).max() );
+
+	args.mIsShuffle = true;
+
+	other.train( dataset, args, &otherLosses );
+
+	printf( "\tshuffled shards, loss %.8f\n", otherLosses[ otherLosses.size() - 1 ] );
+
+	for( size_t shard = 0; shard < dataset.getShardCount(); shard++ ) {
+		char suffix[ 32 ] = { 0 };
+		snprintf( suffix, sizeof( suffix ), ".%05zu", shard );
+
+		remove( ( std::string( prefix ) + suffix + ".images" ).c_str() );
+		remove( ( std::string( prefix ) + suffix + ".labels" ).c_str() );
+	}
+
+	remove( ( std::string( prefix ) + ".shards" ).c_str() );
+}
+
+// the staged batches of the loader threads against the synchronous staging, then
+// training with and without the loader, plain and with augment bound staging
+void testLoader( const char * path, const char * labelPath )
+{
+	printf( "========== test loader ==========\n" );
+
+	ByteDataset bytes;
+	LabelDataset labels;
+
+	Utils::loadMnistImages( 0, path, &bytes );
+	Utils::loadMnistLabels( 0, labelPath, &labels );
+
+	auto createNetwork = [&]( Network * network ) {
+		BaseLayer * layer = new FullConnLayer( { bytes.getSampleSize() }, 30 );
+		layer->setActFunc( ActFunc::sigmoid() );
+		network->addLayer( layer );
+
+		layer = new FullConnLayer( { 30 }, labels.getClassCount() );
+		layer->setActFunc( ActFunc::softmax() );
+		network->addLayer( layer );
+	};
+
+	Network network( Network::eCrossEntropy ), other( Network::eCrossEntropy );
+
+	createNetwork( &network );
+	createNetwork( &other );
+
+	for( size_t i = 0; i < network.getLayers().size(); i++ ) {
+		FullConnLayer * fc = (FullConnLayer*)network.getLayers()[ i ];
+		( (FullConnLayer*)other.getLayers()[ i ] )->setWeights( fc->getWeights(), fc->getBiases() );
+	}
+
+	TrainingData data( NULL, NULL, &bytes, &labels );
+
+	IntVector idxOfData( bytes.size() );
+	std::iota( idxOfData.begin(), idxOfData.end(), 0 );
+	std::shuffle( idxOfData.begin(), idxOfData.end(), std::mt19937( 1 ) );
+
+	const size_t miniBatchCount = 7;
+
+	Augment augment;
+
+	int mismatch = 0;
+	size_t batchCount = 0;
+
+	{
+		BatchLoader loader( network, data, idxOfData, miniBatchCount, augment, 3 );
+
+		MDVector input, target;
+		IntVector batchLabels;
+
+		for( StagedBatch * batch = loader.next(); NULL != batch; batch = loader.next(), batchCount++ ) {
+			size_t begin = batchCount * miniBatchCount, end = std::min( begin + miniBatchCount, idxOfData.size() );
+
+			network.stageMiniBatch( data, ChunkInfo( &idxOfData, begin, end ), NULL, &input, &target, &batchLabels );
+
+			mismatch += batch->mIndex != batchCount || batch->mInput.second != input.second
+					|| batch->mLabels != batchLabels || 0 != std::abs( batch->mInput.first - input.first ).max();
+
+			loader.recycle( batch );
+		}
+
+		mismatch += batchCount != loader.getBatchCount();
+	}
+
+	// the workers blocked on full queues are let go
+	{
+		BatchLoader loader( network, data, idxOfData, miniBatchCount, augment, 3 );
+
+		loader.recycle( loader.next() );
+	}
+
+	printf( "\tstaged %zu batches on 3 threads, mismatch %d, early stop ok\n", batchCount, mismatch );
+
+	CmdArgs_t args = {
+		.mThreadCount = 1,
+		.mEpochCount = 2,
+		.mMiniBatchCount = 10,
+		.mLearningRate = 0.5,
+		.mLambda = 0,
+		.mIsShuffle = true
+	};
+
+	DataVector losses, otherLosses;
+
+	network.train( bytes, labels, args, &losses );
+
+	args.mThreadCount = 4;
+
+	other.train( bytes, labels, args, &otherLosses );
+
+	printf( "\tloss %.8f / %.8f, shuffled batches differ, both finite %d\n", losses[ losses.size() - 1 ],
+			otherLosses[ otherLosses.size() - 1 ], std::isfinite( losses.sum() + otherLosses.sum() ) );
+
+	args.mIsShuffle = false;
+
+	for( size_t i = 0; i < network.getLayers().size(); i++ ) {
+		FullConnLayer * fc = (FullConnLayer*)network.getLayers()[ i ];
+		( (FullConnLayer*)other.getLayers()[ i ] )->setWeights( fc->getWeights(), fc->getBiases() );
+	}
+
+	args.mThreadCount = 1;
+	network.train( bytes, labels, args, &losses );
+
+	args.mThreadCount = 4;
+	other.train( bytes, labels, args, &otherLosses );
+
+	printf( "\tsame order, loss %.8f / %.8f, max diff %.8f\n", losses[ losses.size() - 1 ],
+			otherLosses[ otherLosses.size() - 1 ], std::abs( losses - otherLosses ).max() );
+
+	// the rotation and shift of every sample cost more than the small network
+	args.mIsDataAug = true;
+	args.mEpochCount = 5;
+
+	for( int threadCount : { 1, 2, 4 } ) {
+		args.mThreadCount = threadCount;
+
+		std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+		network.train( bytes, labels, args, &losses );
+
+		std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+		printf( "\tdataaug, thread %d of %u cores, %.2f ms per epoch\n", threadCount, std::thread::hardware_concurrency(),
+				std::chrono::duration_cast<std::chrono::microseconds>( endTime - beginTime ).count() / 1000.0 / args.mEpochCount );
+	}
+}
+
+// full shuffle against block shuffle, staging time of a dataset larger than the cache,
+// and how often two samples of one mini batch meet again in the next epoch
+void testShuffle()
+{
+	printf( "========== test shuffle ==========\n" );
+
+	const size_t count = 100000, sampleSize = 784, miniBatchCount = 16;
+
+	ByteDataset bytes;
+	bytes.reset( sampleSize );
+
+	uint8_t * data = bytes.extend( count );
+	for( size_t i = 0; i < count * sampleSize; i++ ) data[ i ] = i * 2654435761u >> 24;
+
+	std::mt19937 gen( 1 );
+
+	std::vector< DataType > batch( miniBatchCount * sampleSize );
+
+	for( size_t blockSize : { 0, 64, 256, 1024 } ) {
+		IntVector first( count ), second( count ), pos( count );
+
+		std::iota( first.begin(), first.end(), 0 );
+		second = first;
+
+		Utils::shuffle( &first, blockSize, gen );
+		Utils::shuffle( &second, blockSize, gen );
+
+		IntVector sorted( first );
+		std::sort( sorted.begin(), sorted.end() );
+
+		int isPermutation = 1;
+		for( size_t i = 0; i < count; i++ ) isPermutation &= (int)i == sorted[ i ];
+
+		for( size_t i = 0; i < count; i++ ) pos[ second[ i ] ] = i;
+
+		size_t pairs = 0, meets = 0;
+		for( size_t i = 0; i + 1 < count; i++ ) {
+			if( i / miniBatchCount != ( i + 1 ) / miniBatchCount ) continue;
+
+			pairs++;
+			meets += pos[ first[ i ] ] / miniBatchCount == pos[ first[ i + 1 ] ] / miniBatchCount;
+		}
+
+		double displacement = 0;
+		for( size_t i = 0; i < count; i++ ) displacement += std::abs( (double)first[ i ] - (double)i );
+
+		std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+		DataType sum = 0;
+		for( size_t begin = 0; begin < count; begin += miniBatchCount ) {
+			for( size_t i = begin; i < begin + miniBatchCount && i < count; i++ ) {
+				bytes.getSample( first[ i ], batch.data() + ( i - begin ) * sampleSize );
+			}
+			sum += batch[ 0 ];
+		}
+
+		std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+		printf( "\tblock %4zu, permutation %d, mean displacement %.3f, batch pairs met again %.4f, staging %.2f ms, checksum %.0f\n",
+				blockSize, isPermutation, displacement / count / count, double( meets ) / pairs,
+				std::chrono::duration_cast<std::chrono::microseconds>( endTime - beginTime ).count() / 1000.0, sum );
+	}
+}
+
+int main( int argc, const char * argv[] )
+{
+	const char * path = "./dataset.idx";
+
+	if( ! writeImages( path, 1000, 28, 28 ) ) {
+		printf( "write %s fail\n", path );
+		return -1;
+	}
+
+	testLoad( path );
+
+	testIdxFile( path );
+
+	testGzip( path );
+
+	testNormalization();
+
+	testAugment( path );
+
+	testTrain( path );
+
+	testShuffle();
+
+	testCache( path );
+
+	const char * labelPath = "./dataset.labels";
+
+	if( writeLabels( labelPath, 1000, 47 ) ) {
+		testLabels( path, labelPath );
+
+		testShards( path, labelPath );
+
+		testLoader( path, labelPath );
+	}
+
+	remove( labelPath );
+
+	remove( path );
+
+	return 0;
+}
+
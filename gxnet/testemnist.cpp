@@ -3,55 +3,57 @@
 #include "utils.h"
 #include "eval.h"
 
+#include <cstring>
 #include <unistd.h>
 
 using namespace gxnet;
 
-bool loadData( const CmdArgs_t & args, DataMatrix * input, DataMatrix * target,
-		DataMatrix * input4eval, DataMatrix * target4eval )
+bool loadData( const CmdArgs_t & args, ByteDataset * input, LabelDataset * target,
+		DataMatrix * input4eval, LabelDataset * target4eval )
 {
 	const char * path = "emnist/train-images-idx3-ubyte";
-	if( ! Utils::loadMnistImages( args.mTrainingCount, path, input ) ) {
-		printf( "read %s fail\n", path );
-		return false;
-	}
 
-	path = "emnist/train-labels-idx1-ubyte";
-	if( ! Utils::loadMnistLabels( args.mTrainingCount, path, target ) ) {
+	// the images expanded to 32 * 32 are mapped from the cache on later runs
+	DatasetCache cache;
+
+	char params[ 64 ] = { 0 };
+	snprintf( params, sizeof( params ), "images %d, expand 32", args.mTrainingCount );
+
+	if( ! cache.addSource( path ) ) {
 		printf( "read %s fail\n", path );
 		return false;
 	}
 
-	if( args.mIsDataAug ) {
-		// load rotated images
-		path = "emnist/train-images-idx3-ubyte.rot";
-		if( 0 == access( path, F_OK ) ) {
-			if( ! Utils::loadMnistImages( args.mTrainingCount, path, input ) ) {
-				printf( "read %s fail\n", path );
-				return false;
-			}
+	cache.addParams( params );
 
-			path = "emnist/train-labels-idx1-ubyte.rot";
-			if( ! Utils::loadMnistLabels( args.mTrainingCount, path, target ) ) {
-				printf( "read %s fail\n", path );
-				return false;
-			}
+	if( ! cache.load( input ) ) {
+		ByteDataset images;
+
+		if( ! Utils::loadMnistImages( args.mTrainingCount, path, &images ) ) {
+			printf( "read %s fail\n", path );
+			return false;
 		}
 
-		// center mnist images
-		size_t orgSize = input->size();
+		input->reset( 32 * 32 );
+		input->setSampleDims( { 32, 32 } );
+		input->reserve( images.size() );
 
-		for( size_t i = 0; i < orgSize; i++ ) {
-			DataVector newImage;
-			if( Utils::centerMnistImage( input->at( i ), &newImage ) ) {
-				input->emplace_back( newImage );
-				target->emplace_back( target->at( i ) );
-			}
+		for( size_t i = 0; i < images.size(); i++ ) {
+			uint8_t * newImage = input->extend( 1 );
+			for( int x = 0; x < 28; x++ ) memcpy( newImage + ( x + 2 ) * 32 + 2, images.getBytes( i ) + x * 28, 28 );
 		}
 
-		printf( "center %zu images\n", input->size() - orgSize );
+		cache.save( *input );
 	}
 
+	path = "emnist/train-labels-idx1-ubyte";
+	if( ! Utils::loadMnistLabels( args.mTrainingCount, path, target ) ) {
+		printf( "read %s fail\n", path );
+		return false;
+	}
+
+	// args.mIsDataAug rotates, shifts and centers the images while they are staged
+
 	path = "emnist/test-images-idx3-ubyte";
 	if( ! Utils::loadMnistImages( args.mEvalCount, path, input4eval ) ) {
 		printf( "read %s fail\n", path );
@@ -67,12 +69,7 @@ bool loadData( const CmdArgs_t & args, DataMatrix * input, DataMatrix * target,
 	printf( "input { %zu }, target { %zu }, input4eval { %zu }, target4eval { %zu }\n",
 			input->size(), target->size(), input4eval->size(), target4eval->size() );
 
-	// convert to 32 * 32
-	for( auto & item : *input ) {
-		DataVector orgImage = item;
-		Utils::expandMnistImage( orgImage, &item );
-	}
-
+	// convert to 32 * 32, the training images are converted before the cache
 	for( auto & item : *input4eval ) {
 		DataVector orgImage = item;
 		Utils::expandMnistImage( orgImage, &item );
@@ -92,7 +89,9 @@ void save_checkpoint( Network & network, int epoch, DataType loss )
 
 void test( const CmdArgs_t & args )
 {
-	DataMatrix input, target, input4eval, target4eval;
+	ByteDataset input;
+	LabelDataset target, target4eval;
+	DataMatrix input4eval;
 
 	if( ! loadData( args, &input, &target, &input4eval, &target4eval ) ) {
 		printf( "loadData fail\n" );
@@ -101,7 +100,7 @@ void test( const CmdArgs_t & args )
 
 	const char * path = "./emnist.model";
 
-	Dims baseInDims = { 1, (size_t)std::sqrt( input[ 0 ].size() ), (size_t)std::sqrt( input[ 0 ].size() ) };
+	Dims baseInDims = { 1, (size_t)std::sqrt( input.getSampleSize() ), (size_t)std::sqrt( input.getSampleSize() ) };
 
 	//train & save model
 	{
@@ -138,7 +137,7 @@ void test( const CmdArgs_t & args )
 			layer->setActFunc( ActFunc::sigmoid() );
 			network.addLayer( layer );
 
-			layer = new FullConnLayer( layer->getBaseOutDims(), target[ 0 ].size() );
+			layer = new FullConnLayer( layer->getBaseOutDims(), target.getClassCount() );
 			layer->setActFunc( ActFunc::softmax() );
 			network.addLayer( layer );
 		}
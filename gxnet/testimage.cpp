@@ -0,0 +1,460 @@
+#include "image.h"
+#include "inflate.h"
+
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <random>
+
+using namespace gxnet;
+
+// libjpeg quality 95 of the gradients in testJpeg, gray 16x16,
+// and color 24x16 with 4:2:0 chroma and a restart marker after every MCU
+// 371 bytes
+static const uint8_t gGrayJpeg[] = {
+	0xff, 0xd8, 0xff, 0xdb, 0x00, 0x43, 0x00, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01,
+	0x01, 0x02, 0x02, 0x02, 0x02, 0x02, 0x04, 0x03, 0x02, 0x02, 0x02, 0x02, 0x05, 0x04, 0x04, 0x03,
+	0x04, 0x06, 0x05, 0x06, 0x06, 0x06, 0x05, 0x06, 0x06, 0x06, 0x07, 0x09, 0x08, 0x06, 0x07, 0x09,
+	0x07, 0x06, 0x06, 0x08, 0x0b, 0x08, 0x09, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x06, 0x08, 0x0b, 0x0c,
+	0x0b, 0x0a, 0x0c, 0x09, 0x0a, 0x0a, 0x0a, 0xff, 0xc0, 0x00, 0x0b, 0x08, 0x00, 0x10, 0x00, 0x10,
+	0x01, 0x01, 0x11, 0x00, 0xff, 0xc4, 0x00, 0x1f, 0x00, 0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+	0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x10, 0x00, 0x02, 0x01, 0x03, 0x03, 0x02,
+	0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7d, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11,
+	0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91,
+	0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09,
+	0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37,
+	0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57,
+	0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77,
+	0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+	0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+	0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+	0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8,
+	0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xda, 0x00, 0x08,
+	0x01, 0x01, 0x00, 0x00, 0x3f, 0x00, 0xf9, 0x1f, 0xf6, 0x6d, 0xf8, 0x6d, 0xff, 0x00, 0x1e, 0xff,
+	0x00, 0xe8, 0xfe, 0x9d, 0xab, 0xf4, 0x03, 0xf6, 0x6d, 0xf8, 0x6d, 0xff, 0x00, 0x1e, 0xff, 0x00,
+	0xe8, 0xfe, 0x9d, 0xab, 0xe7, 0xff, 0x00, 0xd9, 0xb7, 0xe1, 0xb7, 0xfc, 0x7b, 0xff, 0x00, 0xa3,
+	0xfa, 0x76, 0xaf, 0xd0, 0x0f, 0xd9, 0xb7, 0xe1, 0xb7, 0xfc, 0x7b, 0xff, 0x00, 0xa3, 0xfa, 0x76,
+	0xaf, 0xff, 0xd9,
+};
+
+// 721 bytes
+static const uint8_t gColorJpeg[] = {
+	0xff, 0xd8, 0xff, 0xdb, 0x00, 0x43, 0x00, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01,
+	0x01, 0x02, 0x02, 0x02, 0x02, 0x02, 0x04, 0x03, 0x02, 0x02, 0x02, 0x02, 0x05, 0x04, 0x04, 0x03,
+	0x04, 0x06, 0x05, 0x06, 0x06, 0x06, 0x05, 0x06, 0x06, 0x06, 0x07, 0x09, 0x08, 0x06, 0x07, 0x09,
+	0x07, 0x06, 0x06, 0x08, 0x0b, 0x08, 0x09, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x06, 0x08, 0x0b, 0x0c,
+	0x0b, 0x0a, 0x0c, 0x09, 0x0a, 0x0a, 0x0a, 0xff, 0xdb, 0x00, 0x43, 0x01, 0x02, 0x02, 0x02, 0x02,
+	0x02, 0x02, 0x05, 0x03, 0x03, 0x05, 0x0a, 0x07, 0x06, 0x07, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a,
+	0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a,
+	0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a,
+	0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0xff, 0xc0, 0x00, 0x11,
+	0x08, 0x00, 0x10, 0x00, 0x18, 0x03, 0x01, 0x22, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01, 0xff,
+	0xc4, 0x00, 0x1f, 0x00, 0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b,
+	0xff, 0xc4, 0x00, 0xb5, 0x10, 0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04,
+	0x04, 0x00, 0x00, 0x01, 0x7d, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41,
+	0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1,
+	0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19,
+	0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44,
+	0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64,
+	0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84,
+	0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2,
+	0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9,
+	0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
+	0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3,
+	0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xc4, 0x00, 0x1f, 0x01, 0x00, 0x03, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03,
+	0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x11, 0x00, 0x02, 0x01,
+	0x02, 0x04, 0x04, 0x03, 0x04, 0x07, 0x05, 0x04, 0x04, 0x00, 0x01, 0x02, 0x77, 0x00, 0x01, 0x02,
+	0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32,
+	0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72,
+	0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29,
+	0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53,
+	0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73,
+	0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a,
+	0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8,
+	0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6,
+	0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4,
+	0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff,
+	0xdd, 0x00, 0x04, 0x00, 0x01, 0xff, 0xda, 0x00, 0x0c, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11,
+	0x00, 0x3f, 0x00, 0xa1, 0xe0, 0xbf, 0x8c, 0x7f, 0x73, 0xfd, 0x2b, 0xff, 0x00, 0x1e, 0xaf, 0x5b,
+	0xf0, 0x5f, 0xc6, 0x3f, 0xb9, 0xfe, 0x95, 0xff, 0x00, 0x8f, 0x57, 0xe7, 0xbf, 0x82, 0xfe, 0x31,
+	0xfd, 0xcf, 0xf4, 0xaf, 0xfc, 0x7a, 0xbd, 0x6f, 0xc1, 0x7f, 0x18, 0xfe, 0xe7, 0xfa, 0x5f, 0xfe,
+	0x3d, 0x5d, 0xd8, 0x3f, 0x07, 0xbf, 0xe9, 0xdf, 0xe0, 0x7e, 0x77, 0xe1, 0xe7, 0x87, 0x3f, 0x07,
+	0xb8, 0x7f, 0xff, 0xd0, 0xfa, 0x9f, 0xc1, 0x7f, 0x18, 0xfe, 0xe7, 0xfa, 0x5f, 0xfe, 0x3d, 0x45,
+	0x7c, 0xa5, 0xe0, 0xbf, 0x8c, 0x5f, 0x73, 0xfd, 0x2b, 0xf5, 0xa2, 0xbe, 0xc6, 0x97, 0x83, 0xde,
+	0xe7, 0xf0, 0xff, 0x00, 0x03, 0xfa, 0x1b, 0x21, 0xf0, 0xe7, 0xfe, 0x13, 0xe3, 0xee, 0x1f, 0xff,
+	0xd9,
+};
+
+static void appendBe32( std::vector< uint8_t > * out, uint32_t value )
+{
+	for( int shift : { 24, 16, 8, 0 } ) out->push_back( ( value >> shift ) & 0xff );
+}
+
+static void appendChunk( std::vector< uint8_t > * out, const char * type, const std::vector< uint8_t > & data )
+{
+	std::vector< uint8_t > body( type, type + 4 );
+	body.insert( body.end(), data.begin(), data.end() );
+
+	appendBe32( out, data.size() );
+	out->insert( out->end(), body.begin(), body.end() );
+	appendBe32( out, Inflate::crc32( 0, body.data(), body.size() ) );
+}
+
+/**
+ * A png of packed rows, stride bytes each, the rows filtered with the types 0..4 in turn,
+ * and stored in uncompressed deflate blocks.
+ */
+std::vector< uint8_t > writePng( const std::vector< uint8_t > & rows, int width, int height, int depth, int colorType,
+		const std::vector< uint8_t > & palette = {}, const std::vector< uint8_t > & trns = {} )
+{
+	static const int channelsOfType[ 7 ] = { 1, 0, 3, 1, 2, 0, 4 };
+
+	size_t bits = channelsOfType[ colorType ] * depth, stride = ( width * bits + 7 ) / 8;
+	size_t bpp = std::max( (size_t)1, bits / 8 );
+
+	std::vector< uint8_t > filtered;
+
+	for( int y = 0; y < height; y++ ) {
+		const uint8_t * row = rows.data() + y * stride, * prior = y > 0 ? row - stride : NULL;
+		int type = y % 5;
+
+		filtered.push_back( type );
+
+		for( size_t i = 0; i < stride; i++ ) {
+			int left = i >= bpp ? row[ i - bpp ] : 0, up = NULL != prior ? prior[ i ] : 0;
+			int upLeft = NULL != prior && i >= bpp ? prior[ i - bpp ] : 0;
+
+			int p = left + up - upLeft, pa = std::abs( p - left ), pb = std::abs( p - up ), pc = std::abs( p - upLeft );
+			int paeth = pa <= pb && pa <= pc ? left : ( pb <= pc ? up : upLeft );
+
+			int predict[ 5 ] = { 0, left, up, ( left + up ) >> 1, paeth };
+
+			filtered.push_back( row[ i ] - predict[ type ] );
+		}
+	}
+
+	// zlib header, stored blocks, adler32
+	std::vector< uint8_t > zlib = { 0x78, 0x01 };
+
+	for( size_t begin = 0; begin < filtered.size() || 0 == begin; begin += 65535 ) {
+		size_t count = std::min( filtered.size() - begin, (size_t)65535 );
+
+		zlib.push_back( begin + count >= filtered.size() ? 1 : 0 );
+		zlib.push_back( count & 0xff );
+		zlib.push_back( count >> 8 );
+		zlib.push_back( ~count & 0xff );
+		zlib.push_back( ( ~count >> 8 ) & 0xff );
+		zlib.insert( zlib.end(), filtered.begin() + begin, filtered.begin() + begin + count );
+	}
+
+	uint32_t a = 1, b = 0;
+	for( auto item : filtered ) {
+		a = ( a + item ) % 65521;
+		b = ( b + a ) % 65521;
+	}
+
+	appendBe32( &zlib, ( b << 16 ) | a );
+
+	std::vector< uint8_t > png = { 137, 80, 78, 71, 13, 10, 26, 10 }, header;
+
+	appendBe32( &header, width );
+	appendBe32( &header, height );
+	header.insert( header.end(), { (uint8_t)depth, (uint8_t)colorType, 0, 0, 0 } );
+
+	appendChunk( &png, "IHDR", header );
+	if( ! palette.empty() ) appendChunk( &png, "PLTE", palette );
+	if( ! trns.empty() ) appendChunk( &png, "tRNS", trns );
+	appendChunk( &png, "IDAT", zlib );
+	appendChunk( &png, "IEND", {} );
+
+	return png;
+}
+
+void testPng()
+{
+	printf( "========== test png ==========\n" );
+
+	const int width = 37, height = 23;
+
+	auto check = [&]( const char * tag, const std::vector< uint8_t > & png, const std::vector< uint8_t > & expected ) {
+		int w = 0, h = 0;
+		std::vector< uint8_t > rgba;
+
+		bool ret = Image::decodePng( png.data(), png.size(), &w, &h, &rgba );
+
+		int mismatch = w != width || h != height || rgba.size() != expected.size();
+		for( size_t i = 0; 0 == mismatch && i < expected.size(); i++ ) mismatch += rgba[ i ] != expected[ i ];
+
+		printf( "\t%-12s %s, %dx%d, mismatch %d\n", tag, ret ? "ok" : "fail", w, h, mismatch );
+	};
+
+	auto pixel = []( int x, int y, int c ) { return ( x * 7 + y * 13 + c * 50 + x * y ) & 0xff; };
+
+	std::vector< uint8_t > rows, expected;
+
+	for( int y = 0; y < height; y++ ) {
+		for( int x = 0; x < width; x++ ) {
+			rows.push_back( pixel( x, y, 0 ) );
+			expected.insert( expected.end(), { (uint8_t)pixel( x, y, 0 ), (uint8_t)pixel( x, y, 0 ), (uint8_t)pixel( x, y, 0 ), 255 } );
+		}
+	}
+
+	check( "gray 8", writePng( rows, width, height, 8, 0 ), expected );
+
+	// the high bytes, the low bytes are dropped
+	std::vector< uint8_t > wide;
+	for( auto item : rows ) wide.insert( wide.end(), { item, (uint8_t)( 255 - item ) } );
+
+	check( "gray 16", writePng( wide, width, height, 16, 0 ), expected );
+
+	rows.clear();
+	expected.clear();
+
+	for( int y = 0; y < height; y++ ) {
+		for( int x = 0; x < width; x++ ) {
+			for( int c = 0; c < 4; c++ ) rows.push_back( pixel( x, y, c ) );
+			expected.insert( expected.end(), rows.end() - 4, rows.end() );
+		}
+	}
+
+	check( "rgba 8", writePng( rows, width, height, 8, 6 ), expected );
+
+	std::vector< uint8_t > rgb;
+	for( size_t i = 0; i < rows.size(); i += 4 ) rgb.insert( rgb.end(), rows.begin() + i, rows.begin() + i + 3 );
+	for( size_t i = 3; i < expected.size(); i += 4 ) expected[ i ] = 255;
+
+	check( "rgb 8", writePng( rgb, width, height, 8, 2 ), expected );
+
+	// 4-bit palette indexes, half of the entries with alpha
+	std::vector< uint8_t > palette, trns;
+	for( int i = 0; i < 16; i++ ) palette.insert( palette.end(), { (uint8_t)( i * 16 ), (uint8_t)( 255 - i * 9 ), (uint8_t)( i * i ) } );
+	for( int i = 0; i < 8; i++ ) trns.push_back( i * 30 );
+
+	rows.assign( ( width * 4 + 7 ) / 8 * height, 0 );
+	expected.clear();
+
+	for( int y = 0; y < height; y++ ) {
+		for( int x = 0; x < width; x++ ) {
+			int index = pixel( x, y, 0 ) & 0x0f;
+
+			rows[ y * ( ( width * 4 + 7 ) / 8 ) + x / 2 ] |= index << ( 0 == x % 2 ? 4 : 0 );
+			expected.insert( expected.end(), palette.begin() + index * 3, palette.begin() + index * 3 + 3 );
+			expected.push_back( index < 8 ? trns[ index ] : 255 );
+		}
+	}
+
+	std::vector< uint8_t > png = writePng( rows, width, height, 4, 3, palette, trns );
+
+	check( "palette 4", png, expected );
+
+	// a damaged IDAT fails the chunk crc
+	png[ png.size() - 20 ] ^= 0x55;
+
+	int w = 0, h = 0;
+	std::vector< uint8_t > rgba;
+
+	printf( "\tdamaged %s\n", Image::decodePng( png.data(), png.size(), &w, &h, &rgba ) ? "decoded" : "refused" );
+
+	// oversized headers over a 1x1 IDAT, refused before the rows are allocated
+	for( uint32_t side : { 100000, 4096 } ) {
+		png = writePng( { 0 }, 1, 1, 8, 0 );
+
+		for( int i = 0; i < 8; i++ ) png[ 16 + i ] = side >> ( 24 - 8 * ( i % 4 ) );
+		uint32_t crc = Inflate::crc32( 0, png.data() + 12, 17 );
+		for( int i = 0; i < 4; i++ ) png[ 29 + i ] = crc >> ( 24 - 8 * i );
+
+		printf( "\toversized %ux%u %s\n", side, side, Image::decodePng( png.data(), png.size(), &w, &h, &rgba ) ? "decoded" : "refused" );
+	}
+}
+
+void testJpeg()
+{
+	printf( "========== test jpeg ==========\n" );
+
+	auto check = [&]( const char * tag, const uint8_t * data, size_t size, int width, int height,
+			int ( * expected )( int x, int y, int c ) ) {
+		int w = 0, h = 0;
+		std::vector< uint8_t > rgba;
+
+		bool ret = Image::decodeJpeg( data, size, &w, &h, &rgba );
+
+		int maxDiff = w != width || h != height ? 255 : 0;
+		double total = 0;
+
+		for( int y = 0; 0 == maxDiff && y < h; y++ ) {
+			for( int x = 0; x < w; x++ ) {
+				for( int c = 0; c < 3; c++ ) {
+					int diff = std::abs( rgba[ ( y * w + x ) * 4 + c ] - expected( x, y, c ) );
+					maxDiff = std::max( maxDiff, diff );
+					total += diff;
+				}
+			}
+		}
+
+		printf( "\t%-6s %s, %dx%d, max diff %d, mean diff %.3f\n", tag, ret ? "ok" : "fail", w, h, maxDiff,
+				total / std::max( 1, w * h * 3 ) );
+	};
+
+	check( "gray", gGrayJpeg, sizeof( gGrayJpeg ), 16, 16,
+			[]( int x, int y, int ) { return 40 + x * 8 + y * 4; } );
+
+	check( "color", gColorJpeg, sizeof( gColorJpeg ), 24, 16,
+			[]( int x, int y, int c ) { return 0 == c ? 30 + x * 8 : ( 1 == c ? 200 - y * 10 : 60 + ( x + y ) * 4 ); } );
+
+	// the same frame marked progressive is refused
+	std::vector< uint8_t > progressive( gGrayJpeg, gGrayJpeg + sizeof( gGrayJpeg ) );
+
+	for( size_t i = 0; i + 1 < progressive.size(); i++ ) {
+		if( 0xff == progressive[ i ] && 0xc0 == progressive[ i + 1 ] ) {
+			progressive[ i + 1 ] = 0xc2;
+			break;
+		}
+	}
+
+	int w = 0, h = 0;
+	std::vector< uint8_t > rgba;
+
+	printf( "\tprogressive %s\n", Image::decodeJpeg( progressive.data(), progressive.size(), &w, &h, &rgba ) ? "decoded" : "refused" );
+
+	// the same frame claiming 65535x65535 is refused before the planes are allocated
+	std::vector< uint8_t > oversized( gGrayJpeg, gGrayJpeg + sizeof( gGrayJpeg ) );
+
+	for( size_t i = 0; i + 9 < oversized.size(); i++ ) {
+		if( 0xff == oversized[ i ] && 0xc0 == oversized[ i + 1 ] ) {
+			for( int j = 5; j < 9; j++ ) oversized[ i + j ] = 0xff;
+			break;
+		}
+	}
+
+	printf( "\toversized %s\n", Image::decodeJpeg( oversized.data(), oversized.size(), &w, &h, &rgba ) ? "decoded" : "refused" );
+
+	// 200 codes of 1 bit, the table must be refused before it is filled
+	std::vector< uint8_t > dht = { 0xff, 0xd8, 0xff, 0xc4, 0x00, 19 + 200, 0x00, 200 };
+	dht.resize( dht.size() + 15, 0 );
+	for( int i = 0; i < 200; i++ ) dht.push_back( i );
+	dht.insert( dht.end(), { 0xff, 0xd9 } );
+
+	printf( "\tover subscribed huffman %s\n", Image::decodeJpeg( dht.data(), dht.size(), &w, &h, &rgba ) ? "decoded" : "refused" );
+
+	// damaged files are refused or decoded, but never read or write out of bounds
+	std::mt19937 gen( 1 );
+
+	int decodedCount = 0, flipCount = 300;
+
+	for( int i = 0; i < flipCount; i++ ) {
+		std::vector< uint8_t > damaged( gColorJpeg, gColorJpeg + sizeof( gColorJpeg ) );
+
+		for( int j = 0; j < 4; j++ ) damaged[ gen() % damaged.size() ] = gen();
+
+		decodedCount += Image::decodeJpeg( damaged.data(), damaged.size(), &w, &h, &rgba );
+	}
+
+	printf( "\tbyte flips, %d of %d still decoded\n", decodedCount, flipCount );
+
+	const int count = 1000;
+
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	for( int i = 0; i < count; i++ ) Image::decodeJpeg( gColorJpeg, sizeof( gColorJpeg ), &w, &h, &rgba );
+
+	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+	printf( "\tcolor decode %.2f us\n",
+			std::chrono::duration_cast<std::chrono::nanoseconds>( endTime - beginTime ).count() / 1000.0 / count );
+}
+
+// a blue 7 on white with some light gray noise, which is not ink, the margins stay like conv2mnist.py
+void testMnist()
+{
+	printf( "========== test mnist ==========\n" );
+
+	const int width = 160, height = 100;
+
+	std::vector< uint8_t > rgba( width * height * 4, 255 );
+
+	auto paint = [&]( int x, int y, uint8_t r, uint8_t g, uint8_t b ) {
+		if( x < 0 || y < 0 || x >= width || y >= height ) return;
+
+		uint8_t * pixel = rgba.data() + ( y * width + x ) * 4;
+		pixel[ 0 ] = r;
+		pixel[ 1 ] = g;
+		pixel[ 2 ] = b;
+	};
+
+	for( int i = 0; i < 300; i++ ) paint( ( i * 37 ) % width, ( i * 53 ) % height, 235, 240, 250 );
+
+	for( int y = 10; y < 22; y++ ) {
+		for( int x = 40; x < 126; x++ ) paint( x, y, 30, 60, 200 );
+	}
+
+	for( int y = 22; y < 96; y++ ) {
+		int center = 120 - ( y - 22 ) * 50 / 74;
+		for( int x = center - 6; x < center + 6; x++ ) paint( x, y, 30, 60, 200 );
+	}
+
+	uint8_t direct[ Image::eMnistSize * Image::eMnistSize ], decoded[ Image::eMnistSize * Image::eMnistSize ];
+
+	Image::toMnist( rgba.data(), width, height, direct );
+
+	int beginX = Image::eMnistSize, beginY = Image::eMnistSize, endX = 0, endY = 0;
+
+	for( int y = 0; y < Image::eMnistSize; y++ ) {
+		printf( "\t" );
+
+		for( int x = 0; x < Image::eMnistSize; x++ ) {
+			uint8_t value = direct[ y * Image::eMnistSize + x ];
+
+			printf( "%c", value > 128 ? '#' : ( value > 0 ? '.' : ' ' ) );
+
+			if( value > 0 ) {
+				beginX = std::min( beginX, x );
+				beginY = std::min( beginY, y );
+				endX = std::max( endX, x + 1 );
+				endY = std::max( endY, y + 1 );
+			}
+		}
+
+		printf( "\n" );
+	}
+
+	printf( "\tink rows [%d, %d), cols [%d, %d)\n", beginY, endY, beginX, endX );
+
+	// through a png file
+	std::vector< uint8_t > png = writePng( rgba, width, height, 8, 6 );
+
+	const int count = 100;
+
+	int w = 0, h = 0;
+	std::vector< uint8_t > pixels;
+
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	for( int i = 0; i < count; i++ ) {
+		Image::decode( png.data(), png.size(), &w, &h, &pixels );
+		Image::toMnist( pixels.data(), w, h, decoded );
+	}
+
+	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+	printf( "\tpng %dx%d, mismatch %d, decode and preprocess %.2f us\n", w, h,
+			0 != memcmp( direct, decoded, sizeof( direct ) ),
+			std::chrono::duration_cast<std::chrono::nanoseconds>( endTime - beginTime ).count() / 1000.0 / count );
+}
+
+int main( int argc, const char * argv[] )
+{
+	testPng();
+
+	testJpeg();
+
+	testMnist();
+
+	return 0;
+}
+
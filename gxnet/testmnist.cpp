@@ -7,49 +7,41 @@
 
 using namespace gxnet;
 
-bool loadData( const CmdArgs_t & args, DataMatrix * input, DataMatrix * target,
-		DataMatrix * input4eval, DataMatrix * target4eval )
+bool loadData( const CmdArgs_t & args, ByteDataset * input, LabelDataset * target,
+		DataMatrix * input4eval, LabelDataset * target4eval )
 {
 	const char * path = "mnist/train-images-idx3-ubyte";
-	if( ! Utils::loadMnistImages( args.mTrainingCount, path, input ) ) {
-		printf( "read %s fail\n", path );
-		return false;
-	}
 
-	path = "mnist/train-labels-idx1-ubyte";
-	if( ! Utils::loadMnistLabels( args.mTrainingCount, path, target ) ) {
+	// the inflated images are mapped from the cache on later runs
+	DatasetCache cache;
+
+	char params[ 64 ] = { 0 };
+	snprintf( params, sizeof( params ), "images %d", args.mTrainingCount );
+
+	if( ! cache.addSource( path ) ) {
 		printf( "read %s fail\n", path );
 		return false;
 	}
 
-	if( args.mIsDataAug ) {
-		// load rotated images
-		path = "mnist/train-images-idx3-ubyte.rot";
-		if( 0 == access( path, F_OK ) ) {
-			if( ! Utils::loadMnistImages( args.mTrainingCount, path, input ) ) {
-				printf( "read %s fail\n", path );
-				return false;
-			}
+	cache.addParams( params );
 
-			path = "mnist/train-labels-idx1-ubyte.rot";
-			if( ! Utils::loadMnistLabels( args.mTrainingCount, path, target ) ) {
-				printf( "read %s fail\n", path );
-				return false;
-			}
+	if( ! cache.load( input ) ) {
+		if( ! Utils::loadMnistImages( args.mTrainingCount, path, input ) ) {
+			printf( "read %s fail\n", path );
+			return false;
 		}
 
-		// center mnist images
-		size_t orgSize = input->size();
+		cache.save( *input );
+	}
 
-		for( size_t i = 0; i < orgSize; i++ ) {
-			DataVector newImage;
-			if( Utils::centerMnistImage( ( *input )[ i ], &newImage ) ) {
-				input->emplace_back( newImage );
-				target->emplace_back( ( *target )[ i ] );
-			}
-		}
+	path = "mnist/train-labels-idx1-ubyte";
+	if( ! Utils::loadMnistLabels( args.mTrainingCount, path, target ) ) {
+		printf( "read %s fail\n", path );
+		return false;
 	}
 
+	// args.mIsDataAug rotates, shifts and centers the images while they are staged
+
 	path = "mnist/t10k-images-idx3-ubyte";
 	if( ! Utils::loadMnistImages( args.mEvalCount, path, input4eval ) ) {
 		printf( "read %s fail\n", path );
@@ -79,7 +71,9 @@ void save_checkpoint( Network & network, int epoch, DataType loss )
 
 void test( const CmdArgs_t & args )
 {
-	DataMatrix input, target, input4eval, target4eval;
+	ByteDataset input;
+	LabelDataset target, target4eval;
+	DataMatrix input4eval;
 
 	if( ! loadData( args, &input, &target, &input4eval, &target4eval ) ) {
 		printf( "loadData fail\n" );
@@ -87,8 +81,11 @@ void test( const CmdArgs_t & args )
 	}
 
 	if( gx_is_inner_debug ) {
-		Utils::printMatrix( "input", input );
-		Utils::printMatrix( "target", target );
+		DataMatrix matrix, oneHot;
+		input.toMatrix( &matrix );
+		target.toMatrix( &oneHot );
+		Utils::printMatrix( "input", matrix );
+		Utils::printMatrix( "target", oneHot );
 	}
 
 	const char * path = "./mnist.model";
@@ -111,13 +108,13 @@ void test( const CmdArgs_t & args )
 		} else {
 			BaseLayer * layer = NULL;
 
-			Dims baseInDims = { 1, (size_t)std::sqrt( input[ 0 ].size() ), (size_t)std::sqrt( input[ 0 ].size() ) };
+			Dims baseInDims = { 1, (size_t)std::sqrt( input.getSampleSize() ), (size_t)std::sqrt( input.getSampleSize() ) };
 
 			layer = new FullConnLayer( NULL == layer ? baseInDims : layer->getBaseOutDims(), 30 );
 			layer->setActFunc( ActFunc::sigmoid() );
 			network.addLayer( layer );
 
-			layer = new FullConnLayer( layer->getBaseOutDims(), target[ 0 ].size() );
+			layer = new FullConnLayer( layer->getBaseOutDims(), target.getClassCount() );
 			layer->setActFunc( ActFunc::softmax() );
 			network.addLayer( layer );
 		}
@@ -0,0 +1,561 @@
+
+#include "layer.h"
+#include "context.h"
+#include "packed.h"
+#include "network.h"
+#include "utils.h"
+#include "activation.h"
+
+#include <cstdio>
+#include <cmath>
+#include <memory>
+#include <chrono>
+
+using namespace gxnet;
+
+const int gStorages[] = { PackedRows::eNone, PackedRows::eBF16, PackedRows::eFP16, PackedRows::eInt8, PackedRows::eCsr,
+		PackedRows::eBinary };
+
+template< typename TLayer >
+void forwardAll( TLayer & layer, int storage, const MDVector & inMD, int loops, DataVector * output )
+{
+	layer.setStorage( storage );
+
+	std::unique_ptr< BaseLayerContext > ctx( layer.createCtx() );
+	ctx->setInput( &inMD );
+
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	for( int i = 0; i < loops; i++ ) layer.forward( ctx.get() );
+
+	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+	auto timeSpan = std::chrono::duration_cast<std::chrono::microseconds>( endTime - beginTime );
+
+	*output = ctx->getOutput().first;
+
+	printf( "\t%-6s %d loops, elapsed time: %.3f ms%s\n", PackedRows::type2name( storage ), loops, timeSpan.count() / 1000.0,
+			layer.getStorage() != storage ? ", kept dense" : "" );
+}
+
+template< typename TLayer >
+void testLayer( const char * tag, TLayer & layer, const Dims & inDims, int loops )
+{
+	printf( "========== test %s ==========\n", tag );
+
+	MDVector inMD;
+	inMD.second = inDims;
+	inMD.first.resize( gx_dims_flatten_size( inDims ) );
+	for( auto & item : inMD.first ) item = Utils::random( 0, 1 );
+
+	DataVector expected, output;
+
+	for( auto storage : gStorages ) {
+		forwardAll( layer, storage, inMD, loops, PackedRows::eNone == storage ? &expected : &output );
+
+		if( PackedRows::eNone == storage ) continue;
+
+		DataType maxDiff = std::abs( output - expected ).max();
+		printf( "\t%-6s max diff %.6f, max output %.6f\n", PackedRows::type2name( storage ),
+				maxDiff, std::abs( expected ).max() );
+	}
+}
+
+void testInt8Kernel( size_t aRows, size_t bRows, size_t cols )
+{
+	std::vector< uint8_t > a( aRows * cols );
+	std::vector< int8_t > b( bRows * cols );
+
+	for( auto & item : a ) item = (uint8_t)Utils::random( 0, 255 );
+	for( auto & item : b ) item = (int8_t)Utils::random( -127, 127 );
+
+	std::vector< int32_t > c( aRows * bRows );
+
+	gx_kernels().mRowsProductInt8( a.data(), aRows, b.data(), bRows, cols, c.data() );
+
+	int mismatch = 0;
+
+	for( size_t i = 0; i < aRows; i++ ) {
+		for( size_t j = 0; j < bRows; j++ ) {
+			int32_t expected = 0;
+			for( size_t n = 0; n < cols; n++ ) expected += (int32_t)a[ i * cols + n ] * b[ j * cols + n ];
+
+			if( expected != c[ i * bRows + j ] ) mismatch++;
+		}
+	}
+
+	printf( "%s( %zu, %zu, %zu ) %s, mismatch %d\n", __func__, aRows, bRows, cols, gx_kernels().mIsa, mismatch );
+}
+
+void testBinaryKernel( size_t aRows, size_t bRows, size_t words )
+{
+	std::vector< uint64_t > a( aRows * words ), b( bRows * words );
+
+	for( auto & item : a ) item = ( (uint64_t)Utils::random( 0, 1 << 30 ) << 34 ) ^ (uint64_t)Utils::random( 0, 1 << 30 );
+	for( auto & item : b ) item = ( (uint64_t)Utils::random( 0, 1 << 30 ) << 34 ) ^ (uint64_t)Utils::random( 0, 1 << 30 );
+
+	std::vector< int32_t > c( aRows * bRows );
+
+	gx_kernels().mRowsProductBinary( a.data(), aRows, b.data(), bRows, words, c.data() );
+
+	int mismatch = 0;
+
+	for( size_t i = 0; i < aRows; i++ ) {
+		for( size_t j = 0; j < bRows; j++ ) {
+			int32_t expected = 0;
+			for( size_t n = 0; n < words; n++ ) expected += __builtin_popcountll( a[ i * words + n ] ^ b[ j * words + n ] );
+
+			if( expected != c[ i * bRows + j ] ) mismatch++;
+		}
+	}
+
+	printf( "%s( %zu, %zu, %zu ) %s, mismatch %d\n", __func__, aRows, bRows, words, gx_kernels().mIsa, mismatch );
+}
+
+// the same batches through the dense and the sparse input path, two batches in turn so the
+// columns left over from the batch before are cleared, the gradients must match exactly
+void testSparseInput( size_t sampleCount, DataType zeroRatio, int loops )
+{
+	printf( "========== test sparse input %zu x 784, %.0f%% zeros ==========\n", sampleCount, zeroRatio * 100 );
+
+	FullConnLayer layer( { 784 }, 30 );
+
+	MDVector inputs[ 2 ];
+
+	for( auto & input : inputs ) {
+		input.second = { sampleCount, 784 };
+		input.first.resize( sampleCount * 784 );
+		for( auto & item : input.first ) item = Utils::random( 0, 1 ) < zeroRatio ? 0 : Utils::random( 0, 1 );
+	}
+
+	DataVector deltas[ 2 ];
+	for( auto & delta : deltas ) {
+		delta.resize( sampleCount * 30 );
+		for( auto & item : delta ) item = Utils::random( -1, 1 );
+	}
+
+	DataVector outputs[ 2 ], gradients[ 2 ];
+	double elapsed[ 2 ] = { 0 };
+
+	for( int i = 0; i < 2; i++ ) {
+		std::unique_ptr< BaseLayerContext > ctx( layer.createCtx() );
+
+		// as Network::initCtx does for the first layer
+		( (FullConnLayerContext*)ctx.get() )->getSparseInput().mIsEnabled = 1 == i;
+
+		ctx->getDelta().second = { sampleCount, 30 };
+
+		std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+		for( int n = 0; n < loops; n++ ) {
+			ctx->setInput( &inputs[ n % 2 ] );
+			ctx->getDelta().first = deltas[ n % 2 ];
+
+			layer.forward( ctx.get() );
+			layer.collectGradients( ctx.get() );
+		}
+
+		std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+		elapsed[ i ] = std::chrono::duration_cast<std::chrono::microseconds>( endTime - beginTime ).count() / 1000.0;
+
+		outputs[ i ] = ctx->getOutput().first;
+		gradients[ i ] = ctx->getGradients().first;
+
+		printf( "\t%-6s %d loops, elapsed time: %.3f ms\n", 0 == i ? "dense" : "sparse", loops, elapsed[ i ] );
+	}
+
+	printf( "\tspeedup %.2fx, output max diff %g, gradient mismatch %d\n", elapsed[ 0 ] / elapsed[ 1 ],
+			std::abs( outputs[ 1 ] - outputs[ 0 ] ).max(), 0 != std::abs( gradients[ 1 ] - gradients[ 0 ] ).max() );
+}
+
+void testQuantizedModel()
+{
+	printf( "========== test quantized model ==========\n" );
+
+	Network network;
+
+	network.addLayer( new ConvExLayer( { 1, 28, 28 }, 4, 5 ) );
+	network.addLayer( new FullConnLayer( { 4, 24, 24 }, 30 ) );
+	network.addLayer( new FullConnLayer( { 30 }, 10 ) );
+
+	DataMatrix input( 20 );
+	for( auto & item : input ) {
+		item.resize( 28 * 28 );
+		for( auto & pixel : item ) pixel = Utils::random( 0, 1 );
+	}
+
+	DataMatrix expected, output, reloaded;
+
+	network.setTraining( false );
+	network.forward( input, &expected );
+
+	printf( "quantize %d layers\n", network.quantize( input ) );
+
+	network.forward( input, &output );
+
+	const char * path = "./packed.model";
+
+	Network other;
+
+	bool ret = Utils::save( path, network ) && Utils::load( path, &other );
+
+	other.forward( input, &reloaded );
+
+	DataType maxDiff = 0, maxOutput = 0, maxReloadDiff = 0;
+
+	for( size_t i = 0; i < input.size(); i++ ) {
+		maxDiff = std::max( maxDiff, std::abs( output[ i ] - expected[ i ] ).max() );
+		maxOutput = std::max( maxOutput, std::abs( expected[ i ] ).max() );
+		maxReloadDiff = std::max( maxReloadDiff, std::abs( reloaded[ i ] - output[ i ] ).max() );
+	}
+
+	printf( "\tint8 max diff %.6f, max output %.6f\n", maxDiff, maxOutput );
+	printf( "\tsave and load %s, max diff %.6f\n", ret ? "ok" : "fail", maxReloadDiff );
+}
+
+void testQat()
+{
+	printf( "========== test quantization-aware training ==========\n" );
+
+	Network network;
+
+	network.setLossFuncType( Network::eCrossEntropy );
+
+	BaseLayer * layer = new FullConnLayer( { 784 }, 30 );
+	layer->setActFunc( ActFunc::sigmoid() );
+	network.addLayer( layer );
+
+	layer = new FullConnLayer( { 30 }, 10 );
+	layer->setActFunc( ActFunc::softmax() );
+	network.addLayer( layer );
+
+	DataMatrix input( 200 ), target( 200 );
+	for( size_t i = 0; i < input.size(); i++ ) {
+		input[ i ].resize( 28 * 28 );
+		for( auto & pixel : input[ i ] ) pixel = Utils::random( 0, 1 );
+
+		target[ i ].resize( 10 );
+		target[ i ] = 0;
+		target[ i ][ i % 10 ] = 1;
+	}
+
+	CmdArgs_t args = {
+		.mEpochCount = 5,
+		.mMiniBatchCount = 10,
+		.mLearningRate = 0.5,
+		.mLambda = 0,
+		.mIsShuffle = false,
+		.mIsQat = true
+	};
+
+	network.train( input, target, args );
+
+	for( auto & layer : network.getLayers() ) {
+		if( BaseLayer::eFakeQuant == layer->getType() ) {
+			printf( "\tlearned scale %.6f\n", ( (FakeQuantLayer*)layer )->getScale() );
+		}
+	}
+
+	const char * path = "./packed.model";
+
+	Network other;
+
+	bool ret = Utils::save( path, network ) && Utils::load( path, &other );
+
+	DataMatrix expected, output, reloaded;
+
+	network.setTraining( false );
+	network.forward( input, &expected );
+
+	other.forward( input, &reloaded );
+
+	printf( "export %d layers\n", network.quantize( input ) );
+
+	network.forward( input, &output );
+
+	DataType maxDiff = 0, maxOutput = 0, maxReloadDiff = 0;
+
+	for( size_t i = 0; i < input.size(); i++ ) {
+		maxDiff = std::max( maxDiff, std::abs( output[ i ] - expected[ i ] ).max() );
+		maxOutput = std::max( maxOutput, std::abs( expected[ i ] ).max() );
+		maxReloadDiff = std::max( maxReloadDiff, std::abs( reloaded[ i ] - expected[ i ] ).max() );
+	}
+
+	printf( "\tint8 export max diff %.6f, max output %.6f\n", maxDiff, maxOutput );
+	printf( "\tsave and load %s, max diff %.6f\n", ret ? "ok" : "fail", maxReloadDiff );
+}
+
+long fileSize( const char * path )
+{
+	FILE * fp = fopen( path, "r" );
+	if( NULL == fp ) return -1;
+
+	fseek( fp, 0, SEEK_END );
+	long size = ftell( fp );
+	fclose( fp );
+
+	return size;
+}
+
+void testBinaryModel()
+{
+	printf( "========== test binary model ==========\n" );
+
+	Network network;
+
+	network.setLossFuncType( Network::eCrossEntropy );
+
+	BaseLayer * layer = new FullConnLayer( { 784 }, 64 );
+	layer->setActFunc( ActFunc::tanh() );
+	network.addLayer( layer );
+
+	layer = new FullConnLayer( { 64 }, 64 );
+	layer->setActFunc( ActFunc::tanh() );
+	network.addLayer( layer );
+
+	layer = new FullConnLayer( { 64 }, 10 );
+	layer->setActFunc( ActFunc::softmax() );
+	network.addLayer( layer );
+
+	DataMatrix input( 200 ), target( 200 );
+	for( size_t i = 0; i < input.size(); i++ ) {
+		input[ i ].resize( 28 * 28 );
+		for( auto & pixel : input[ i ] ) pixel = Utils::random( 0, 1 );
+
+		target[ i ].resize( 10 );
+		target[ i ] = 0;
+		target[ i ][ i % 10 ] = 1;
+	}
+
+	CmdArgs_t args = {
+		.mEpochCount = 5,
+		.mMiniBatchCount = 10,
+		.mLearningRate = 0.1,
+		.mLambda = 0,
+		.mIsShuffle = false,
+		.mIsBinary = true
+	};
+
+	network.train( input, target, args );
+
+	DataMatrix expected, output, reloaded;
+
+	network.setTraining( false );
+	network.forward( input, &expected );
+
+	printf( "binarize %d layers\n", network.binarize() );
+
+	network.forward( input, &output );
+
+	const char * path = "./packed.model";
+
+	Network other;
+
+	bool ret = Utils::save( path, network ) && Utils::load( path, &other );
+
+	other.forward( input, &reloaded );
+
+	DataType maxDiff = 0, maxOutput = 0, maxReloadDiff = 0;
+
+	for( size_t i = 0; i < input.size(); i++ ) {
+		maxDiff = std::max( maxDiff, std::abs( output[ i ] - expected[ i ] ).max() );
+		maxOutput = std::max( maxOutput, std::abs( expected[ i ] ).max() );
+		maxReloadDiff = std::max( maxReloadDiff, std::abs( reloaded[ i ] - output[ i ] ).max() );
+	}
+
+	printf( "\tbinary export max diff %.6f, max output %.6f\n", maxDiff, maxOutput );
+	printf( "\tsave and load %s, max diff %.6f\n", ret ? "ok" : "fail", maxReloadDiff );
+
+	// the hidden ConvEx layer stays in DataType, only the hidden FullConn layer turns binary
+	Network conv;
+
+	conv.addLayer( new ConvExLayer( { 1, 28, 28 }, 4, 5 ) );
+	conv.addLayer( new ConvExLayer( { 4, 24, 24 }, 4, 5 ) );
+	conv.addLayer( new FullConnLayer( { 4, 20, 20 }, 32 ) );
+	conv.addLayer( new FullConnLayer( { 32 }, 10 ) );
+
+	int count = conv.prepareBinary();
+
+	printf( "\tconv network, %d binary layers, %s\n", count,
+			1 == count && PackedRows::eNone == ( (ConvExLayer*)conv.getLayers()[ 1 ] )->getFakeQuant() ? "ok" : "fail" );
+}
+
+void testPrunedModel()
+{
+	printf( "========== test pruned model ==========\n" );
+
+	Network network;
+
+	network.setLossFuncType( Network::eCrossEntropy );
+
+	BaseLayer * layer = new FullConnLayer( { 784 }, 30 );
+	layer->setActFunc( ActFunc::sigmoid() );
+	network.addLayer( layer );
+
+	layer = new FullConnLayer( { 30 }, 10 );
+	layer->setActFunc( ActFunc::softmax() );
+	network.addLayer( layer );
+
+	DataMatrix input( 200 ), target( 200 );
+	for( size_t i = 0; i < input.size(); i++ ) {
+		input[ i ].resize( 28 * 28 );
+		for( auto & pixel : input[ i ] ) pixel = Utils::random( 0, 1 );
+
+		target[ i ].resize( 10 );
+		target[ i ] = 0;
+		target[ i ][ i % 10 ] = 1;
+	}
+
+	CmdArgs_t args = {
+		.mEpochCount = 4,
+		.mMiniBatchCount = 10,
+		.mLearningRate = 0.5,
+		.mLambda = 0,
+		.mIsShuffle = false,
+		.mPruneSparsity = 0.9
+	};
+
+	network.train( input, target, args );
+
+	for( auto & item : network.getLayers() ) {
+		printf( "\tsparsity %.4f\n", ( (FullConnLayer*)item )->getSparsity() );
+	}
+
+	const char * path = "./packed.model";
+
+	DataMatrix expected, reloaded;
+
+	network.setTraining( false );
+	network.forward( input, &expected );
+
+	Utils::save( path, network );
+	long denseSize = fileSize( path );
+
+	for( auto & item : network.getLayers() ) ( (FullConnLayer*)item )->setStorage( PackedRows::eCsr );
+
+	Network other;
+
+	bool ret = Utils::save( path, network ) && Utils::load( path, &other );
+
+	other.forward( input, &reloaded );
+
+	DataType maxDiff = 0;
+	for( size_t i = 0; i < input.size(); i++ ) {
+		maxDiff = std::max( maxDiff, std::abs( reloaded[ i ] - expected[ i ] ).max() );
+	}
+
+	printf( "\tmodel size none %ld, csr %ld\n", denseSize, fileSize( path ) );
+	printf( "\tsave and load %s, max diff %.6f\n", ret ? "ok" : "fail", maxDiff );
+}
+
+void testLowRank()
+{
+	printf( "========== test low rank FullConnLayer 784x300 ==========\n" );
+
+	// rank 20 weights with a little noise
+	size_t rows = 300, cols = 784, rank = 20;
+
+	MDVector a( DataVector( rows * rank ), { rows, rank } ), b( DataVector( rank * cols ), { rank, cols } );
+	for( auto & item : a.first ) item = Utils::random();
+	for( auto & item : b.first ) item = Utils::random();
+
+	MDVector weights;
+	gx_matmul( MDSpanRO( a ), MDSpanRO( b ), &weights );
+	for( auto & item : weights.first ) item += Utils::random( -0.01, 0.01 );
+
+	DataVector biases( rows );
+	for( auto & item : biases ) item = Utils::random();
+
+	Network network;
+
+	FullConnLayer * fc = new FullConnLayer( { cols }, rows );
+	fc->setWeights( weights, biases );
+	network.addLayer( fc );
+
+	DataMatrix input( 200 );
+	for( auto & item : input ) {
+		item.resize( cols );
+		for( auto & pixel : item ) pixel = Utils::random( 0, 1 );
+	}
+
+	DataMatrix expected, output;
+
+	auto forwardAll = [ & ]( DataMatrix * result ) {
+		std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+		for( int i = 0; i < 10; i++ ) network.forward( input, result );
+
+		std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+		return std::chrono::duration_cast<std::chrono::microseconds>( endTime - beginTime ).count() / 1000.0;
+	};
+
+	network.setTraining( false );
+
+	double denseTime = forwardAll( &expected );
+
+	int count = network.factorize( 0.999 );
+
+	double lowRankTime = forwardAll( &output );
+
+	DataType maxDiff = 0, maxOutput = 0;
+	for( size_t i = 0; i < input.size(); i++ ) {
+		maxDiff = std::max( maxDiff, std::abs( output[ i ] - expected[ i ] ).max() );
+		maxOutput = std::max( maxOutput, std::abs( expected[ i ] ).max() );
+	}
+
+	printf( "\tfactorize %d layers, %zu layers now\n", count, network.getLayers().size() );
+	printf( "\tdense %.3f ms, low rank %.3f ms\n", denseTime, lowRankTime );
+	printf( "\tmax diff %.6f, max output %.6f\n", maxDiff, maxOutput );
+}
+
+int main( int argc, const char * argv[] )
+{
+	testInt8Kernel( 1, 30, 784 );
+	testInt8Kernel( 3, 7, 25 );
+	testInt8Kernel( 5, 47, 130 );
+
+	testBinaryKernel( 1, 1024, 64 );
+	testBinaryKernel( 3, 7, 5 );
+	testBinaryKernel( 5, 47, 13 );
+
+	FullConnLayer fc( { 784 }, 30 );
+	testLayer( "FullConnLayer 784x30, batch 1", fc, { 1, 784 }, 20000 );
+
+	FullConnLayer head( { 60 }, 47 );
+	testLayer( "FullConnLayer 60x47, batch 1", head, { 1, 60 }, 50000 );
+
+	// weights larger than the caches, where the 16-bit storage pays off
+	FullConnLayer wide( { 4096 }, 1024 );
+	testLayer( "FullConnLayer 4096x1024, batch 1", wide, { 1, 4096 }, 50 );
+
+	// 90% of the weights pruned, where csr pays off
+	fc.prune( 0.9 );
+	testLayer( "FullConnLayer 784x30 90% pruned, batch 1", fc, { 1, 784 }, 20000 );
+
+	head.prune( 0.9 );
+	testLayer( "FullConnLayer 60x47 90% pruned, batch 1", head, { 1, 60 }, 50000 );
+
+	// mnist images are about 80% zeros
+	testSparseInput( 1, 0.8, 20000 );
+	testSparseInput( 10, 0.8, 2000 );
+	testSparseInput( 100, 0.8, 200 );
+	testSparseInput( 10, 0.6, 2000 );
+	testSparseInput( 10, 0.4, 2000 );
+
+	ConvExLayer conv( { 1, 28, 28 }, 4, 5 );
+	testLayer( "ConvExLayer 4x5x5", conv, { 1, 1, 28, 28 }, 500 );
+
+	testQuantizedModel();
+
+	testQat();
+
+	testBinaryModel();
+
+	testPrunedModel();
+
+	testLowRank();
+
+	return 0;
+}
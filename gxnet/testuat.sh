@@ -1,5 +1,3 @@
-which python > /dev/null 2>&1|| alias python=python3
-
 PROG=$0
 
 path=""
@@ -43,9 +41,7 @@ for i in $files;
 do
 	target=`echo $i | grep -Eo '([0-9]+)' | head -1`
 
-	test -f $i".mnist" || python ./conv2mnist.py $i
-
-	test -f $i".mnist" && ./gxtool --model $model --file $i".mnist"
+	./gxtool --model $model --file $i
 
 	if [ "$target" -eq "$?" ];
 	then
@@ -2,11 +2,10 @@ from __future__ import print_function
 
 import struct
 import numpy as np
-import random
 import ctypes
 import sys
-
-from PIL import Image
+import os
+import gzip
 
 def print_mnist( data ):
 	tmp = data.reshape( -1 )
@@ -17,11 +16,18 @@ def print_mnist( data ):
 			#print( tmp[ i * 28 + j ], " ", end="" )
 		print( "" )
 
-def read_mnist_images( path ):
-
-	fp = open( path, "rb" )
+def read_idx( path ):
+	if not os.path.exists( path ) and os.path.exists( path + ".gz" ):
+		fp = gzip.open( path + ".gz", "rb" )
+	else:
+		fp = open( path, "rb" )
 	buff = fp.read()
 	fp.close()
+	return buff
+
+def read_mnist_images( path ):
+
+	buff = read_idx( path )
 
 	offset = 0
 
@@ -42,9 +48,7 @@ def read_mnist_images( path ):
 	return images
 
 def read_mnist_labels( path ):
-	fp = open( path, "rb" )
-	buff = fp.read()
-	fp.close()
+	buff = read_idx( path )
 
 	offset = 0
 
@@ -104,22 +108,6 @@ def convert( image_path, label_path, suffix, transform ):
 	fp.close()
 	fp2.close()
 
-def rotate_mnist( rotation_range, image_path, label_path ):
-
-	def transform( org_array, label ):
-		while True:
-			theta = float( random.uniform( rotation_range[ 0 ], rotation_range[ 1 ] ) )
-			if 0 != theta: break
-
-		org_img = Image.fromarray( np.uint8( org_array ) )
-		new_img = org_img.rotate( theta, resample = Image.BICUBIC )
-
-		return np.array( new_img )
-
-	print( "rotation_range {}".format( rotation_range ) )
-
-	convert( image_path, label_path, "rot", transform )
-
 def recover_emnist( image_path, label_path ):
 
 	def transform( org_array, label ):
@@ -141,12 +129,10 @@ def recover_emnist( image_path, label_path ):
 if __name__ == '__main__':
 
 	if( len( sys.argv ) < 4 ):
-		print( "Usage: %s <rotate|recover> <images idx3 file> <labels idx1 file>\n" % ( sys.argv[ 0 ] ) )
+		print( "Usage: %s <recover> <images idx3 file> <labels idx1 file>\n" % ( sys.argv[ 0 ] ) )
 		sys.exit( -1 )
 
-	if sys.argv[ 1 ] == "rotate":
-		rotate_mnist( [ -15, 15 ], sys.argv[ 2 ], sys.argv[ 3 ] )
-	elif sys.argv[ 1 ] == "recover":
+	if sys.argv[ 1 ] == "recover":
 		recover_emnist( sys.argv[ 2 ], sys.argv[ 3 ] )
 	else:
 		print( "unknown command", sys.argv[ 1 ] )
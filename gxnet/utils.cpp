@@ -12,6 +12,7 @@
 #include <random>
 #include <numeric>
 #include <climits>
+#include <limits>
 #include <algorithm>
 #include <thread>
 
@@ -20,10 +21,34 @@
 #include <assert.h>
 #include <string.h>
 
-#include <arpa/inet.h>
-
 namespace gxnet {
 
+void Utils :: shuffle( IntVector * idx, size_t blockSize, std::mt19937 & gen )
+{
+	if( blockSize <= 1 || blockSize >= idx->size() ) {
+		std::shuffle( idx->begin(), idx->end(), gen );
+		return;
+	}
+
+	std::rotate( idx->begin(), idx->begin() + gen() % blockSize, idx->end() );
+
+	IntVector order( ( idx->size() + blockSize - 1 ) / blockSize );
+	std::iota( order.begin(), order.end(), 0 );
+	std::shuffle( order.begin(), order.end(), gen );
+
+	IntVector result;
+	result.reserve( idx->size() );
+
+	for( auto & block : order ) {
+		size_t begin = block * blockSize, end = std::min( idx->size(), begin + blockSize );
+
+		result.insert( result.end(), idx->begin() + begin, idx->begin() + end );
+		std::shuffle( result.end() - ( end - begin ), result.end(), gen );
+	}
+
+	idx->swap( result );
+}
+
 DataType Utils :: calcSSE( const DataVector & output, const DataVector & target )
 {
 	assert( output.size() == target.size() );
@@ -57,6 +82,82 @@ DataType Utils :: random( DataType min, DataType max )
 	return dist( gen );
 }
 
+size_t Utils :: truncatedSvd( const MDVector & matrix, DataType energy, size_t maxRank,
+		MDVector * u, DataVector * s, MDVector * vt )
+{
+	assert( matrix.second.size() == 2 );
+
+	size_t rows = matrix.second[ 0 ], cols = matrix.second[ 1 ];
+
+	maxRank = std::min( maxRank, std::min( rows, cols ) );
+
+	DataVector residual = matrix.first;
+
+	DataType total = ( residual * residual ).sum(), kept = 0;
+
+	std::vector< DataVector > us, vs;
+	std::vector< DataType > ss;
+
+	while( ss.size() < maxRank && kept < energy * total ) {
+		DataVector uk( rows ), vk( cols );
+		for( auto & item : vk ) item = random();
+
+		DataType sigma = 0;
+
+		// v = normalize( At * A * v ) converges to the top right singular vector of the residual
+		for( int iter = 0; iter < 500; iter++ ) {
+			for( size_t r = 0; r < rows; r++ ) uk[ r ] = gx_inner_product( std::begin( residual ) + r * cols, std::begin( vk ), cols );
+
+			vk = 0;
+			for( size_t r = 0; r < rows; r++ ) gx_vs_product_add( std::begin( residual ) + r * cols, uk[ r ], std::begin( vk ), cols );
+
+			DataType norm = std::sqrt( ( vk * vk ).sum() );
+
+			if( norm <= 0 ) break;
+
+			vk /= norm;
+
+			DataType last = sigma;
+			sigma = std::sqrt( norm );
+
+			if( std::abs( sigma - last ) <= sigma * std::numeric_limits< DataType >::epsilon() * 16 ) break;
+		}
+
+		for( size_t r = 0; r < rows; r++ ) uk[ r ] = gx_inner_product( std::begin( residual ) + r * cols, std::begin( vk ), cols );
+
+		sigma = std::sqrt( ( uk * uk ).sum() );
+
+		if( sigma <= 0 ) break;
+
+		uk /= sigma;
+
+		// deflate, the next round finds the next singular triplet
+		for( size_t r = 0; r < rows; r++ ) gx_vs_product_add( std::begin( vk ), -sigma * uk[ r ], std::begin( residual ) + r * cols, cols );
+
+		us.push_back( uk );
+		vs.push_back( vk );
+		ss.push_back( sigma );
+
+		kept += sigma * sigma;
+	}
+
+	size_t rank = ss.size();
+
+	u->second = { rows, rank };
+	u->first.resize( rows * rank );
+	vt->second = { rank, cols };
+	vt->first.resize( rank * cols );
+	s->resize( rank );
+
+	for( size_t k = 0; k < rank; k++ ) {
+		( *s )[ k ] = ss[ k ];
+		u->first[ std::slice( k, rows, rank ) ] = us[ k ];
+		vt->first[ std::slice( k * cols, cols, 1 ) ] = vs[ k ];
+	}
+
+	return rank;
+}
+
 void Utils :: printMnistImage( const char * tag, const DataVector & data )
 {
 	printf( "%s { %ld }\n", tag, data.size() );
@@ -148,112 +249,90 @@ bool Utils :: expandMnistImage( DataVector & orgImage, DataVector * newImage )
 	return ret;
 }
 
-bool Utils :: loadMnistImages( int limitCount, const char * path, DataMatrix * images )
+bool Utils :: loadMnistImages( int limitCount, const char * path, ByteDataset * images )
 {
-	std::ifstream file( path, std::ios::binary );
+	IdxFilePtr file( new IdxFile() );
 
-	if( ! file.is_open() ) {
-		printf( "open %s fail, errno %d, %s\n", path, errno, strerror( errno ) );
+	if( ! file->open( path ) ) return false;
+
+	if( file->getDims().size() != 3 ) {
+		printf( "read %s, not an images file, dims %zu\n", path, file->getDims().size() );
 		return false;
 	}
 
-	int magic = 0, rows = 0, cols = 0;
-	int imageCount = 0, imageSize = 0;
-
-	file.read( ( char * )&magic, sizeof( magic ) );
-	magic = ntohl( magic );
+	int imageCount = file->getCount(), imageSize = file->getItemSize();
 
-	if( magic != 2051 ) return false;
+	// the limit counts the images already loaded, as the DataMatrix loader did
+	if( limitCount > 0 ) imageCount = std::max( 0, std::min( imageCount, limitCount - (int)images->size() ) );
 
-	file.read( ( char * )&imageCount, sizeof( imageCount ) );
-	imageCount = ntohl( imageCount );
-
-	file.read( ( char * )&rows, sizeof( rows ) );
-	rows = ntohl( rows );
-
-	file.read( ( char * )&cols, sizeof( cols ));
-	cols = ntohl( cols );
-
-	imageSize = rows * cols;
+	if( images->size() <= 0 ) {
+		// zero copy, the dataset reads the mapped file
+		images->attach( file, imageCount );
+	} else if( (int)images->getSampleSize() == imageSize ) {
+		memcpy( images->extend( imageCount ), file->getItem( 0 ), (size_t)imageCount * imageSize );
+	} else {
+		printf( "%s image size %d mismatch %zu\n", __func__, imageSize, images->getSampleSize() );
+		return false;
+	}
 
-	bool ret = true;
+	printf( "%s load %s images %zu\n", __func__, path, images->size() );
 
-	images->reserve( imageCount );
+	return true;
+}
 
-	unsigned char * buff = ( unsigned char * )malloc( imageSize );
-	for( int i = 0; i < imageCount; i++ ) {
-		if( ! file.read( (char*)buff, imageSize ) ) {
-			printf( "%s read fail\n", __func__ );
-			ret = false;
-			break;
-		}
+bool Utils :: loadMnistImages( int limitCount, const char * path, DataMatrix * images )
+{
+	ByteDataset tmp;
 
-		if( limitCount > 0 && (int)images->size() >= limitCount ) break;
+	if( limitCount > 0 && (int)images->size() >= limitCount ) return true;
 
-		images->emplace_back( DataVector( imageSize ) );
-		for( int j = 0; j < imageSize; j++ ) {
-			images->back()[ j ] = buff[ j ] / 255.0;
-		}
-	}
-	free( buff );
+	bool ret = loadMnistImages( limitCount > 0 ? limitCount - images->size() : 0, path, &tmp );
 
-	printf( "%s load %s images %zu\n", __func__, path, images->size() );
+	tmp.toMatrix( images );
 
 	return ret;
 }
 
-bool Utils :: loadMnistLabels( int limitCount, const char * path, DataMatrix * labels )
+bool Utils :: loadMnistLabels( int limitCount, const char * path, LabelDataset * labels )
 {
-	std::ifstream file( path, std::ios::binary );
-
-	if( ! file.is_open() ) {
-		printf( "open %s fail, errno %d, %s\n", path, errno, strerror( errno ) );
-		return false;
-	}
-
-	int magic = 0, labelCount = 0;
+	IdxFile file;
 
-	file.read( ( char * )&magic, sizeof( magic ) );
-	magic = ntohl( magic );
+	if( ! file.open( path ) ) return false;
 
-	if( magic != 2049 ) {
-		printf( "read %s, invalid magic %d\n", path, magic );
+	if( file.getDims().size() != 1 ) {
+		printf( "read %s, not a labels file, dims %zu\n", path, file.getDims().size() );
 		return false;
 	}
 
-	file.read( ( char * )&labelCount, sizeof( labelCount ) );
-	labelCount = ntohl( labelCount );
+	const uint8_t * items = file.getItem( 0 );
 
-	bool ret = true;
+	// the one-hot size covers every class of the file, not only the loaded ones
+	if( file.getCount() > 0 ) {
+		size_t maxClasses = *std::max_element( items, items + file.getCount() );
+		labels->setClassCount( std::max( labels->getClassCount(), maxClasses + 1 ) );
+	}
 
-	labels->reserve( labelCount );
+	size_t labelCount = file.getCount();
+	if( limitCount > 0 ) labelCount = std::min( labelCount, (size_t)std::max( 0, limitCount - (int)labels->size() ) );
 
-	std::vector< unsigned char > tmpVec( labelCount );
+	labels->reserve( labels->size() + labelCount );
 
-	unsigned char maxClasses = 0;
+	for( size_t i = 0; i < labelCount; i++ ) labels->append( items[ i ] );
 
-	for( int i = 0; i < labelCount; i++ ) {
-		unsigned char buff = 0;
-		if( ! file.read( ( char * )&buff, 1 ) ) {
-			printf( "%s read fail, label %d\n", __func__, buff );
-			ret = false;
-			break;
-		}
-
-		tmpVec[ i ] = buff;
+	printf( "%s load %s labels %zu\n", __func__, path, labels->size() );
 
-		maxClasses = std::max( maxClasses, buff );
-	}
+	return true;
+}
 
-	for( auto & item : tmpVec ) {
+bool Utils :: loadMnistLabels( int limitCount, const char * path, DataMatrix * labels )
+{
+	LabelDataset tmp;
 
-		if( limitCount > 0 && (int)labels->size() >= limitCount ) break;
+	if( limitCount > 0 && (int)labels->size() >= limitCount ) return true;
 
-		labels->emplace_back( DataVector( maxClasses + 1 ) );
-		labels->back()[ item ] = 1;
-	}
+	bool ret = loadMnistLabels( limitCount > 0 ? limitCount - labels->size() : 0, path, &tmp );
 
-	printf( "%s load %s labels %zu\n", __func__, path, labels->size() );
+	tmp.toMatrix( labels );
 
 	return ret;
 }
@@ -373,14 +452,103 @@ void Utils :: printVector( const char * tag, const DataVector & data, bool useSc
 	printf( "\n" );
 }
 
+static const int gScalePrecision = std::numeric_limits< DataType >::max_digits10 - 1;
+
+// int8 rows are saved as integers after a line of row scales, about a quarter of the DataType text
+static void saveInt8Rows( FILE * fp, const PackedRows & packed, bool isOneLine )
+{
+	// the scales are exact, so the reloaded weights quantize to the same integers
+	fprintf( fp, "%s\n", gx_vector2string( packed.getScales(), ',', gScalePrecision ).c_str() );
+
+	IntVector tmp;
+
+	for( size_t k = 0; k < packed.getRows(); k++ ) {
+		packed.getInt8Row( k, &tmp );
+		fprintf( fp, "%s%s", k > 0 && isOneLine ? "," : "", gx_vector2string( tmp ).c_str() );
+		if( !isOneLine ) fprintf( fp, "\n" );
+	}
+
+	if( isOneLine ) fprintf( fp, "\n" );
+}
+
+// csr rows are saved as col:value pairs of the nonzeros, one row per line
+static void saveCsrRows( FILE * fp, const PackedRows & packed )
+{
+	const std::vector< uint32_t > & rowPtr = packed.getRowPtr(), & colIdx = packed.getColIdx();
+
+	for( size_t k = 0; k < packed.getRows(); k++ ) {
+		for( size_t i = rowPtr[ k ]; i < rowPtr[ k + 1 ]; i++ ) {
+			fprintf( fp, "%s%u:%e", i > rowPtr[ k ] ? "," : "", colIdx[ i ], packed.getValues()[ i ] );
+		}
+		fprintf( fp, "\n" );
+	}
+}
+
+static void loadCsrRow( const std::string & line, DataVector * row )
+{
+	std::stringstream ss( line );
+	std::string token;
+
+	*row = 0;
+
+	while( std::getline( ss, token, ',' ) ) {
+		size_t pos = token.find( ':' );
+		if( std::string::npos == pos ) continue;
+
+		size_t col = std::stoul( token.substr( 0, pos ) );
+		if( col < row->size() ) ( *row )[ col ] = std::stod( token.substr( pos + 1 ) );
+	}
+}
+
+// binary rows are saved as hex words of the sign bits after a line of row scales
+static void saveBinaryRows( FILE * fp, const PackedRows & packed, bool isOneLine )
+{
+	fprintf( fp, "%s\n", gx_vector2string( packed.getScales(), ',', gScalePrecision ).c_str() );
+
+	std::vector< uint64_t > words;
+
+	for( size_t k = 0; k < packed.getRows(); k++ ) {
+		packed.getBinaryRow( k, &words );
+		fprintf( fp, "%s", k > 0 ? ( isOneLine ? "," : "" ) : "" );
+		for( auto & w : words ) fprintf( fp, "%016llx", (unsigned long long)w );
+		if( !isOneLine ) fprintf( fp, "\n" );
+	}
+
+	if( isOneLine ) fprintf( fp, "\n" );
+}
+
+// row = +1 or -1 for each column, the caller applies the row scale
+static void loadBinaryRow( const std::string & hex, DataType * row, size_t cols )
+{
+	for( size_t c = 0; c < cols; c++ ) {
+		size_t w = c / 64;
+		uint64_t word = w * 16 + 16 <= hex.size() ? std::stoull( hex.substr( w * 16, 16 ), NULL, 16 ) : 0;
+		row[ c ] = ( word >> ( c % 64 ) ) & 1 ? -1 : 1;
+	}
+}
+
+static std::string storage2string( int storage, DataType inScale )
+{
+	char buff[ 128 ] = { 0 };
+
+	if( PackedRows::eInt8 == storage ) {
+		snprintf( buff, sizeof( buff ), "Storage = %s; InScale = %.*e;", PackedRows::type2name( storage ),
+				gScalePrecision, inScale );
+	} else {
+		snprintf( buff, sizeof( buff ), "Storage = %s;", PackedRows::type2name( storage ) );
+	}
+
+	return buff;
+}
+
 bool Utils :: save( const char * path, const Network & network )
 {
 	FILE * fp = fopen( path, "w" );
 
 	if( NULL == fp ) return false;
 
-	fprintf( fp, "Network: LayerCount = %ld; LossFuncType = %d;\n",
-			network.getLayers().size(), network.getLossFuncType() );
+	fprintf( fp, "Network: LayerCount = %ld; LossFuncType = %d; DataType = %s;\n",
+			network.getLayers().size(), network.getLossFuncType(), gx_data_type_name() );
 
 	for( size_t i = 0; i < network.getLayers().size(); i++ ) {
 		BaseLayer * layer = network.getLayers() [ i ];
@@ -393,30 +561,72 @@ bool Utils :: save( const char * path, const Network & network )
 		if( BaseLayer::eFullConn == layer->getType() ) {
 			FullConnLayer * fc = (FullConnLayer*)layer;
 			MDSpanRO weightsRO( fc->getWeights() );
-			fprintf( fp, "Weights: Count = %zu;\n", weightsRO.dim( 0 ) );
-			for( size_t k = 0; k < weightsRO.dim( 0 ); k++ ) {
-				DataVector tmp( weightsRO.data() + k * weightsRO.dim( 1 ), weightsRO.dim( 1 ) );
-				fprintf( fp, "%s\n", gx_vector2string( tmp ).c_str() );
+			const PackedRows & packed = fc->getPacked();
+			fprintf( fp, "Weights: Count = %zu; %s\n", weightsRO.dim( 0 ),
+					storage2string( packed.getType(), packed.getInScale() ).c_str() );
+			if( PackedRows::eInt8 == packed.getType() ) {
+				saveInt8Rows( fp, packed, false );
+			} else if( PackedRows::eBinary == packed.getType() ) {
+				saveBinaryRows( fp, packed, false );
+			} else if( PackedRows::eCsr == packed.getType() ) {
+				saveCsrRows( fp, packed );
+			} else {
+				// the int8 grid of a fake quant layer must survive the reload
+				int precision = PackedRows::eNone != fc->getFakeQuant() ? gScalePrecision : 6;
+				for( size_t k = 0; k < weightsRO.dim( 0 ); k++ ) {
+					DataVector tmp( weightsRO.data() + k * weightsRO.dim( 1 ), weightsRO.dim( 1 ) );
+					fprintf( fp, "%s\n", gx_vector2string( tmp, ',', precision ).c_str() );
+				}
 			}
 			fprintf( fp, "Biases: Count = %zu;\n", fc->getBiases().size() );
 			fprintf( fp, "%s\n", gx_vector2string( fc->getBiases() ).c_str() );
 		}
 		if( BaseLayer::eMaxPool == layer->getType() ) {
-			fprintf( fp, "Weights: PoolSize = %zu;\n", ((MaxPoolLayer*)layer)->getPoolSize() );
+			MaxPoolLayer * pool = (MaxPoolLayer*)layer;
+			fprintf( fp, "Weights: PoolSize = %zu; Stride = %zu; Padding = %zu;\n",
+					pool->getPoolSize(), pool->getStride(), pool->getPadding() );
 		}
 		if( BaseLayer::eAvgPool == layer->getType() ) {
-			fprintf( fp, "Weights: PoolSize = %zu;\n", ((AvgPoolLayer*)layer)->getPoolSize() );
+			AvgPoolLayer * pool = (AvgPoolLayer*)layer;
+			fprintf( fp, "Weights: PoolSize = %zu; Stride = %zu; Padding = %zu;\n",
+					pool->getPoolSize(), pool->getStride(), pool->getPadding() );
 		}
-		if( BaseLayer::eConv == layer->getType() || BaseLayer::eConvEx == layer->getType() ) {
+		if( BaseLayer::eConv == layer->getType() || BaseLayer::eConvEx == layer->getType()
+				|| BaseLayer::eDepthwiseConv == layer->getType() ) {
 			ConvLayer * conv = (ConvLayer*)layer;
-			fprintf( fp, "Weights: FilterDims = %s;\n", gx_vector2string( conv->getFilters().second ).c_str() );
-			fprintf( fp, "%s\n", gx_vector2string( conv->getFilters().first ).c_str() );
+			PackedRows none;
+			const PackedRows & packed = BaseLayer::eConvEx == layer->getType()
+					? ( (ConvExLayer*)layer )->getPacked() : none;
+			fprintf( fp, "Weights: FilterDims = %s; Stride = %zu; Padding = %zu; %s\n",
+					gx_vector2string( conv->getFilters().second ).c_str(), conv->getStride(), conv->getPadding(),
+					storage2string( packed.getType(), packed.getInScale() ).c_str() );
+			if( PackedRows::eInt8 == packed.getType() ) {
+				saveInt8Rows( fp, packed, true );
+			} else if( PackedRows::eBinary == packed.getType() ) {
+				saveBinaryRows( fp, packed, true );
+			} else {
+				int precision = BaseLayer::eConvEx == layer->getType()
+						&& PackedRows::eNone != ( (ConvExLayer*)layer )->getFakeQuant() ? gScalePrecision : 6;
+				fprintf( fp, "%s\n", gx_vector2string( conv->getFilters().first, ',', precision ).c_str() );
+			}
 			fprintf( fp, "Biases: Count = %zu;\n", conv->getBiases().size() );
 			fprintf( fp, "%s\n", gx_vector2string( conv->getBiases() ).c_str() );
 		}
 		if( BaseLayer::eDropout == layer->getType() ) {
 			fprintf( fp, "Weights: DropRate = %e;\n", ((DropoutLayer*)layer)->getDropRate() );
 		}
+		if( BaseLayer::eFakeQuant == layer->getType() ) {
+			fprintf( fp, "Weights: Scale = %.*e;\n", gScalePrecision, ((FakeQuantLayer*)layer)->getScale() );
+		}
+		if( BaseLayer::eBatchNorm == layer->getType() ) {
+			BatchNormLayer * bn = (BatchNormLayer*)layer;
+			fprintf( fp, "Weights: Count = %zu; Momentum = %e; Epsilon = %e;\n",
+					bn->getGamma().size(), bn->getMomentum(), bn->getEpsilon() );
+			fprintf( fp, "%s\n", gx_vector2string( bn->getGamma() ).c_str() );
+			fprintf( fp, "%s\n", gx_vector2string( bn->getBeta() ).c_str() );
+			fprintf( fp, "%s\n", gx_vector2string( bn->getRunningMean() ).c_str() );
+			fprintf( fp, "%s\n", gx_vector2string( bn->getRunningVar() ).c_str() );
+		}
 	}
 
 	fclose( fp );
@@ -442,9 +652,15 @@ bool Utils :: load( const char * path, Network * network )
 
 	std::string line;
 
-	// Network: LayerCount = x; LossFuncType = x;
+	// Network: LayerCount = x; LossFuncType = x; DataType = x;
 	if( ! std::getline( fp, line ) ) return false;
 
+	// the text format is precision neutral, a mismatch only loses digits
+	std::string dataType = getString( line, "DataType = (\\S+);", "double" );
+	if( dataType != gx_data_type_name() ) {
+		printf( "load %s model %s into %s build\n", dataType.c_str(), path, gx_data_type_name() );
+	}
+
 	network->setLossFuncType( std::stoi( getString( line, "LossFuncType = (\\S+);", "1" ) ) );
 
 	int layerCount = std::stoi( getString( line, "LayerCount = (\\S+);", "0" ) );
@@ -464,13 +680,22 @@ bool Utils :: load( const char * path, Network * network )
 		gx_string2vector( getString( line, "BaseInDims = (\\S+);", "0" ), &baseInDims );
 
 		if( BaseLayer::eFullConn == layerType ) {
-			// Weights: Count = xx;
+			// Weights: Count = xx; Storage = xx; [ InScale = xx; ]
 			if( ! std::getline( fp, line ) ) return false;
 
 			int count = std::stoi( getString( line, "Count = (\\S+);", "0" ) );
+			int storage = PackedRows::name2type( getString( line, "Storage = (\\S+);", "none" ).c_str() );
+			DataType inScale = std::stod( getString( line, "InScale = (\\S+);", "0" ) );
 
 			layer = new FullConnLayer( baseInDims, count );
 
+			// int8 and binary rows follow a line of row scales
+			DataVector scales( 1, count );
+			if( PackedRows::eInt8 == storage || PackedRows::eBinary == storage ) {
+				if( ! std::getline( fp, line ) ) return false;
+				gx_string2valarray( line, &scales );
+			}
+
 			MDVector weights;
 			weights.second = { (size_t)count, layer->getBaseInSize() };
 			weights.first.resize( gx_dims_flatten_size( weights.second ) );
@@ -478,7 +703,14 @@ bool Utils :: load( const char * path, Network * network )
 				if( ! std::getline( fp, line ) ) return false;
 
 				DataVector tmp( layer->getBaseInSize() );
-				gx_string2valarray( line, &tmp );
+				if( PackedRows::eCsr == storage ) {
+					loadCsrRow( line, &tmp );
+				} else if( PackedRows::eBinary == storage ) {
+					loadBinaryRow( line, std::begin( tmp ), tmp.size() );
+				} else {
+					gx_string2valarray( line, &tmp );
+				}
+				if( PackedRows::eInt8 == storage || PackedRows::eBinary == storage ) tmp *= scales[ i ];
 
 				std::copy( std::begin( tmp ), std::end( tmp ),
 						std::begin( weights.first ) + i * layer->getBaseInSize() );
@@ -493,18 +725,45 @@ bool Utils :: load( const char * path, Network * network )
 			gx_string2valarray( line, &biases );
 
 			((FullConnLayer*)layer)->setWeights( weights, biases );
+			if( storage > 0 ) ((FullConnLayer*)layer)->setStorage( storage, inScale );
 		}
-		if( BaseLayer::eConv == layerType || BaseLayer::eConvEx == layerType ) {
-			// Weights: FilterDims = f,c,x,y;
+		if( BaseLayer::eConv == layerType || BaseLayer::eConvEx == layerType
+				|| BaseLayer::eDepthwiseConv == layerType ) {
+			// Weights: FilterDims = f,c,x,y; Stride = x; Padding = x; Storage = x; [ InScale = x; ]
 			if( ! std::getline( fp, line ) ) return false;
 
 			MDVector filters;
 			gx_string2vector( getString( line, "FilterDims = (\\S+);", "0" ), &filters.second );
 
+			int stride = std::stoi( getString( line, "Stride = (\\S+);", "1" ) );
+			int padding = std::stoi( getString( line, "Padding = (\\S+);", "0" ) );
+			int storage = PackedRows::name2type( getString( line, "Storage = (\\S+);", "none" ).c_str() );
+			DataType inScale = std::stod( getString( line, "InScale = (\\S+);", "0" ) );
+
+			DataVector scales( 1, filters.second[ 0 ] );
+			if( PackedRows::eInt8 == storage || PackedRows::eBinary == storage ) {
+				if( ! std::getline( fp, line ) ) return false;
+				gx_string2valarray( line, &scales );
+			}
+
 			if( ! std::getline( fp, line ) ) return false;
 
 			filters.first.resize( gx_dims_flatten_size( filters.second ) );
-			gx_string2valarray( line, &filters.first );
+
+			size_t rowSize = filters.first.size() / scales.size();
+			if( PackedRows::eBinary == storage ) {
+				std::stringstream ss( line );
+				std::string token;
+				for( size_t i = 0; i < scales.size() && std::getline( ss, token, ',' ); i++ ) {
+					loadBinaryRow( token, std::begin( filters.first ) + i * rowSize, rowSize );
+				}
+			} else {
+				gx_string2valarray( line, &filters.first );
+			}
+
+			for( size_t i = 0; ( PackedRows::eInt8 == storage || PackedRows::eBinary == storage ) && i < scales.size(); i++ ) {
+				filters.first[ std::slice( i * rowSize, rowSize, 1 ) ] *= DataVector( scales[ i ], rowSize );
+			}
 
 			// Biases: Count = xx;
 			if( ! std::getline( fp, line ) ) return false;
@@ -515,26 +774,36 @@ bool Utils :: load( const char * path, Network * network )
 			gx_string2valarray( line, &biases );
 
 			if( BaseLayer::eConv == layerType ) {
-				layer = new ConvLayer( baseInDims, filters, biases );
+				layer = new ConvLayer( baseInDims, filters, biases, stride, padding );
+			} else if( BaseLayer::eConvEx == layerType ) {
+				layer = new ConvExLayer( baseInDims, filters, biases, stride, padding );
+				if( storage > 0 ) ((ConvExLayer*)layer)->setStorage( storage, inScale );
 			} else {
-				layer = new ConvExLayer( baseInDims, filters, biases );
+				layer = new DepthwiseConvLayer( baseInDims, filters, biases, stride, padding );
 			}
 		}
 		if( BaseLayer::eMaxPool == layerType ) {
-			// Weights: PoolSize = xx;
+			// Weights: PoolSize = xx; Stride = xx; Padding = xx;
 			if( ! std::getline( fp, line ) ) return false;
 
 			int poolSize = std::stoi( getString( line, "PoolSize = (\\S+);", "0" ) );
+			int stride = std::stoi( getString( line, "Stride = (\\S+);", "0" ) );
+			int padding = std::stoi( getString( line, "Padding = (\\S+);", "0" ) );
 
-			layer = new MaxPoolLayer( baseInDims, poolSize );
+			layer = new MaxPoolLayer( baseInDims, poolSize, stride, padding );
 		}
 		if( BaseLayer::eAvgPool == layerType ) {
-			// Weights: PoolSize = xx;
+			// Weights: PoolSize = xx; Stride = xx; Padding = xx;
 			if( ! std::getline( fp, line ) ) return false;
 
 			int poolSize = std::stoi( getString( line, "PoolSize = (\\S+);", "0" ) );
+			int stride = std::stoi( getString( line, "Stride = (\\S+);", "0" ) );
+			int padding = std::stoi( getString( line, "Padding = (\\S+);", "0" ) );
 
-			layer = new AvgPoolLayer( baseInDims, poolSize );
+			layer = new AvgPoolLayer( baseInDims, poolSize, stride, padding );
+		}
+		if( BaseLayer::eGlobalAvgPool == layerType ) {
+			layer = new GlobalAvgPoolLayer( baseInDims );
 		}
 		if( BaseLayer::eDropout == layerType ) {
 			// Weights: DropRate = xx;
@@ -544,6 +813,45 @@ bool Utils :: load( const char * path, Network * network )
 
 			layer = new DropoutLayer( baseInDims, dropRate );
 		}
+		if( BaseLayer::eBatchNorm == layerType ) {
+			// Weights: Count = xx; Momentum = xx; Epsilon = xx;
+			if( ! std::getline( fp, line ) ) return false;
+
+			int count = std::stoi( getString( line, "Count = (\\S+);", "0" ) );
+			DataType momentum = std::stod( getString( line, "Momentum = (\\S+);", "0.9" ) );
+			DataType epsilon = std::stod( getString( line, "Epsilon = (\\S+);", "1e-5" ) );
+
+			// gamma, beta, running mean, running var
+			std::vector< DataVector > params( 4, DataVector( count ) );
+			for( auto & item : params ) {
+				if( ! std::getline( fp, line ) ) return false;
+				gx_string2valarray( line, &item );
+			}
+
+			layer = new BatchNormLayer( baseInDims, momentum, epsilon );
+			((BatchNormLayer*)layer)->setParams( params[ 0 ], params[ 1 ], params[ 2 ], params[ 3 ] );
+		}
+
+		if( BaseLayer::eFakeQuant == layerType ) {
+			// Weights: Scale = xx;
+			if( ! std::getline( fp, line ) ) return false;
+
+			DataType scale = std::stod( getString( line, "Scale = (\\S+);", "1" ) );
+
+			layer = new FakeQuantLayer( baseInDims, scale );
+		}
+
+		if( BaseLayer::eBinarize == layerType ) layer = new BinarizeLayer( baseInDims );
+
+		// the layer after a FakeQuantLayer was trained on int8 grid weights, after a BinarizeLayer on binary ones
+		int prevType = network->getLayers().size() > 0 ? network->getLayers().back()->getType() : 0;
+		int fakeQuant = BaseLayer::eFakeQuant == prevType ? PackedRows::eInt8
+				: ( BaseLayer::eBinarize == prevType ? PackedRows::eBinary : PackedRows::eNone );
+
+		if( PackedRows::eNone != fakeQuant ) {
+			if( BaseLayer::eFullConn == layerType ) ((FullConnLayer*)layer)->setFakeQuant( fakeQuant );
+			if( BaseLayer::eConvEx == layerType ) ((ConvExLayer*)layer)->setFakeQuant( fakeQuant );
+		}
 
 		if( actFuncType > 0 ) layer->setActFunc( new ActFunc( actFuncType ) );
 
@@ -568,6 +876,12 @@ void Utils :: getCmdArgs( int argc, char * const argv[],
 		{ "debug",       no_argument,        NULL, 9 },
 		{ "thread",      required_argument,  NULL, 10 },
 		{ "dataaug",     required_argument,  NULL, 11 },
+		{ "qat",         required_argument,  NULL, 12 },
+		{ "prune",       required_argument,  NULL, 13 },
+		{ "prunefilters", required_argument, NULL, 14 },
+		{ "lowrank",     required_argument,  NULL, 15 },
+		{ "binary",      required_argument,  NULL, 16 },
+		{ "shuffleblock", required_argument, NULL, 17 },
 		{ "help",        no_argument,        NULL, 99 },
 		{ 0, 0, 0, 0}
 	};
@@ -612,11 +926,29 @@ void Utils :: getCmdArgs( int argc, char * const argv[],
 			case 11:
 				args->mIsDataAug = 0 == atoi( optarg ) ? false : true;
 				break;
+			case 12:
+				args->mIsQat = 0 == atoi( optarg ) ? false : true;
+				break;
+			case 13:
+				args->mPruneSparsity = atof( optarg );
+				break;
+			case 14:
+				args->mPruneFilterRatio = atof( optarg );
+				break;
+			case 15:
+				args->mLowRankEnergy = atof( optarg );
+				break;
+			case 16:
+				args->mIsBinary = 0 == atoi( optarg ) ? false : true;
+				break;
+			case 17:
+				args->mShuffleBlock = atoi( optarg );
+				break;
 			case '?' :
 			case 'v' :
 			default:
 				printf( "Usage: %s [-v]\n", argv[ 0 ] );
-				printf( "\t--thread <thread count>\n" );
+				printf( "\t--thread <thread count> the threads but the training one stage the next mini batches, default is %d\n", defaultArgs.mThreadCount );
 				printf( "\t--model <model path> if path exist, then continue training\n" );
 				printf( "\t--training <training data count> 0 for all, default is %d\n", defaultArgs.mTrainingCount );
 				printf( "\t--eval <eval count> 0 for all, default is %d\n", defaultArgs.mEvalCount );
@@ -625,7 +957,13 @@ void Utils :: getCmdArgs( int argc, char * const argv[],
 				printf( "\t--lr <learning rate> default is %.2f\n", defaultArgs.mLearningRate );
 				printf( "\t--lambda <lambda> default is %.2f\n", defaultArgs.mLambda );
 				printf( "\t--shuffle <shuffle> 0 for no shuffle, otherwise shuffle, default is %d\n", defaultArgs.mIsShuffle );
+				printf( "\t--shuffleblock <samples> 0 for a full shuffle, otherwise shuffle blocks of consecutive samples, default is %d\n", defaultArgs.mShuffleBlock );
 				printf( "\t--dataaug <dataaug> 0 for no dataaug, otherwise dataaug, default is %d\n", defaultArgs.mIsShuffle );
+				printf( "\t--qat <qat> 0 for no quantization-aware training, otherwise qat, default is %d\n", defaultArgs.mIsQat );
+				printf( "\t--prune <sparsity> magnitude prune FullConn weights up to the sparsity, default is %f\n", defaultArgs.mPruneSparsity );
+				printf( "\t--prunefilters <ratio> remove the ratio of Conv filters with the smallest L1 norm before training, default is %f\n", defaultArgs.mPruneFilterRatio );
+				printf( "\t--lowrank <energy> factorize FullConn weights by truncated SVD before training, default is %f\n", defaultArgs.mLowRankEnergy );
+				printf( "\t--binary <binary> 0 for no binary training, otherwise binary hidden FullConn layers, default is %d\n", defaultArgs.mIsBinary );
 				printf( "\t--debug debug mode on\n" );
 				printf( "\t--help show usage\n" );
 				exit( 0 );
@@ -636,11 +974,15 @@ void Utils :: getCmdArgs( int argc, char * const argv[],
 	printf( "\ttrainingCount %d, evalCount %d\n", args->mTrainingCount, args->mEvalCount );
 	printf( "\tepochCount %d, miniBatchCount %d, learningRate %f, lambda %f\n",
 		args->mEpochCount, args->mMiniBatchCount, args->mLearningRate, args->mLambda );
-	printf( "\tshuffle %s, debug %s\n", args->mIsShuffle ? "true" : "false", gx_is_inner_debug ? "true" : "false" );
-	printf( "\tdataaug %s\n", args->mIsDataAug ? "true" : "false" );
+	printf( "\tshuffle %s, shuffleblock %d, debug %s\n", args->mIsShuffle ? "true" : "false",
+			args->mShuffleBlock, gx_is_inner_debug ? "true" : "false" );
+	printf( "\tdataaug %s, qat %s, prune %f, prunefilters %f, lowrank %f, binary %s\n", args->mIsDataAug ? "true" : "false",
+			args->mIsQat ? "true" : "false", args->mPruneSparsity, args->mPruneFilterRatio, args->mLowRankEnergy,
+			args->mIsBinary ? "true" : "false" );
 	printf( "\tmodelPath %s\n", NULL == args->mModelPath ? "NULL" : args->mModelPath );
 	printf( "\tthreadCount %d, hardware_concurrency: %u\n", args->mThreadCount, std::thread::hardware_concurrency() );
-	printf( "\tsimd::size %zu\n", DataSimd::size() );
+	printf( "\tsimd %s, simd::size %zu, DataType %s\n",
+			gx_kernels().mIsa, gx_kernels().mSimdSize, gx_data_type_name() );
 #ifdef ENABLE_EIGEN
 	printf( "\tusing eigen\n" );
 #endif
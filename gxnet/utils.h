@@ -2,8 +2,10 @@
 
 #include "common.h"
 #include "context.h"
+#include "dataset.h"
 
 #include <algorithm>
+#include <random>
 
 namespace gxnet {
 
@@ -16,8 +18,14 @@ typedef struct tagCmdArgs {
 	DataType mLearningRate;
 	DataType mLambda;
 	bool mIsShuffle;
+	int mShuffleBlock;
 	bool mIsDataAug;
 	const char * mModelPath;
+	bool mIsQat;
+	DataType mPruneSparsity;
+	DataType mPruneFilterRatio;
+	DataType mLowRankEnergy;
+	bool mIsBinary;
 } CmdArgs_t;
 
 class Network;
@@ -34,8 +42,23 @@ public:
 
 	static DataType random( DataType min, DataType max );
 
+	/**
+	 * blockSize 0 for a full shuffle. Otherwise shuffle the order of the blocks of
+	 * consecutive indexes and the order inside every block, the block borders move
+	 * by a random offset on every call, so the neighbours of a sample change too.
+	 */
+	static void shuffle( IntVector * idx, size_t blockSize, std::mt19937 & gen );
+
 	static DataType calcSSE( const DataVector & output, const DataVector & target );
 
+	/**
+	 * Truncated SVD by power iteration with deflation, matrix (R,C) ~= u * diag( s ) * vt,
+	 * u dims (R,K), vt dims (K,C). Stops at maxRank, or once the squared s keep the energy
+	 * ratio of the squared Frobenius norm. Returns K.
+	 */
+	static size_t truncatedSvd( const MDVector & matrix, DataType energy, size_t maxRank,
+			MDVector * u, DataVector * s, MDVector * vt );
+
 	static void printMnistImage( const char * tag, const DataVector & data );
 
 	static bool centerMnistImage( DataVector & orgImage, DataVector * newImage );
@@ -44,6 +67,11 @@ public:
 
 	static bool loadMnistImages( int limitCount, const char * path, DataMatrix * images );
 
+	// appends to images, the first load sets its sample size
+	static bool loadMnistImages( int limitCount, const char * path, ByteDataset * images );
+
+	static bool loadMnistLabels( int limitCount, const char * path, LabelDataset * labels );
+
 	static bool loadMnistLabels( int limitCount, const char * path, DataMatrix * labels );
 
 	static void printMatrix( const char * tag, const DataMatrix & data,